@@ -0,0 +1,116 @@
+/**
+ * @file DesfireClock.h
+ * @brief Microsecond clocks for readers, timeouts and measurements
+ *
+ * Readers take round trip times and enforce response timeouts against a
+ * DesfireClock. By default this is the system clock; simulations give the
+ * reader a DesfireVirtualClock instead, which only advances when the
+ * simulated card, RF link and host spend time. Waiting then returns at once
+ * while every measured time stays what the hardware would have taken, so a
+ * day of gate traffic runs in seconds and still reports realistic timings.
+ */
+
+#ifndef DESFIRE_CLOCK_H
+#define DESFIRE_CLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Source of time for readers and measurements
+ */
+class DesfireClock {
+public:
+    /**
+     * @brief Virtual destructor
+     */
+    virtual ~DesfireClock() {
+    }
+
+    /**
+     * @brief Get the time of a monotonic microsecond clock
+     *
+     * @return uint32_t Time in microseconds, wrapping around
+     */
+    virtual uint32_t micros() = 0;
+
+    /**
+     * @brief Let time pass
+     *
+     * @param duration Time to wait in microseconds
+     */
+    virtual void delayMicros(uint32_t duration) = 0;
+};
+
+/**
+ * @brief Clock of the platform (micros() on Arduino, CLOCK_MONOTONIC otherwise)
+ */
+class DesfireSystemClock : public DesfireClock {
+public:
+    /**
+     * @brief Get the time of the platform clock
+     *
+     * @return uint32_t Time in microseconds, wrapping around
+     */
+    virtual uint32_t micros() override;
+
+    /**
+     * @brief Wait for a time
+     *
+     * @param duration Time to wait in microseconds
+     */
+    virtual void delayMicros(uint32_t duration) override;
+
+    /**
+     * @brief Get the shared system clock
+     *
+     * @return DesfireSystemClock& System clock
+     */
+    static DesfireSystemClock& instance();
+};
+
+/**
+ * @brief Simulated clock that advances only when time is spent
+ *
+ * Not synchronized: share one virtual clock only between objects used by
+ * the same thread.
+ */
+class DesfireVirtualClock : public DesfireClock {
+public:
+    /**
+     * @brief Construct a clock starting at zero
+     */
+    DesfireVirtualClock();
+
+    /**
+     * @brief Get the simulated time
+     *
+     * @return uint32_t Time in microseconds, wrapping around
+     */
+    virtual uint32_t micros() override;
+
+    /**
+     * @brief Advance the clock without waiting
+     *
+     * @param duration Time to add in microseconds
+     */
+    virtual void delayMicros(uint32_t duration) override;
+
+    /**
+     * @brief Get the time elapsed since the clock was started or reset
+     *
+     * @return uint64_t Simulated time in microseconds, not wrapping around
+     */
+    uint64_t getElapsed() const;
+
+    /**
+     * @brief Restart the clock at zero
+     */
+    void reset();
+
+private:
+    /** Simulated time in microseconds */
+    uint64_t _now;
+};
+
+#endif  // DESFIRE_CLOCK_H
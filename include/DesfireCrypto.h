@@ -0,0 +1,281 @@
+/**
+ * @file DesfireCrypto.h
+ * @brief AES-128 block cipher and CMAC for DESFire secure messaging
+ *
+ * This file provides the AES-128 cipher used for EV2 authentication and
+ * secure messaging, together with an incremental AES-CMAC (NIST SP 800-38B).
+ *
+ * Host builds on x86-64 and on 64-bit ARM Linux also carry a hardware path
+ * (AES-NI or the ARMv8 crypto extensions), chosen at run time when the CPU
+ * supports it. Define DESFIRE_AES_PORTABLE to build the portable path only.
+ */
+
+#ifndef DESFIRE_CRYPTO_H
+#define DESFIRE_CRYPTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(ARDUINO) && !defined(DESFIRE_AES_PORTABLE) && defined(__GNUC__) && \
+    (defined(__x86_64__) || (defined(__aarch64__) && defined(__linux__)))
+#define DF_AES_HARDWARE 1
+#else
+#define DF_AES_HARDWARE 0
+#endif
+
+/**
+ * @brief Cryptographic constants
+ */
+enum DesfireCryptoConstants : uint8_t {
+    DF_AES_BLOCK_SIZE   = 16,  ///< AES block size in bytes
+    DF_AES_KEY_SIZE     = 16,  ///< AES-128 key size in bytes
+    DF_AES_ROUNDS       = 10,  ///< Number of AES-128 rounds
+    DF_CMAC_SIZE        = 16,  ///< Full CMAC length in bytes
+    DF_MACT_SIZE        = 8,   ///< Truncated EV2 MAC length in bytes
+    DF_CMAC_BATCH_LANES = 8    ///< Messages advanced together by computeBatch()
+};
+
+/**
+ * @brief AES-128 block cipher
+ *
+ * Holds the expanded key so that repeated operations with the same key (a
+ * session key, a master key during diversification) skip the key schedule.
+ */
+class DesfireAES {
+public:
+    /**
+     * @brief Construct a cipher without a key
+     */
+    DesfireAES();
+
+    /**
+     * @brief Construct a cipher and set its key
+     *
+     * @param key AES-128 key (16 bytes)
+     */
+    explicit DesfireAES(const uint8_t* key);
+
+    /**
+     * @brief Destroy the cipher, wiping the expanded key
+     */
+    ~DesfireAES();
+
+    /**
+     * @brief Set the key and expand the key schedule
+     *
+     * @param key AES-128 key (16 bytes)
+     */
+    void setKey(const uint8_t* key);
+
+    /**
+     * @brief Wipe the expanded key
+     */
+    void clear();
+
+    /**
+     * @brief Encrypt a single block
+     *
+     * @param input Plaintext block (16 bytes)
+     * @param output Ciphertext block (16 bytes, may equal input)
+     */
+    void encryptBlock(const uint8_t* input, uint8_t* output) const;
+
+    /**
+     * @brief Decrypt a single block
+     *
+     * @param input Ciphertext block (16 bytes)
+     * @param output Plaintext block (16 bytes, may equal input)
+     */
+    void decryptBlock(const uint8_t* input, uint8_t* output) const;
+
+    /**
+     * @brief Encrypt in CBC mode
+     *
+     * @param iv Initialization vector (16 bytes), updated to the last ciphertext block
+     * @param input Plaintext, length must be a multiple of 16
+     * @param output Ciphertext buffer (may equal input)
+     * @param length Length in bytes
+     * @return true if the data was encrypted
+     * @return false if the length is not block aligned
+     */
+    bool encryptCBC(uint8_t* iv, const uint8_t* input, uint8_t* output, size_t length) const;
+
+    /**
+     * @brief Decrypt in CBC mode
+     *
+     * @param iv Initialization vector (16 bytes), updated to the last ciphertext block
+     * @param input Ciphertext, length must be a multiple of 16
+     * @param output Plaintext buffer (may equal input)
+     * @param length Length in bytes
+     * @return true if the data was decrypted
+     * @return false if the length is not block aligned
+     */
+    bool decryptCBC(uint8_t* iv, const uint8_t* input, uint8_t* output, size_t length) const;
+
+    /**
+     * @brief Encrypt independent blocks
+     *
+     * The hardware path encrypts several blocks in parallel, so batches of
+     * independent operations under one key (ECB, or one CBC-MAC step of
+     * many messages) run several times faster than block by block.
+     *
+     * @param input Plaintext blocks
+     * @param output Ciphertext blocks (may equal input)
+     * @param count Number of blocks
+     */
+    void encryptBlocks(const uint8_t* input, uint8_t* output, size_t count) const;
+
+    /**
+     * @brief Encrypt independent blocks, each under its own key
+     *
+     * Block i is encrypted with ciphers[i]. The hardware path runs several
+     * keys in parallel, which lets one CBC-MAC step of many messages under
+     * different keys (such as per-card session keys) run as one batch.
+     *
+     * @param ciphers Cipher of every block
+     * @param input Plaintext blocks
+     * @param output Ciphertext blocks (may equal input)
+     * @param count Number of blocks
+     */
+    static void encryptEach(const DesfireAES* const* ciphers,
+                            const uint8_t*           input,
+                            uint8_t*                 output,
+                            size_t                   count);
+
+    /**
+     * @brief Check whether the hardware path is in use
+     *
+     * @return true if blocks are processed with AES instructions
+     * @return false if the portable implementation is used
+     */
+    static bool isAccelerated();
+
+    /**
+     * @brief Enable or disable the hardware path
+     *
+     * Meant for benchmarks and tests; call it while no other thread uses a
+     * cipher.
+     *
+     * @param enabled Use AES instructions when the CPU supports them
+     * @return true if the hardware path is now in use
+     * @return false if the portable implementation is used
+     */
+    static bool setAccelerated(bool enabled);
+
+    /**
+     * @brief Clear a buffer holding key material
+     *
+     * The writes go through a volatile pointer, so the compiler keeps them
+     * even when the buffer is not read again.
+     *
+     * @param buffer Buffer to clear
+     * @param length Length of the buffer
+     */
+    static void wipe(void* buffer, size_t length);
+
+private:
+    /** Expanded key schedule (11 round keys) */
+    uint8_t _roundKeys[(DF_AES_ROUNDS + 1) * DF_AES_BLOCK_SIZE];
+
+#if DF_AES_HARDWARE
+    /** Round keys of the equivalent inverse cipher, for hardware decryption */
+    uint8_t _decryptKeys[(DF_AES_ROUNDS + 1) * DF_AES_BLOCK_SIZE];
+#endif
+};
+
+/**
+ * @brief Incremental AES-CMAC
+ *
+ * Data can be fed in pieces, which keeps the MAC over a long command in
+ * secure messaging free of large temporary buffers.
+ */
+class DesfireCMAC {
+public:
+    /**
+     * @brief Start a CMAC computation
+     *
+     * @param cipher Cipher holding the MAC key, must outlive this object
+     */
+    explicit DesfireCMAC(const DesfireAES& cipher);
+
+    /**
+     * @brief Destroy the CMAC state, wiping intermediate values
+     */
+    ~DesfireCMAC();
+
+    /**
+     * @brief Add data to the MAC
+     *
+     * @param data Data to add
+     * @param length Length of the data
+     */
+    void update(const uint8_t* data, size_t length);
+
+    /**
+     * @brief Finish the computation
+     *
+     * @param mac Buffer to store the full CMAC (16 bytes)
+     */
+    void finish(uint8_t* mac);
+
+    /**
+     * @brief Compute the CMAC of a message in one call
+     *
+     * @param cipher Cipher holding the MAC key
+     * @param data Message
+     * @param length Length of the message
+     * @param mac Buffer to store the full CMAC (16 bytes)
+     */
+    static void compute(const DesfireAES& cipher, const uint8_t* data, size_t length, uint8_t* mac);
+
+    /**
+     * @brief Derive the CMAC subkeys K1 = 2 * E(0) and K2 = 4 * E(0)
+     *
+     * @param cipher Cipher holding the MAC key
+     * @param subkey1 Buffer to store K1, used for a complete last block (16 bytes)
+     * @param subkey2 Buffer to store K2, used for a padded last block (16 bytes)
+     */
+    static void deriveSubkeys(const DesfireAES& cipher, uint8_t* subkey1, uint8_t* subkey2);
+
+    /**
+     * @brief Compute the CMACs of many messages, each under its own key
+     *
+     * The messages advance in lockstep, one block of every message still
+     * running per DesfireAES::encryptEach() call, so the hardware path
+     * overlaps the rounds of different messages.
+     *
+     * @param ciphers Cipher holding the MAC key of every message
+     * @param messages Messages
+     * @param lengths Length of every message
+     * @param macs Buffer to store the full CMACs (16 bytes each)
+     * @param count Number of messages
+     */
+    static void computeBatch(const DesfireAES* const* ciphers,
+                             const uint8_t* const*    messages,
+                             const size_t*            lengths,
+                             uint8_t*                 macs,
+                             size_t                   count);
+
+    /**
+     * @brief Truncate a CMAC to the 8-byte EV2 MACt (odd-numbered bytes)
+     *
+     * @param mac Full CMAC (16 bytes)
+     * @param truncated Buffer to store the MACt (8 bytes)
+     */
+    static void truncate(const uint8_t* mac, uint8_t* truncated);
+
+private:
+    /** Cipher holding the MAC key */
+    const DesfireAES& _cipher;
+
+    /** CBC-MAC chaining state */
+    uint8_t _state[DF_AES_BLOCK_SIZE];
+
+    /** Buffered, not yet processed input */
+    uint8_t _buffer[DF_AES_BLOCK_SIZE];
+
+    /** Number of buffered bytes */
+    uint8_t _buffered;
+};
+
+#endif  // DESFIRE_CRYPTO_H
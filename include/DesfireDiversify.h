@@ -0,0 +1,142 @@
+/**
+ * @file DesfireDiversify.h
+ * @brief AN10922 AES-128 key diversification, one card or a whole batch
+ *
+ * A diversified key is the CMAC of the diversification constant 01h and the
+ * diversification input (UID, AID and system identifier), always padded to
+ * two blocks. Personalization stations derive the keys of a whole batch of
+ * cards at once: the batch path hands many inputs to
+ * DesfireCMAC::computeBatch(), which the hardware path processes several
+ * blocks at a time, and fills a compact key table.
+ */
+
+#ifndef DESFIRE_DIVERSIFY_H
+#define DESFIRE_DIVERSIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "DesfireCrypto.h"
+
+/**
+ * @brief Diversification constants
+ */
+enum DesfireDiversifyConstants : uint8_t {
+    DF_DIV_CONSTANT_AES128 = 0x01,  ///< Diversification constant of AES-128 keys
+    DF_DIV_MESSAGE_SIZE    = 32,    ///< Constant and input, padded to two blocks
+    DF_DIV_INPUT_MAX       = 31,    ///< Largest diversification input
+    DF_DIV_UID_SIZE        = 10,    ///< Largest UID
+    DF_DIV_AID_SIZE        = 3,     ///< Application ID size
+    DF_DIV_BATCH_LANES     = 16     ///< Inputs gathered per DesfireCMAC::computeBatch() call
+};
+
+/**
+ * @brief Entry of a key table
+ *
+ * The caller fills UID, AID and key number; deriveTable() fills the key.
+ */
+struct DesfireKeyTableEntry {
+    uint8_t uid[DF_DIV_UID_SIZE];  ///< Card UID
+    uint8_t uidLength;             ///< Length of the UID
+    uint8_t aid[DF_DIV_AID_SIZE];  ///< Application ID (as sent to the card)
+    uint8_t keyNo;                 ///< Key number within the application
+    uint8_t key[DF_AES_KEY_SIZE];  ///< Diversified key
+};
+
+/**
+ * @brief AN10922 AES-128 key diversification under one master key
+ */
+class DesfireKeyDiversifier {
+public:
+    /**
+     * @brief Construct a diversifier
+     *
+     * @param masterKey Master key (16 bytes)
+     * @param systemId System identifier appended to every input, nullptr for none
+     * @param systemIdLength Length of the system identifier
+     */
+    DesfireKeyDiversifier(const uint8_t* masterKey,
+                          const uint8_t* systemId       = nullptr,
+                          uint8_t        systemIdLength = 0);
+
+    /**
+     * @brief Destroy the diversifier, wiping the subkey mask
+     */
+    ~DesfireKeyDiversifier();
+
+    /**
+     * @brief Derive the key of one card
+     *
+     * The diversification input is the UID, the AID if given and the system
+     * identifier.
+     *
+     * @param uid Card UID
+     * @param uidLength Length of the UID (at most DF_DIV_UID_SIZE)
+     * @param aid Application ID (3 bytes), nullptr for the PICC level
+     * @param key Buffer to store the diversified key (16 bytes)
+     * @return true if the key was derived
+     * @return false if the input is longer than DF_DIV_INPUT_MAX
+     */
+    bool diversify(const uint8_t* uid, uint8_t uidLength, const uint8_t* aid, uint8_t* key) const;
+
+    /**
+     * @brief Derive the keys of a key table
+     *
+     * Entries of other key numbers are left unchanged, so a table holding
+     * several keys per application is filled with one diversifier per
+     * master key. Entries whose input is too long get an all-zero key.
+     *
+     * @param entries Key table
+     * @param count Number of entries
+     * @param keyNo Key number derived under this master key
+     * @return size_t Number of keys derived
+     */
+    size_t deriveTable(DesfireKeyTableEntry* entries, size_t count, uint8_t keyNo) const;
+
+    /**
+     * @brief Find an entry of a key table
+     *
+     * @param entries Key table
+     * @param count Number of entries
+     * @param uid Card UID
+     * @param uidLength Length of the UID
+     * @param aid Application ID (3 bytes)
+     * @param keyNo Key number
+     * @return const DesfireKeyTableEntry* Matching entry, nullptr if none
+     */
+    static const DesfireKeyTableEntry* find(const DesfireKeyTableEntry* entries,
+                                            size_t                      count,
+                                            const uint8_t*              uid,
+                                            uint8_t                     uidLength,
+                                            const uint8_t*              aid,
+                                            uint8_t                     keyNo);
+
+private:
+    /** Cipher holding the master key */
+    DesfireAES _cipher;
+
+    /** CMAC subkeys K1 ^ K2, folded into a padded message */
+    uint8_t _paddedMask[DF_AES_BLOCK_SIZE];
+
+    /** System identifier */
+    uint8_t _systemId[DF_DIV_INPUT_MAX];
+
+    /** Length of the system identifier */
+    uint8_t _systemIdLength;
+
+    /**
+     * @brief Build the padded message for a CMAC over both blocks
+     *
+     * @param uid Card UID
+     * @param uidLength Length of the UID
+     * @param aid Application ID (3 bytes), nullptr for none
+     * @param message Buffer to store the message (32 bytes)
+     * @return true if the message was built
+     * @return false if the input is too long
+     */
+    bool buildMessage(const uint8_t* uid,
+                      uint8_t        uidLength,
+                      const uint8_t* aid,
+                      uint8_t*       message) const;
+};
+
+#endif  // DESFIRE_DIVERSIFY_H
@@ -0,0 +1,69 @@
+/**
+ * @file DesfireECC.h
+ * @brief ECDSA signature verification on the NIST P-224 (secp224r1) curve
+ *
+ * NXP originality signatures are ECDSA signatures over secp224r1. This file
+ * provides a verifier sized for microcontrollers: both the generator and the
+ * public key are multiplied with fixed-base comb tables that are built once
+ * and then reused for every verification.
+ */
+
+#ifndef DESFIRE_ECC_H
+#define DESFIRE_ECC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief P-224 constants
+ */
+enum DesfireECCConstants : uint8_t {
+    DF_ECC_SCALAR_LENGTH     = 28,  ///< Length of a P-224 scalar/coordinate in bytes
+    DF_ECC_PUBLIC_KEY_LENGTH = 57,  ///< Uncompressed public key length (04 || X || Y)
+    DF_ECC_SIGNATURE_LENGTH  = 56,  ///< Raw signature length (r || s)
+    DF_ECC_COMB_WIDTH        = 5,   ///< Comb width, each table holds 2^width - 1 points
+    DF_ECC_KEY_TABLE_SLOTS   = 3    ///< Number of public key tables kept in RAM
+};
+
+/**
+ * @brief ECDSA verifier for secp224r1
+ *
+ * The comb table for the generator is built on first use, tables for public
+ * keys are built on first use of a key and cached in DF_ECC_KEY_TABLE_SLOTS
+ * slots; the oldest table is replaced. Call precompute() while idle to take
+ * table construction off the critical path. On Linux hosts the shared cache
+ * is guarded by a reader-writer lock: verifications with cached tables run
+ * in parallel, building a table waits for them. Other targets are
+ * single-threaded and take no lock.
+ */
+class DesfireECC {
+public:
+    /**
+     * @brief Verify an ECDSA P-224 signature
+     *
+     * The message is used directly as the ECDSA digest (leftmost 224 bits),
+     * which is how NXP signs card UIDs for the originality check.
+     *
+     * @param publicKey Uncompressed public key (04 || X || Y, 57 bytes)
+     * @param message Signed message
+     * @param messageLength Length of the message in bytes
+     * @param signature Raw signature (r || s, 56 bytes)
+     * @return true if the signature is valid
+     * @return false if the signature or public key is invalid
+     */
+    static bool verify(const uint8_t* publicKey,
+                       const uint8_t* message,
+                       size_t         messageLength,
+                       const uint8_t* signature);
+
+    /**
+     * @brief Build the comb tables for the generator and a public key
+     *
+     * @param publicKey Uncompressed public key (04 || X || Y, 57 bytes)
+     * @return true if the tables are available
+     * @return false if the public key is not a valid curve point
+     */
+    static bool precompute(const uint8_t* publicKey);
+};
+
+#endif  // DESFIRE_ECC_H
@@ -0,0 +1,682 @@
+/**
+ * @file DesfireEmulator.h
+ * @brief Software DESFire EV2 card and reader for simulations
+ *
+ * DesfireCardEmulator answers native and ISO wrapped DESFire frames the way
+ * an EV2 card does, including command and response chaining, EV2
+ * authentication and secure messaging, backup files with commit and abort,
+ * and the proximity check. Each answer comes with the time a card would
+ * take: frame delay, command processing, AES blocks and EEPROM programming.
+ *
+ * DesfireEmulatedReader drives the card through NFCReaderInterface and
+ * spends the card time, the RF frame times at the current bit rate and the
+ * host link latency on its clock. On a DesfireVirtualClock no real time
+ * passes, yet round trips, response timeouts and DesfireNFC exchange
+ * statistics all see the simulated times.
+ */
+
+#ifndef DESFIRE_EMULATOR_H
+#define DESFIRE_EMULATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "DesfireClock.h"
+#include "DesfireCrypto.h"
+#include "DesfireSecureMessaging.h"
+#include "DesfireTypes.h"
+#include "NFCReaderInterface.h"
+
+/**
+ * @brief Emulator constants
+ */
+enum DesfireEmulatorConstants : uint16_t {
+    DF_EMU_UID_SIZE     = 7,     ///< UID of the emulated card
+    DF_EMU_MAX_APPS     = 4,     ///< Applications besides the PICC level
+    DF_EMU_MAX_KEYS     = 4,     ///< AES keys per application
+    DF_EMU_MAX_FILES    = 8,     ///< Data files per application
+    DF_EMU_STORAGE_SIZE = 4096,  ///< File memory shared by all applications
+    DF_EMU_FRAME_DATA   = 59,    ///< Response data per frame (FSD 64 less PCB, CRC and status)
+    DF_EMU_BUFFER_SIZE  = 300,   ///< Longest command or response of one command
+    DF_EMU_PAGE_SIZE    = 32     ///< EEPROM bytes programmed at a time
+};
+
+/**
+ * @brief Fixed times of the emulated link in microseconds
+ */
+enum DesfireEmulatorTimes : uint32_t {
+    DF_EMU_ACTIVATION_TIME = 5000,   ///< Anticollision, selection and RATS
+    DF_EMU_FRAME_WAIT_TIME = 77330,  ///< Reader wait for a silent card (FWI 8)
+    DF_EMU_HOST_LATENCY    = 400     ///< Default host to reader latency per exchange
+};
+
+/**
+ * @brief Processing times of the emulated card in microseconds
+ */
+struct DesfireEmulatorTiming {
+    uint32_t frameDelay;   ///< Delay before every answer (frame delay time)
+    uint32_t commandTime;  ///< Processing of every command except the proximity check
+    uint32_t cryptoTime;   ///< Processing of one AES block
+    uint32_t writeTime;    ///< Programming of one EEPROM page
+    uint32_t commitTime;   ///< Programming of a commit or abort
+    uint32_t extraDelay;   ///< Delay added to every answer, e.g. by a relay
+};
+
+/**
+ * @brief Settings of an emulated data file
+ */
+struct DesfireEmulatorFile {
+    uint8_t                 fileNo;    ///< File number
+    DesfreFileType          type;      ///< DF_FILE_STANDARD or DF_FILE_BACKUP
+    DesfreCommunicationMode commMode;  ///< Communication mode for key access
+    uint8_t                 readKey;   ///< Read access (DF_AR_KEY0 to DF_AR_NEVER)
+    uint8_t                 writeKey;  ///< Write access (DF_AR_KEY0 to DF_AR_NEVER)
+    uint16_t                size;      ///< File size in bytes
+};
+
+/**
+ * @brief Software DESFire EV2 card
+ *
+ * Holds the PICC level (AID 000000) and up to DF_EMU_MAX_APPS applications
+ * with AES keys and standard or backup data files. A transaction MAC file
+ * can be created with CreateTransactionMACFile; it holds its key, but no
+ * transaction MACs are computed. SetConfiguration accepts a new ATS, whose
+ * frame size applies from the next activation. As a DESFire Light, the first
+ * application stands for the Light application. Free access files are always
+ * read and written in plain. Random numbers come from a seeded generator, so
+ * a simulation runs the same on every repetition.
+ */
+class DesfireCardEmulator {
+public:
+    /**
+     * @brief Construct a card with an empty PICC level and an all-zero master key
+     *
+     * @param uid Card UID (7 bytes)
+     */
+    explicit DesfireCardEmulator(const uint8_t* uid);
+
+    /**
+     * @brief Add an application
+     *
+     * @param aid Application ID (3 bytes, not 000000)
+     * @param key Initial value of all keys (16 bytes)
+     * @param keyCount Number of keys (1 to DF_EMU_MAX_KEYS)
+     * @return true if the application was added
+     * @return false if it exists, the key count is invalid or no slot is left
+     */
+    bool addApplication(const uint8_t* aid, const uint8_t* key, uint8_t keyCount);
+
+    /**
+     * @brief Change a key
+     *
+     * @param aid Application ID (3 bytes, 000000 for the PICC master key)
+     * @param keyNo Key number
+     * @param key New key (16 bytes)
+     * @return true if the key was changed
+     * @return false if the application or key does not exist
+     */
+    bool setKey(const uint8_t* aid, uint8_t keyNo, const uint8_t* key);
+
+    /**
+     * @brief Add a data file to an application
+     *
+     * @param aid Application ID (3 bytes)
+     * @param file File settings
+     * @param contents Initial contents (size bytes), nullptr for zeros
+     * @return true if the file was added
+     * @return false if the settings are invalid or the memory is full
+     */
+    bool addFile(const uint8_t* aid, const DesfireEmulatorFile& file, const uint8_t* contents);
+
+    /**
+     * @brief Get the committed contents of a file
+     *
+     * @param aid Application ID (3 bytes)
+     * @param fileNo File number
+     * @return const uint8_t* File contents, nullptr if the file does not exist
+     */
+    const uint8_t* getFileData(const uint8_t* aid, uint8_t fileNo) const;
+
+    /**
+     * @brief Get the key of a transaction MAC file
+     *
+     * @param aid Application ID (3 bytes)
+     * @param fileNo File number of the transaction MAC file
+     * @param version Pointer to variable that will store the key version, may be nullptr
+     * @return const uint8_t* AES key (16 bytes), nullptr if there is no such file
+     */
+    const uint8_t* getTransactionMACKey(const uint8_t* aid, uint8_t fileNo, uint8_t* version) const;
+
+    /**
+     * @brief Get the UID of the card
+     *
+     * @return const uint8_t* UID (DF_EMU_UID_SIZE bytes)
+     */
+    const uint8_t* getUID() const;
+
+    /**
+     * @brief Seed the generator of RndB, TI and the proximity check numbers
+     *
+     * @param seed Seed, 0 is replaced by a fixed value
+     */
+    void setSeed(uint32_t seed);
+
+    /**
+     * @brief Present the card as a DESFire Light
+     *
+     * GetVersion reports the Light hardware type, and ISOSelectFile with the
+     * DF name of the Light application selects the first application.
+     *
+     * @param light true for a DESFire Light, false for an EV2
+     */
+    void setLight(bool light);
+
+    /**
+     * @brief Set the processing times
+     *
+     * @param timing Processing times
+     */
+    void setTiming(const DesfireEmulatorTiming& timing);
+
+    /**
+     * @brief Get the processing times
+     *
+     * @return const DesfireEmulatorTiming& Processing times in use
+     */
+    const DesfireEmulatorTiming& getTiming() const;
+
+    /**
+     * @brief Put the card into or take it out of the field
+     *
+     * @param present true if the card is in the field
+     */
+    void setPresent(bool present);
+
+    /**
+     * @brief Check whether the card is in the field
+     *
+     * @return true if the card is in the field
+     * @return false otherwise
+     */
+    bool isPresent() const;
+
+    /**
+     * @brief Activate the card after it entered the field
+     *
+     * Selects the PICC level, ends the session and discards uncommitted
+     * changes, as a power cycle of a real card does.
+     */
+    void activate();
+
+    /**
+     * @brief Get the frame size (FSC) of the current activation
+     *
+     * @return uint16_t Frame size announced by the ATS at activation
+     */
+    uint16_t getFrameSize() const;
+
+    /**
+     * @brief Process one frame
+     *
+     * @param frame Native frame or ISO wrapped APDU
+     * @param length Length of the frame
+     * @param response Buffer to store the answer (at least DF_EMU_FRAME_DATA + 2 bytes)
+     * @return uint16_t Length of the answer, 0 if the card stays silent
+     */
+    uint16_t process(const uint8_t* frame, uint16_t length, uint8_t* response);
+
+    /**
+     * @brief Get the time the card took for the last frame
+     *
+     * @return uint32_t Time from the end of the command to the start of the answer
+     */
+    uint32_t getProcessingTime() const;
+
+    /**
+     * @brief Check whether an EV2 session is active
+     *
+     * @return true if a session is active
+     * @return false otherwise
+     */
+    bool isAuthenticated() const;
+
+    /**
+     * @brief Get the command counter of the session
+     *
+     * @return uint16_t Command counter, 0 without a session
+     */
+    uint16_t getCommandCounter() const;
+
+private:
+    /**
+     * @brief Kinds of continuation expected with the next AF frame
+     */
+    enum Pending : uint8_t {
+        PENDING_NONE,       ///< No continuation
+        PENDING_VERSION,    ///< Next GetVersion frame
+        PENDING_RESPONSE,   ///< Next frame of a chained response
+        PENDING_COMMAND,    ///< Next frame of a chained command
+        PENDING_AUTH,       ///< Second part of AuthenticateEV2First
+        PENDING_AUTH_RENEW  ///< Second part of AuthenticateEV2NonFirst
+    };
+
+    /**
+     * @brief Data file and its place in the storage
+     */
+    struct File {
+        DesfireEmulatorFile settings;  ///< File settings
+        uint16_t            offset;    ///< Committed contents in the storage
+        uint16_t            shadow;    ///< Uncommitted contents of a backup file
+        bool                dirty;     ///< Flag indicating uncommitted changes
+    };
+
+    /**
+     * @brief Application or PICC level
+     */
+    struct Application {
+        uint8_t aid[3];                                   ///< Application ID
+        uint8_t keys[DF_EMU_MAX_KEYS][DF_AES_KEY_SIZE];  ///< AES keys
+        uint8_t keyCount;                                 ///< Number of keys
+        File    files[DF_EMU_MAX_FILES];                  ///< Data files
+        uint8_t fileCount;                                ///< Number of files
+    };
+
+    /** UID */
+    uint8_t _uid[DF_EMU_UID_SIZE];
+
+    /** PICC level (index 0) and applications */
+    Application _apps[DF_EMU_MAX_APPS + 1];
+
+    /** Number of entries in _apps */
+    uint8_t _appCount;
+
+    /** File memory */
+    uint8_t _storage[DF_EMU_STORAGE_SIZE];
+
+    /** Bytes of the file memory in use */
+    uint16_t _storageUsed;
+
+    /** Selected application, index into _apps */
+    uint8_t _selected;
+
+    /** Card side of the EV2 session */
+    DesfireSecureMessaging _session;
+
+    /** Key number of the session */
+    uint8_t _authKeyNo;
+
+    /** Key number of a running authentication */
+    uint8_t _pendingKeyNo;
+
+    /** Card challenge of a running authentication */
+    uint8_t _rndB[DF_AES_BLOCK_SIZE];
+
+    /** Continuation expected with the next AF frame */
+    Pending _pending;
+
+    /** Next GetVersion frame */
+    uint8_t _versionFrame;
+
+    /** Command code of a chained command */
+    uint8_t _command;
+
+    /** Chained command data */
+    uint8_t _input[DF_EMU_BUFFER_SIZE];
+
+    /** Length of the chained command data */
+    uint16_t _inputLength;
+
+    /** Expected length of the chained command data */
+    uint16_t _inputExpected;
+
+    /** Response of the current command */
+    uint8_t _output[DF_EMU_BUFFER_SIZE];
+
+    /** Length of the response */
+    uint16_t _outputLength;
+
+    /** Bytes of the response already sent */
+    uint16_t _outputSent;
+
+    /** Proximity check MAC input (FDh || OPT || pubRespTime || RndR/RndC pairs) */
+    uint8_t _pcInput[4 + 2 * DF_PC_RND_SIZE];
+
+    /** Length of the proximity check MAC input, 0 without PreparePC */
+    uint8_t _pcLength;
+
+    /** State of the random generator */
+    uint32_t _random;
+
+    /** Processing times */
+    DesfireEmulatorTiming _timing;
+
+    /** Time taken for the last frame */
+    uint32_t _time;
+
+    /** Flag indicating that the card is in the field */
+    bool _present;
+
+    /** Flag indicating a DESFire Light */
+    bool _light;
+
+    /** FSCI of the configured ATS, used from the next activation */
+    uint8_t _fsci;
+
+    /** Frame size (FSC) of the current activation */
+    uint16_t _frameSize;
+
+    /**
+     * @brief Run a complete command
+     *
+     * @param command Command code
+     * @param data Command data
+     * @param length Length of the command data
+     * @return uint8_t Status code, the response data is left in _output
+     */
+    uint8_t execute(uint8_t command, uint8_t* data, uint16_t length);
+
+    /**
+     * @brief Handle an AF frame
+     *
+     * @param data Frame data
+     * @param length Length of the frame data
+     * @return uint8_t Status code, the response data is left in _output
+     */
+    uint8_t proceed(const uint8_t* data, uint16_t length);
+
+    /**
+     * @brief Run the first part of an EV2 authentication
+     *
+     * @param keyNo Key number
+     * @param first true for AuthenticateEV2First, false for NonFirst
+     * @return uint8_t Status code
+     */
+    uint8_t authenticate(uint8_t keyNo, bool first);
+
+    /**
+     * @brief Run the second part of an EV2 authentication
+     *
+     * @param data Encrypted RndA || RndB'
+     * @param length Length of the data
+     * @return uint8_t Status code
+     */
+    uint8_t completeAuthentication(const uint8_t* data, uint16_t length);
+
+    /**
+     * @brief Run ReadData
+     *
+     * @param command Command code
+     * @param data Command header and MAC
+     * @param length Length of the data
+     * @return uint8_t Status code
+     */
+    uint8_t readData(uint8_t command, uint8_t* data, uint16_t length);
+
+    /**
+     * @brief Run WriteData
+     *
+     * @param command Command code
+     * @param data Command header, data and MAC
+     * @param length Length of the data
+     * @return uint8_t Status code
+     */
+    uint8_t writeData(uint8_t command, uint8_t* data, uint16_t length);
+
+    /**
+     * @brief Run CreateTransactionMACFile
+     *
+     * @param command Command code
+     * @param data Plain header, encrypted TMKey || TMKeyVer and MAC
+     * @param length Length of the data
+     * @return uint8_t Status code
+     */
+    uint8_t createTransactionMACFile(uint8_t command, uint8_t* data, uint16_t length);
+
+    /**
+     * @brief Run an interindustry command, only the Light application selection is emulated
+     *
+     * @param apdu Command APDU
+     * @param length Length of the APDU
+     * @return uint16_t Status word
+     */
+    uint16_t executeISO(const uint8_t* apdu, uint16_t length);
+
+    /**
+     * @brief Run SetConfiguration, only the ATS option is emulated
+     *
+     * @param command Command code
+     * @param data Option, encrypted option data and MAC
+     * @param length Length of the data
+     * @return uint8_t Status code
+     */
+    uint8_t setConfiguration(uint8_t command, uint8_t* data, uint16_t length);
+
+    /**
+     * @brief Run CommitTransaction or AbortTransaction
+     *
+     * @param command Command code
+     * @param data Option and MAC
+     * @param length Length of the data
+     * @return uint8_t Status code
+     */
+    uint8_t finishTransaction(uint8_t command, uint8_t* data, uint16_t length);
+
+    /**
+     * @brief Run one of the proximity check commands
+     *
+     * @param command Command code
+     * @param data Command data
+     * @param length Length of the data
+     * @return uint8_t Status code
+     */
+    uint8_t proximityCheck(uint8_t command, const uint8_t* data, uint16_t length);
+
+    /**
+     * @brief Get the length of a command once all chained frames arrived
+     *
+     * @param command Command code
+     * @param data Data of the first frame
+     * @param length Length of the data
+     * @return uint16_t Expected length of the command data
+     */
+    uint16_t getExpectedLength(uint8_t command, const uint8_t* data, uint16_t length);
+
+    /**
+     * @brief Check an access right against the session
+     *
+     * @param access Access right (DF_AR_KEY0 to DF_AR_NEVER)
+     * @return uint8_t Status code
+     */
+    uint8_t checkAccess(uint8_t access) const;
+
+    /**
+     * @brief Get the communication mode of an access
+     *
+     * @param file File
+     * @param access Access right used
+     * @return DesfreCommunicationMode Mode of the command and response
+     */
+    DesfreCommunicationMode getCommMode(const File& file, uint8_t access) const;
+
+    /**
+     * @brief Protect the response data in _output with the session
+     *
+     * @param length Length of the plain response data
+     * @param mode Communication mode
+     * @return uint8_t Status code
+     */
+    uint8_t protectOutput(uint16_t length, DesfreCommunicationMode mode);
+
+    /**
+     * @brief Build the next frame of the response
+     *
+     * @param status Status code of the command
+     * @param wrapped true for an ISO wrapped answer
+     * @param response Buffer to store the frame
+     * @return uint16_t Length of the frame
+     */
+    uint16_t emit(uint8_t status, bool wrapped, uint8_t* response);
+
+    /**
+     * @brief End the session and discard the running command
+     */
+    void endSession();
+
+    /**
+     * @brief Discard the uncommitted changes of the selected application
+     */
+    void discardChanges();
+
+    /**
+     * @brief Find an application
+     *
+     * @param aid Application ID (3 bytes)
+     * @return int Index into _apps, -1 if not found
+     */
+    int findApplication(const uint8_t* aid) const;
+
+    /**
+     * @brief Find a file of the selected application
+     *
+     * @param fileNo File number
+     * @return File* File, nullptr if not found
+     */
+    File* findFile(uint8_t fileNo);
+
+    /**
+     * @brief Add the time of AES operations on a number of bytes
+     *
+     * @param length Number of bytes
+     */
+    void chargeCrypto(uint16_t length);
+
+    /**
+     * @brief Fill a buffer from the random generator
+     *
+     * @param buffer Buffer to fill
+     * @param length Number of bytes
+     */
+    void fillRandom(uint8_t* buffer, uint8_t length);
+};
+
+/**
+ * @brief Reader driving a DesfireCardEmulator
+ *
+ * Every exchange spends the host latency, the RF frames at the current bit
+ * rate and the card processing time on the reader clock. Response timeouts
+ * are checked against the card time, as a reader timer would. Frames are
+ * sent without ISO14443-4 chaining, the card ignores those beyond its frame
+ * size.
+ */
+class DesfireEmulatedReader : public NFCReaderInterface {
+public:
+    /**
+     * @brief Construct a reader
+     *
+     * @param card Emulated card, must outlive the reader
+     * @param clock Clock that receives the simulated time, must outlive the reader
+     */
+    DesfireEmulatedReader(DesfireCardEmulator& card, DesfireClock& clock);
+
+    /**
+     * @brief Initialize the reader
+     *
+     * @return true always
+     */
+    virtual bool begin() override;
+
+    /**
+     * @brief Get the firmware version of the reader
+     *
+     * @return uint32_t Fixed version of the emulated reader
+     */
+    virtual uint32_t getFirmwareVersion() override;
+
+    /**
+     * @brief Configure the reader for card communication
+     *
+     * @return true always
+     */
+    virtual bool configure() override;
+
+    /**
+     * @brief Activate the card if it is in the field
+     *
+     * @param uid Buffer to store the card UID
+     * @param uidLength Pointer to variable that will store the UID length
+     * @return true if a card was detected
+     * @return false if no card was detected
+     */
+    virtual bool detectCard(uint8_t* uid, uint8_t* uidLength) override;
+
+    /**
+     * @brief Send a frame to the card and receive the answer
+     *
+     * @param txData Data to transmit
+     * @param txLength Length of data to transmit
+     * @param rxData Buffer to store the response
+     * @param rxLength Size of rxData in, length of the response out
+     * @return true if the card answered in time
+     * @return false if the card is gone, silent or too slow
+     */
+    virtual bool transceive(const uint8_t* txData,
+                            uint16_t       txLength,
+                            uint8_t*       rxData,
+                            uint16_t*      rxLength) override;
+
+    /**
+     * @brief Limit the time the card may take to answer
+     *
+     * @param timeout Longest accepted card response time in microseconds, 0 for the default
+     * @return true always
+     */
+    virtual bool setResponseTimeout(uint32_t timeout) override;
+
+    /**
+     * @brief Change the bit rate of the activated card
+     *
+     * @param kbps Bit rate in kbit/s for both directions (106, 212, 424 or 848)
+     * @return true if the bit rate is in use
+     * @return false if no card is active or the bit rate is invalid
+     */
+    virtual bool setBitRate(uint16_t kbps) override;
+
+    /**
+     * @brief Set the latency of the host link
+     *
+     * @param latency Time added to every exchange in microseconds
+     */
+    void setHostLatency(uint32_t latency);
+
+    /**
+     * @brief Get the bit rate in use
+     *
+     * @return uint16_t Bit rate in kbit/s
+     */
+    uint16_t getBitRate() const;
+
+private:
+    /** Emulated card */
+    DesfireCardEmulator& _card;
+
+    /** Host link latency per exchange */
+    uint32_t _hostLatency;
+
+    /** Response timeout, 0 for the frame waiting time */
+    uint32_t _responseTimeout;
+
+    /** Bit rate in kbit/s */
+    uint16_t _bitRate;
+
+    /** Flag indicating an activated card */
+    bool _active;
+
+    /**
+     * @brief Get the RF time of a frame
+     *
+     * @param length Length of the frame data
+     * @return uint32_t Time in microseconds at the current bit rate
+     */
+    uint32_t getFrameTime(uint16_t length) const;
+};
+
+#endif  // DESFIRE_EMULATOR_H
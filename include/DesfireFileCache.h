@@ -0,0 +1,144 @@
+/**
+ * @file DesfireFileCache.h
+ * @brief Cache of file contents validated by a card-side change counter
+ *
+ * Returning cards usually carry unchanged files. Instead of reading a whole
+ * file on every tap, the reader reads a short counter that the card advances
+ * on every change (the transaction MAC counter or an application-defined
+ * counter) and reuses the cached contents while the counter is unchanged.
+ */
+
+#ifndef DESFIRE_FILE_CACHE_H
+#define DESFIRE_FILE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "DesfireTypes.h"
+
+/**
+ * @brief File cache constants
+ */
+enum DesfireFileCacheConstants : uint16_t {
+    DF_FILE_CACHE_ENTRIES   = 4,    ///< Number of cached file ranges
+    DF_FILE_CACHE_DATA_SIZE = 256,  ///< Maximum size of a cached file range
+    DF_FILE_CACHE_UID_SIZE  = 10    ///< Maximum UID length
+};
+
+/**
+ * @brief Location of the counter that validates cached file contents
+ *
+ * The counter is read little endian, up to 4 bytes. For the transaction MAC
+ * counter use the TMAC file with offset 0 and length DF_EV2_TMC_LENGTH.
+ */
+struct DesfireCacheValidator {
+    uint8_t                 fileNo;    ///< File holding the counter
+    uint8_t                 offset;    ///< Offset of the counter within the file
+    uint8_t                 length;    ///< Length of the counter in bytes (1 to 4)
+    DesfreCommunicationMode commMode;  ///< Communication mode of the file
+};
+
+/**
+ * @brief Per-UID cache of file ranges keyed by application, file and counter
+ */
+class DesfireFileCache {
+public:
+    /**
+     * @brief Construct an empty cache
+     */
+    DesfireFileCache();
+
+    /**
+     * @brief Look up a cached file range
+     *
+     * An entry whose counter differs from the current one is stale and is
+     * dropped.
+     *
+     * @param uid Card UID
+     * @param uidLength Length of the UID
+     * @param aid Application ID (3 bytes)
+     * @param fileNo File number
+     * @param offset Offset within the file
+     * @param length Length of the range
+     * @param counter Current value of the validating counter
+     * @return const uint8_t* Cached data, nullptr if not cached or stale
+     */
+    const uint8_t* lookup(const uint8_t* uid,
+                          uint8_t        uidLength,
+                          const uint8_t* aid,
+                          uint8_t        fileNo,
+                          uint32_t       offset,
+                          uint32_t       length,
+                          uint32_t       counter);
+
+    /**
+     * @brief Store a file range, replacing the least recently used entry
+     *
+     * @param uid Card UID
+     * @param uidLength Length of the UID
+     * @param aid Application ID (3 bytes)
+     * @param fileNo File number
+     * @param offset Offset within the file
+     * @param length Length of the range
+     * @param counter Value of the validating counter when the data was read
+     * @param data File data
+     * @return true if the range was stored
+     * @return false if the range is too large to be cached
+     */
+    bool store(const uint8_t* uid,
+               uint8_t        uidLength,
+               const uint8_t* aid,
+               uint8_t        fileNo,
+               uint32_t       offset,
+               uint32_t       length,
+               uint32_t       counter,
+               const uint8_t* data);
+
+    /**
+     * @brief Drop all entries of a card
+     *
+     * @param uid Card UID
+     * @param uidLength Length of the UID
+     */
+    void invalidate(const uint8_t* uid, uint8_t uidLength);
+
+    /**
+     * @brief Drop all entries
+     */
+    void clear();
+
+private:
+    /**
+     * @brief Cached file range
+     */
+    struct Entry {
+        uint8_t  uid[DF_FILE_CACHE_UID_SIZE];    ///< Card UID
+        uint8_t  uidLength;                      ///< Length of the UID, 0 if unused
+        uint8_t  aid[3];                         ///< Application ID
+        uint8_t  fileNo;                         ///< File number
+        uint32_t offset;                         ///< Offset within the file
+        uint32_t length;                         ///< Length of the range
+        uint32_t counter;                        ///< Validating counter value
+        uint32_t lastUse;                        ///< Use stamp for LRU replacement
+        uint8_t  data[DF_FILE_CACHE_DATA_SIZE];  ///< Cached data
+    };
+
+    /** Cache entries */
+    Entry _entries[DF_FILE_CACHE_ENTRIES];
+
+    /** Use stamp source */
+    uint32_t _useCounter;
+
+    /**
+     * @brief Find the entry for a file range regardless of its counter
+     *
+     * @return Entry* Matching entry, nullptr if none
+     */
+    Entry* find(const uint8_t* uid,
+                uint8_t        uidLength,
+                const uint8_t* aid,
+                uint8_t        fileNo,
+                uint32_t       offset,
+                uint32_t       length);
+};
+
+#endif  // DESFIRE_FILE_CACHE_H
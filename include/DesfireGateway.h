@@ -0,0 +1,289 @@
+/**
+ * @file DesfireGateway.h
+ * @brief Worker pool driving many readers from one process on Linux
+ *
+ * Every reader is owned by exactly one worker thread, which runs all of its
+ * DesfireNFC exchanges, so session state never crosses threads and needs no
+ * locks. CPU-bound work such as key diversification or MAC verification is
+ * submitted as tasks: each worker keeps its own task deque, runs its newest
+ * task between two reader steps and steals the oldest task of another
+ * worker when its own deque is empty, so workers waiting on a slow card
+ * leave their tasks to idle ones. Completed tasks are returned through one
+ * lock-free single-producer ring per worker, drained by the application
+ * thread with collect().
+ *
+ * Only available on Linux.
+ */
+
+#ifndef DESFIRE_GATEWAY_H
+#define DESFIRE_GATEWAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "DesfireStatus.h"
+
+#if defined(__linux__)
+
+#include <pthread.h>
+#include <atomic>
+
+class DesfireNFC;
+class DesfireGateway;
+
+/**
+ * @brief Gateway constants
+ */
+enum DesfireGatewayConstants : uint16_t {
+    DF_GATEWAY_MAX_WORKERS = 32,   ///< Maximum number of worker threads
+    DF_GATEWAY_MAX_READERS = 128,  ///< Maximum number of readers
+    DF_GATEWAY_QUEUE_SIZE  = 64,   ///< Tasks waiting per worker
+    DF_GATEWAY_RESULT_SIZE = 128,  ///< Results waiting per worker (power of two)
+    DF_GATEWAY_IDLE_WAIT   = 10    ///< Time an idle worker sleeps between checks (ms)
+};
+
+/**
+ * @brief One step of the state machine of a reader
+ *
+ * Called repeatedly on the worker that owns the reader, typically detecting
+ * a card and running a transaction with it. Tasks submitted from the step
+ * go to the deque of the same worker.
+ *
+ * @param gateway Gateway running the step
+ * @param nfc DesfireNFC instance of the reader
+ * @param reader Index of the reader
+ * @param context User-provided context
+ */
+typedef void (*DesfireReaderStep)(DesfireGateway& gateway,
+                                  DesfireNFC&     nfc,
+                                  uint8_t         reader,
+                                  void*           context);
+
+/**
+ * @brief CPU-bound work run on any worker
+ *
+ * @param context User-provided context holding input and output
+ * @return DesfireStatus Result reported by collect()
+ */
+typedef DesfireStatus (*DesfireTaskFunction)(void* context);
+
+/**
+ * @brief Task submitted to the gateway
+ */
+struct DesfireGatewayTask {
+    DesfireTaskFunction run;      ///< Work to run
+    void*               context;  ///< Context passed to run
+    uint8_t             reader;   ///< Reader the task belongs to
+};
+
+/**
+ * @brief Result of a completed task
+ */
+struct DesfireGatewayResult {
+    DesfireStatus status;   ///< Status returned by the task
+    void*         context;  ///< Context of the task
+    uint8_t       reader;   ///< Reader the task belongs to
+};
+
+/**
+ * @brief Worker pool with per-reader affinity and task stealing
+ */
+class DesfireGateway {
+public:
+    /**
+     * @brief Construct a gateway
+     *
+     * @param workers Number of worker threads (1 to DF_GATEWAY_MAX_WORKERS)
+     * @param pinCores Pin worker n to CPU core n modulo the number of cores
+     */
+    DesfireGateway(uint8_t workers, bool pinCores = false);
+
+    /**
+     * @brief Stop the workers and destroy the gateway
+     */
+    ~DesfireGateway();
+
+    /**
+     * @brief Add a reader before start()
+     *
+     * Readers are assigned to workers in turn, reader n to worker n modulo
+     * the number of workers.
+     *
+     * @param nfc DesfireNFC instance of the reader, owned by the caller
+     * @param step State machine step of the reader
+     * @param context User-provided context passed to step
+     * @return int16_t Index of the reader, -1 if full, running or step is null
+     */
+    int16_t addReader(DesfireNFC& nfc, DesfireReaderStep step, void* context);
+
+    /**
+     * @brief Start the workers
+     *
+     * @return true if all workers are running
+     * @return false if already running or a thread could not be created
+     */
+    bool start();
+
+    /**
+     * @brief Stop the workers after their current step or task
+     *
+     * Tasks still waiting are dropped; results already completed stay
+     * available to collect().
+     */
+    void stop();
+
+    /**
+     * @brief Submit a task
+     *
+     * From a worker the task goes to the deque of that worker, otherwise to
+     * the worker owning task.reader.
+     *
+     * @param task Task to run
+     * @return true if the task was queued
+     * @return false if the deque is full or the task has no function
+     */
+    bool submit(const DesfireGatewayTask& task);
+
+    /**
+     * @brief Take completed task results
+     *
+     * Must only be called from one thread at a time.
+     *
+     * @param results Array to store the results
+     * @param maxResults Size of the array
+     * @return uint16_t Number of results stored
+     */
+    uint16_t collect(DesfireGatewayResult* results, uint16_t maxResults);
+
+    /**
+     * @brief Get the number of worker threads
+     *
+     * @return uint8_t Number of workers
+     */
+    uint8_t getWorkerCount() const;
+
+    /**
+     * @brief Get the worker owning a reader
+     *
+     * @param reader Index of the reader
+     * @return uint8_t Index of the worker
+     */
+    uint8_t getWorkerOf(uint8_t reader) const;
+
+    /**
+     * @brief Get the worker the calling thread belongs to
+     *
+     * @return int16_t Index of the worker, -1 outside the workers of any gateway
+     */
+    static int16_t currentWorker();
+
+private:
+    /**
+     * @brief Reader registered with the gateway
+     */
+    struct Reader {
+        DesfireNFC*       nfc;      ///< DesfireNFC instance
+        DesfireReaderStep step;     ///< State machine step
+        void*             context;  ///< Context passed to step
+    };
+
+    /**
+     * @brief State of one worker thread
+     *
+     * Aligned to a cache line so that workers do not share lines.
+     */
+    struct alignas(64) Worker {
+        DesfireGateway*       gateway;                          ///< Owning gateway
+        pthread_t             thread;                           ///< Worker thread
+        uint8_t               index;                            ///< Index of the worker
+        bool                  started;                          ///< Thread was created
+        pthread_mutex_t       queueLock;                        ///< Guards the task deque
+        DesfireGatewayTask    queue[DF_GATEWAY_QUEUE_SIZE];     ///< Task deque (ring)
+        uint16_t              queueHead;                        ///< Oldest task, stolen first
+        uint16_t              queueCount;                       ///< Number of waiting tasks
+        DesfireGatewayResult  results[DF_GATEWAY_RESULT_SIZE];  ///< Result ring
+        std::atomic<uint32_t> resultHead;                       ///< Next result to collect
+        std::atomic<uint32_t> resultTail;                       ///< Next result to store
+    };
+
+    /** Worker states */
+    Worker _workers[DF_GATEWAY_MAX_WORKERS];
+
+    /** Number of workers */
+    uint8_t _workerCount;
+
+    /** Pin workers to CPU cores */
+    bool _pinCores;
+
+    /** Registered readers */
+    Reader _readers[DF_GATEWAY_MAX_READERS];
+
+    /** Number of registered readers */
+    uint8_t _readerCount;
+
+    /** Flag telling the workers to keep running */
+    std::atomic<bool> _running;
+
+    /** Number of tasks waiting in all deques */
+    std::atomic<uint32_t> _pending;
+
+    /** Guards the idle condition */
+    pthread_mutex_t _idleLock;
+
+    /** Signalled when a task is submitted or the gateway stops */
+    pthread_cond_t _idle;
+
+    /**
+     * @brief Entry point of a worker thread
+     *
+     * @param argument Worker state
+     * @return void* Always nullptr
+     */
+    static void* workerMain(void* argument);
+
+    /**
+     * @brief Run the loop of a worker until stop()
+     *
+     * @param worker Worker state
+     */
+    void run(Worker& worker);
+
+    /**
+     * @brief Take the newest task of a worker's own deque
+     *
+     * @param worker Worker state
+     * @param task Task taken
+     * @return true if a task was taken
+     * @return false if the deque is empty
+     */
+    bool popTask(Worker& worker, DesfireGatewayTask& task);
+
+    /**
+     * @brief Take the oldest task of another worker's deque
+     *
+     * @param worker Worker state of the thief
+     * @param task Task taken
+     * @return true if a task was taken
+     * @return false if all other deques are empty
+     */
+    bool stealTask(Worker& worker, DesfireGatewayTask& task);
+
+    /**
+     * @brief Check whether a worker's result ring has room for a result
+     *
+     * @param worker Worker state
+     * @return true if a result can be stored
+     * @return false if the ring is full
+     */
+    static bool hasResultSpace(const Worker& worker);
+
+    /**
+     * @brief Wait for a submitted task, a collected result or stop()
+     *
+     * @param worker Worker state
+     */
+    void waitIdle(const Worker& worker);
+};
+
+#endif  // __linux__
+
+#endif  // DESFIRE_GATEWAY_H
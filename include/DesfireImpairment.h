@@ -0,0 +1,316 @@
+/**
+ * @file DesfireImpairment.h
+ * @brief RF channel impairment model around any reader
+ *
+ * DesfireImpairedReader sits between DesfireNFC and a reader and degrades
+ * the link the way the edge of the field does: commands and answers get
+ * lost, answers arrive with bit errors, exchanges take a variable time and
+ * the card leaves the field in the middle of an exchange (tearing), after
+ * the card may or may not have executed the command. All decisions come
+ * from a seeded generator, so a failing run repeats exactly.
+ *
+ * Waiting is spent on the clock of the wrapped reader; around a
+ * DesfireEmulatedReader on a DesfireVirtualClock, whole impairment profiles
+ * run in a fraction of a second. The statistics give the effective
+ * throughput of each profile.
+ */
+
+#ifndef DESFIRE_IMPAIRMENT_H
+#define DESFIRE_IMPAIRMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "NFCReaderInterface.h"
+
+/**
+ * @brief Impairment constants
+ */
+enum DesfireImpairmentConstants : uint32_t {
+    DF_IMPAIR_SCALE        = 1000000,  ///< Probabilities are given per million
+    DF_IMPAIR_TIMEOUT      = 77330,    ///< Default reader wait for a lost frame (FWI 8)
+    DF_IMPAIR_REMOVAL_TIME = 500000,   ///< Default time a removed card stays away
+    DF_IMPAIR_SEED         = 0x9E3779B9
+};
+
+/**
+ * @brief Predefined impairment profiles
+ */
+enum DesfireImpairmentPreset : uint8_t {
+    DF_IMPAIR_CLEAN   = 0,  ///< No impairment
+    DF_IMPAIR_NOISY   = 1,  ///< Occasional loss and bit errors, little jitter
+    DF_IMPAIR_EDGE    = 2,  ///< Edge of the field: frequent loss, jitter and removal
+    DF_IMPAIR_TEARING = 3   ///< Good link, cards pulled away early
+};
+
+/**
+ * @brief Settings of the impaired channel
+ *
+ * Probabilities are per million (DF_IMPAIR_SCALE).
+ */
+struct DesfireImpairment {
+    uint32_t commandLoss;   ///< Probability that the card does not receive a command
+    uint32_t responseLoss;  ///< Probability that the answer of the card is lost
+    uint32_t bitErrorRate;  ///< Probability that a bit of an answer flips
+    bool     crcCheck;      ///< true: the reader rejects corrupted answers, false: delivers them
+    uint32_t jitter;        ///< Largest delay added to an exchange (microseconds)
+    uint32_t removalRate;   ///< Probability that the card leaves the field during an exchange
+    uint32_t removalTime;   ///< Time a removed card stays away (microseconds)
+    uint32_t timeout;       ///< Reader wait for a lost frame (microseconds)
+};
+
+/**
+ * @brief Counts and times of the impaired channel
+ */
+struct DesfireImpairmentStats {
+    uint32_t exchanges;      ///< Exchanges requested by the host
+    uint32_t delivered;      ///< Exchanges that returned an answer
+    uint32_t lostCommands;   ///< Commands the card did not receive
+    uint32_t lostResponses;  ///< Answers lost after the card executed the command
+    uint32_t corrupted;      ///< Answers hit by bit errors
+    uint32_t removals;       ///< Removals of the card during an exchange
+    uint64_t bytes;          ///< Command and answer bytes of delivered exchanges
+    uint64_t time;           ///< Time spent in exchanges (microseconds)
+};
+
+/**
+ * @brief Reader that impairs the channel to a wrapped reader
+ *
+ * Detection, configuration and bit rate changes are passed through; while
+ * a removed card is away, detection fails. Not synchronized.
+ */
+class DesfireImpairedReader : public NFCReaderInterface {
+public:
+    /**
+     * @brief Construct a reader with a clean channel
+     *
+     * The reader shares the clock of the wrapped reader.
+     *
+     * @param reader Wrapped reader, must outlive this reader
+     * @param seed Seed of the generator, 0 for a fixed default
+     */
+    explicit DesfireImpairedReader(NFCReaderInterface& reader, uint32_t seed = 0);
+
+    /**
+     * @brief Get the settings of a predefined profile
+     *
+     * @param preset Profile
+     * @return DesfireImpairment Settings of the profile
+     */
+    static DesfireImpairment getPreset(DesfireImpairmentPreset preset);
+
+    /**
+     * @brief Set the impairment of the channel
+     *
+     * @param impairment Settings to use
+     */
+    void setImpairment(const DesfireImpairment& impairment);
+
+    /**
+     * @brief Get the impairment of the channel
+     *
+     * @return const DesfireImpairment& Settings in use
+     */
+    const DesfireImpairment& getImpairment() const;
+
+    /**
+     * @brief Restart the generator
+     *
+     * @param seed Seed of the generator, 0 for a fixed default
+     */
+    void setSeed(uint32_t seed);
+
+    /**
+     * @brief Remove the card during the next exchange
+     *
+     * Forces a tearing at a known point, independent of the removal rate.
+     *
+     * @param executed true if the card executes the command before it leaves
+     */
+    void tearNextExchange(bool executed);
+
+    /**
+     * @brief Check whether a removed card is away
+     *
+     * @return true if the card left the field and was not detected again
+     * @return false otherwise
+     */
+    bool isRemoved() const;
+
+    /**
+     * @brief Get the counts and times of the channel
+     *
+     * @return const DesfireImpairmentStats& Statistics since the last reset
+     */
+    const DesfireImpairmentStats& getStats() const;
+
+    /**
+     * @brief Get the effective throughput of the channel
+     *
+     * @return uint32_t Delivered command and answer bytes per second of
+     *         exchange time, 0 before the first exchange
+     */
+    uint32_t getThroughput() const;
+
+    /**
+     * @brief Clear the statistics
+     */
+    void resetStats();
+
+    /**
+     * @brief Initialize the wrapped reader
+     *
+     * @return true if initialization was successful
+     * @return false if initialization failed
+     */
+    virtual bool begin() override;
+
+    /**
+     * @brief Get the firmware version of the wrapped reader
+     *
+     * @return uint32_t Version information (0 if failed)
+     */
+    virtual uint32_t getFirmwareVersion() override;
+
+    /**
+     * @brief Configure the wrapped reader
+     *
+     * @return true if configuration was successful
+     * @return false if configuration failed
+     */
+    virtual bool configure() override;
+
+    /**
+     * @brief Detect a card with the wrapped reader
+     *
+     * A removed card is not detected before its removal time has passed.
+     *
+     * @param uid Buffer to store the card UID
+     * @param uidLength Pointer to variable that will store the UID length
+     * @return true if a card was detected
+     * @return false if no card was detected
+     */
+    virtual bool detectCard(uint8_t* uid, uint8_t* uidLength) override;
+
+    /**
+     * @brief Exchange a frame over the impaired channel
+     *
+     * @param txData Data to transmit
+     * @param txLength Length of data to transmit
+     * @param rxData Buffer to store the response
+     * @param rxLength Pointer to variable that will store the response length
+     * @return true if an answer was delivered, possibly with bit errors
+     * @return false if a frame was lost, rejected or the card is away
+     */
+    virtual bool transceive(const uint8_t* txData,
+                            uint16_t       txLength,
+                            uint8_t*       rxData,
+                            uint16_t*      rxLength) override;
+
+    /**
+     * @brief Limit the time the card may take to answer
+     *
+     * Also the wait for a lost frame while set.
+     *
+     * @param timeout Longest accepted card response time in microseconds, 0 for the default
+     * @return true if the wrapped reader enforces the limit
+     * @return false otherwise
+     */
+    virtual bool setResponseTimeout(uint32_t timeout) override;
+
+    /**
+     * @brief Get the largest command of the wrapped reader
+     *
+     * @return uint16_t Maximum length of txData in bytes
+     */
+    virtual uint16_t getMaxTransmitLength() override;
+
+    /**
+     * @brief Get the largest response of the wrapped reader
+     *
+     * @return uint16_t Maximum length of rxData in bytes, status word included
+     */
+    virtual uint16_t getMaxReceiveLength() override;
+
+    /**
+     * @brief Change the bit rate with the wrapped reader
+     *
+     * @param kbps Bit rate in kbit/s for both directions (106, 212, 424 or 848)
+     * @return true if the bit rate is in use
+     * @return false if the reader or the card does not support it
+     */
+    virtual bool setBitRate(uint16_t kbps) override;
+
+    /**
+     * @brief Check whether the wrapped reader passes native DESFire frames
+     *
+     * @return true if any frame is sent to the card unchanged
+     * @return false if only APDUs are accepted
+     */
+    virtual bool supportsNativeFrames() override;
+
+private:
+    /** Wrapped reader */
+    NFCReaderInterface& _reader;
+
+    /** Settings in use */
+    DesfireImpairment _impairment;
+
+    /** Statistics since the last reset */
+    DesfireImpairmentStats _stats;
+
+    /** State of the generator (xorshift32) */
+    uint32_t _random;
+
+    /** Response timeout set by the host, 0 if unset */
+    uint32_t _responseTimeout;
+
+    /** Flag indicating a removed card */
+    bool _removed;
+
+    /** Clock time at which a removed card returns */
+    uint32_t _returnTime;
+
+    /** Flag indicating a forced tearing of the next exchange */
+    bool _tearPending;
+
+    /** Flag indicating that the card executes the torn command */
+    bool _tearExecuted;
+
+    /**
+     * @brief Get the next number of the generator
+     *
+     * @return uint32_t Pseudo random number
+     */
+    uint32_t nextRandom();
+
+    /**
+     * @brief Decide an event
+     *
+     * @param probability Probability per million
+     * @return true if the event happens
+     * @return false otherwise
+     */
+    bool chance(uint32_t probability);
+
+    /**
+     * @brief Flip bits of an answer at the bit error rate
+     *
+     * @param data Answer
+     * @param length Length of the answer
+     * @return true if a bit was flipped
+     * @return false if the answer is unchanged
+     */
+    bool corrupt(uint8_t* data, uint16_t length);
+
+    /**
+     * @brief Take the card out of the field
+     */
+    void removeCard();
+
+    /**
+     * @brief Wait for a frame that does not arrive
+     */
+    void waitTimeout();
+};
+
+#endif  // DESFIRE_IMPAIRMENT_H
@@ -0,0 +1,207 @@
+/**
+ * @file DesfireNDEF.h
+ * @brief NFC Forum Type 4 Tag capability container and streaming NDEF parser
+ *
+ * The NDEF message is parsed while it is being read, so that a record is
+ * handed to the application as soon as its last payload byte arrives and
+ * the read can stop once the wanted record has been seen.
+ */
+
+#ifndef DESFIRE_NDEF_H
+#define DESFIRE_NDEF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief NDEF constants
+ */
+enum NDEFConstants : uint16_t {
+    NDEF_CC_LENGTH        = 15,      ///< Length of the capability container read
+    NDEF_NLEN_LENGTH      = 2,       ///< Length of the NDEF length field (NLEN)
+    NDEF_TYPE_MAX_LENGTH  = 16,      ///< Maximum record type length kept
+    NDEF_PAYLOAD_MAX      = 256,     ///< Maximum record payload kept
+    NDEF_CC_FILE_ID       = 0xE103,  ///< File identifier of the capability container
+    NDEF_TLV_FILE_CONTROL = 0x04     ///< T of the NDEF file control TLV
+};
+
+/**
+ * @brief NDEF record type name format (TNF)
+ */
+enum NDEFTypeNameFormat : uint8_t {
+    NDEF_TNF_EMPTY      = 0x00,  ///< Empty record
+    NDEF_TNF_WELL_KNOWN = 0x01,  ///< NFC Forum well-known type (RTD)
+    NDEF_TNF_MEDIA      = 0x02,  ///< Media type (RFC 2046)
+    NDEF_TNF_URI        = 0x03,  ///< Absolute URI (RFC 3986)
+    NDEF_TNF_EXTERNAL   = 0x04,  ///< NFC Forum external type
+    NDEF_TNF_UNKNOWN    = 0x05,  ///< Unknown type
+    NDEF_TNF_UNCHANGED  = 0x06   ///< Continuation of a chunked record
+};
+
+/**
+ * @brief Capability container of a Type 4 Tag
+ */
+struct NDEFCapabilityContainer {
+    uint8_t  mappingVersion;    ///< Mapping version (0x20 for version 2.0)
+    uint16_t maxReadLength;     ///< Maximum data read with one READ BINARY (MLe)
+    uint16_t maxCommandLength;  ///< Maximum data sent with one UPDATE BINARY (MLc)
+    uint16_t fileId;            ///< File identifier of the NDEF file
+    uint16_t maxNdefSize;       ///< Size of the NDEF file including NLEN
+    uint8_t  readAccess;        ///< Read access condition (0x00 for free access)
+    uint8_t  writeAccess;       ///< Write access condition (0xFF for read only)
+};
+
+/**
+ * @brief A complete NDEF record
+ *
+ * The payload points into the parser and is only valid during the callback.
+ */
+struct NDEFRecord {
+    NDEFTypeNameFormat tnf;                         ///< Type name format
+    uint8_t            type[NDEF_TYPE_MAX_LENGTH];  ///< Record type
+    uint8_t            typeLength;                  ///< Length of the record type (up to 16 kept)
+    const uint8_t*     payload;                     ///< Payload, nullptr if too large
+    uint32_t           payloadLength;               ///< Length of the payload
+    bool               messageBegin;                ///< First record of the message
+    bool               messageEnd;                  ///< Last record of the message
+};
+
+/**
+ * @brief Called for every complete record
+ *
+ * @param record Complete record
+ * @param context Context pointer given to the parser
+ * @return true to continue parsing
+ * @return false to stop, no more data is needed
+ */
+typedef bool (*NDEFRecordCallback)(const NDEFRecord& record, void* context);
+
+/**
+ * @brief Incremental parser for an NDEF message
+ *
+ * Data may be fed in pieces of any size. Chunked records are not supported
+ * and are reported as malformed.
+ */
+class NDEFParser {
+public:
+    /**
+     * @brief Construct a parser
+     *
+     * @param callback Function called for every complete record
+     * @param context Context pointer passed to the callback
+     */
+    NDEFParser(NDEFRecordCallback callback, void* context);
+
+    /**
+     * @brief Prepare the parser for a new message
+     */
+    void reset();
+
+    /**
+     * @brief Parse the next piece of the NDEF message
+     *
+     * @param data Message data
+     * @param length Length of the data
+     * @return true if the data was parsed
+     * @return false if the message is malformed
+     */
+    bool feed(const uint8_t* data, size_t length);
+
+    /**
+     * @brief Check whether parsing has finished
+     *
+     * @return true after the last record or when the callback stopped parsing
+     * @return false if more data is needed
+     */
+    bool isComplete() const;
+
+    /**
+     * @brief Parse a capability container
+     *
+     * @param data Capability container (at least NDEF_CC_LENGTH bytes)
+     * @param length Length of the data
+     * @param cc Structure to store the parsed capability container
+     * @return true if the capability container is valid
+     * @return false otherwise
+     */
+    static bool parseCapabilityContainer(const uint8_t*           data,
+                                         size_t                   length,
+                                         NDEFCapabilityContainer* cc);
+
+    /**
+     * @brief Decode a well-known URI record
+     *
+     * @param record Record of type "U"
+     * @param uri Buffer to store the NUL-terminated URI
+     * @param size Size of the buffer
+     * @return true if the record is a URI record and the URI fits
+     * @return false otherwise
+     */
+    static bool decodeURI(const NDEFRecord& record, char* uri, size_t size);
+
+    /**
+     * @brief Decode a well-known text record
+     *
+     * @param record Record of type "T"
+     * @param text Buffer to store the NUL-terminated text (UTF-8 records only)
+     * @param size Size of the buffer
+     * @return true if the record is a UTF-8 text record and the text fits
+     * @return false otherwise
+     */
+    static bool decodeText(const NDEFRecord& record, char* text, size_t size);
+
+private:
+    /**
+     * @brief Position of the parser within a record
+     */
+    enum State : uint8_t {
+        STATE_HEADER,
+        STATE_TYPE_LENGTH,
+        STATE_PAYLOAD_LENGTH,
+        STATE_ID_LENGTH,
+        STATE_TYPE,
+        STATE_ID,
+        STATE_PAYLOAD,
+        STATE_DONE,
+        STATE_ERROR
+    };
+
+    /** Record callback */
+    NDEFRecordCallback _callback;
+
+    /** Callback context */
+    void* _context;
+
+    /** Current parser state */
+    State _state;
+
+    /** Header byte of the current record */
+    uint8_t _header;
+
+    /** Bytes left in the current field */
+    uint32_t _remaining;
+
+    /** Length of the ID field */
+    uint8_t _idLength;
+
+    /** Flag indicating that the next record is the first of the message */
+    bool _first;
+
+    /** Record being assembled */
+    NDEFRecord _record;
+
+    /** Payload of the current record */
+    uint8_t _payload[NDEF_PAYLOAD_MAX];
+
+    /**
+     * @brief Move on after a field, skipping empty fields
+     */
+    void nextField();
+
+    /**
+     * @brief Hand the current record to the callback
+     */
+    void completeRecord();
+};
+
+#endif  // DESFIRE_NDEF_H
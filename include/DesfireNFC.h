@@ -9,9 +9,23 @@
 #ifndef DESFIRE_NFC_H
 #define DESFIRE_NFC_H
 
+#ifdef ARDUINO
 #include <Arduino.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#endif
+#include "DesfireFileCache.h"
+#include "DesfireNDEF.h"
+#include "DesfireOriginality.h"
+#include "DesfireRandom.h"
+#include "DesfireReadPlan.h"
+#include "DesfireSecureMessaging.h"
 #include "DesfireStatus.h"
+#include "DesfireStrategy.h"
 #include "DesfireTypes.h"
+#include "DesfireWritePlan.h"
 #include "ISO7816APDU.h"
 #include "ISO7816Constants.h"
 #include "NFCReaderInterface.h"
@@ -39,6 +53,16 @@ public:
      */
     bool initialize();
 
+    /**
+     * @brief Perform background work while no card is being processed
+     *
+     * Tops up the pool of pre-generated authentication challenges so that
+     * authenticate() does not have to wait for the random number generator,
+     * and builds the originality check tables one at a time.
+     * Call this from loop() while no card is in the field.
+     */
+    void idle();
+
     /**
      * @brief Detect if a DESFire card is present in the field
      *
@@ -56,6 +80,30 @@ public:
      */
     bool getCardUID(uint8_t* uid, uint8_t* uidLength);
 
+    /**
+     * @brief Check whether the detected card presented a random UID
+     *
+     * Cards configured for random ID answer anticollision with a 4-byte UID
+     * starting with 08h that changes on every activation.
+     *
+     * @return true if the UID of the detected card is random
+     * @return false otherwise
+     */
+    bool hasRandomUID() const;
+
+    /**
+     * @brief Get the real UID of the card with GetCardUID
+     *
+     * Requires an EV2 session, the UID is returned encrypted. The result is
+     * remembered for the current activation of the card, so later calls and
+     * the per-card caches use the real UID without another exchange.
+     *
+     * @param uid Buffer to store the UID (should be at least 10 bytes)
+     * @param uidLength Pointer to variable that will store the UID length
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus getRealCardUID(uint8_t* uid, uint8_t* uidLength);
+
     /**
      * @brief Get version information from the card
      *
@@ -73,17 +121,128 @@ public:
      */
     bool getVersion(DESFireCardVersion* version);
 
+    /**
+     * @brief Select the fastest supported options for the detected card
+     *
+     * Runs GetVersion and derives the authentication method, framing, frame
+     * size and bit rate from the card generation. The decision is cached per
+     * UID: when the card is detected again, detectCard() applies it before
+     * the first command, and the bit rate can only be raised at that point.
+     * Random-ID cards are cached once their real UID is known.
+     *
+     * @param strategy Structure to store the selected strategy (optional)
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus selectStrategy(DesfireCardStrategy* strategy = nullptr);
+
+    /**
+     * @brief Get the strategy in use for the detected card
+     *
+     * @return const DesfireCardStrategy& Current strategy, the default for
+     *         unknown cards until selectStrategy() or a cached strategy applies
+     */
+    const DesfireCardStrategy& getStrategy() const;
+
     /**
      * @brief Select a DESFire application by its ID
      *
+     * With the DESFire Light profile the only application is selected by its
+     * DF name and the AID is ignored.
+     *
      * @param aid Application ID (3 bytes)
      * @return DesfireStatus Status code of the operation
      */
     DesfireStatus selectApplication(uint8_t* aid);
 
+    /**
+     * @brief Get the command profile of the card
+     *
+     * getVersion() selects the profile from the hardware type. detectCard()
+     * starts a known card with the profile of its cached strategy and any
+     * other card with DF_PROFILE_GENERIC; a reader that only sees one kind of
+     * card can set it after detection and skip getVersion().
+     *
+     * @return DesfireCardProfile Current profile
+     */
+    DesfireCardProfile getCardProfile() const;
+
+    /**
+     * @brief Set the command profile of the card
+     *
+     * @param profile Profile to use
+     */
+    void setCardProfile(DesfireCardProfile profile);
+
+    /**
+     * @brief Get the description of a DESFire Light file
+     *
+     * @param fileNo File number
+     * @return const DesfireFileInfo* File description, nullptr if not part of the file set
+     */
+    static const DesfireFileInfo* getLightFileInfo(uint8_t fileNo);
+
+    /**
+     * @brief Read a complete data file of a DESFire Light
+     *
+     * The size comes from the fixed file set, so no GetFileSettings exchange
+     * is needed.
+     *
+     * @param fileNo Standard data or transaction MAC file number
+     * @param data Buffer to store the file contents
+     * @param length Pointer to the buffer size, updated with the file size
+     * @param commMode Communication mode of the file
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus readLightFile(uint8_t                 fileNo,
+                                uint8_t*                data,
+                                uint16_t*               length,
+                                DesfreCommunicationMode commMode = DF_COMM_PLAIN);
+
+    /**
+     * @brief Read the NDEF message of a Type 4 Tag
+     *
+     * Selects the NDEF application by DF name, reads the capability container
+     * and the NDEF file with the largest READ BINARY the card and the reader
+     * allow. Every response is fed to the parser right away, the read stops
+     * as soon as the parser is complete.
+     *
+     * @param parser Parser that receives the NDEF message
+     * @param cc Structure to store the capability container (optional)
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus readNDEF(NDEFParser& parser, NDEFCapabilityContainer* cc = nullptr);
+
+    /**
+     * @brief Read the NXP originality signature (Read_Sig)
+     *
+     * Must be called before authentication, the signature is returned in
+     * plain only on unauthenticated sessions.
+     *
+     * @param signature Buffer to store the signature (56 bytes)
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus readSignature(uint8_t* signature);
+
+    /**
+     * @brief Verify that the card is a genuine NXP DESFire
+     *
+     * Reads the originality signature and verifies it over the card UID. UIDs
+     * that passed once are cached and return immediately without touching the
+     * card.
+     *
+     * @param version Version information returned by getVersion()
+     * @return DesfireStatus DFST_SUCCESS if genuine, DFST_ORIGINALITY_ERROR if
+     *         the signature does not verify, DFST_PARAMETER_ERROR if the card
+     *         type has no originality signature
+     */
+    DesfireStatus verifyOriginality(const DESFireCardVersion& version);
+
     /**
      * @brief Authenticate with the specified key
      *
+     * Not available with the DESFire Light profile, the Light only supports
+     * EV2 authentication (authenticateEV2First()).
+     *
      * @param keyNo Key number to authenticate with
      * @param key Pointer to the key data
      * @param keySize Size of the key in bytes
@@ -91,6 +250,356 @@ public:
      */
     DesfireStatus authenticate(uint8_t keyNo, const uint8_t* key, uint8_t keySize);
 
+    /**
+     * @brief Authenticate with an AES key using AuthenticateEV2First
+     *
+     * Starts an EV2 secure messaging session: later commands are protected
+     * with the derived session keys and the command counter.
+     *
+     * @param keyNo Key number to authenticate with
+     * @param key AES-128 key (16 bytes)
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus authenticateEV2First(uint8_t keyNo, const uint8_t* key);
+
+    /**
+     * @brief Authenticate with an AES key using EV1 AuthenticateAES
+     *
+     * Establishes the session key for EV1 cards. EV1 secure messaging is not
+     * applied to later commands, files must allow plain communication.
+     *
+     * @param keyNo Key number to authenticate with
+     * @param key AES-128 key (16 bytes)
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus authenticateAES(uint8_t keyNo, const uint8_t* key);
+
+    /**
+     * @brief Authenticate with another key using AuthenticateEV2NonFirst
+     *
+     * Requires an EV2 session. Saves the capability exchange of
+     * AuthenticateEV2First and keeps the transaction identifier and command
+     * counter, only the session keys change.
+     *
+     * @param keyNo Key number to authenticate with
+     * @param key AES-128 key (16 bytes)
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus authenticateEV2NonFirst(uint8_t keyNo, const uint8_t* key);
+
+    /**
+     * @brief Authenticate with an AES key using the method of the strategy
+     *
+     * EV2, EV3 and Light cards use AuthenticateEV2First, or NonFirst within a
+     * session, EV1 cards AuthenticateAES.
+     *
+     * @param keyNo Key number to authenticate with
+     * @param key AES-128 key (16 bytes)
+     * @return DesfireStatus Status code of the operation, DFST_ILLEGAL_COMMAND
+     *         if the card has no AES authentication
+     */
+    DesfireStatus authenticateWithStrategy(uint8_t keyNo, const uint8_t* key);
+
+    /**
+     * @brief Change a card configuration option with SetConfiguration
+     *
+     * Requires an EV2 session with the PICC master key, the option data is
+     * sent encrypted. Some options (format disable, random ID) can never be
+     * reverted. A new ATS takes effect with the next activation of the card.
+     *
+     * @param option Configuration option
+     * @param data Option data
+     * @param dataLen Length of the option data
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus setConfiguration(DesfireConfigOption option,
+                                   const uint8_t*      data,
+                                   uint8_t             dataLen);
+
+    /**
+     * @brief Apply a card configuration within the current session
+     *
+     * Runs one SetConfiguration per selected option (default key, ATS, PICC
+     * configuration, in this order) without re-authenticating in between,
+     * so it can be one step of a personalization sequence. Stops at the
+     * first failing option.
+     *
+     * @param config Configuration to apply
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus applyConfiguration(const DesfireConfiguration& config);
+
+    /**
+     * @brief Set the frame size (FSC) the cards accept
+     *
+     * Determines how much command data is sent per frame before the rest
+     * follows in additional frames, together with the reader limit. Replaced
+     * on detection by the frame size of the strategy of a known card, which
+     * setConfiguration() updates when it configures a new ATS, and by the
+     * factory frame size (64 bytes) for any other card.
+     *
+     * @param frameSize Card frame size in bytes (16 to 256)
+     */
+    void setCardFrameSize(uint16_t frameSize);
+
+    /**
+     * @brief Read data from a standard, backup or transaction MAC file
+     *
+     * @param fileNo File number
+     * @param offset Offset within the file
+     * @param length Number of bytes to read (must be greater than 0)
+     * @param data Buffer to store the data (at least length bytes)
+     * @param commMode Communication mode of the file
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus readData(uint8_t                 fileNo,
+                           uint32_t                offset,
+                           uint32_t                length,
+                           uint8_t*                data,
+                           DesfreCommunicationMode commMode = DF_COMM_PLAIN);
+
+    /**
+     * @brief Read several ranges of files of the selected application
+     *
+     * Plans the reads with DesfireReadPlanner: overlapping and adjacent
+     * ranges, and ranges at most maxGap bytes apart, are read with a single
+     * ReadData command and the data is copied to the buffer of each range.
+     * Stops at the first failing command.
+     *
+     * @param requests Ranges to read (at most DF_READ_PLAN_MAX_REQUESTS)
+     * @param count Number of requests
+     * @param maxGap Largest gap between two ranges that is read through
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus readDataRanges(const DesfireReadRequest* requests,
+                                 uint8_t                   count,
+                                 uint32_t                  maxGap = DF_READ_PLAN_MAX_GAP);
+
+    /**
+     * @brief Read a file range from each of several applications in one pass
+     *
+     * Selects each application, authenticates with the entry's key using
+     * the method of the card's strategy and reads the range into the result
+     * of the same index. Consecutive entries of the same application share
+     * one select; a different key of that application switches the session
+     * with AuthenticateEV2NonFirst where the card has it, consecutive
+     * entries with the same key share one authentication and entries
+     * without a key read in the current session. A failing entry does not
+     * stop the sweep, a lost card does: the remaining entries get
+     * DFST_COMMUNICATION_ERROR without further exchanges. Runs
+     * selectStrategy() first if the card has no strategy yet; if that
+     * fails, every entry gets DFST_COMMUNICATION_ERROR.
+     *
+     * @param entries File ranges to read
+     * @param results Array of count results, in the order of the entries
+     * @param count Number of entries
+     * @return DesfireStatus DFST_SUCCESS if every entry was read, otherwise
+     *         the status of the first failed entry
+     */
+    DesfireStatus readApplicationFiles(const DesfireSweepEntry* entries,
+                                       DesfireSweepResult*      results,
+                                       uint8_t                  count);
+
+    /**
+     * @brief Read data, reusing contents cached on an earlier tap
+     *
+     * Reads the validating counter first (one short exchange). While it is
+     * unchanged since the contents were cached for this card, application
+     * and file range, the cached contents are returned without reading the
+     * file. Otherwise the file is read and cached. Ranges larger than
+     * DF_FILE_CACHE_DATA_SIZE are read but not cached.
+     *
+     * @param fileNo File number
+     * @param offset Offset within the file
+     * @param length Number of bytes to read (must be greater than 0)
+     * @param data Buffer to store the data (at least length bytes)
+     * @param commMode Communication mode of the file
+     * @param validator Counter that the card changes whenever the file changes
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus readDataCached(uint8_t                      fileNo,
+                                 uint32_t                     offset,
+                                 uint32_t                     length,
+                                 uint8_t*                     data,
+                                 DesfreCommunicationMode      commMode,
+                                 const DesfireCacheValidator& validator);
+
+    /**
+     * @brief Write data to a standard or backup file
+     *
+     * Long writes are split into several WriteData commands. Writes to a
+     * backup file take effect with commitTransaction(). Cached contents of
+     * the card are dropped, the validating counter of a cached range does
+     * not necessarily change with the write.
+     *
+     * @param fileNo File number
+     * @param offset Offset within the file
+     * @param length Number of bytes to write (must be greater than 0)
+     * @param data Data to write
+     * @param commMode Communication mode of the file
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus writeData(uint8_t                 fileNo,
+                            uint32_t                offset,
+                            uint32_t                length,
+                            const uint8_t*          data,
+                            DesfreCommunicationMode commMode = DF_COMM_PLAIN);
+
+    /**
+     * @brief Write only the bytes that differ from the previous contents
+     *
+     * Plans the write with DesfireWritePlanner against a shadow copy of the
+     * range, for example the data returned by readDataCached() on this tap,
+     * and issues one WriteData per changed span. Nothing is sent when the
+     * contents are unchanged. On a backup file all spans are committed
+     * together, on a standard file a failure can leave earlier spans
+     * written; update the shadow copy only after success.
+     *
+     * @param fileNo File number
+     * @param offset Offset of the range within the file
+     * @param length Length of the range
+     * @param previous Contents of the range on the card (shadow copy)
+     * @param data New contents of the range
+     * @param commMode Communication mode of the file
+     * @param maxGap Largest unchanged run that is rewritten to join two changes
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus writeDataDelta(uint8_t                 fileNo,
+                                 uint32_t                offset,
+                                 uint32_t                length,
+                                 const uint8_t*          previous,
+                                 const uint8_t*          data,
+                                 DesfreCommunicationMode commMode = DF_COMM_PLAIN,
+                                 uint32_t                maxGap   = DF_WRITE_PLAN_MAX_GAP);
+
+    /**
+     * @brief Create a transaction MAC file in the selected application
+     *
+     * Requires an EV2 session, the TMAC key is sent encrypted. Write access
+     * is always denied for the TMAC file.
+     *
+     * @param fileNo File number
+     * @param commMode Communication mode for reading the file
+     * @param readAccess Key number for read access (DF_AR_*)
+     * @param commitReaderIdAccess Key number for CommitReaderID (DF_AR_*)
+     * @param changeAccess Key number for changing the file settings (DF_AR_*)
+     * @param tmKey AES transaction MAC key (16 bytes)
+     * @param tmKeyVersion Version of the transaction MAC key
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus createTransactionMACFile(uint8_t                 fileNo,
+                                           DesfreCommunicationMode commMode,
+                                           uint8_t                 readAccess,
+                                           uint8_t                 commitReaderIdAccess,
+                                           uint8_t                 changeAccess,
+                                           const uint8_t*          tmKey,
+                                           uint8_t                 tmKeyVersion);
+
+    /**
+     * @brief Read the last transaction MAC from a transaction MAC file
+     *
+     * @param fileNo File number of the transaction MAC file
+     * @param tmac Pointer to a DesfireTransactionMAC struct to store TMC and TMV
+     * @param commMode Communication mode of the file
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus readTransactionMAC(uint8_t                 fileNo,
+                                     DesfireTransactionMAC*  tmac,
+                                     DesfreCommunicationMode commMode = DF_COMM_PLAIN);
+
+    /**
+     * @brief Commit the current transaction
+     *
+     * When tmac is given, the card is asked to return the transaction MAC
+     * counter and value of this transaction in the commit response, which
+     * saves reading the transaction MAC file afterwards. This requires a
+     * transaction MAC file in the selected application.
+     *
+     * @param tmac Pointer to a DesfireTransactionMAC struct to store TMC and
+     *        TMV, nullptr to commit without requesting them
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus commitTransaction(DesfireTransactionMAC* tmac = nullptr);
+
+    /**
+     * @brief Abort the current transaction
+     *
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus abortTransaction();
+
+    /**
+     * @brief Check that the card is close to the reader (EV2 proximity check)
+     *
+     * Requires an EV2 session. Runs PreparePC, the timed ProximityCheck
+     * rounds with a fresh reader challenge and VerifyPC. A relay adds delay
+     * to every round, so the check fails when any round takes longer than
+     * maxRoundTrip. Readers that can enforce a card response timeout in
+     * hardware get maxRoundTrip as limit for the timed rounds, which leaves
+     * the host stack out of the measurement; calibrate maxRoundTrip against
+     * a genuine card on the installed reader.
+     *
+     * @param maxRoundTrip Longest accepted round trip time in microseconds
+     * @param result Structure to store the measured times (optional)
+     * @param rounds Number of timed rounds (1, 2, 4 or 8)
+     * @return DesfireStatus DFST_SUCCESS if the card is close, DFST_PROXIMITY_ERROR
+     *         if a round was too slow, DFST_AUTHENTICATION_ERROR if VerifyPC fails
+     */
+    DesfireStatus proximityCheck(uint32_t               maxRoundTrip,
+                                 DesfireProximityCheck* result = nullptr,
+                                 uint8_t                rounds = DF_PC_RND_SIZE);
+
+    /**
+     * @brief Read the command counter of the card with GetCommandCounter
+     *
+     * The command is sent in plain and is not counted by the card. With an
+     * active EV2 session the returned value must match the local counter, or
+     * be one more after a command whose response was lost; the local counter
+     * then continues from it. Any other value ends the session, so a forged
+     * reply cannot roll the counter back.
+     *
+     * @param counter Pointer to variable that will store the counter
+     * @return DesfireStatus Status code of the operation, DFST_INTEGRITY_ERROR
+     *         if the value does not fit the session
+     */
+    DesfireStatus getCommandCounter(uint16_t* counter);
+
+    /**
+     * @brief Set the command counter of the card with SetCommandCounter
+     *
+     * Requires an EV2 session. The command is MACed with the current counter,
+     * both sides continue from the new value.
+     *
+     * @param counter New command counter
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus setCommandCounter(uint16_t counter);
+
+    /**
+     * @brief Get the local command counter of the EV2 session
+     *
+     * Nothing is sent to the card; compare with getCommandCounter() to
+     * check that both sides agree.
+     *
+     * @return uint16_t Command counter, 0 without an EV2 session
+     */
+    uint16_t getSessionCounter() const;
+
+    /**
+     * @brief Get the counts and times of the exchanges with the reader
+     *
+     * Every frame is timed by the reader clock, so a reader on a
+     * DesfireVirtualClock reports simulated times.
+     *
+     * @return const DesfireExchangeStats& Statistics since the last reset
+     */
+    const DesfireExchangeStats& getExchangeStats() const;
+
+    /**
+     * @brief Clear the exchange statistics
+     */
+    void resetExchangeStats();
+
 private:
     /** Reference to the NFC reader implementation */
     NFCReaderInterface& _reader;
@@ -104,12 +613,54 @@ private:
     /** Flag indicating if a card has been detected */
     bool _cardDetected;
 
+    /** Flag indicating that the detected UID is a random ID */
+    bool _randomUID;
+
+    /** Real UID resolved with GetCardUID for the current activation */
+    uint8_t _realUID[10];
+
+    /** Length of the real UID, 0 if not resolved */
+    uint8_t _realUIDLength;
+
     /** Current session key after authentication */
     uint8_t _sessionKey[24];
 
     /** Flag indicating if authentication was successful */
     bool _authenticated;
 
+    /** EV2 secure messaging session (active after authenticateEV2First) */
+    DesfireSecureMessaging _secureMessaging;
+
+    /** Flag indicating that the card may have counted a command the reader did not see complete */
+    bool _counterResync;
+
+    /** Pool of pre-generated authentication challenges */
+    DesfireNoncePool _noncePool;
+
+    /** Command profile of the card */
+    DesfireCardProfile _profile;
+
+    /** Frame size accepted by the cards (FSC) */
+    uint16_t _cardFrameSize;
+
+    /** Options in use for the detected card */
+    DesfireCardStrategy _strategy;
+
+    /** Strategies of known cards */
+    DesfireStrategyCache _strategyCache;
+
+    /** Currently selected application ID */
+    uint8_t _selectedAID[3];
+
+    /** File contents cached across taps */
+    DesfireFileCache _fileCache;
+
+    /** Originality verifier and verified-UID cache */
+    DesfireOriginality _originality;
+
+    /** Challenge (RndA) of the current authentication */
+    uint8_t _rndA[DF_NONCE_MAX_LENGTH];
+
     /** Current cryptographic mode (DES, 3DES, AES) */
     DesfreCryptoMode _cryptoMode;
 
@@ -119,21 +670,196 @@ private:
     /** Buffer for card responses */
     uint8_t _responseBuffer[ISO7816Constants::ISO_MAX_APDU_SIZE];
 
+    /** Exchange counts and times */
+    DesfireExchangeStats _exchangeStats;
+
     /**
      * @brief Transmit a DESFire command using ISO7816-4 APDU wrapping
      *
+     * Cards whose strategy selects native framing get a native frame instead.
+     *
      * @param command DESFire command code
      * @param data Pointer to command data
      * @param dataLen Length of command data
      * @param response Buffer to store the response
      * @param responseLen Reference to variable that will hold response length
+     * @param roundTrip Pointer to variable that will store the round trip time
+     *        in microseconds (optional)
      * @return DesfireStatus Status code of the operation
      */
     DesfireStatus transmit(DesfireCommand command,
                            const uint8_t* data,
                            uint8_t        dataLen,
                            uint8_t*       response,
-                           uint16_t&      responseLen);
+                           uint16_t&      responseLen,
+                           uint32_t*      roundTrip = nullptr);
+
+    /**
+     * @brief Transmit an interindustry ISO7816-4 command (CLA 00)
+     *
+     * @param ins Instruction byte
+     * @param p1 Parameter 1
+     * @param p2 Parameter 2
+     * @param data Command data
+     * @param dataLen Length of command data
+     * @param le Expected response length (0 for none)
+     * @param response Buffer to store the response
+     * @param responseLen Reference to variable that will hold response length
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus transmitISO(ISO7816Instruction ins,
+                              uint8_t            p1,
+                              uint8_t            p2,
+                              const uint8_t*     data,
+                              uint8_t            dataLen,
+                              uint8_t            le,
+                              uint8_t*           response,
+                              uint16_t&          responseLen);
+
+    /**
+     * @brief Send a native frame and split the response into status and data
+     *
+     * @param frame Command code followed by the command data
+     * @param frameLen Length of the frame
+     * @param response Buffer to store the response data
+     * @param responseLen Reference to variable that will hold response length
+     * @param roundTrip Pointer to variable that will store the round trip time (optional)
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus transceiveNative(const uint8_t* frame,
+                                   uint16_t       frameLen,
+                                   uint8_t*       response,
+                                   uint16_t&      responseLen,
+                                   uint32_t*      roundTrip = nullptr);
+
+    /**
+     * @brief Send an APDU and split the response into data and status
+     *
+     * @param apdu Complete APDU
+     * @param apduLen Length of the APDU
+     * @param response Buffer to store the response data
+     * @param responseLen Reference to variable that will hold response length
+     * @param roundTrip Pointer to variable that will store the round trip time (optional)
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus transceiveAPDU(const uint8_t* apdu,
+                                 uint16_t       apduLen,
+                                 uint8_t*       response,
+                                 uint16_t&      responseLen,
+                                 uint32_t*      roundTrip = nullptr);
+
+    /**
+     * @brief Exchange a complete command, following command and response chaining
+     *
+     * Command data longer than one frame is sent in DF_CMD_GET_ADDITIONAL_FRAME
+     * frames, response frames are requested until the card signals completion
+     * and concatenated.
+     *
+     * @param command DESFire command code
+     * @param data Pointer to command data
+     * @param dataLen Length of command data
+     * @param response Buffer to store the complete response
+     * @param responseLen Reference to variable that will hold response length
+     * @param responseSize Size of the response buffer
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus exchange(uint8_t        command,
+                           const uint8_t* data,
+                           uint16_t       dataLen,
+                           uint8_t*       response,
+                           uint16_t&      responseLen,
+                           uint16_t       responseSize);
+
+    /**
+     * @brief Exchange a command with EV2 secure messaging applied
+     *
+     * Without an EV2 session the command is exchanged in plain. A failed
+     * command or a response that does not verify ends the session.
+     *
+     * @param command DESFire command code
+     * @param header Command header (never encrypted)
+     * @param headerLen Length of the command header
+     * @param data Command data (encrypted in DF_COMM_ENCRYPT)
+     * @param dataLen Length of command data
+     * @param commMode Communication mode
+     * @param response Buffer to store the plain response
+     * @param responseLen Reference to variable that will hold response length
+     * @param responseSize Size of the response buffer
+     * @return DesfireStatus Status code of the operation
+     */
+    DesfireStatus transmitSecure(uint8_t                 command,
+                                 const uint8_t*          header,
+                                 uint8_t                 headerLen,
+                                 const uint8_t*          data,
+                                 uint16_t                dataLen,
+                                 DesfreCommunicationMode commMode,
+                                 uint8_t*                response,
+                                 uint16_t&               responseLen,
+                                 uint16_t                responseSize);
+
+    /**
+     * @brief End the current authentication and secure messaging session
+     */
+    void resetAuthentication();
+
+    /**
+     * @brief Switch to the options of a strategy
+     *
+     * @param strategy Strategy to apply
+     * @param activation True right after activation, when the bit rate may change
+     */
+    void applyStrategy(const DesfireCardStrategy& strategy, bool activation);
+
+    /**
+     * @brief Send a frame to the reader and count it in the exchange statistics
+     *
+     * @param txData Frame to transmit
+     * @param txLength Length of the frame
+     * @param rxData Buffer to store the response
+     * @param rxLength Size of rxData in, length of the response out
+     * @param roundTrip Pointer to variable that will store the round trip time (optional)
+     * @return true if a response was received
+     * @return false if the exchange failed
+     */
+    bool transceiveCounted(const uint8_t* txData,
+                           uint16_t       txLength,
+                           uint8_t*       rxData,
+                           uint16_t*      rxLength,
+                           uint32_t*      roundTrip);
+
+    /**
+     * @brief Get the command data sent per frame
+     *
+     * @return uint8_t Number of command data bytes that fit one frame
+     */
+    uint8_t getFrameDataSize();
+
+    /**
+     * @brief Get the ReadData length of one command
+     *
+     * @param commMode Communication mode of the file
+     * @param command Pointer to variable that will store the read command code
+     * @return uint32_t Number of file bytes read per command
+     */
+    uint32_t getReadChunkSize(DesfreCommunicationMode commMode, uint8_t* command);
+
+    /**
+     * @brief Get the WriteData length of one command
+     *
+     * @param commMode Communication mode of the file
+     * @param command Pointer to variable that will store the write command code
+     * @return uint32_t Number of file bytes written per command
+     */
+    uint32_t getWriteChunkSize(DesfreCommunicationMode commMode, uint8_t* command);
+
+    /**
+     * @brief Get the UID that identifies the card in per-card caches
+     *
+     * @param uidLength Pointer to variable that will store the UID length
+     * @return const uint8_t* Anticollision UID, or the real UID for random-ID
+     *         cards, nullptr if a random-ID card has not been resolved yet
+     */
+    const uint8_t* getIdentityUID(uint8_t* uidLength) const;
 
     /**
      * @brief Build an ISO7816-4 APDU
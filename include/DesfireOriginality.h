@@ -0,0 +1,99 @@
+/**
+ * @file DesfireOriginality.h
+ * @brief NXP originality signature check
+ *
+ * Genuine DESFire EV2/EV3/Light cards carry an ECDSA secp224r1 signature over
+ * their UID, created with an NXP private key and returned by Read_Sig. This
+ * file provides the NXP public keys and a cache of UIDs that already passed
+ * the check.
+ */
+
+#ifndef DESFIRE_ORIGINALITY_H
+#define DESFIRE_ORIGINALITY_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#endif
+#include "DesfireECC.h"
+#include "DesfireTypes.h"
+
+/**
+ * @brief Originality check constants
+ */
+enum DesfireOriginalityConstants : uint8_t {
+    DF_ORIGINALITY_UID_LENGTH = 7,  ///< Length of the signed UID
+    DF_ORIGINALITY_CACHE_SIZE = 16  ///< Number of verified UIDs remembered
+};
+
+/**
+ * @brief Verifier for NXP originality signatures with a verified-UID cache
+ */
+class DesfireOriginality {
+public:
+    /**
+     * @brief Construct a verifier with an empty cache
+     */
+    DesfireOriginality();
+
+    /**
+     * @brief Get the NXP public key for a card type
+     *
+     * @param version Version information of the card
+     * @return const uint8_t* Public key (57 bytes), nullptr if the card type has no known key
+     */
+    static const uint8_t* getPublicKey(const DESFireCardVersion& version);
+
+    /**
+     * @brief Check whether a UID already passed the originality check
+     *
+     * @param uid Card UID (7 bytes)
+     * @return true if the UID is in the verified cache
+     * @return false otherwise
+     */
+    bool isVerified(const uint8_t* uid) const;
+
+    /**
+     * @brief Verify a Read_Sig signature and remember the UID on success
+     *
+     * @param version Version information of the card (provides type and UID)
+     * @param signature Signature returned by Read_Sig (56 bytes)
+     * @return true if the signature is genuine
+     * @return false if the signature is invalid or the card type is unknown
+     */
+    bool verify(const DESFireCardVersion& version, const uint8_t* signature);
+
+    /**
+     * @brief Build the next missing comb table for the NXP public keys
+     *
+     * Meant to be called repeatedly while idle; each call builds at most one
+     * table so that no single call stalls the main loop for long.
+     *
+     * @return true if more tables remain to be built
+     * @return false if all tables are ready
+     */
+    bool precomputeNext();
+
+    /**
+     * @brief Forget all verified UIDs
+     */
+    void clear();
+
+private:
+    /** UIDs that passed the check, used as a ring buffer */
+    uint8_t _verified[DF_ORIGINALITY_CACHE_SIZE][DF_ORIGINALITY_UID_LENGTH];
+
+    /** Number of valid cache entries */
+    uint8_t _count;
+
+    /** Next cache entry to overwrite */
+    uint8_t _next;
+
+    /** Number of public key tables built by precomputeNext() */
+    uint8_t _precomputed;
+};
+
+#endif  // DESFIRE_ORIGINALITY_H
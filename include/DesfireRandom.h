@@ -0,0 +1,123 @@
+/**
+ * @file DesfireRandom.h
+ * @brief Random number source and authentication challenge pool
+ *
+ * This file provides access to the platform random number generator and a
+ * pool of pre-generated random bytes from which authentication challenges
+ * (RndA) are taken.
+ */
+
+#ifndef DESFIRE_RANDOM_H
+#define DESFIRE_RANDOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Random pool constants
+ */
+enum DesfireRandomConstants : uint16_t {
+    DF_NONCE_POOL_SIZE  = 128,  ///< Number of pre-generated bytes held by the pool
+    DF_NONCE_MAX_LENGTH = 16    ///< Largest challenge handed out (3K3DES/AES RndA)
+};
+
+/**
+ * @brief Replacement random source
+ *
+ * @param buffer Buffer to fill
+ * @param length Number of bytes to generate
+ * @return true if the buffer was filled
+ * @return false if the source is unavailable
+ */
+typedef bool (*DesfireRandomSource)(uint8_t* buffer, size_t length);
+
+/**
+ * @brief Access to the platform random number generator
+ *
+ * On ESP32 targets the hardware RNG is used. Note that the ESP32 RNG only
+ * produces true random numbers while the RF subsystem (WiFi/BT) is running or
+ * after bootloader_random_enable() has been called. Native builds read from
+ * /dev/urandom.
+ */
+class DesfireRandom {
+public:
+    /**
+     * @brief Fill a buffer with random bytes
+     *
+     * @param buffer Buffer to fill
+     * @param length Number of bytes to generate
+     * @return true if the buffer was filled
+     * @return false if the random source is unavailable
+     */
+    static bool fill(uint8_t* buffer, size_t length);
+
+    /**
+     * @brief Replace the platform random number generator
+     *
+     * Meant for boards with an external RNG and for tests; call it while no
+     * other thread draws random bytes.
+     *
+     * @param source Replacement source, nullptr for the platform generator
+     */
+    static void setSource(DesfireRandomSource source);
+};
+
+/**
+ * @brief Pool of pre-generated random bytes for authentication challenges
+ *
+ * The pool is topped up while the reader is idle so that taking a challenge
+ * during authentication is a plain memory copy. If the pool runs dry the
+ * challenge is generated directly from the random source instead.
+ */
+class DesfireNoncePool {
+public:
+    /**
+     * @brief Construct an empty pool
+     */
+    DesfireNoncePool();
+
+    /**
+     * @brief Destroy the pool, wiping any unused random bytes
+     */
+    ~DesfireNoncePool();
+
+    /**
+     * @brief Top up the pool from the random source
+     *
+     * @return uint16_t Number of bytes added to the pool
+     */
+    uint16_t refill();
+
+    /**
+     * @brief Take a challenge from the pool
+     *
+     * Bytes handed out are wiped from the pool and never reused.
+     *
+     * @param nonce Buffer to store the challenge
+     * @param length Length of the challenge (at most DF_NONCE_MAX_LENGTH)
+     * @return true if the challenge was generated
+     * @return false if the length is invalid or no random bytes are available
+     */
+    bool take(uint8_t* nonce, uint8_t length);
+
+    /**
+     * @brief Get the number of pre-generated bytes available
+     *
+     * @return uint16_t Number of bytes in the pool
+     */
+    uint16_t available() const {
+        return _count;
+    }
+
+private:
+    /** Ring buffer of pre-generated random bytes */
+    uint8_t _pool[DF_NONCE_POOL_SIZE];
+
+    /** Index of the next byte to hand out */
+    uint16_t _head;
+
+    /** Number of bytes currently available */
+    uint16_t _count;
+};
+
+#endif  // DESFIRE_RANDOM_H
@@ -0,0 +1,86 @@
+/**
+ * @file DesfireReadPlan.h
+ * @brief Coalescing of file range reads into few ReadData commands
+ *
+ * Every ReadData costs a full command round trip over RF, while a few more
+ * bytes in a response cost little. The planner merges overlapping, adjacent
+ * and nearly adjacent ranges of the same file into spans of at most one
+ * ReadData command each, so that application code can ask for individual
+ * fields without paying one exchange per field.
+ */
+
+#ifndef DESFIRE_READ_PLAN_H
+#define DESFIRE_READ_PLAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "DesfireTypes.h"
+
+/**
+ * @brief Read planner constants
+ */
+enum DesfireReadPlanConstants : uint8_t {
+    DF_READ_PLAN_MAX_REQUESTS = 32,  ///< Maximum number of ranges per plan
+    DF_READ_PLAN_MAX_GAP      = 16   ///< Default gap read through to join two ranges
+};
+
+/**
+ * @brief One file range requested by the application
+ */
+struct DesfireReadRequest {
+    uint8_t                 fileNo;    ///< File number
+    uint32_t                offset;    ///< Offset within the file
+    uint32_t                length;    ///< Number of bytes to read (must be greater than 0)
+    uint8_t*                data;      ///< Buffer to store the data (at least length bytes)
+    DesfreCommunicationMode commMode;  ///< Communication mode of the file
+};
+
+/**
+ * @brief File range read with one command
+ */
+struct DesfireReadSpan {
+    uint8_t                 fileNo;    ///< File number
+    uint32_t                offset;    ///< Offset within the file
+    uint32_t                length;    ///< Number of bytes to read
+    DesfreCommunicationMode commMode;  ///< Communication mode of the file
+};
+
+/**
+ * @brief Planner merging file range reads
+ */
+class DesfireReadPlanner {
+public:
+    /**
+     * @brief Merge requested ranges into spans
+     *
+     * Ranges of the same file and communication mode are joined when they
+     * overlap or are at most maxGap bytes apart and the joined span stays
+     * within maxSpan bytes. A range longer than maxSpan gets a span of its
+     * own, which also serves every range it contains. Spans are ordered by
+     * file and offset.
+     *
+     * @param requests Requested ranges
+     * @param count Number of requests (at most DF_READ_PLAN_MAX_REQUESTS)
+     * @param maxSpan Largest span read with one command
+     * @param maxGap Largest gap between two ranges that is read through
+     * @param spans Array of at least count spans to store the plan
+     * @return uint8_t Number of spans, 0 if the requests are not valid
+     */
+    static uint8_t plan(const DesfireReadRequest* requests,
+                        uint8_t                   count,
+                        uint32_t                  maxSpan,
+                        uint32_t                  maxGap,
+                        DesfireReadSpan*          spans);
+
+    /**
+     * @brief Check whether a span covers a requested range
+     *
+     * @param span Planned span
+     * @param request Requested range
+     * @return true if the range lies within the span
+     * @return false otherwise
+     */
+    static bool covers(const DesfireReadSpan& span, const DesfireReadRequest& request);
+};
+
+#endif  // DESFIRE_READ_PLAN_H
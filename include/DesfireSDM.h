@@ -0,0 +1,166 @@
+/**
+ * @file DesfireSDM.h
+ * @brief Secure Dynamic Messaging (SUN) verification
+ *
+ * Cards with SDM enabled mirror encrypted PICC data (UID and read counter)
+ * and a MAC into the NDEF message on every read. Verifying this mirror
+ * proves the card is genuine from a single unauthenticated read. Only the
+ * SDM keys are needed, so the verifier runs on the reader as well as in the
+ * native build for backend verification.
+ */
+
+#ifndef DESFIRE_SDM_H
+#define DESFIRE_SDM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "DesfireCrypto.h"
+
+/**
+ * @brief SDM constants
+ */
+enum DesfireSDMConstants : uint8_t {
+    DF_SDM_PICC_DATA_SIZE = 16,    ///< Length of the encrypted PICC data
+    DF_SDM_UID_SIZE       = 7,     ///< Length of the mirrored UID
+    DF_SDM_COUNTER_SIZE   = 3,     ///< Length of the mirrored read counter
+    DF_SDM_TAG_UID        = 0x80,  ///< PICCDataTag: UID mirrored
+    DF_SDM_TAG_COUNTER    = 0x40,  ///< PICCDataTag: read counter mirrored
+    DF_SDM_TAG_UID_LENGTH = 0x0F   ///< PICCDataTag: mask of the UID length
+};
+
+/**
+ * @brief Card data recovered from a SUN message
+ */
+struct DesfireSUN {
+    uint8_t  uid[DF_SDM_UID_SIZE];  ///< Card UID
+    uint8_t  uidLength;             ///< Length of the UID, 0 if not mirrored
+    uint32_t counter;               ///< SDM read counter
+    bool     hasCounter;            ///< Flag indicating that the counter is mirrored
+};
+
+/**
+ * @brief Verifier for SDM mirrors of one key set
+ *
+ * The meta read key decrypts the PICC data, the file read key is the base of
+ * the per-read session keys. Both expanded keys are kept so that verifying
+ * many messages skips the key schedule.
+ */
+class DesfireSDM {
+public:
+    /**
+     * @brief Construct a verifier without keys
+     */
+    DesfireSDM();
+
+    /**
+     * @brief Construct a verifier and set its keys
+     *
+     * @param metaReadKey SDM meta read key (16 bytes)
+     * @param fileReadKey SDM file read key (16 bytes)
+     */
+    DesfireSDM(const uint8_t* metaReadKey, const uint8_t* fileReadKey);
+
+    /**
+     * @brief Set the SDM keys
+     *
+     * @param metaReadKey SDM meta read key (16 bytes)
+     * @param fileReadKey SDM file read key (16 bytes)
+     */
+    void setKeys(const uint8_t* metaReadKey, const uint8_t* fileReadKey);
+
+    /**
+     * @brief Decrypt the mirrored PICC data
+     *
+     * @param encrypted Encrypted PICC data (16 bytes)
+     * @param sun Structure to store the UID and read counter
+     * @return true if the PICC data tag is valid
+     * @return false otherwise
+     */
+    bool decryptPICCData(const uint8_t* encrypted, DesfireSUN* sun) const;
+
+    /**
+     * @brief Check the SDM MAC of a read
+     *
+     * @param sun UID and read counter of the read
+     * @param macInput Mirrored data from SDMMACInputOffset up to the MAC (may be empty)
+     * @param macInputLength Length of the MAC input
+     * @param mac Mirrored MAC (8 bytes)
+     * @return true if the MAC is valid
+     * @return false otherwise
+     */
+    bool verifyMAC(const DesfireSUN& sun,
+                   const uint8_t*    macInput,
+                   size_t            macInputLength,
+                   const uint8_t*    mac) const;
+
+    /**
+     * @brief Derive the MAC session key of a read
+     *
+     * Lets batch verifiers compute the SDM MACs of many reads together.
+     *
+     * @param sun UID and read counter of the read
+     * @param sessionKey Cipher to set KSesSDMFileReadMAC on
+     */
+    void deriveMACKey(const DesfireSUN& sun, DesfireAES* sessionKey) const;
+
+    /**
+     * @brief Decrypt mirrored encrypted file data
+     *
+     * @param sun UID and read counter of the read
+     * @param encrypted Encrypted file data (multiple of 16 bytes)
+     * @param plain Buffer to store the plain file data (may equal encrypted)
+     * @param length Length of the data
+     * @return true if the data was decrypted
+     * @return false if the length is not a multiple of the block size
+     */
+    bool decryptFileData(const DesfireSUN& sun,
+                         const uint8_t*    encrypted,
+                         uint8_t*          plain,
+                         size_t            length) const;
+
+    /**
+     * @brief Decrypt the PICC data and check the MAC in one step
+     *
+     * @param encryptedPICCData Encrypted PICC data (16 bytes)
+     * @param macInput Mirrored data from SDMMACInputOffset up to the MAC (may be empty)
+     * @param macInputLength Length of the MAC input
+     * @param mac Mirrored MAC (8 bytes)
+     * @param sun Structure to store the UID and read counter
+     * @return true if the message is authentic
+     * @return false otherwise
+     */
+    bool verify(const uint8_t* encryptedPICCData,
+                const uint8_t* macInput,
+                size_t         macInputLength,
+                const uint8_t* mac,
+                DesfireSUN*    sun) const;
+
+    /**
+     * @brief Convert a hex string of the NDEF mirror to bytes
+     *
+     * @param text Hex characters (upper or lower case)
+     * @param textLength Number of characters (even)
+     * @param data Buffer to store the bytes
+     * @param dataSize Size of the buffer
+     * @return size_t Number of bytes stored, 0 if the text is not valid hex or too long
+     */
+    static size_t parseHex(const char* text, size_t textLength, uint8_t* data, size_t dataSize);
+
+private:
+    /** Cipher with the SDM meta read key */
+    DesfireAES _metaReadKey;
+
+    /** Cipher with the SDM file read key */
+    DesfireAES _fileReadKey;
+
+    /**
+     * @brief Derive a session key from the file read key
+     *
+     * @param label Session vector label (0xC33C for encryption, 0x3CC3 for MAC)
+     * @param sun UID and read counter of the read
+     * @param sessionKey Cipher to set the session key on
+     */
+    void deriveSessionKey(uint16_t label, const DesfireSUN& sun, DesfireAES* sessionKey) const;
+};
+
+#endif  // DESFIRE_SDM_H
@@ -0,0 +1,234 @@
+/**
+ * @file DesfireSecureMessaging.h
+ * @brief EV2 secure messaging
+ *
+ * After AuthenticateEV2First the card and reader share two AES session keys,
+ * a transaction identifier (TI) and a command counter (CmdCtr). This file
+ * implements the protection of commands and responses in the MAC and full
+ * (encrypted) communication modes as defined for DESFire EV2.
+ */
+
+#ifndef DESFIRE_SECURE_MESSAGING_H
+#define DESFIRE_SECURE_MESSAGING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "DesfireCrypto.h"
+#include "DesfireTypes.h"
+
+/**
+ * @brief EV2 secure messaging session
+ */
+class DesfireSecureMessaging {
+public:
+    /**
+     * @brief Construct an inactive session
+     */
+    DesfireSecureMessaging();
+
+    /**
+     * @brief Start a session after a successful AuthenticateEV2First
+     *
+     * Derives the session encryption and MAC keys from the authentication key
+     * and both challenges, and resets the command counter to zero.
+     *
+     * @param key Authentication key (16 bytes)
+     * @param rndA Reader challenge (16 bytes)
+     * @param rndB Card challenge (16 bytes)
+     * @param ti Transaction identifier returned by the card (4 bytes)
+     */
+    void begin(const uint8_t* key, const uint8_t* rndA, const uint8_t* rndB, const uint8_t* ti);
+
+    /**
+     * @brief Continue the session after a successful AuthenticateEV2NonFirst
+     *
+     * Derives new session keys, the transaction identifier and the command
+     * counter are kept.
+     *
+     * @param key Authentication key (16 bytes)
+     * @param rndA Reader challenge (16 bytes)
+     * @param rndB Card challenge (16 bytes)
+     */
+    void renew(const uint8_t* key, const uint8_t* rndA, const uint8_t* rndB);
+
+    /**
+     * @brief End the session and wipe the session keys
+     */
+    void reset();
+
+    /**
+     * @brief Check whether a session is active
+     *
+     * @return true if a session is active
+     * @return false otherwise
+     */
+    bool isActive() const;
+
+    /**
+     * @brief Get the current command counter
+     *
+     * @return uint16_t Command counter
+     */
+    uint16_t getCommandCounter() const;
+
+    /**
+     * @brief Set the command counter
+     *
+     * Used to follow the card after commands whose response could not be
+     * verified, and after SetCommandCounter.
+     *
+     * @param counter New command counter
+     */
+    void setCommandCounter(uint16_t counter);
+
+    /**
+     * @brief Check whether the command counter has reached its limit
+     *
+     * The card refuses further commands in the session once the counter
+     * reaches 0xFFFF, a new authentication is required.
+     *
+     * @return true if no further command can be protected
+     * @return false otherwise
+     */
+    bool isCommandCounterExhausted() const;
+
+    /**
+     * @brief Get the transaction identifier of the session
+     *
+     * @return const uint8_t* Transaction identifier (4 bytes)
+     */
+    const uint8_t* getTransactionIdentifier() const;
+
+    /**
+     * @brief Compute a truncated MAC with the session MAC key
+     *
+     * Used by commands that define their own MAC input without command
+     * counter and transaction identifier (VerifyPC).
+     *
+     * @param data MAC input
+     * @param length Length of the MAC input
+     * @param mac Buffer to store the MAC (8 bytes)
+     * @return true if the MAC was computed
+     * @return false if no session is active
+     */
+    bool computeMAC(const uint8_t* data, size_t length, uint8_t* mac) const;
+
+    /**
+     * @brief Protect a command
+     *
+     * Produces header || data for DF_COMM_PLAIN, header || data || MACt for
+     * DF_COMM_MAC and header || E(data) || MACt for DF_COMM_ENCRYPT.
+     *
+     * @param command Command code
+     * @param header Command header (sent in plain in every mode)
+     * @param headerLength Length of the command header
+     * @param data Command data
+     * @param dataLength Length of the command data
+     * @param mode Communication mode
+     * @param output Buffer to store the protected command
+     * @param outputSize Size of the output buffer
+     * @return uint16_t Length of the protected command, 0 if the buffer is too small
+     */
+    uint16_t wrapCommand(uint8_t                 command,
+                         const uint8_t*          header,
+                         uint8_t                 headerLength,
+                         const uint8_t*          data,
+                         uint16_t                dataLength,
+                         DesfreCommunicationMode mode,
+                         uint8_t*                output,
+                         uint16_t                outputSize) const;
+
+    /**
+     * @brief Verify and decrypt a response in place
+     *
+     * Advances the command counter when the response is accepted.
+     *
+     * @param returnCode Return code of the response (0x00 for success)
+     * @param data Response data, replaced by the plain response data
+     * @param dataLength Length of the response data, updated
+     * @param mode Communication mode
+     * @return true if the response is authentic
+     * @return false if the MAC or padding does not verify
+     */
+    bool unwrapResponse(uint8_t                 returnCode,
+                        uint8_t*                data,
+                        uint16_t*               dataLength,
+                        DesfreCommunicationMode mode);
+
+    /**
+     * @brief Verify and decrypt a protected command in place (card side)
+     *
+     * Counterpart of wrapCommand() for card emulation. The header stays in
+     * front of the plain command data; the counter is not changed.
+     *
+     * @param command Command code
+     * @param data Protected command (header || data || MACt), replaced by header || data
+     * @param dataLength Length of the protected command, updated
+     * @param headerLength Length of the command header
+     * @param mode Communication mode
+     * @return true if the command is authentic
+     * @return false if the MAC or padding does not verify
+     */
+    bool unwrapCommand(uint8_t                 command,
+                       uint8_t*                data,
+                       uint16_t*               dataLength,
+                       uint8_t                 headerLength,
+                       DesfreCommunicationMode mode) const;
+
+    /**
+     * @brief Protect a response (card side)
+     *
+     * Counterpart of unwrapResponse() for card emulation: produces data,
+     * data || MACt or E(data) || MACt and advances the command counter.
+     *
+     * @param returnCode Return code of the response (0x00 for success)
+     * @param data Response data
+     * @param dataLength Length of the response data
+     * @param mode Communication mode
+     * @param output Buffer to store the protected response
+     * @param outputSize Size of the output buffer
+     * @return uint16_t Length of the protected response, 0 if the buffer is too small
+     */
+    uint16_t wrapResponse(uint8_t                 returnCode,
+                          const uint8_t*          data,
+                          uint16_t                dataLength,
+                          DesfreCommunicationMode mode,
+                          uint8_t*                output,
+                          uint16_t                outputSize);
+
+private:
+    /** Session encryption key (KSesAuthENC) */
+    DesfireAES _encKey;
+
+    /** Session MAC key (KSesAuthMAC) */
+    DesfireAES _macKey;
+
+    /** Transaction identifier */
+    uint8_t _ti[DF_EV2_TI_LENGTH];
+
+    /** Command counter */
+    uint16_t _cmdCtr;
+
+    /** Flag indicating an active session */
+    bool _active;
+
+    /**
+     * @brief Derive the session encryption and MAC keys
+     *
+     * @param key Authentication key (16 bytes)
+     * @param rndA Reader challenge (16 bytes)
+     * @param rndB Card challenge (16 bytes)
+     */
+    void deriveKeys(const uint8_t* key, const uint8_t* rndA, const uint8_t* rndB);
+
+    /**
+     * @brief Compute the IV for command or response encryption
+     *
+     * @param label Label (0xA55A for commands, 0x5AA5 for responses)
+     * @param counter Command counter to use
+     * @param iv Buffer to store the IV (16 bytes)
+     */
+    void computeIV(uint16_t label, uint16_t counter, uint8_t* iv) const;
+};
+
+#endif  // DESFIRE_SECURE_MESSAGING_H
@@ -47,6 +47,8 @@ enum class DesfireStatus : uint16_t {
     DFST_CRYPTO_ERROR        = 0xFC,  ///< Error in cryptographic operation
     DFST_BUFFER_OVERFLOW     = 0xFB,  ///< Buffer overflow
     DFST_BUFFER_TOO_SMALL    = 0xFA,  ///< Buffer provided is too small
+    DFST_ORIGINALITY_ERROR   = 0xF9,  ///< Originality signature is not genuine
+    DFST_PROXIMITY_ERROR     = 0xF8,  ///< Card answered too slowly in the proximity check
 
     // ISO7816 status codes
     DFST_ISO_COMMAND_COMPLETED       = 0x9000,  ///< Command completed
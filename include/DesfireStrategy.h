@@ -0,0 +1,145 @@
+/**
+ * @file DesfireStrategy.h
+ * @brief Per card generation selection of the fastest supported options
+ *
+ * DESFire generations differ in the authentication they offer, in whether
+ * native frames are accepted and in their frame size. The strategy for a
+ * card is derived once from GetVersion and cached per UID, so a returning
+ * card is handled with its best options from the first command on.
+ */
+
+#ifndef DESFIRE_STRATEGY_H
+#define DESFIRE_STRATEGY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "DesfireTypes.h"
+
+/**
+ * @brief Strategy constants
+ */
+enum DesfireStrategyConstants : uint16_t {
+    DF_STRATEGY_CACHE_ENTRIES = 16,   ///< Number of cached card strategies
+    DF_STRATEGY_UID_SIZE      = 10,   ///< Maximum UID length
+    DF_STRATEGY_FRAME_SIZE    = 64,   ///< Frame size of the factory ATS (FSCI 5)
+    DF_STRATEGY_BITRATE_BASE  = 106,  ///< Bit rate every card supports (kbit/s)
+    DF_STRATEGY_BITRATE_MAX   = 848   ///< Highest ISO14443-4 bit rate of DESFire cards (kbit/s)
+};
+
+/**
+ * @brief Authentication method used for AES keys
+ */
+enum DesfireAuthMethod : uint8_t {
+    DF_AUTH_METHOD_LEGACY = 0x00,  ///< Native Authenticate (0Ah), no AES keys
+    DF_AUTH_METHOD_AES    = 0x01,  ///< EV1 AuthenticateAES (AAh)
+    DF_AUTH_METHOD_EV2    = 0x02   ///< AuthenticateEV2First, NonFirst within a session
+};
+
+/**
+ * @brief Options selected for a card
+ */
+struct DesfireCardStrategy {
+    DesfireCardGeneration generation;     ///< Card generation
+    DesfireAuthMethod     authMethod;     ///< Fastest authentication for AES keys
+    bool                  nativeFraming;  ///< Send native frames instead of ISO wrapped APDUs
+    uint16_t              frameSize;      ///< Frame size accepted by the card (FSC)
+    uint16_t              bitRate;        ///< Highest bit rate of the card (kbit/s)
+};
+
+/**
+ * @brief Strategy selection and per-UID strategy cache
+ */
+class DesfireStrategyCache {
+public:
+    /**
+     * @brief Construct an empty cache
+     */
+    DesfireStrategyCache();
+
+    /**
+     * @brief Select the strategy for a card generation
+     *
+     * @param version Version information returned by GetVersion
+     * @return DesfireCardStrategy Fastest options supported by the card
+     */
+    static DesfireCardStrategy select(const DESFireCardVersion& version);
+
+    /**
+     * @brief Get the strategy used for cards of unknown generation
+     *
+     * ISO framing, native authentication, the factory frame size and the
+     * base bit rate work with every DESFire card.
+     *
+     * @return DesfireCardStrategy Strategy for unknown cards
+     */
+    static DesfireCardStrategy getDefault();
+
+    /**
+     * @brief Get the frame size announced by an ATS
+     *
+     * @param fsci FSCI, the lower nibble of the ATS format byte T0
+     * @return uint16_t Frame size (FSC) in bytes, RFU values map to 256
+     */
+    static uint16_t getFrameSize(uint8_t fsci);
+
+    /**
+     * @brief Look up the strategy of a card
+     *
+     * @param uid Card UID
+     * @param uidLength Length of the UID
+     * @param strategy Structure to store the cached strategy
+     * @return true if the card is cached
+     * @return false otherwise
+     */
+    bool lookup(const uint8_t* uid, uint8_t uidLength, DesfireCardStrategy* strategy);
+
+    /**
+     * @brief Store the strategy of a card, replacing the least recently used entry
+     *
+     * @param uid Card UID
+     * @param uidLength Length of the UID
+     * @param strategy Strategy of the card
+     * @return true if the strategy was stored
+     * @return false if the UID is not valid
+     */
+    bool store(const uint8_t* uid, uint8_t uidLength, const DesfireCardStrategy& strategy);
+
+    /**
+     * @brief Drop the strategy of a card
+     *
+     * @param uid Card UID
+     * @param uidLength Length of the UID
+     */
+    void invalidate(const uint8_t* uid, uint8_t uidLength);
+
+    /**
+     * @brief Drop all entries
+     */
+    void clear();
+
+private:
+    /**
+     * @brief Cached strategy
+     */
+    struct Entry {
+        uint8_t             uid[DF_STRATEGY_UID_SIZE];  ///< Card UID
+        uint8_t             uidLength;                  ///< Length of the UID, 0 if unused
+        uint32_t            lastUse;                    ///< Use stamp for LRU replacement
+        DesfireCardStrategy strategy;                   ///< Strategy of the card
+    };
+
+    /** Cache entries */
+    Entry _entries[DF_STRATEGY_CACHE_ENTRIES];
+
+    /** Use stamp source */
+    uint32_t _useCounter;
+
+    /**
+     * @brief Find the entry of a card
+     *
+     * @return Entry* Matching entry, nullptr if none
+     */
+    Entry* find(const uint8_t* uid, uint8_t uidLength);
+};
+
+#endif  // DESFIRE_STRATEGY_H
@@ -8,7 +8,8 @@
 #ifndef DESFIRE_TYPES_H
 #define DESFIRE_TYPES_H
 
-#include <Arduino.h>
+#include <stdint.h>
+#include "DesfireStatus.h"
 
 /**
  * @brief DESFire command codes
@@ -83,6 +84,60 @@ enum DesfreCommunicationMode : uint8_t {
     DF_COMM_ENCRYPT = 0x03   ///< Encrypted data
 };
 
+/**
+ * @brief SetConfiguration options
+ */
+enum DesfireConfigOption : uint8_t {
+    DF_CONFIG_PICC             = 0x00,  ///< PICC configuration (format disable, random ID)
+    DF_CONFIG_DEFAULT_KEY      = 0x01,  ///< Default key for new applications
+    DF_CONFIG_ATS              = 0x02,  ///< User-defined ATS
+    DF_CONFIG_SAK              = 0x03,  ///< User-defined SAK
+    DF_CONFIG_SECURE_MESSAGING = 0x04,  ///< Secure messaging configuration
+    DF_CONFIG_CAPABILITY       = 0x05   ///< Capability data (PDCap2)
+};
+
+/**
+ * @brief Flags of the PICC configuration byte (DF_CONFIG_PICC)
+ */
+enum DesfirePICCConfig : uint8_t {
+    DF_PICC_CONFIG_FORMAT_DISABLED = 0x01,  ///< FormatPICC is disabled permanently
+    DF_PICC_CONFIG_RANDOM_ID       = 0x02   ///< Random UID during anticollision (permanent)
+};
+
+/**
+ * @brief SetConfiguration size limits
+ */
+enum DesfireConfigConstants : uint8_t {
+    DF_CONFIG_DEFAULT_KEY_SIZE = 24,  ///< Default key field (AES keys use the first 16 bytes)
+    DF_CONFIG_ATS_MAX_LENGTH   = 20   ///< Maximum length of a user-defined ATS
+};
+
+/**
+ * @brief Card configuration applied in one authenticated session
+ *
+ * Set a bit (1 << DesfireConfigOption) in options for every part to apply.
+ */
+struct DesfireConfiguration {
+    uint8_t options;                                 ///< Options to apply
+    uint8_t piccFlags;                               ///< DF_CONFIG_PICC flags
+    uint8_t defaultKey[DF_CONFIG_DEFAULT_KEY_SIZE];  ///< DF_CONFIG_DEFAULT_KEY key
+    uint8_t defaultKeyVersion;                       ///< DF_CONFIG_DEFAULT_KEY version
+    uint8_t ats[DF_CONFIG_ATS_MAX_LENGTH];           ///< DF_CONFIG_ATS, starting with TL
+    uint8_t atsLength;                               ///< Length of the ATS (equals TL)
+};
+
+/**
+ * @brief Card generation derived from the GetVersion hardware information
+ */
+enum DesfireCardGeneration : uint8_t {
+    DF_GEN_UNKNOWN = 0x00,  ///< Not a known DESFire generation
+    DF_GEN_D40     = 0x01,  ///< MIFARE DESFire (D40), native DES authentication only
+    DF_GEN_EV1     = 0x02,  ///< DESFire EV1, adds AES authentication
+    DF_GEN_EV2     = 0x03,  ///< DESFire EV2, adds EV2 authentication and secure messaging
+    DF_GEN_EV3     = 0x04,  ///< DESFire EV3
+    DF_GEN_LIGHT   = 0x05   ///< DESFire Light, EV2 authentication with ISO framing only
+};
+
 /**
  * @brief DESFire card version information
  */
@@ -123,6 +178,7 @@ struct DESFireCardVersion {
                 return "DESFire EV2";
             case 0x03:
                 return "DESFire EV3";
+            case 0x08:
             case 0x41:
                 return "DESFire Light";
             default:
@@ -130,6 +186,52 @@ struct DESFireCardVersion {
         }
     }
 
+    /**
+     * @brief Check whether the card is a DESFire Light
+     *
+     * @return true if the card is a DESFire Light
+     * @return false otherwise
+     */
+    bool isLight() const {
+        return getGeneration() == DF_GEN_LIGHT;
+    }
+
+    /**
+     * @brief Get the card generation
+     *
+     * Accepts both the library type codes (see getCardTypeName()) and the
+     * NXP encoding, where EV1, EV2 and EV3 share type 01h and differ in the
+     * major version.
+     *
+     * @return DesfireCardGeneration Card generation
+     */
+    DesfireCardGeneration getGeneration() const {
+        switch (hardwareType) {
+            case 0x00:
+                return DF_GEN_D40;
+            case 0x01:
+                switch (hardwareVersionMajor) {
+                    case 0x00:
+                        return DF_GEN_D40;
+                    case 0x12:
+                        return DF_GEN_EV2;
+                    case 0x33:
+                        return DF_GEN_EV3;
+                    default:
+                        return DF_GEN_EV1;
+                }
+            case 0x02:
+                return DF_GEN_EV2;
+            case 0x03:
+                return DF_GEN_EV3;
+            case 0x08:
+            case 0x41:
+                return DF_GEN_LIGHT;
+            default:
+                return DF_GEN_UNKNOWN;
+        }
+    }
+
     /**
      * @brief Get storage size in bytes
      *
@@ -185,7 +287,8 @@ enum DesfreFileType : uint8_t {
     DF_FILE_BACKUP   = 0x01,  ///< Backup data file
     DF_FILE_VALUE    = 0x02,  ///< Value file for stored value
     DF_FILE_LINEAR   = 0x03,  ///< Linear record file
-    DF_FILE_CYCLIC   = 0x04   ///< Cyclic record file
+    DF_FILE_CYCLIC   = 0x04,  ///< Cyclic record file
+    DF_FILE_TMAC     = 0x05   ///< Transaction MAC file (EV2)
 };
 
 /**
@@ -244,21 +347,133 @@ enum DesfireEV2Command : uint8_t {
     DF_CMD_AUTHENTICATE_EV2_NONFIRST = 0x77,  ///< Non-first part of EV2 authentication
 
     // Transaction MAC commands
-    DF_CMD_COMMIT_TRANSACTION_MAC = 0xC7,  ///< Commit transaction with MAC
-    DF_CMD_ABORT_TRANSACTION_MAC  = 0xA7,  ///< Abort transaction with MAC
+    DF_CMD_COMMIT_TRANSACTION_MAC      = 0xC7,  ///< Commit transaction with MAC
+    DF_CMD_ABORT_TRANSACTION_MAC       = 0xA7,  ///< Abort transaction with MAC
+    DF_CMD_CREATE_TRANSACTION_MAC_FILE = 0xCE,  ///< Create a transaction MAC file
 
     // Command counter
     DF_CMD_GET_COMMAND_COUNTER = 0x7A,  ///< Get command counter
-    DF_CMD_SET_COMMAND_COUNTER = 0x7B   ///< Set command counter
+    DF_CMD_SET_COMMAND_COUNTER = 0x7B,  ///< Set command counter
+
+    // Originality check
+    DF_CMD_READ_SIG = 0x3C,  ///< Read NXP originality signature
+
+    // Proximity check
+    DF_CMD_PREPARE_PC      = 0xF0,  ///< Prepare the proximity check
+    DF_CMD_PROXIMITY_CHECK = 0xF2,  ///< One timed round of the proximity check
+    DF_CMD_VERIFY_PC       = 0xFD,  ///< Verify the proximity check
+
+    // Data commands with ISO/IEC 14443-4 chaining
+    DF_CMD_READ_DATA_ISO  = 0xAD,  ///< Read data without additional frames (EV3, Light)
+    DF_CMD_WRITE_DATA_ISO = 0x8D   ///< Write data without additional frames (EV3, Light)
 };
 
 /**
  * @brief DESFire EV2 specific constants
  */
 enum DesfireEV2Constants : uint8_t {
-    DF_EV2_MAC_LENGTH     = 8,  ///< Length of CMAC in bytes
-    DF_EV2_COUNTER_LENGTH = 4,  ///< Length of command counter in bytes
-    DF_EV2_TI_LENGTH      = 4   ///< Length of transaction identifier in bytes
+    DF_EV2_MAC_LENGTH         = 8,     ///< Length of CMAC in bytes
+    DF_EV2_COUNTER_LENGTH     = 4,     ///< Length of command counter in bytes
+    DF_EV2_TI_LENGTH          = 4,     ///< Length of transaction identifier in bytes
+    DF_EV2_TMC_LENGTH         = 4,     ///< Length of transaction MAC counter in bytes
+    DF_EV2_TMV_LENGTH         = 8,     ///< Length of transaction MAC value in bytes
+    DF_EV2_TM_KEY_AES         = 0x02,  ///< TMKeyOption for an AES transaction MAC key
+    DF_EV2_COMMIT_RETURN_TMAC = 0x01   ///< CommitTransaction option returning TMC and TMV
+};
+
+/**
+ * @brief Proximity check constants
+ */
+enum DesfireProximityConstants : uint8_t {
+    DF_PC_RND_SIZE      = 8,     ///< Length of the reader and card random numbers
+    DF_PC_OPT_PPS1      = 0x01,  ///< OPT flag: PPS1 follows pubRespTime
+    DF_PC_VERIFY_RESULT = 0x90   ///< First byte of the MAC input of the VerifyPC response
+};
+
+/**
+ * @brief Result of a proximity check
+ */
+struct DesfireProximityCheck {
+    uint8_t  opt;                        ///< Options returned by PreparePC
+    uint16_t pubRespTime;                ///< Response time published by the card
+    uint8_t  pps1;                       ///< PPS1 returned by PreparePC (if DF_PC_OPT_PPS1)
+    uint8_t  rounds;                     ///< Number of timed rounds
+    uint32_t roundTrip[DF_PC_RND_SIZE];  ///< Round trip time of each round (microseconds)
+    uint32_t maxRoundTrip;               ///< Longest round trip time (microseconds)
+};
+
+/**
+ * @brief Reader exchanges counted by DesfireNFC, timed by the reader clock
+ */
+struct DesfireExchangeStats {
+    uint32_t exchanges;  ///< Frames exchanged with the card
+    uint32_t failures;   ///< Exchanges without a response
+    uint64_t totalTime;  ///< Sum of the round trip times (microseconds)
+    uint32_t maxTime;    ///< Longest round trip time (microseconds)
+};
+
+/**
+ * @brief Application sweep constants
+ */
+enum DesfireSweepConstants : uint8_t {
+    DF_SWEEP_DATA_SIZE = 64  ///< Largest file range read per application
+};
+
+/**
+ * @brief One file range to read in an application sweep
+ */
+struct DesfireSweepEntry {
+    uint8_t                 aid[3];    ///< Application ID
+    uint8_t                 keyNo;     ///< Key number to authenticate with
+    const uint8_t*          key;       ///< AES key (16 bytes), nullptr for no authentication
+    uint8_t                 fileNo;    ///< File number
+    uint32_t                offset;    ///< Offset within the file
+    uint8_t                 length;    ///< Number of bytes to read (1 to DF_SWEEP_DATA_SIZE)
+    DesfreCommunicationMode commMode;  ///< Communication mode of the file
+};
+
+/**
+ * @brief Result of one entry of an application sweep
+ */
+struct DesfireSweepResult {
+    DesfireStatus status;                    ///< Status of the entry
+    uint8_t       length;                    ///< Number of bytes read, 0 on failure
+    uint8_t       data[DF_SWEEP_DATA_SIZE];  ///< File data
+};
+
+/**
+ * @brief Command profile selected for the detected card
+ */
+enum DesfireCardProfile : uint8_t {
+    DF_PROFILE_GENERIC = 0x00,  ///< Full DESFire command set, file layout unknown
+    DF_PROFILE_LIGHT   = 0x01   ///< DESFire Light: one application, fixed file set
+};
+
+/**
+ * @brief DESFire Light constants
+ */
+enum DesfireLightConstants : uint8_t {
+    DF_LIGHT_HARDWARE_TYPE  = 0x08,  ///< Hardware type reported by GetVersion
+    DF_LIGHT_FILE_COUNT     = 6,     ///< Number of files in the fixed file set
+    DF_LIGHT_DF_NAME_LENGTH = 16     ///< Length of the application DF name
+};
+
+/**
+ * @brief Description of a file of a known file layout
+ */
+struct DesfireFileInfo {
+    uint8_t        fileNo;     ///< File number
+    uint16_t       isoFileId;  ///< ISO/IEC 7816-4 file identifier
+    DesfreFileType type;       ///< File type
+    uint16_t       size;       ///< File size in bytes (record size for record files)
+};
+
+/**
+ * @brief Transaction MAC returned by CommitTransaction or read from the TMAC file
+ */
+struct DesfireTransactionMAC {
+    uint32_t counter;                   ///< Transaction MAC counter (TMC)
+    uint8_t  value[DF_EV2_TMV_LENGTH];  ///< Transaction MAC value (TMV)
 };
 
 #endif  // DESFIRE_TYPES_H
\ No newline at end of file
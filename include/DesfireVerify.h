@@ -0,0 +1,305 @@
+/**
+ * @file DesfireVerify.h
+ * @brief Backend verification of transaction MACs and SUN messages in bulk
+ *
+ * Readers log the Transaction MAC (TMC and TMV) of every committed
+ * transaction and forward the SUN URLs of tapped cards; a backend checks
+ * them afterwards, often millions at a time. Records are read from a text
+ * stream, one per line, and verified in groups of DF_VERIFY_LANES: the
+ * session keys and the MACs of a group are computed with
+ * DesfireCMAC::computeBatch(), which advances the CMACs of all records
+ * together so that the hardware AES path overlaps them. Large batches are
+ * split across threads on Linux.
+ *
+ * Record lines (hex fields, '#' starts a comment line):
+ *
+ *     T,<UID>,<TMC>,<TMI>,<TMV>
+ *     S,<PICCData>,<MAC input>,<MAC>
+ *
+ * The TMC is a hex number, the TMI the transaction MAC input as logged by
+ * the reader and the MAC input of a SUN record may be empty.
+ *
+ * The TMC to log is the one of the transaction itself: the value returned
+ * by CommitTransaction, or read from the transaction MAC file after the
+ * commit. That is the value stored before the transaction plus 1, which
+ * the card used for SesTMMACKey; the stored value itself does not verify.
+ */
+
+#ifndef DESFIRE_VERIFY_H
+#define DESFIRE_VERIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "DesfireCrypto.h"
+#include "DesfireDiversify.h"
+#include "DesfireSDM.h"
+
+#ifndef ARDUINO
+#include <stdio.h>
+#endif
+
+/**
+ * @brief Verification constants
+ */
+enum DesfireVerifyConstants : uint16_t {
+    DF_VERIFY_UID_SIZE    = 7,     ///< UID of a transaction MAC record
+    DF_VERIFY_INPUT_SIZE  = 512,   ///< Largest TMI or SDM MAC input
+    DF_VERIFY_LINE_SIZE   = 1100,  ///< Longest record line
+    DF_VERIFY_LANES       = 8,     ///< Records verified together
+    DF_VERIFY_MAX_THREADS = 32     ///< Maximum number of verification threads
+};
+
+/**
+ * @brief Kind of a record
+ */
+enum DesfireVerifyType : uint8_t {
+    DF_VERIFY_TYPE_NONE = 0,    ///< Line could not be parsed
+    DF_VERIFY_TYPE_TMAC = 'T',  ///< Transaction MAC of a committed transaction
+    DF_VERIFY_TYPE_SUN  = 'S'   ///< SDM mirror of a read
+};
+
+/**
+ * @brief Outcome of the verification of a record
+ */
+enum DesfireVerifyResult : uint8_t {
+    DF_VERIFY_PENDING   = 0,  ///< Not verified yet
+    DF_VERIFY_OK        = 1,  ///< MAC is valid
+    DF_VERIFY_BAD_MAC   = 2,  ///< MAC does not match, or PICC data is invalid
+    DF_VERIFY_MALFORMED = 3,  ///< Line could not be parsed
+    DF_VERIFY_NO_KEY    = 4   ///< No key was set for this kind of record
+};
+
+/**
+ * @brief Record to verify
+ */
+struct DesfireVerifyRecord {
+    DesfireVerifyType   type;                             ///< Kind of record
+    DesfireVerifyResult result;                           ///< Outcome, set by the verifier
+    uint32_t            line;                             ///< Line number in the stream
+    uint8_t             uid[DF_VERIFY_UID_SIZE];          ///< Card UID (TMAC)
+    uint32_t            counter;                          ///< TMC of the transaction (TMAC)
+    uint8_t             piccData[DF_SDM_PICC_DATA_SIZE];  ///< Encrypted PICC data (SUN)
+    uint8_t             input[DF_VERIFY_INPUT_SIZE];      ///< TMI or SDM MAC input
+    uint16_t            inputLength;                      ///< Length of the input
+    uint8_t             mac[DF_MACT_SIZE];                ///< TMV or SDM MAC
+    DesfireSUN          sun;                              ///< Recovered card data (SUN)
+};
+
+/**
+ * @brief Called for every parsed or verified record
+ *
+ * @param record Record
+ * @param context Context pointer given to the parser or verifier
+ * @return true to continue
+ * @return false to stop
+ */
+typedef bool (*DesfireVerifyCallback)(const DesfireVerifyRecord& record, void* context);
+
+/**
+ * @brief Incremental parser for a stream of record lines
+ *
+ * Data may be fed in pieces of any size. Blank lines and comments are
+ * skipped; lines that cannot be parsed are passed on with the result
+ * DF_VERIFY_MALFORMED so that the output keeps one entry per record line.
+ */
+class DesfireRecordParser {
+public:
+    /**
+     * @brief Construct a parser
+     *
+     * @param callback Function called for every record line
+     * @param context Context pointer passed to the callback
+     */
+    DesfireRecordParser(DesfireVerifyCallback callback, void* context);
+
+    /**
+     * @brief Prepare the parser for a new stream
+     */
+    void reset();
+
+    /**
+     * @brief Parse the next piece of the stream
+     *
+     * @param data Stream data
+     * @param length Length of the data
+     * @return true if the data was parsed
+     * @return false if the callback stopped parsing
+     */
+    bool feed(const char* data, size_t length);
+
+    /**
+     * @brief Parse a last line without a line break
+     *
+     * @return true if the stream was parsed
+     * @return false if the callback stopped parsing
+     */
+    bool finish();
+
+    /**
+     * @brief Get the number of lines parsed so far
+     *
+     * @return uint32_t Number of complete lines
+     */
+    uint32_t getLineCount() const;
+
+    /**
+     * @brief Parse one record line
+     *
+     * @param line Line without the line break
+     * @param length Length of the line
+     * @param record Record to fill, its result is DF_VERIFY_MALFORMED on failure
+     * @return true if the line is a valid record
+     * @return false otherwise
+     */
+    static bool parseLine(const char* line, size_t length, DesfireVerifyRecord* record);
+
+private:
+    /** Record callback */
+    DesfireVerifyCallback _callback;
+
+    /** Callback context */
+    void* _context;
+
+    /** Line being assembled */
+    char _line[DF_VERIFY_LINE_SIZE];
+
+    /** Length of the line being assembled */
+    uint16_t _length;
+
+    /** Flag indicating that the current line is too long */
+    bool _overflow;
+
+    /** Number of complete lines */
+    uint32_t _lineCount;
+
+    /** Record passed to the callback */
+    DesfireVerifyRecord _record;
+
+    /**
+     * @brief Parse the assembled line and pass it to the callback
+     *
+     * @return true to continue
+     * @return false if the callback stopped parsing
+     */
+    bool emitLine();
+};
+
+/**
+ * @brief Verifier for transaction MAC and SUN records
+ *
+ * Transaction MAC keys are either one application-wide key or derived per
+ * card with AN10922 from the record UID. SUN records are checked with a
+ * DesfireSDM key set.
+ */
+class DesfireTransactionVerifier {
+public:
+    /**
+     * @brief Construct a verifier without keys
+     */
+    DesfireTransactionVerifier();
+
+    /**
+     * @brief Set one transaction MAC key for all cards
+     *
+     * @param key AppTransactionMACKey (16 bytes)
+     */
+    void setTransactionMACKey(const uint8_t* key);
+
+    /**
+     * @brief Derive the transaction MAC key of every card from its UID
+     *
+     * @param diversifier Diversifier holding the master key, must outlive the verifier
+     * @param aid Application ID used as diversification input (3 bytes), nullptr for none
+     */
+    void setKeyDiversifier(const DesfireKeyDiversifier* diversifier, const uint8_t* aid);
+
+    /**
+     * @brief Set the key set of SUN records
+     *
+     * @param sdm SDM verifier, must outlive the verifier, nullptr to reject SUN records
+     */
+    void setSDM(const DesfireSDM* sdm);
+
+    /**
+     * @brief Verify a batch of records
+     *
+     * Sets the result of every record still DF_VERIFY_PENDING. With more
+     * than one thread the batch is split into equal slices, one per thread.
+     *
+     * @param records Records to verify
+     * @param count Number of records
+     * @param threads Number of threads (1 to DF_VERIFY_MAX_THREADS, Linux only)
+     * @return size_t Number of records with a valid MAC
+     */
+    size_t verifyBatch(DesfireVerifyRecord* records, size_t count, uint8_t threads = 1) const;
+
+#ifndef ARDUINO
+    /**
+     * @brief Verify all records of a stream
+     *
+     * Records are collected in the caller's buffer and verified whenever it
+     * is full; the callback then gets every record in stream order.
+     *
+     * @param input Stream of record lines
+     * @param batch Buffer of records
+     * @param batchSize Number of records in the buffer
+     * @param callback Function called for every verified record
+     * @param context Context pointer passed to the callback
+     * @param threads Number of threads (1 to DF_VERIFY_MAX_THREADS, Linux only)
+     * @return size_t Number of records with a valid MAC
+     */
+    size_t verifyStream(FILE*                 input,
+                        DesfireVerifyRecord*  batch,
+                        size_t                batchSize,
+                        DesfireVerifyCallback callback,
+                        void*                 context,
+                        uint8_t               threads = 1) const;
+#endif
+
+private:
+    /** Cipher with the transaction MAC key */
+    DesfireAES _tmKey;
+
+    /** Flag indicating that a transaction MAC key is set */
+    bool _hasTMKey;
+
+    /** Diversifier of per-card transaction MAC keys, nullptr for one key */
+    const DesfireKeyDiversifier* _diversifier;
+
+    /** Application ID used as diversification input */
+    uint8_t _aid[DF_DIV_AID_SIZE];
+
+    /** Flag indicating that the AID is part of the diversification input */
+    bool _hasAID;
+
+    /** SDM verifier, nullptr if not set */
+    const DesfireSDM* _sdm;
+
+    /**
+     * @brief Verify up to DF_VERIFY_LANES records together
+     *
+     * @param records Records to verify
+     * @param count Number of records
+     */
+    void verifyLanes(DesfireVerifyRecord* records, uint8_t count) const;
+
+    /**
+     * @brief Verify a slice of a batch
+     *
+     * @param records Records to verify
+     * @param count Number of records
+     */
+    void verifySlice(DesfireVerifyRecord* records, size_t count) const;
+
+#if defined(__linux__)
+    /**
+     * @brief Entry point of a verification thread
+     *
+     * @param argument Slice to verify
+     * @return void* Always nullptr
+     */
+    static void* threadMain(void* argument);
+#endif
+};
+
+#endif  // DESFIRE_VERIFY_H
@@ -0,0 +1,63 @@
+/**
+ * @file DesfireWritePlan.h
+ * @brief Delta planning of file writes against a shadow copy
+ *
+ * Writes are slower than reads on DESFire, every written byte costs EEPROM
+ * programming time on top of the transfer. Given the previous contents of a
+ * file range, the planner finds the changed bytes and groups them into as
+ * few WriteData commands as pay off: changes separated by a short unchanged
+ * run are written together, since rewriting a few bytes costs less than an
+ * additional command exchange.
+ */
+
+#ifndef DESFIRE_WRITE_PLAN_H
+#define DESFIRE_WRITE_PLAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Write planner constants
+ */
+enum DesfireWritePlanConstants : uint8_t {
+    DF_WRITE_PLAN_MAX_SPANS = 8,  ///< Maximum number of WriteData commands per plan
+    DF_WRITE_PLAN_MAX_GAP   = 8   ///< Default unchanged run rewritten to join two changes
+};
+
+/**
+ * @brief Changed range written with one command, relative to the range start
+ */
+struct DesfireWriteSpan {
+    uint32_t offset;  ///< Offset of the first changed byte
+    uint32_t length;  ///< Number of bytes to write
+};
+
+/**
+ * @brief Planner finding the changed ranges of a file write
+ */
+class DesfireWritePlanner {
+public:
+    /**
+     * @brief Find the ranges that differ from the previous contents
+     *
+     * Changes at most maxGap unchanged bytes apart are joined. When more
+     * than maxSpans ranges remain, the last span is extended over the rest,
+     * so the plan always covers every change.
+     *
+     * @param previous Previous contents (shadow copy)
+     * @param data New contents
+     * @param length Length of the contents
+     * @param maxGap Largest unchanged run that is rewritten to join two changes
+     * @param spans Array to store the plan
+     * @param maxSpans Size of the span array (at least 1)
+     * @return uint8_t Number of spans, 0 if nothing changed
+     */
+    static uint8_t plan(const uint8_t*    previous,
+                        const uint8_t*    data,
+                        uint32_t          length,
+                        uint32_t          maxGap,
+                        DesfireWriteSpan* spans,
+                        uint8_t           maxSpans);
+};
+
+#endif  // DESFIRE_WRITE_PLAN_H
@@ -9,7 +9,13 @@
 #ifndef ISO7816_APDU_H
 #define ISO7816_APDU_H
 
+#ifdef ARDUINO
 #include <Arduino.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#endif
 #include "DesfireStatus.h"
 #include "ISO7816Constants.h"
 
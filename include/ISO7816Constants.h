@@ -9,7 +9,13 @@
 #ifndef ISO7816_CONSTANTS_H
 #define ISO7816_CONSTANTS_H
 
+#ifdef ARDUINO
 #include <Arduino.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#endif
 
 /**
  * @brief ISO 7816-4 class byte (CLA) values
@@ -51,8 +57,9 @@ enum ISO7816Instruction : uint8_t {
  */
 enum ISO7816StatusWord : uint16_t {
     // Success codes
-    ISO_SW_SUCCESS         = 0x9000,  ///< Command successful
-    ISO_SW_SUCCESS_DESFIRE = 0x9100,  ///< DESFire success
+    ISO_SW_SUCCESS          = 0x9000,  ///< Command successful
+    ISO_SW_SUCCESS_DESFIRE  = 0x9100,  ///< DESFire success
+    ISO_SW_SUCCESS_READ_SIG = 0x9190,  ///< DESFire success (Read_Sig)
 
     // Warning codes
     ISO_SW_WARNING_NVM         = 0x6200,  ///< Warning: NVM unchanged
@@ -10,7 +10,13 @@
 #ifndef NFC_READER_INTERFACE_H
 #define NFC_READER_INTERFACE_H
 
+#ifdef ARDUINO
 #include <Arduino.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+#include "DesfireClock.h"
 
 /**
  * @brief Interface for NFC reader operations
@@ -20,6 +26,12 @@
  */
 class NFCReaderInterface {
 public:
+    /**
+     * @brief Construct a reader timed by the system clock
+     */
+    NFCReaderInterface() : _clock(nullptr) {
+    }
+
     /**
      * @brief Virtual destructor
      */
@@ -73,6 +85,131 @@ public:
                             uint16_t       txLength,
                             uint8_t*       rxData,
                             uint16_t*      rxLength) = 0;
+
+    /**
+     * @brief Send data to the card and measure the round trip time
+     *
+     * The time is taken as close to the transport as the reader allows, it
+     * always includes the reader's own latency.
+     *
+     * @param txData Data to transmit
+     * @param txLength Length of data to transmit
+     * @param rxData Buffer to store the response
+     * @param rxLength Pointer to variable that will store the response length
+     * @param roundTrip Pointer to variable that will store the round trip time in microseconds
+     * @return true if transmission was successful
+     * @return false if transmission failed
+     */
+    virtual bool transceiveTimed(const uint8_t* txData,
+                                 uint16_t       txLength,
+                                 uint8_t*       rxData,
+                                 uint16_t*      rxLength,
+                                 uint32_t*      roundTrip) {
+        uint32_t start  = clockMicros();
+        bool     result = transceive(txData, txLength, rxData, rxLength);
+        *roundTrip      = clockMicros() - start;
+        return result;
+    }
+
+    /**
+     * @brief Limit the time the card may take to answer
+     *
+     * Enforced by the reader hardware, independent of the host, so a late
+     * answer fails the exchange. Readers without such a timer keep their
+     * default timeout.
+     *
+     * @param timeout Longest accepted card response time in microseconds, 0 for the default
+     * @return true if the limit is enforced
+     * @return false if the reader cannot enforce it
+     */
+    virtual bool setResponseTimeout(uint32_t timeout) {
+        (void)timeout;
+        return false;
+    }
+
+    /**
+     * @brief Get the largest command the reader can transmit in one exchange
+     *
+     * Readers that chain ISO14443-4 frames internally can accept commands
+     * larger than the card frame size; the library splits longer commands
+     * into DESFire additional frames.
+     *
+     * @return uint16_t Maximum length of txData in bytes
+     */
+    virtual uint16_t getMaxTransmitLength() {
+        return 64;
+    }
+
+    /**
+     * @brief Get the largest response the reader can return in one exchange
+     *
+     * @return uint16_t Maximum length of rxData in bytes, status word included
+     */
+    virtual uint16_t getMaxReceiveLength() {
+        return 64;
+    }
+
+    /**
+     * @brief Change the bit rate of the activated card
+     *
+     * Only possible directly after activation (PPS). Readers without bit
+     * rate control stay at 106 kbit/s.
+     *
+     * @param kbps Bit rate in kbit/s for both directions (106, 212, 424 or 848)
+     * @return true if the bit rate is in use
+     * @return false if the reader or the card does not support it
+     */
+    virtual bool setBitRate(uint16_t kbps) {
+        return kbps == 106;
+    }
+
+    /**
+     * @brief Check whether the reader passes native DESFire frames to the card
+     *
+     * Readers that only transport ISO7816-4 APDUs get ISO wrapped commands,
+     * whatever the strategy of the card.
+     *
+     * @return true if any frame is sent to the card unchanged
+     * @return false if only APDUs are accepted
+     */
+    virtual bool supportsNativeFrames() {
+        return true;
+    }
+
+    /**
+     * @brief Set the clock that times exchanges and timeouts
+     *
+     * Simulated readers run on a DesfireVirtualClock, so that waiting for
+     * the simulated card costs no real time.
+     *
+     * @param clock Clock to use, must outlive the reader, nullptr for the system clock
+     */
+    void setClock(DesfireClock* clock) {
+        _clock = clock;
+    }
+
+    /**
+     * @brief Get the clock that times exchanges and timeouts
+     *
+     * @return DesfireClock& Clock in use
+     */
+    DesfireClock& getClock() {
+        return (_clock != nullptr) ? *_clock : DesfireSystemClock::instance();
+    }
+
+protected:
+    /**
+     * @brief Get the time of the reader clock
+     *
+     * @return uint32_t Time in microseconds, wrapping around
+     */
+    uint32_t clockMicros() {
+        return getClock().micros();
+    }
+
+private:
+    /** Clock set with setClock(), nullptr for the system clock */
+    DesfireClock* _clock;
 };
 
-#endif  // NFC_READER_INTERFACE_H
\ No newline at end of file
+#endif  // NFC_READER_INTERFACE_H
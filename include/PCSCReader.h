@@ -0,0 +1,206 @@
+/**
+ * @file PCSCReader.h
+ * @brief Contactless reader over PC/SC for desktop and server encoding stations
+ *
+ * Talks to USB CCID readers through the PC/SC API (pcsc-lite on Linux and
+ * macOS, WinSCard on Windows). The reader negotiates the highest bit rate
+ * and chains frames itself, so bulk personalization runs at the speed of
+ * the reader instead of that of an MCU link. DESFire cards only take short
+ * APDUs, so exchanges stay within those whatever the reader supports.
+ *
+ * Only built with DESFIRE_PCSC defined and linked against the PC/SC library.
+ */
+
+#ifndef PCSC_READER_H
+#define PCSC_READER_H
+
+#include "NFCReaderInterface.h"
+
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+
+/**
+ * @brief PC/SC reader constants
+ */
+enum PCSCReaderConstants : uint32_t {
+    PCSC_READER_NAME_SIZE = 128,   ///< Maximum length of a reader name
+    PCSC_READER_LIST_SIZE = 1024,  ///< Size of the reader list buffer
+    PCSC_SHORT_APDU_SIZE  = 261,   ///< Short APDU: header, Lc, 255 data bytes, Le
+    PCSC_SHORT_RESPONSE   = 258,   ///< Short response: 256 data bytes and SW
+    PCSC_DETECT_TIMEOUT   = 100    ///< Time detectCard() waits for a card (ms)
+};
+
+/**
+ * @brief Contactless reader over PC/SC
+ */
+class PCSCReader : public NFCReaderInterface {
+public:
+    /**
+     * @brief Construct a reader
+     *
+     * @param readerName Part of the PC/SC reader name to use, nullptr for the first reader
+     */
+    PCSCReader(const char* readerName = nullptr);
+
+    /**
+     * @brief Destroy the reader and release the PC/SC context
+     */
+    virtual ~PCSCReader();
+
+    /**
+     * @brief Connect to the PC/SC service, select the reader and read its features
+     *
+     * @return true if a matching reader was found
+     * @return false if the service is not running or no reader matches
+     */
+    virtual bool begin() override;
+
+    /**
+     * @brief Get the firmware version of the reader
+     *
+     * @return uint32_t Vendor IFD version, 1 if the reader does not report it, 0 without reader
+     */
+    virtual uint32_t getFirmwareVersion() override;
+
+    /**
+     * @brief Configure the reader for card communication
+     *
+     * PC/SC readers are configured by their driver, this only checks that a
+     * reader is selected.
+     *
+     * @return true if a reader is selected
+     * @return false otherwise
+     */
+    virtual bool configure() override;
+
+    /**
+     * @brief Detect a card and connect to it
+     *
+     * Waits up to PCSC_DETECT_TIMEOUT for a card. A card connected before is
+     * reset, which starts a new activation like on other readers. The UID is
+     * read with the PC/SC GET DATA command; cards that do not answer it,
+     * such as contact or virtual cards, are reported with an empty UID.
+     *
+     * @param uid Buffer to store the card UID (10 bytes)
+     * @param uidLength Pointer to variable that will store the UID length
+     * @return true if a card is connected
+     * @return false if no card was detected
+     */
+    virtual bool detectCard(uint8_t* uid, uint8_t* uidLength) override;
+
+    /**
+     * @brief Send an APDU to the card and receive the response
+     *
+     * @param txData APDU to transmit
+     * @param txLength Length of the APDU
+     * @param rxData Buffer to store the response
+     * @param rxLength Size of rxData in, length of the response out
+     * @return true if transmission was successful
+     * @return false if transmission failed
+     */
+    virtual bool transceive(const uint8_t* txData,
+                            uint16_t       txLength,
+                            uint8_t*       rxData,
+                            uint16_t*      rxLength) override;
+
+    /**
+     * @brief Get the largest command the reader can transmit in one exchange
+     *
+     * @return uint16_t Length of a short APDU
+     */
+    virtual uint16_t getMaxTransmitLength() override;
+
+    /**
+     * @brief Get the largest response the reader can return in one exchange
+     *
+     * @return uint16_t Length of a short response, status word included
+     */
+    virtual uint16_t getMaxReceiveLength() override;
+
+    /**
+     * @brief Accept the bit rate of the card
+     *
+     * CCID readers negotiate the highest common bit rate on activation, so
+     * every rate is reported as in use.
+     *
+     * @param kbps Bit rate in kbit/s
+     * @return true always
+     */
+    virtual bool setBitRate(uint16_t kbps) override;
+
+    /**
+     * @brief Check whether the reader passes native DESFire frames to the card
+     *
+     * Readers with APDU level exchange reject native frames, so only ISO
+     * wrapped commands are sent.
+     *
+     * @return false always
+     */
+    virtual bool supportsNativeFrames() override;
+
+    /**
+     * @brief Get the name of the selected reader
+     *
+     * @return const char* Reader name, empty before begin()
+     */
+    const char* getReaderName() const;
+
+    /**
+     * @brief Disconnect the card and release the PC/SC context
+     */
+    void end();
+
+private:
+    /** Part of the reader name to match */
+    char _filter[PCSC_READER_NAME_SIZE];
+
+    /** Name of the selected reader */
+    char _readerName[PCSC_READER_NAME_SIZE];
+
+    /** PC/SC context */
+    SCARDCONTEXT _context;
+
+    /** Flag indicating that the context is established */
+    bool _hasContext;
+
+    /** Connected card */
+    SCARDHANDLE _card;
+
+    /** Flag indicating that a card is connected */
+    bool _connected;
+
+    /** Protocol of the connected card */
+    DWORD _protocol;
+
+    /** Vendor IFD version of the reader */
+    uint32_t _firmwareVersion;
+
+    /**
+     * @brief Select the first reader whose name contains the filter
+     *
+     * @return true if a reader was selected
+     * @return false otherwise
+     */
+    bool selectReader();
+
+    /**
+     * @brief Read the version of the reader
+     *
+     * Uses a direct connection, which needs no card. Readers that refuse it
+     * report the version as unknown.
+     */
+    void readVersion();
+
+    /**
+     * @brief Disconnect the connected card
+     *
+     * @param disposition SCARD_LEAVE_CARD or SCARD_RESET_CARD
+     */
+    void disconnect(DWORD disposition);
+};
+
+#endif  // PCSC_READER_H
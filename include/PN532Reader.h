@@ -95,6 +95,54 @@ public:
                             uint8_t*       rxData,
                             uint16_t*      rxLength) override;
 
+    /**
+     * @brief Get the largest command the reader can transmit in one exchange
+     *
+     * @return uint16_t Maximum length of txData in bytes
+     */
+    virtual uint16_t getMaxTransmitLength() override;
+
+    /**
+     * @brief Get the largest response the reader can return in one exchange
+     *
+     * @return uint16_t Maximum length of rxData in bytes
+     */
+    virtual uint16_t getMaxReceiveLength() override;
+
+    /**
+     * @brief Send data to the card and measure the round trip time
+     *
+     * Timestamps with the CPU cycle counter where available. The time
+     * includes the host link and the driver polling the PN532, use
+     * setResponseTimeout() for a limit on the card response alone.
+     *
+     * @param txData Data to transmit
+     * @param txLength Length of data to transmit
+     * @param rxData Buffer to store the response
+     * @param rxLength Pointer to variable that will store the response length
+     * @param roundTrip Pointer to variable that will store the round trip time in microseconds
+     * @return true if transmission was successful
+     * @return false if transmission failed
+     */
+    virtual bool transceiveTimed(const uint8_t* txData,
+                                 uint16_t       txLength,
+                                 uint8_t*       rxData,
+                                 uint16_t*      rxLength,
+                                 uint32_t*      roundTrip) override;
+
+    /**
+     * @brief Limit the time the card may take to answer
+     *
+     * Sets the PN532 communication timeout (RFConfiguration item 02h), which
+     * runs on the RF side in steps of 100 us * 2^n. The answer of the PN532
+     * is read from the bus, so only I2C and SPI connections support a limit.
+     *
+     * @param timeout Longest accepted card response time in microseconds, 0 for the default
+     * @return true if the limit is enforced
+     * @return false if the PN532 did not confirm the configuration
+     */
+    virtual bool setResponseTimeout(uint32_t timeout) override;
+
     /**
      * @brief Get direct access to the underlying Adafruit_PN532 object
      *
@@ -108,6 +156,17 @@ private:
     Adafruit_PN532* _nfc;             // PN532 controller
     bool            _ownNFC;          // Whether we created the _nfc instance
     uint8_t         _connectionType;  // Type of connection (0=I2C, 1=SPI, 2=HSU)
+    TwoWire*        _wire;            // I2C bus of the PN532
+    uint8_t         _ss;              // SPI slave select pin of the PN532
+
+    /**
+     * @brief Read and check the answer to a command that returns no data
+     *
+     * @param command Command code that was sent
+     * @return true if the PN532 answered the command
+     * @return false if no answer or a different frame arrived in time
+     */
+    bool readEmptyAnswer(uint8_t command);
 };
 
 #endif  // PN532_READER_H
\ No newline at end of file
@@ -0,0 +1,286 @@
+/**
+ * @file PN532SerialReader.h
+ * @brief PN532 reader on a POSIX serial port (HSU) for Linux gateways
+ *
+ * Speaks PN532 host frames directly over a termios serial device, such as a
+ * PN532 board on a USB-UART adapter. The descriptor is non-blocking and all
+ * waiting is done with epoll and a deadline, so a stalled adapter fails an
+ * exchange instead of hanging the process, and one process can drive many
+ * readers, one thread per reader. Owning the frame layer also gives access
+ * to the PN532 commands the Arduino driver hides: bit rate selection
+ * (InPSL), the RF response timeout and extended frames for full-size
+ * DESFire frames.
+ *
+ * Only available on Linux.
+ */
+
+#ifndef PN532_SERIAL_READER_H
+#define PN532_SERIAL_READER_H
+
+#include "NFCReaderInterface.h"
+
+/**
+ * @brief Serial reader constants
+ */
+enum PN532SerialConstants : uint32_t {
+    PN532_HSU_BAUD_DEFAULT   = 115200,  ///< Baud rate of the PN532 after power-up
+    PN532_HSU_DEVICE_SIZE    = 64,      ///< Maximum length of the device path
+    PN532_HSU_MAX_DATA       = 262,     ///< Largest InDataExchange payload in one frame
+    PN532_HSU_FRAME_SIZE     = 275,     ///< Largest frame incl. preamble and postamble
+    PN532_HSU_ACK_TIMEOUT    = 30,      ///< Time the PN532 takes to acknowledge (ms)
+    PN532_HSU_ANSWER_TIMEOUT = 1000     ///< Time the PN532 takes to answer a command (ms)
+};
+
+/**
+ * @brief PN532 reader on a POSIX serial port
+ */
+class PN532SerialReader : public NFCReaderInterface {
+public:
+    /**
+     * @brief Construct a reader for a serial device
+     *
+     * The device is opened by begin(). Baud rates above the PN532 default
+     * are switched to with SetSerialBaudRate once the PN532 answers; the
+     * PN532 and Linux both support 230400, 460800 and 921600.
+     *
+     * @param device Path of the serial device, e.g. /dev/ttyUSB0
+     * @param baudRate Baud rate used after initialization
+     */
+    PN532SerialReader(const char* device, uint32_t baudRate = PN532_HSU_BAUD_DEFAULT);
+
+    /**
+     * @brief Destroy the reader and close the device
+     */
+    virtual ~PN532SerialReader();
+
+    /**
+     * @brief Open the device, wake the PN532 and switch to the baud rate
+     *
+     * @return true if the PN532 answered
+     * @return false if the device could not be opened or the PN532 is silent
+     */
+    virtual bool begin() override;
+
+    /**
+     * @brief Get the firmware version of the PN532
+     *
+     * @return uint32_t IC, version, revision and support bytes (0 if failed)
+     */
+    virtual uint32_t getFirmwareVersion() override;
+
+    /**
+     * @brief Configure the PN532 for card communication
+     *
+     * @return true if configuration was successful
+     * @return false if configuration failed
+     */
+    virtual bool configure() override;
+
+    /**
+     * @brief Detect if an ISO14443A card is present
+     *
+     * @param uid Buffer to store the card UID
+     * @param uidLength Pointer to variable that will store the UID length
+     * @return true if a card was detected
+     * @return false if no card was detected
+     */
+    virtual bool detectCard(uint8_t* uid, uint8_t* uidLength) override;
+
+    /**
+     * @brief Send data to the card and receive the response
+     *
+     * @param txData Data to transmit
+     * @param txLength Length of data to transmit
+     * @param rxData Buffer to store the response
+     * @param rxLength Size of rxData in, length of the response out
+     * @return true if transmission was successful
+     * @return false if transmission failed
+     */
+    virtual bool transceive(const uint8_t* txData,
+                            uint16_t       txLength,
+                            uint8_t*       rxData,
+                            uint16_t*      rxLength) override;
+
+    /**
+     * @brief Limit the time the card may take to answer
+     *
+     * @param timeout Longest accepted card response time in microseconds, 0 for the default
+     * @return true if the limit is enforced
+     * @return false if the PN532 rejected the configuration
+     */
+    virtual bool setResponseTimeout(uint32_t timeout) override;
+
+    /**
+     * @brief Change the bit rate of the activated card with InPSL
+     *
+     * @param kbps Bit rate in kbit/s for both directions (106, 212, 424 or 848)
+     * @return true if the bit rate is in use
+     * @return false if the PN532 or the card rejected it
+     */
+    virtual bool setBitRate(uint16_t kbps) override;
+
+    /**
+     * @brief Get the largest command the reader can transmit in one exchange
+     *
+     * @return uint16_t Maximum length of txData in bytes
+     */
+    virtual uint16_t getMaxTransmitLength() override;
+
+    /**
+     * @brief Get the largest response the reader can return in one exchange
+     *
+     * @return uint16_t Maximum length of rxData in bytes
+     */
+    virtual uint16_t getMaxReceiveLength() override;
+
+    /**
+     * @brief Close the device
+     */
+    void end();
+
+private:
+    /** Path of the serial device */
+    char _device[PN532_HSU_DEVICE_SIZE];
+
+    /** Baud rate used after initialization */
+    uint32_t _baudRate;
+
+    /** Baud rate the device currently runs at */
+    uint32_t _lineRate;
+
+    /** Serial device descriptor, -1 if closed */
+    int _fd;
+
+    /** epoll instance watching the device */
+    int _epoll;
+
+    /** Flag indicating that the PN532 must be woken before the next command */
+    bool _asleep;
+
+    /** Logical number of the activated target */
+    uint8_t _target;
+
+    /** Frame buffer */
+    uint8_t _frame[PN532_HSU_FRAME_SIZE];
+
+    /** Bytes read from the device but not yet parsed */
+    uint8_t _input[PN532_HSU_FRAME_SIZE];
+
+    /** Position of the next unparsed byte in _input */
+    uint16_t _inputStart;
+
+    /** End of the unparsed bytes in _input */
+    uint16_t _inputEnd;
+
+    /**
+     * @brief Wake the PN532 and leave its low power mode
+     *
+     * @return true if the PN532 answered
+     * @return false otherwise
+     */
+    bool wake();
+
+    /**
+     * @brief Set the local baud rate of the device
+     *
+     * @param baudRate Baud rate
+     * @return true if the rate was set
+     * @return false if the rate is not supported
+     */
+    bool setLocalBaudRate(uint32_t baudRate);
+
+    /**
+     * @brief Send a command and receive its answer
+     *
+     * @param command Command code and parameters, without TFI
+     * @param commandLength Length of the command
+     * @param answer Buffer to store the answer parameters, without TFI and code
+     * @param answerLength Size of answer in, length of the parameters out
+     * @param timeout Time the PN532 may take to answer (ms)
+     * @return true if the PN532 answered the command
+     * @return false on timeout, NACK, error frame or a corrupt frame
+     */
+    bool sendCommand(const uint8_t* command,
+                     uint16_t       commandLength,
+                     uint8_t*       answer,
+                     uint16_t*      answerLength,
+                     uint32_t       timeout = PN532_HSU_ANSWER_TIMEOUT);
+
+    /**
+     * @brief Drop unparsed and pending input, such as the late answer of an aborted command
+     */
+    void discardInput();
+
+    /**
+     * @brief Send a command frame
+     *
+     * @param command Command code and parameters, without TFI
+     * @param commandLength Length of the command
+     * @return true if the frame was written
+     * @return false otherwise
+     */
+    bool writeFrame(const uint8_t* command, uint16_t commandLength);
+
+    /**
+     * @brief Receive a frame
+     *
+     * Skips bytes up to the next start code. An ACK frame is returned with
+     * a length of 0, a NACK frame fails.
+     *
+     * @param data Buffer to store TFI and data of the frame
+     * @param length Size of data in, length of the frame data out
+     * @param deadline Time at which to give up (ms, monotonic clock)
+     * @return true if a complete frame with valid checksums was received
+     * @return false otherwise
+     */
+    bool readFrame(uint8_t* data, uint16_t* length, uint64_t deadline);
+
+    /**
+     * @brief Send an ACK frame, which aborts the current command
+     *
+     * @return true if the frame was written
+     * @return false otherwise
+     */
+    bool writeAck();
+
+    /**
+     * @brief Write bytes, waiting for the device to accept them
+     *
+     * @param data Bytes to write
+     * @param length Number of bytes
+     * @param deadline Time at which to give up (ms, monotonic clock)
+     * @return true if all bytes were written
+     * @return false otherwise
+     */
+    bool writeAll(const uint8_t* data, size_t length, uint64_t deadline);
+
+    /**
+     * @brief Read bytes, waiting for the device to deliver them
+     *
+     * @param data Buffer to store the bytes
+     * @param length Number of bytes
+     * @param deadline Time at which to give up (ms, monotonic clock)
+     * @return true if all bytes were read
+     * @return false otherwise
+     */
+    bool readAll(uint8_t* data, size_t length, uint64_t deadline);
+
+    /**
+     * @brief Wait until the device is ready
+     *
+     * @param events EPOLLIN or EPOLLOUT
+     * @param deadline Time at which to give up (ms, monotonic clock)
+     * @return true if the device is ready
+     * @return false on timeout or error
+     */
+    bool waitReady(uint32_t events, uint64_t deadline);
+
+    /**
+     * @brief Get the time of the monotonic clock in milliseconds
+     *
+     * @return uint64_t Time in milliseconds
+     */
+    static uint64_t now();
+};
+
+#endif  // PN532_SERIAL_READER_H
@@ -0,0 +1,426 @@
+/**
+ * @file PN532Simulator.h
+ * @brief Byte-level simulator of the PN532 host interface
+ *
+ * PN532Simulator takes the bytes a host driver writes to a PN532 and
+ * produces the bytes the PN532 would return, over HSU, I2C or SPI: normal
+ * and extended information frames with their checksums, ACK and NACK in
+ * both directions, the I2C status byte and the SPI direction bytes. The
+ * commands a DESFire driver needs are executed against a pluggable card,
+ * for example a DesfireCardEmulator through PN532EmulatedCard.
+ *
+ * Transport drivers can thus be tested and benchmarked without a board:
+ * behind a pseudo-terminal for PN532SerialReader, or called directly from
+ * a bus stub. With a clock set, every command spends the host link and RF
+ * time on it.
+ *
+ * SPI bytes are taken after the LSB-first bit order has been applied.
+ */
+
+#ifndef PN532_SIMULATOR_H
+#define PN532_SIMULATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "DesfireClock.h"
+#include "DesfireEmulator.h"
+
+/**
+ * @brief Simulator constants
+ */
+enum PN532SimulatorConstants : uint32_t {
+    PN532_SIM_MAX_DATA   = 262,     ///< Largest InDataExchange payload
+    PN532_SIM_FRAME_DATA = 265,     ///< Largest TFI and data of a frame
+    PN532_SIM_FRAME_SIZE = 275,     ///< Largest frame incl. preamble and postamble
+    PN532_SIM_UID_SIZE   = 10,      ///< Largest NFCID1
+    PN532_SIM_ATS_SIZE   = 20,      ///< Largest ATS
+    PN532_SIM_HSU_BAUD   = 115200,  ///< Baud rate of the PN532 after power-up
+    PN532_SIM_I2C_CLOCK  = 400000,  ///< I2C clock (Hz)
+    PN532_SIM_SPI_CLOCK  = 5000000  ///< SPI clock (Hz)
+};
+
+/**
+ * @brief Host interface of the PN532
+ */
+enum PN532HostInterface : uint8_t {
+    PN532_HOST_HSU = 0,  ///< High speed UART
+    PN532_HOST_I2C = 1,  ///< I2C, reads start with the status byte
+    PN532_HOST_SPI = 2   ///< SPI, transactions start with a direction byte
+};
+
+/**
+ * @brief SPI direction bytes and the status byte
+ */
+enum PN532HostByte : uint8_t {
+    PN532_SPI_DATA_WRITE  = 0x01,  ///< SPI: host frame follows
+    PN532_SPI_STATUS_READ = 0x02,  ///< SPI: read the status byte
+    PN532_SPI_DATA_READ   = 0x03,  ///< SPI: read the ready frame
+    PN532_STATUS_BUSY     = 0x00,  ///< No frame ready
+    PN532_STATUS_READY    = 0x01   ///< A frame is ready to be read
+};
+
+/**
+ * @brief Activation data of an ISO14443A target
+ */
+struct PN532TargetInfo {
+    uint8_t sensRes[2];                ///< SENS_RES (ATQA)
+    uint8_t selRes;                    ///< SEL_RES (SAK)
+    uint8_t uid[PN532_SIM_UID_SIZE];   ///< NFCID1
+    uint8_t uidLength;                 ///< Length of the NFCID1
+    uint8_t ats[PN532_SIM_ATS_SIZE];   ///< ATS, length byte included
+    uint8_t atsLength;                 ///< Length of the ATS
+};
+
+/**
+ * @brief Counts of the simulated link
+ */
+struct PN532SimulatorStats {
+    uint32_t commands;  ///< Host frames executed
+    uint32_t acks;      ///< ACK frames received from the host
+    uint32_t nacks;     ///< NACK frames received from the host
+    uint32_t errors;    ///< Host frames dropped on a checksum or length error
+    uint32_t timeouts;  ///< Card exchanges that timed out
+};
+
+/**
+ * @brief Card in the field of the simulated PN532
+ */
+class PN532SimulatedCard {
+public:
+    /**
+     * @brief Virtual destructor
+     */
+    virtual ~PN532SimulatedCard() {
+    }
+
+    /**
+     * @brief Activate the card (anticollision, selection and RATS)
+     *
+     * @param target Structure to store the activation data
+     * @return true if a card answered
+     * @return false if the field is empty
+     */
+    virtual bool activate(PN532TargetInfo* target) = 0;
+
+    /**
+     * @brief Exchange an ISO14443-4 information frame with the card
+     *
+     * @param command Command frame
+     * @param length Length of the command
+     * @param response Buffer to store the answer
+     * @param size Size of the buffer
+     * @param time Pointer to variable that will store the card processing time (microseconds)
+     * @return uint16_t Length of the answer, 0 if the card stays silent
+     */
+    virtual uint16_t exchange(const uint8_t* command,
+                              uint16_t       length,
+                              uint8_t*       response,
+                              uint16_t       size,
+                              uint32_t*      time) = 0;
+
+    /**
+     * @brief Change the bit rate (PPS)
+     *
+     * @param kbps Bit rate in kbit/s for both directions
+     * @return true if the card accepted it
+     * @return false otherwise
+     */
+    virtual bool setBitRate(uint16_t kbps) {
+        return kbps == 106;
+    }
+};
+
+/**
+ * @brief DesfireCardEmulator as card of the simulated PN532
+ */
+class PN532EmulatedCard : public PN532SimulatedCard {
+public:
+    /**
+     * @brief Construct the adapter
+     *
+     * @param card Emulated card, must outlive the adapter
+     */
+    explicit PN532EmulatedCard(DesfireCardEmulator& card);
+
+    /**
+     * @brief Activate the emulated card if it is in the field
+     *
+     * @param target Structure to store the activation data
+     * @return true if the card is present
+     * @return false otherwise
+     */
+    virtual bool activate(PN532TargetInfo* target) override;
+
+    /**
+     * @brief Pass a frame to the emulated card
+     *
+     * @param command Command frame
+     * @param length Length of the command
+     * @param response Buffer to store the answer
+     * @param size Size of the buffer
+     * @param time Pointer to variable that will store the card processing time (microseconds)
+     * @return uint16_t Length of the answer, 0 if the card stays silent
+     */
+    virtual uint16_t exchange(const uint8_t* command,
+                              uint16_t       length,
+                              uint8_t*       response,
+                              uint16_t       size,
+                              uint32_t*      time) override;
+
+    /**
+     * @brief Accept any ISO14443A bit rate
+     *
+     * @param kbps Bit rate in kbit/s for both directions
+     * @return true if the bit rate is 106, 212, 424 or 848
+     * @return false otherwise
+     */
+    virtual bool setBitRate(uint16_t kbps) override;
+
+private:
+    /** Emulated card */
+    DesfireCardEmulator& _card;
+};
+
+/**
+ * @brief PN532 host interface simulator
+ *
+ * Commands are executed as soon as their frame is complete; the ACK and the
+ * answer are then ready to be read. Not synchronized.
+ */
+class PN532Simulator {
+public:
+    /**
+     * @brief Construct a simulator
+     *
+     * @param card Card in the field, nullptr for an empty field
+     * @param host Host interface
+     */
+    explicit PN532Simulator(PN532SimulatedCard* card, PN532HostInterface host = PN532_HOST_HSU);
+
+    /**
+     * @brief Set the clock that receives the link and RF time
+     *
+     * @param clock Clock to use, nullptr to spend no time
+     */
+    void setClock(DesfireClock* clock);
+
+    /**
+     * @brief Replace the card in the field
+     *
+     * @param card Card in the field, nullptr for an empty field
+     */
+    void setCard(PN532SimulatedCard* card);
+
+    /**
+     * @brief Reset to the power-up state
+     */
+    void reset();
+
+    /**
+     * @brief Receive bytes from the host (HSU)
+     *
+     * @param data Bytes written by the host
+     * @param length Number of bytes
+     */
+    void write(const uint8_t* data, uint16_t length);
+
+    /**
+     * @brief Send bytes to the host (HSU)
+     *
+     * @param data Buffer to store the bytes
+     * @param size Size of the buffer
+     * @return uint16_t Number of bytes stored, 0 if nothing is pending
+     */
+    uint16_t read(uint8_t* data, uint16_t size);
+
+    /**
+     * @brief Run an I2C write transaction
+     *
+     * @param data Bytes written by the host
+     * @param length Number of bytes
+     */
+    void i2cWrite(const uint8_t* data, uint16_t length);
+
+    /**
+     * @brief Run an I2C read transaction
+     *
+     * The first byte is the status byte. Reading any frame byte consumes
+     * the ready frame, bytes beyond its end read as zero.
+     *
+     * @param data Buffer to store the bytes
+     * @param length Number of bytes read by the host
+     */
+    void i2cRead(uint8_t* data, uint16_t length);
+
+    /**
+     * @brief Run a full-duplex SPI transaction (chip select low to high)
+     *
+     * @param tx Bytes sent by the host, starting with the direction byte
+     * @param rx Buffer to store the bytes returned to the host
+     * @param length Length of the transaction
+     */
+    void spiTransfer(const uint8_t* tx, uint8_t* rx, uint16_t length);
+
+    /**
+     * @brief Check whether a frame is ready (IRQ line low)
+     *
+     * @return true if the ACK or an answer can be read
+     * @return false otherwise
+     */
+    bool isReady() const;
+
+    /**
+     * @brief Get the counts of the link
+     *
+     * @return const PN532SimulatorStats& Counts since the last reset
+     */
+    const PN532SimulatorStats& getStats() const;
+
+    /**
+     * @brief Get the HSU baud rate in use
+     *
+     * @return uint32_t Baud rate
+     */
+    uint32_t getBaudRate() const;
+
+    /**
+     * @brief Get the RF bit rate in use
+     *
+     * @return uint16_t Bit rate in kbit/s
+     */
+    uint16_t getBitRate() const;
+
+private:
+    /** Card in the field */
+    PN532SimulatedCard* _card;
+
+    /** Host interface */
+    PN532HostInterface _host;
+
+    /** Clock that receives the time, nullptr for none */
+    DesfireClock* _clock;
+
+    /** Counts since the last reset */
+    PN532SimulatorStats _stats;
+
+    /** Host frame being received */
+    uint8_t _input[PN532_SIM_FRAME_SIZE];
+
+    /** Number of bytes in _input */
+    uint16_t _inputLength;
+
+    /** Answer frame, kept for a NACK */
+    uint8_t _answer[PN532_SIM_FRAME_SIZE];
+
+    /** Length of the answer frame */
+    uint16_t _answerLength;
+
+    /** Flag indicating an ACK to send */
+    bool _ackPending;
+
+    /** Flag indicating an answer to send */
+    bool _answerPending;
+
+    /** Bytes of the current frame sent over HSU */
+    uint16_t _sent;
+
+    /** Flag indicating an activated target */
+    bool _targetActive;
+
+    /** Activation data of the target */
+    PN532TargetInfo _target;
+
+    /** HSU baud rate */
+    uint32_t _baudRate;
+
+    /** HSU baud rate after the host acknowledges SetSerialBaudRate, 0 if none */
+    uint32_t _nextBaudRate;
+
+    /** RF bit rate in kbit/s */
+    uint16_t _bitRate;
+
+    /** Communication timeout code (RFConfiguration item 02h) */
+    uint8_t _timeoutCode;
+
+    /** Passive activation retries (RFConfiguration item 05h) */
+    uint8_t _passiveRetries;
+
+    /**
+     * @brief Parse one byte from the host
+     *
+     * @param value Byte
+     */
+    void receiveByte(uint8_t value);
+
+    /**
+     * @brief Handle a complete host frame
+     */
+    void handleFrame();
+
+    /**
+     * @brief Execute a command
+     *
+     * @param command Command code and parameters
+     * @param length Length of the command
+     */
+    void execute(const uint8_t* command, uint16_t length);
+
+    /**
+     * @brief Queue an answer frame
+     *
+     * @param code Command code of the answer (command code + 1)
+     * @param data Answer parameters
+     * @param length Length of the parameters
+     */
+    void answer(uint8_t code, const uint8_t* data, uint16_t length);
+
+    /**
+     * @brief Queue the syntax error frame
+     */
+    void answerError();
+
+    /**
+     * @brief Get the frame that is ready to be read
+     *
+     * @param length Pointer to variable that will store the length of the frame
+     * @return const uint8_t* Frame, nullptr if none is ready
+     */
+    const uint8_t* getReadyFrame(uint16_t* length) const;
+
+    /**
+     * @brief Mark the ready frame as read
+     */
+    void consumeFrame();
+
+    /**
+     * @brief Spend time on the clock
+     *
+     * @param duration Time in microseconds
+     */
+    void spend(uint32_t duration);
+
+    /**
+     * @brief Get the communication timeout
+     *
+     * @return uint32_t Longest card response time in microseconds
+     */
+    uint32_t getTimeout() const;
+
+    /**
+     * @brief Get the time to move bytes over the host link
+     *
+     * @param bytes Number of bytes
+     * @return uint32_t Time in microseconds
+     */
+    uint32_t getLinkTime(uint32_t bytes) const;
+
+    /**
+     * @brief Get the RF time of a frame
+     *
+     * @param length Length of the frame data
+     * @return uint32_t Time in microseconds at the current bit rate
+     */
+    uint32_t getFrameTime(uint16_t length) const;
+};
+
+#endif  // PN532_SIMULATOR_H
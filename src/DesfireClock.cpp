@@ -0,0 +1,95 @@
+/**
+ * @file DesfireClock.cpp
+ * @brief Implementation of the system and virtual clocks
+ */
+
+#include "DesfireClock.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <time.h>
+#endif
+
+/**
+ * @brief Get the time of a monotonic microsecond clock
+ *
+ * @return uint32_t Time in microseconds, wrapping around
+ */
+uint32_t DesfireSystemClock::micros() {
+#ifdef ARDUINO
+    return ::micros();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint32_t>(now.tv_sec * 1000000ULL + now.tv_nsec / 1000);
+#endif
+}
+
+/**
+ * @brief Wait for a time
+ *
+ * @param duration Time to wait in microseconds
+ */
+void DesfireSystemClock::delayMicros(uint32_t duration) {
+#ifdef ARDUINO
+    delayMicroseconds(duration);
+#else
+    struct timespec wait;
+    wait.tv_sec  = duration / 1000000;
+    wait.tv_nsec = static_cast<long>(duration % 1000000) * 1000;
+    while (nanosleep(&wait, &wait) != 0) {
+        // Interrupted, sleep for the remaining time
+    }
+#endif
+}
+
+/**
+ * @brief Get the shared system clock
+ *
+ * @return DesfireSystemClock& System clock
+ */
+DesfireSystemClock& DesfireSystemClock::instance() {
+    static DesfireSystemClock clock;
+    return clock;
+}
+
+/**
+ * @brief Construct a clock starting at zero
+ */
+DesfireVirtualClock::DesfireVirtualClock() : _now(0) {
+}
+
+/**
+ * @brief Get the simulated time
+ *
+ * @return uint32_t Time in microseconds, wrapping around
+ */
+uint32_t DesfireVirtualClock::micros() {
+    return static_cast<uint32_t>(_now);
+}
+
+/**
+ * @brief Advance the clock without waiting
+ *
+ * @param duration Time to add in microseconds
+ */
+void DesfireVirtualClock::delayMicros(uint32_t duration) {
+    _now += duration;
+}
+
+/**
+ * @brief Get the time elapsed since the clock was started or reset
+ *
+ * @return uint64_t Simulated time in microseconds
+ */
+uint64_t DesfireVirtualClock::getElapsed() const {
+    return _now;
+}
+
+/**
+ * @brief Restart the clock at zero
+ */
+void DesfireVirtualClock::reset() {
+    _now = 0;
+}
@@ -0,0 +1,991 @@
+/**
+ * @file DesfireCrypto.cpp
+ * @brief Implementation of AES-128 and AES-CMAC
+ *
+ * Portable byte-oriented AES (FIPS-197) using S-box lookups, and on host
+ * builds a hardware path with AES-NI or the ARMv8 crypto extensions. The
+ * hardware functions are compiled with a target attribute, so the rest of
+ * the library needs no special compiler flags and still runs on CPUs
+ * without AES instructions.
+ */
+
+#include "DesfireCrypto.h"
+
+#include <string.h>
+
+#if DF_AES_HARDWARE
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <wmmintrin.h>
+#else
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_AES
+#define HWCAP_AES (1 << 3)
+#endif
+#endif
+#endif
+
+static const uint8_t AES_SBOX[256] = {
+    0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+    0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0, 0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+    0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+    0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+    0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0, 0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+    0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+    0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+    0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5, 0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+    0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+    0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+    0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C, 0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+    0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+    0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+    0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E, 0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+    0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+    0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16};
+
+static const uint8_t AES_INV_SBOX[256] = {
+    0x52, 0x09, 0x6A, 0xD5, 0x30, 0x36, 0xA5, 0x38, 0xBF, 0x40, 0xA3, 0x9E, 0x81, 0xF3, 0xD7, 0xFB,
+    0x7C, 0xE3, 0x39, 0x82, 0x9B, 0x2F, 0xFF, 0x87, 0x34, 0x8E, 0x43, 0x44, 0xC4, 0xDE, 0xE9, 0xCB,
+    0x54, 0x7B, 0x94, 0x32, 0xA6, 0xC2, 0x23, 0x3D, 0xEE, 0x4C, 0x95, 0x0B, 0x42, 0xFA, 0xC3, 0x4E,
+    0x08, 0x2E, 0xA1, 0x66, 0x28, 0xD9, 0x24, 0xB2, 0x76, 0x5B, 0xA2, 0x49, 0x6D, 0x8B, 0xD1, 0x25,
+    0x72, 0xF8, 0xF6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xD4, 0xA4, 0x5C, 0xCC, 0x5D, 0x65, 0xB6, 0x92,
+    0x6C, 0x70, 0x48, 0x50, 0xFD, 0xED, 0xB9, 0xDA, 0x5E, 0x15, 0x46, 0x57, 0xA7, 0x8D, 0x9D, 0x84,
+    0x90, 0xD8, 0xAB, 0x00, 0x8C, 0xBC, 0xD3, 0x0A, 0xF7, 0xE4, 0x58, 0x05, 0xB8, 0xB3, 0x45, 0x06,
+    0xD0, 0x2C, 0x1E, 0x8F, 0xCA, 0x3F, 0x0F, 0x02, 0xC1, 0xAF, 0xBD, 0x03, 0x01, 0x13, 0x8A, 0x6B,
+    0x3A, 0x91, 0x11, 0x41, 0x4F, 0x67, 0xDC, 0xEA, 0x97, 0xF2, 0xCF, 0xCE, 0xF0, 0xB4, 0xE6, 0x73,
+    0x96, 0xAC, 0x74, 0x22, 0xE7, 0xAD, 0x35, 0x85, 0xE2, 0xF9, 0x37, 0xE8, 0x1C, 0x75, 0xDF, 0x6E,
+    0x47, 0xF1, 0x1A, 0x71, 0x1D, 0x29, 0xC5, 0x89, 0x6F, 0xB7, 0x62, 0x0E, 0xAA, 0x18, 0xBE, 0x1B,
+    0xFC, 0x56, 0x3E, 0x4B, 0xC6, 0xD2, 0x79, 0x20, 0x9A, 0xDB, 0xC0, 0xFE, 0x78, 0xCD, 0x5A, 0xF4,
+    0x1F, 0xDD, 0xA8, 0x33, 0x88, 0x07, 0xC7, 0x31, 0xB1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xEC, 0x5F,
+    0x60, 0x51, 0x7F, 0xA9, 0x19, 0xB5, 0x4A, 0x0D, 0x2D, 0xE5, 0x7A, 0x9F, 0x93, 0xC9, 0x9C, 0xEF,
+    0xA0, 0xE0, 0x3B, 0x4D, 0xAE, 0x2A, 0xF5, 0xB0, 0xC8, 0xEB, 0xBB, 0x3C, 0x83, 0x53, 0x99, 0x61,
+    0x17, 0x2B, 0x04, 0x7E, 0xBA, 0x77, 0xD6, 0x26, 0xE1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0C, 0x7D};
+
+static const uint8_t AES_RCON[DF_AES_ROUNDS] = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36};
+
+static inline uint8_t xtime(uint8_t x) {
+    return static_cast<uint8_t>((x << 1) ^ ((x & 0x80) ? 0x1B : 0x00));
+}
+
+static inline uint8_t gmul(uint8_t a, uint8_t b) {
+    uint8_t result = 0;
+    while (b) {
+        if (b & 1) {
+            result ^= a;
+        }
+        a = xtime(a);
+        b >>= 1;
+    }
+    return result;
+}
+
+#if DF_AES_HARDWARE
+
+#if defined(__x86_64__)
+#define DF_AES_TARGET __attribute__((target("aes,sse2")))
+
+typedef __m128i AESBlock;
+
+DF_AES_TARGET static inline AESBlock loadBlock(const uint8_t* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+DF_AES_TARGET static inline void storeBlock(uint8_t* p, AESBlock block) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), block);
+}
+
+DF_AES_TARGET static inline AESBlock xorBlock(AESBlock a, AESBlock b) {
+    return _mm_xor_si128(a, b);
+}
+
+DF_AES_TARGET static inline AESBlock invMixColumns(AESBlock block) {
+    return _mm_aesimc_si128(block);
+}
+
+/**
+ * @brief Encrypt LANES blocks, interleaving the rounds to hide the latency of AESENC
+ */
+template <int LANES>
+DF_AES_TARGET static inline void encryptLanes(AESBlock* s, const uint8_t* keys) {
+    AESBlock key = loadBlock(keys);
+    for (int l = 0; l < LANES; l++) {
+        s[l] = _mm_xor_si128(s[l], key);
+    }
+    for (int round = 1; round < DF_AES_ROUNDS; round++) {
+        key = loadBlock(&keys[round * DF_AES_BLOCK_SIZE]);
+        for (int l = 0; l < LANES; l++) {
+            s[l] = _mm_aesenc_si128(s[l], key);
+        }
+    }
+    key = loadBlock(&keys[DF_AES_ROUNDS * DF_AES_BLOCK_SIZE]);
+    for (int l = 0; l < LANES; l++) {
+        s[l] = _mm_aesenclast_si128(s[l], key);
+    }
+}
+
+/**
+ * @brief Encrypt LANES blocks, each under its own round keys
+ */
+template <int LANES>
+DF_AES_TARGET static inline void encryptLanesEach(AESBlock* s, const uint8_t* const* keys) {
+    for (int l = 0; l < LANES; l++) {
+        s[l] = _mm_xor_si128(s[l], loadBlock(keys[l]));
+    }
+    for (int round = 1; round < DF_AES_ROUNDS; round++) {
+        for (int l = 0; l < LANES; l++) {
+            s[l] = _mm_aesenc_si128(s[l], loadBlock(&keys[l][round * DF_AES_BLOCK_SIZE]));
+        }
+    }
+    for (int l = 0; l < LANES; l++) {
+        s[l] = _mm_aesenclast_si128(s[l], loadBlock(&keys[l][DF_AES_ROUNDS * DF_AES_BLOCK_SIZE]));
+    }
+}
+
+/**
+ * @brief Decrypt LANES blocks with the equivalent inverse cipher keys
+ */
+template <int LANES>
+DF_AES_TARGET static inline void decryptLanes(AESBlock* s, const uint8_t* keys) {
+    AESBlock key = loadBlock(keys);
+    for (int l = 0; l < LANES; l++) {
+        s[l] = _mm_xor_si128(s[l], key);
+    }
+    for (int round = 1; round < DF_AES_ROUNDS; round++) {
+        key = loadBlock(&keys[round * DF_AES_BLOCK_SIZE]);
+        for (int l = 0; l < LANES; l++) {
+            s[l] = _mm_aesdec_si128(s[l], key);
+        }
+    }
+    key = loadBlock(&keys[DF_AES_ROUNDS * DF_AES_BLOCK_SIZE]);
+    for (int l = 0; l < LANES; l++) {
+        s[l] = _mm_aesdeclast_si128(s[l], key);
+    }
+}
+
+/**
+ * @brief Check the CPU for AES-NI
+ */
+static bool detectHardware() {
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_AES);
+}
+
+#else
+#ifdef __clang__
+#define DF_AES_TARGET __attribute__((target("crypto")))
+#else
+#define DF_AES_TARGET __attribute__((target("+crypto")))
+#endif
+
+typedef uint8x16_t AESBlock;
+
+DF_AES_TARGET static inline AESBlock loadBlock(const uint8_t* p) {
+    return vld1q_u8(p);
+}
+
+DF_AES_TARGET static inline void storeBlock(uint8_t* p, AESBlock block) {
+    vst1q_u8(p, block);
+}
+
+DF_AES_TARGET static inline AESBlock xorBlock(AESBlock a, AESBlock b) {
+    return veorq_u8(a, b);
+}
+
+DF_AES_TARGET static inline AESBlock invMixColumns(AESBlock block) {
+    return vaesimcq_u8(block);
+}
+
+/**
+ * @brief Encrypt LANES blocks, interleaving the rounds to hide the latency of AESE
+ *
+ * AESE adds the round key before SubBytes, so the last key is added apart.
+ */
+template <int LANES>
+DF_AES_TARGET static inline void encryptLanes(AESBlock* s, const uint8_t* keys) {
+    for (int round = 0; round < DF_AES_ROUNDS - 1; round++) {
+        AESBlock key = loadBlock(&keys[round * DF_AES_BLOCK_SIZE]);
+        for (int l = 0; l < LANES; l++) {
+            s[l] = vaesmcq_u8(vaeseq_u8(s[l], key));
+        }
+    }
+    AESBlock key  = loadBlock(&keys[(DF_AES_ROUNDS - 1) * DF_AES_BLOCK_SIZE]);
+    AESBlock last = loadBlock(&keys[DF_AES_ROUNDS * DF_AES_BLOCK_SIZE]);
+    for (int l = 0; l < LANES; l++) {
+        s[l] = veorq_u8(vaeseq_u8(s[l], key), last);
+    }
+}
+
+/**
+ * @brief Encrypt LANES blocks, each under its own round keys
+ */
+template <int LANES>
+DF_AES_TARGET static inline void encryptLanesEach(AESBlock* s, const uint8_t* const* keys) {
+    for (int round = 0; round < DF_AES_ROUNDS - 1; round++) {
+        for (int l = 0; l < LANES; l++) {
+            AESBlock key = loadBlock(&keys[l][round * DF_AES_BLOCK_SIZE]);
+            s[l]         = vaesmcq_u8(vaeseq_u8(s[l], key));
+        }
+    }
+    for (int l = 0; l < LANES; l++) {
+        AESBlock key  = loadBlock(&keys[l][(DF_AES_ROUNDS - 1) * DF_AES_BLOCK_SIZE]);
+        AESBlock last = loadBlock(&keys[l][DF_AES_ROUNDS * DF_AES_BLOCK_SIZE]);
+        s[l]          = veorq_u8(vaeseq_u8(s[l], key), last);
+    }
+}
+
+/**
+ * @brief Decrypt LANES blocks with the equivalent inverse cipher keys
+ */
+template <int LANES>
+DF_AES_TARGET static inline void decryptLanes(AESBlock* s, const uint8_t* keys) {
+    for (int round = 0; round < DF_AES_ROUNDS - 1; round++) {
+        AESBlock key = loadBlock(&keys[round * DF_AES_BLOCK_SIZE]);
+        for (int l = 0; l < LANES; l++) {
+            s[l] = vaesimcq_u8(vaesdq_u8(s[l], key));
+        }
+    }
+    AESBlock key  = loadBlock(&keys[(DF_AES_ROUNDS - 1) * DF_AES_BLOCK_SIZE]);
+    AESBlock last = loadBlock(&keys[DF_AES_ROUNDS * DF_AES_BLOCK_SIZE]);
+    for (int l = 0; l < LANES; l++) {
+        s[l] = veorq_u8(vaesdq_u8(s[l], key), last);
+    }
+}
+
+/**
+ * @brief Check the CPU for the ARMv8 AES instructions
+ */
+static bool detectHardware() {
+    return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+}
+#endif
+
+/** Blocks processed in parallel by the hardware path */
+#define AES_HW_LANES 4
+
+/**
+ * @brief Derive the equivalent inverse cipher keys from the round keys
+ *
+ * The keys are used in reverse order, with InvMixColumns applied to all
+ * but the first and the last.
+ */
+DF_AES_TARGET static void hwExpandDecryptKeys(const uint8_t* roundKeys, uint8_t* decryptKeys) {
+    storeBlock(decryptKeys, loadBlock(&roundKeys[DF_AES_ROUNDS * DF_AES_BLOCK_SIZE]));
+    for (uint8_t round = 1; round < DF_AES_ROUNDS; round++) {
+        AESBlock key = loadBlock(&roundKeys[(DF_AES_ROUNDS - round) * DF_AES_BLOCK_SIZE]);
+        storeBlock(&decryptKeys[round * DF_AES_BLOCK_SIZE], invMixColumns(key));
+    }
+    storeBlock(&decryptKeys[DF_AES_ROUNDS * DF_AES_BLOCK_SIZE], loadBlock(roundKeys));
+}
+
+DF_AES_TARGET static void hwEncryptBlocks(const uint8_t* keys,
+                                          const uint8_t* input,
+                                          uint8_t*       output,
+                                          size_t         count) {
+    AESBlock s[AES_HW_LANES];
+
+    for (; count >= AES_HW_LANES; count -= AES_HW_LANES) {
+        for (int l = 0; l < AES_HW_LANES; l++) {
+            s[l] = loadBlock(&input[l * DF_AES_BLOCK_SIZE]);
+        }
+        encryptLanes<AES_HW_LANES>(s, keys);
+        for (int l = 0; l < AES_HW_LANES; l++) {
+            storeBlock(&output[l * DF_AES_BLOCK_SIZE], s[l]);
+        }
+        input += AES_HW_LANES * DF_AES_BLOCK_SIZE;
+        output += AES_HW_LANES * DF_AES_BLOCK_SIZE;
+    }
+
+    for (; count > 0; count--) {
+        s[0] = loadBlock(input);
+        encryptLanes<1>(s, keys);
+        storeBlock(output, s[0]);
+        input += DF_AES_BLOCK_SIZE;
+        output += DF_AES_BLOCK_SIZE;
+    }
+}
+
+/**
+ * @brief Encrypt block i with round keys i, several blocks in parallel
+ */
+DF_AES_TARGET static void hwEncryptEach(const uint8_t* const* keys,
+                                        const uint8_t*        input,
+                                        uint8_t*              output,
+                                        size_t                count) {
+    AESBlock s[AES_HW_LANES];
+
+    for (; count >= AES_HW_LANES; count -= AES_HW_LANES) {
+        for (int l = 0; l < AES_HW_LANES; l++) {
+            s[l] = loadBlock(&input[l * DF_AES_BLOCK_SIZE]);
+        }
+        encryptLanesEach<AES_HW_LANES>(s, keys);
+        for (int l = 0; l < AES_HW_LANES; l++) {
+            storeBlock(&output[l * DF_AES_BLOCK_SIZE], s[l]);
+        }
+        keys += AES_HW_LANES;
+        input += AES_HW_LANES * DF_AES_BLOCK_SIZE;
+        output += AES_HW_LANES * DF_AES_BLOCK_SIZE;
+    }
+
+    for (; count > 0; count--) {
+        s[0] = loadBlock(input);
+        encryptLanesEach<1>(s, keys);
+        storeBlock(output, s[0]);
+        keys++;
+        input += DF_AES_BLOCK_SIZE;
+        output += DF_AES_BLOCK_SIZE;
+    }
+}
+
+DF_AES_TARGET static void hwDecryptBlock(const uint8_t* keys,
+                                         const uint8_t* input,
+                                         uint8_t*       output) {
+    AESBlock s = loadBlock(input);
+    decryptLanes<1>(&s, keys);
+    storeBlock(output, s);
+}
+
+DF_AES_TARGET static void hwEncryptCBC(const uint8_t* keys,
+                                       uint8_t*       iv,
+                                       const uint8_t* input,
+                                       uint8_t*       output,
+                                       size_t         length) {
+    AESBlock chain = loadBlock(iv);
+
+    for (size_t offset = 0; offset < length; offset += DF_AES_BLOCK_SIZE) {
+        chain = xorBlock(chain, loadBlock(&input[offset]));
+        encryptLanes<1>(&chain, keys);
+        storeBlock(&output[offset], chain);
+    }
+
+    storeBlock(iv, chain);
+}
+
+/**
+ * @brief Decrypt in CBC mode, several blocks in parallel
+ *
+ * The ciphertext blocks are loaded before the plaintext is stored, so the
+ * output may equal the input.
+ */
+DF_AES_TARGET static void hwDecryptCBC(const uint8_t* keys,
+                                       uint8_t*       iv,
+                                       const uint8_t* input,
+                                       uint8_t*       output,
+                                       size_t         length) {
+    AESBlock chain = loadBlock(iv);
+    AESBlock c[AES_HW_LANES];
+    AESBlock s[AES_HW_LANES];
+    size_t   offset = 0;
+
+    for (; length - offset >= AES_HW_LANES * DF_AES_BLOCK_SIZE;
+         offset += AES_HW_LANES * DF_AES_BLOCK_SIZE) {
+        for (int l = 0; l < AES_HW_LANES; l++) {
+            c[l] = loadBlock(&input[offset + l * DF_AES_BLOCK_SIZE]);
+            s[l] = c[l];
+        }
+        decryptLanes<AES_HW_LANES>(s, keys);
+        for (int l = 0; l < AES_HW_LANES; l++) {
+            storeBlock(&output[offset + l * DF_AES_BLOCK_SIZE], xorBlock(s[l], chain));
+            chain = c[l];
+        }
+    }
+
+    for (; offset < length; offset += DF_AES_BLOCK_SIZE) {
+        c[0] = loadBlock(&input[offset]);
+        s[0] = c[0];
+        decryptLanes<1>(s, keys);
+        storeBlock(&output[offset], xorBlock(s[0], chain));
+        chain = c[0];
+    }
+
+    storeBlock(iv, chain);
+}
+
+/** Hardware path enabled by setAccelerated() */
+static bool hardwareEnabled = true;
+
+/**
+ * @brief Check once whether the CPU has AES instructions
+ *
+ * A function-local static, so that ciphers constructed during static
+ * initialization see the detected value.
+ */
+static bool hardwareSupported() {
+    static const bool supported = detectHardware();
+    return supported;
+}
+
+static inline bool useHardware() {
+    return hardwareEnabled && hardwareSupported();
+}
+#endif
+
+/**
+ * @brief Construct a cipher without a key
+ */
+DesfireAES::DesfireAES() {
+    memset(_roundKeys, 0, sizeof(_roundKeys));
+#if DF_AES_HARDWARE
+    memset(_decryptKeys, 0, sizeof(_decryptKeys));
+#endif
+}
+
+/**
+ * @brief Construct a cipher and set its key
+ *
+ * @param key AES-128 key (16 bytes)
+ */
+DesfireAES::DesfireAES(const uint8_t* key) {
+    setKey(key);
+}
+
+/**
+ * @brief Destroy the cipher, wiping the expanded key
+ */
+DesfireAES::~DesfireAES() {
+    clear();
+}
+
+/**
+ * @brief Wipe the expanded key
+ */
+void DesfireAES::clear() {
+    wipe(_roundKeys, sizeof(_roundKeys));
+#if DF_AES_HARDWARE
+    wipe(_decryptKeys, sizeof(_decryptKeys));
+#endif
+}
+
+/**
+ * @brief Set the key and expand the key schedule
+ *
+ * @param key AES-128 key (16 bytes)
+ */
+void DesfireAES::setKey(const uint8_t* key) {
+    memcpy(_roundKeys, key, DF_AES_KEY_SIZE);
+
+    for (uint8_t i = 4; i < 4 * (DF_AES_ROUNDS + 1); i++) {
+        uint8_t temp[4];
+        memcpy(temp, &_roundKeys[(i - 1) * 4], 4);
+
+        if (i % 4 == 0) {
+            // RotWord, SubWord, Rcon
+            uint8_t t = temp[0];
+            temp[0]   = AES_SBOX[temp[1]] ^ AES_RCON[i / 4 - 1];
+            temp[1]   = AES_SBOX[temp[2]];
+            temp[2]   = AES_SBOX[temp[3]];
+            temp[3]   = AES_SBOX[t];
+        }
+
+        for (uint8_t j = 0; j < 4; j++) {
+            _roundKeys[i * 4 + j] = _roundKeys[(i - 4) * 4 + j] ^ temp[j];
+        }
+    }
+
+#if DF_AES_HARDWARE
+    // Prepared whenever the CPU supports it, so setAccelerated() can switch at any time
+    if (hardwareSupported()) {
+        hwExpandDecryptKeys(_roundKeys, _decryptKeys);
+    }
+#endif
+}
+
+/**
+ * @brief Encrypt a single block
+ *
+ * @param input Plaintext block (16 bytes)
+ * @param output Ciphertext block (16 bytes, may equal input)
+ */
+void DesfireAES::encryptBlock(const uint8_t* input, uint8_t* output) const {
+#if DF_AES_HARDWARE
+    if (useHardware()) {
+        hwEncryptBlocks(_roundKeys, input, output, 1);
+        return;
+    }
+#endif
+
+    uint8_t s[DF_AES_BLOCK_SIZE];
+
+    for (uint8_t i = 0; i < DF_AES_BLOCK_SIZE; i++) {
+        s[i] = input[i] ^ _roundKeys[i];
+    }
+
+    for (uint8_t round = 1; round <= DF_AES_ROUNDS; round++) {
+        // SubBytes and ShiftRows (state is column-major: s[col * 4 + row])
+        uint8_t t[DF_AES_BLOCK_SIZE];
+        for (uint8_t col = 0; col < 4; col++) {
+            for (uint8_t row = 0; row < 4; row++) {
+                t[col * 4 + row] = AES_SBOX[s[((col + row) % 4) * 4 + row]];
+            }
+        }
+
+        // MixColumns (skipped in the final round)
+        if (round != DF_AES_ROUNDS) {
+            for (uint8_t col = 0; col < 4; col++) {
+                uint8_t* c   = &t[col * 4];
+                uint8_t  all = c[0] ^ c[1] ^ c[2] ^ c[3];
+                uint8_t  c0  = c[0];
+                c[0] ^= all ^ xtime(c[0] ^ c[1]);
+                c[1] ^= all ^ xtime(c[1] ^ c[2]);
+                c[2] ^= all ^ xtime(c[2] ^ c[3]);
+                c[3] ^= all ^ xtime(c[3] ^ c0);
+            }
+        }
+
+        // AddRoundKey
+        const uint8_t* roundKey = &_roundKeys[round * DF_AES_BLOCK_SIZE];
+        for (uint8_t i = 0; i < DF_AES_BLOCK_SIZE; i++) {
+            s[i] = t[i] ^ roundKey[i];
+        }
+    }
+
+    memcpy(output, s, DF_AES_BLOCK_SIZE);
+}
+
+/**
+ * @brief Decrypt a single block
+ *
+ * @param input Ciphertext block (16 bytes)
+ * @param output Plaintext block (16 bytes, may equal input)
+ */
+void DesfireAES::decryptBlock(const uint8_t* input, uint8_t* output) const {
+#if DF_AES_HARDWARE
+    if (useHardware()) {
+        hwDecryptBlock(_decryptKeys, input, output);
+        return;
+    }
+#endif
+
+    uint8_t s[DF_AES_BLOCK_SIZE];
+
+    const uint8_t* lastKey = &_roundKeys[DF_AES_ROUNDS * DF_AES_BLOCK_SIZE];
+    for (uint8_t i = 0; i < DF_AES_BLOCK_SIZE; i++) {
+        s[i] = input[i] ^ lastKey[i];
+    }
+
+    for (int8_t round = DF_AES_ROUNDS - 1; round >= 0; round--) {
+        // InvShiftRows and InvSubBytes
+        uint8_t t[DF_AES_BLOCK_SIZE];
+        for (uint8_t col = 0; col < 4; col++) {
+            for (uint8_t row = 0; row < 4; row++) {
+                t[((col + row) % 4) * 4 + row] = AES_INV_SBOX[s[col * 4 + row]];
+            }
+        }
+
+        // AddRoundKey
+        const uint8_t* roundKey = &_roundKeys[round * DF_AES_BLOCK_SIZE];
+        for (uint8_t i = 0; i < DF_AES_BLOCK_SIZE; i++) {
+            t[i] ^= roundKey[i];
+        }
+
+        // InvMixColumns (skipped after the last round key)
+        if (round != 0) {
+            for (uint8_t col = 0; col < 4; col++) {
+                uint8_t* c = &t[col * 4];
+                uint8_t  a0 = c[0], a1 = c[1], a2 = c[2], a3 = c[3];
+                c[0] = gmul(a0, 0x0E) ^ gmul(a1, 0x0B) ^ gmul(a2, 0x0D) ^ gmul(a3, 0x09);
+                c[1] = gmul(a0, 0x09) ^ gmul(a1, 0x0E) ^ gmul(a2, 0x0B) ^ gmul(a3, 0x0D);
+                c[2] = gmul(a0, 0x0D) ^ gmul(a1, 0x09) ^ gmul(a2, 0x0E) ^ gmul(a3, 0x0B);
+                c[3] = gmul(a0, 0x0B) ^ gmul(a1, 0x0D) ^ gmul(a2, 0x09) ^ gmul(a3, 0x0E);
+            }
+        }
+
+        memcpy(s, t, DF_AES_BLOCK_SIZE);
+    }
+
+    memcpy(output, s, DF_AES_BLOCK_SIZE);
+}
+
+/**
+ * @brief Encrypt in CBC mode
+ *
+ * @param iv Initialization vector (16 bytes), updated to the last ciphertext block
+ * @param input Plaintext, length must be a multiple of 16
+ * @param output Ciphertext buffer (may equal input)
+ * @param length Length in bytes
+ * @return true if the data was encrypted
+ * @return false if the length is not block aligned
+ */
+bool DesfireAES::encryptCBC(uint8_t*       iv,
+                            const uint8_t* input,
+                            uint8_t*       output,
+                            size_t         length) const {
+    if (length % DF_AES_BLOCK_SIZE) {
+        return false;
+    }
+
+#if DF_AES_HARDWARE
+    if (useHardware()) {
+        hwEncryptCBC(_roundKeys, iv, input, output, length);
+        return true;
+    }
+#endif
+
+    for (size_t offset = 0; offset < length; offset += DF_AES_BLOCK_SIZE) {
+        for (uint8_t i = 0; i < DF_AES_BLOCK_SIZE; i++) {
+            iv[i] ^= input[offset + i];
+        }
+        encryptBlock(iv, iv);
+        memcpy(&output[offset], iv, DF_AES_BLOCK_SIZE);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Decrypt in CBC mode
+ *
+ * @param iv Initialization vector (16 bytes), updated to the last ciphertext block
+ * @param input Ciphertext, length must be a multiple of 16
+ * @param output Plaintext buffer (may equal input)
+ * @param length Length in bytes
+ * @return true if the data was decrypted
+ * @return false if the length is not block aligned
+ */
+bool DesfireAES::decryptCBC(uint8_t*       iv,
+                            const uint8_t* input,
+                            uint8_t*       output,
+                            size_t         length) const {
+    if (length % DF_AES_BLOCK_SIZE) {
+        return false;
+    }
+
+#if DF_AES_HARDWARE
+    if (useHardware()) {
+        hwDecryptCBC(_decryptKeys, iv, input, output, length);
+        return true;
+    }
+#endif
+
+    for (size_t offset = 0; offset < length; offset += DF_AES_BLOCK_SIZE) {
+        uint8_t block[DF_AES_BLOCK_SIZE];
+        memcpy(block, &input[offset], DF_AES_BLOCK_SIZE);
+        decryptBlock(block, &output[offset]);
+        for (uint8_t i = 0; i < DF_AES_BLOCK_SIZE; i++) {
+            output[offset + i] ^= iv[i];
+        }
+        memcpy(iv, block, DF_AES_BLOCK_SIZE);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Encrypt independent blocks
+ *
+ * @param input Plaintext blocks
+ * @param output Ciphertext blocks (may equal input)
+ * @param count Number of blocks
+ */
+void DesfireAES::encryptBlocks(const uint8_t* input, uint8_t* output, size_t count) const {
+#if DF_AES_HARDWARE
+    if (useHardware()) {
+        hwEncryptBlocks(_roundKeys, input, output, count);
+        return;
+    }
+#endif
+
+    for (size_t i = 0; i < count; i++) {
+        encryptBlock(&input[i * DF_AES_BLOCK_SIZE], &output[i * DF_AES_BLOCK_SIZE]);
+    }
+}
+
+/**
+ * @brief Encrypt independent blocks, each under its own key
+ *
+ * @param ciphers Cipher of every block
+ * @param input Plaintext blocks
+ * @param output Ciphertext blocks (may equal input)
+ * @param count Number of blocks
+ */
+void DesfireAES::encryptEach(const DesfireAES* const* ciphers,
+                             const uint8_t*           input,
+                             uint8_t*                 output,
+                             size_t                   count) {
+#if DF_AES_HARDWARE
+    if (useHardware()) {
+        const uint8_t* keys[AES_HW_LANES];
+        while (count > 0) {
+            size_t lanes = (count < AES_HW_LANES) ? count : AES_HW_LANES;
+            for (size_t l = 0; l < lanes; l++) {
+                keys[l] = ciphers[l]->_roundKeys;
+            }
+            hwEncryptEach(keys, input, output, lanes);
+            ciphers += lanes;
+            input += lanes * DF_AES_BLOCK_SIZE;
+            output += lanes * DF_AES_BLOCK_SIZE;
+            count -= lanes;
+        }
+        return;
+    }
+#endif
+
+    for (size_t i = 0; i < count; i++) {
+        ciphers[i]->encryptBlock(&input[i * DF_AES_BLOCK_SIZE], &output[i * DF_AES_BLOCK_SIZE]);
+    }
+}
+
+/**
+ * @brief Check whether the hardware path is in use
+ *
+ * @return true if blocks are processed with AES instructions
+ * @return false if the portable implementation is used
+ */
+bool DesfireAES::isAccelerated() {
+#if DF_AES_HARDWARE
+    return useHardware();
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Enable or disable the hardware path
+ *
+ * @param enabled Use AES instructions when the CPU supports them
+ * @return true if the hardware path is now in use
+ * @return false if the portable implementation is used
+ */
+bool DesfireAES::setAccelerated(bool enabled) {
+#if DF_AES_HARDWARE
+    hardwareEnabled = enabled;
+#else
+    (void)enabled;
+#endif
+    return isAccelerated();
+}
+
+/**
+ * @brief Clear a buffer holding key material
+ *
+ * @param buffer Buffer to clear
+ * @param length Length of the buffer
+ */
+void DesfireAES::wipe(void* buffer, size_t length) {
+    volatile uint8_t* p = static_cast<volatile uint8_t*>(buffer);
+    while (length--) {
+        *p++ = 0;
+    }
+}
+
+/**
+ * @brief Double a block in GF(2^128) (CMAC subkey generation)
+ */
+static void cmacDouble(uint8_t* block) {
+    uint8_t carry = block[0] & 0x80;
+    for (uint8_t i = 0; i < DF_AES_BLOCK_SIZE - 1; i++) {
+        block[i] = static_cast<uint8_t>((block[i] << 1) | (block[i + 1] >> 7));
+    }
+    block[DF_AES_BLOCK_SIZE - 1] = static_cast<uint8_t>(block[DF_AES_BLOCK_SIZE - 1] << 1);
+    if (carry) {
+        block[DF_AES_BLOCK_SIZE - 1] ^= 0x87;
+    }
+}
+
+/**
+ * @brief Start a CMAC computation
+ *
+ * @param cipher Cipher holding the MAC key, must outlive this object
+ */
+DesfireCMAC::DesfireCMAC(const DesfireAES& cipher) : _cipher(cipher), _buffered(0) {
+    memset(_state, 0, sizeof(_state));
+    memset(_buffer, 0, sizeof(_buffer));
+}
+
+/**
+ * @brief Destroy the CMAC state, wiping intermediate values
+ */
+DesfireCMAC::~DesfireCMAC() {
+    DesfireAES::wipe(_state, sizeof(_state));
+    DesfireAES::wipe(_buffer, sizeof(_buffer));
+}
+
+/**
+ * @brief Add data to the MAC
+ *
+ * @param data Data to add
+ * @param length Length of the data
+ */
+void DesfireCMAC::update(const uint8_t* data, size_t length) {
+    while (length > 0) {
+        // The last block is held back until finish() knows whether it is complete
+        if (_buffered == DF_AES_BLOCK_SIZE) {
+            for (uint8_t i = 0; i < DF_AES_BLOCK_SIZE; i++) {
+                _state[i] ^= _buffer[i];
+            }
+            _cipher.encryptBlock(_state, _state);
+            _buffered = 0;
+        }
+
+        size_t chunk = DF_AES_BLOCK_SIZE - _buffered;
+        if (chunk > length) {
+            chunk = length;
+        }
+        memcpy(&_buffer[_buffered], data, chunk);
+        _buffered += static_cast<uint8_t>(chunk);
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+/**
+ * @brief Finish the computation
+ *
+ * @param mac Buffer to store the full CMAC (16 bytes)
+ */
+void DesfireCMAC::finish(uint8_t* mac) {
+    uint8_t subkey1[DF_AES_BLOCK_SIZE];
+    uint8_t subkey2[DF_AES_BLOCK_SIZE];
+    deriveSubkeys(_cipher, subkey1, subkey2);
+
+    const uint8_t* subkey = subkey1;
+    if (_buffered < DF_AES_BLOCK_SIZE) {
+        subkey             = subkey2;
+        _buffer[_buffered] = 0x80;
+        memset(&_buffer[_buffered + 1], 0, DF_AES_BLOCK_SIZE - _buffered - 1);
+    }
+
+    for (uint8_t i = 0; i < DF_AES_BLOCK_SIZE; i++) {
+        _state[i] ^= _buffer[i] ^ subkey[i];
+    }
+    _cipher.encryptBlock(_state, mac);
+
+    DesfireAES::wipe(subkey1, sizeof(subkey1));
+    DesfireAES::wipe(subkey2, sizeof(subkey2));
+    memset(_state, 0, sizeof(_state));
+    _buffered = 0;
+}
+
+/**
+ * @brief Compute the CMAC of a message in one call
+ *
+ * @param cipher Cipher holding the MAC key
+ * @param data Message
+ * @param length Length of the message
+ * @param mac Buffer to store the full CMAC (16 bytes)
+ */
+void DesfireCMAC::compute(const DesfireAES& cipher,
+                          const uint8_t*    data,
+                          size_t            length,
+                          uint8_t*          mac) {
+    DesfireCMAC cmac(cipher);
+    cmac.update(data, length);
+    cmac.finish(mac);
+}
+
+/**
+ * @brief Derive the CMAC subkeys K1 = 2 * E(0) and K2 = 4 * E(0)
+ *
+ * @param cipher Cipher holding the MAC key
+ * @param subkey1 Buffer to store K1, used for a complete last block (16 bytes)
+ * @param subkey2 Buffer to store K2, used for a padded last block (16 bytes)
+ */
+void DesfireCMAC::deriveSubkeys(const DesfireAES& cipher, uint8_t* subkey1, uint8_t* subkey2) {
+    memset(subkey1, 0, DF_AES_BLOCK_SIZE);
+    cipher.encryptBlock(subkey1, subkey1);
+    cmacDouble(subkey1);
+    memcpy(subkey2, subkey1, DF_AES_BLOCK_SIZE);
+    cmacDouble(subkey2);
+}
+
+/**
+ * @brief Compute the CMACs of many messages, each under its own key
+ *
+ * @param ciphers Cipher holding the MAC key of every message
+ * @param messages Messages
+ * @param lengths Length of every message
+ * @param macs Buffer to store the full CMACs (16 bytes each)
+ * @param count Number of messages
+ */
+void DesfireCMAC::computeBatch(const DesfireAES* const* ciphers,
+                               const uint8_t* const*    messages,
+                               const size_t*            lengths,
+                               uint8_t*                 macs,
+                               size_t                   count) {
+    const DesfireAES* active[DF_CMAC_BATCH_LANES];
+    uint8_t           lanes[DF_CMAC_BATCH_LANES];
+    uint8_t           subkeys[DF_CMAC_BATCH_LANES * DF_AES_BLOCK_SIZE];
+    uint8_t           blocks[DF_CMAC_BATCH_LANES * DF_AES_BLOCK_SIZE];
+
+    for (size_t base = 0; base < count; base += DF_CMAC_BATCH_LANES) {
+        uint8_t laneCount = (count - base < DF_CMAC_BATCH_LANES)
+                                ? static_cast<uint8_t>(count - base)
+                                : static_cast<uint8_t>(DF_CMAC_BATCH_LANES);
+        uint8_t* state    = &macs[base * DF_AES_BLOCK_SIZE];
+
+        // Subkeys K1 = 2 * E(0) of every key in one step
+        memset(subkeys, 0, laneCount * DF_AES_BLOCK_SIZE);
+        DesfireAES::encryptEach(&ciphers[base], subkeys, subkeys, laneCount);
+        memset(state, 0, laneCount * DF_AES_BLOCK_SIZE);
+
+        size_t maxBlocks = 1;
+        for (uint8_t l = 0; l < laneCount; l++) {
+            size_t blockCount = (lengths[base + l] + DF_AES_BLOCK_SIZE - 1) / DF_AES_BLOCK_SIZE;
+            if (blockCount > maxBlocks) {
+                maxBlocks = blockCount;
+            }
+            cmacDouble(&subkeys[l * DF_AES_BLOCK_SIZE]);
+        }
+
+        // Block j of every message that has one, the last block with its subkey
+        for (size_t j = 0; j < maxBlocks; j++) {
+            uint8_t activeCount = 0;
+            for (uint8_t l = 0; l < laneCount; l++) {
+                const uint8_t* message = messages[base + l];
+                size_t         length  = lengths[base + l];
+                size_t         offset  = j * DF_AES_BLOCK_SIZE;
+                if (offset >= length && !(j == 0 && length == 0)) {
+                    continue;
+                }
+
+                uint8_t* block = &blocks[activeCount * DF_AES_BLOCK_SIZE];
+                size_t   chunk = length - offset;
+                if (chunk > DF_AES_BLOCK_SIZE) {
+                    chunk = DF_AES_BLOCK_SIZE;
+                }
+                memcpy(block, &message[offset], chunk);
+
+                if (offset + DF_AES_BLOCK_SIZE >= length) {
+                    uint8_t* subkey = &subkeys[l * DF_AES_BLOCK_SIZE];
+                    if (chunk < DF_AES_BLOCK_SIZE) {
+                        cmacDouble(subkey);
+                        block[chunk] = 0x80;
+                        memset(&block[chunk + 1], 0, DF_AES_BLOCK_SIZE - chunk - 1);
+                    }
+                    for (uint8_t i = 0; i < DF_AES_BLOCK_SIZE; i++) {
+                        block[i] ^= subkey[i];
+                    }
+                }
+                for (uint8_t i = 0; i < DF_AES_BLOCK_SIZE; i++) {
+                    block[i] ^= state[l * DF_AES_BLOCK_SIZE + i];
+                }
+
+                active[activeCount]  = ciphers[base + l];
+                lanes[activeCount++] = l;
+            }
+
+            DesfireAES::encryptEach(active, blocks, blocks, activeCount);
+            for (uint8_t a = 0; a < activeCount; a++) {
+                memcpy(&state[lanes[a] * DF_AES_BLOCK_SIZE],
+                       &blocks[a * DF_AES_BLOCK_SIZE],
+                       DF_AES_BLOCK_SIZE);
+            }
+        }
+    }
+
+    DesfireAES::wipe(subkeys, sizeof(subkeys));
+    DesfireAES::wipe(blocks, sizeof(blocks));
+}
+
+/**
+ * @brief Truncate a CMAC to the 8-byte EV2 MACt (odd-numbered bytes)
+ *
+ * @param mac Full CMAC (16 bytes)
+ * @param truncated Buffer to store the MACt (8 bytes)
+ */
+void DesfireCMAC::truncate(const uint8_t* mac, uint8_t* truncated) {
+    for (uint8_t i = 0; i < DF_MACT_SIZE; i++) {
+        truncated[i] = mac[2 * i + 1];
+    }
+}
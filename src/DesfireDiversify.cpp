@@ -0,0 +1,207 @@
+/**
+ * @file DesfireDiversify.cpp
+ * @brief Implementation of AN10922 AES-128 key diversification
+ */
+
+#include "DesfireDiversify.h"
+
+#include <string.h>
+
+#define DIV_PADDING 0x80  // First padding byte of a short message
+
+/**
+ * @brief Construct a diversifier
+ *
+ * @param masterKey Master key (16 bytes)
+ * @param systemId System identifier appended to every input, nullptr for none
+ * @param systemIdLength Length of the system identifier
+ */
+DesfireKeyDiversifier::DesfireKeyDiversifier(const uint8_t* masterKey,
+                                             const uint8_t* systemId,
+                                             uint8_t        systemIdLength)
+    : _cipher(masterKey) {
+    uint8_t subkey1[DF_AES_BLOCK_SIZE];
+    uint8_t subkey2[DF_AES_BLOCK_SIZE];
+    DesfireCMAC::deriveSubkeys(_cipher, subkey1, subkey2);
+    for (uint8_t i = 0; i < DF_AES_BLOCK_SIZE; i++) {
+        _paddedMask[i] = subkey1[i] ^ subkey2[i];
+    }
+    DesfireAES::wipe(subkey1, sizeof(subkey1));
+    DesfireAES::wipe(subkey2, sizeof(subkey2));
+
+    // A longer identifier keeps its length, so every derivation fails
+    memset(_systemId, 0, sizeof(_systemId));
+    if (systemId != nullptr) {
+        size_t copied = (systemIdLength < sizeof(_systemId)) ? systemIdLength : sizeof(_systemId);
+        memcpy(_systemId, systemId, copied);
+    } else {
+        systemIdLength = 0;
+    }
+    _systemIdLength = systemIdLength;
+}
+
+/**
+ * @brief Destroy the diversifier, wiping the subkey mask
+ */
+DesfireKeyDiversifier::~DesfireKeyDiversifier() {
+    DesfireAES::wipe(_paddedMask, sizeof(_paddedMask));
+}
+
+/**
+ * @brief Derive the key of one card
+ *
+ * @param uid Card UID
+ * @param uidLength Length of the UID (at most DF_DIV_UID_SIZE)
+ * @param aid Application ID (3 bytes), nullptr for the PICC level
+ * @param key Buffer to store the diversified key (16 bytes)
+ * @return true if the key was derived
+ * @return false if the input is longer than DF_DIV_INPUT_MAX
+ */
+bool DesfireKeyDiversifier::diversify(const uint8_t* uid,
+                                      uint8_t        uidLength,
+                                      const uint8_t* aid,
+                                      uint8_t*       key) const {
+    uint8_t message[DF_DIV_MESSAGE_SIZE];
+    if (key == nullptr || !buildMessage(uid, uidLength, aid, message)) {
+        return false;
+    }
+
+    DesfireCMAC::compute(_cipher, message, sizeof(message), key);
+    DesfireAES::wipe(message, sizeof(message));
+    return true;
+}
+
+/**
+ * @brief Derive the keys of a key table
+ *
+ * Messages are gathered DF_DIV_BATCH_LANES at a time and handed to
+ * DesfireCMAC::computeBatch(), all under the master key.
+ *
+ * @param entries Key table
+ * @param count Number of entries
+ * @param keyNo Key number derived under this master key
+ * @return size_t Number of keys derived
+ */
+size_t DesfireKeyDiversifier::deriveTable(DesfireKeyTableEntry* entries,
+                                          size_t                count,
+                                          uint8_t               keyNo) const {
+    if (entries == nullptr) {
+        return 0;
+    }
+
+    uint8_t               messages[DF_DIV_BATCH_LANES * DF_DIV_MESSAGE_SIZE];
+    uint8_t               macs[DF_DIV_BATCH_LANES * DF_CMAC_SIZE];
+    const DesfireAES*     ciphers[DF_DIV_BATCH_LANES];
+    const uint8_t*        pointers[DF_DIV_BATCH_LANES];
+    size_t                lengths[DF_DIV_BATCH_LANES];
+    DesfireKeyTableEntry* lanes[DF_DIV_BATCH_LANES];
+    uint8_t               laneCount = 0;
+    size_t                derived   = 0;
+
+    for (uint8_t lane = 0; lane < DF_DIV_BATCH_LANES; lane++) {
+        ciphers[lane]  = &_cipher;
+        pointers[lane] = &messages[lane * DF_DIV_MESSAGE_SIZE];
+        lengths[lane]  = DF_DIV_MESSAGE_SIZE;
+    }
+
+    for (size_t i = 0; i <= count; i++) {
+        if (i < count && entries[i].keyNo == keyNo) {
+            uint8_t* message = &messages[laneCount * DF_DIV_MESSAGE_SIZE];
+            if (buildMessage(entries[i].uid, entries[i].uidLength, entries[i].aid, message)) {
+                lanes[laneCount++] = &entries[i];
+            } else {
+                memset(entries[i].key, 0, sizeof(entries[i].key));
+            }
+        }
+
+        // Run a full batch, or what is left after the last entry
+        if (laneCount == DF_DIV_BATCH_LANES || (i == count && laneCount > 0)) {
+            DesfireCMAC::computeBatch(ciphers, pointers, lengths, macs, laneCount);
+            for (uint8_t lane = 0; lane < laneCount; lane++) {
+                memcpy(lanes[lane]->key, &macs[lane * DF_CMAC_SIZE], DF_AES_KEY_SIZE);
+            }
+            derived += laneCount;
+            laneCount = 0;
+        }
+    }
+
+    DesfireAES::wipe(messages, sizeof(messages));
+    DesfireAES::wipe(macs, sizeof(macs));
+    return derived;
+}
+
+/**
+ * @brief Find an entry of a key table
+ *
+ * @param entries Key table
+ * @param count Number of entries
+ * @param uid Card UID
+ * @param uidLength Length of the UID
+ * @param aid Application ID (3 bytes)
+ * @param keyNo Key number
+ * @return const DesfireKeyTableEntry* Matching entry, nullptr if none
+ */
+const DesfireKeyTableEntry* DesfireKeyDiversifier::find(const DesfireKeyTableEntry* entries,
+                                                        size_t                      count,
+                                                        const uint8_t*              uid,
+                                                        uint8_t                     uidLength,
+                                                        const uint8_t*              aid,
+                                                        uint8_t                     keyNo) {
+    if (entries == nullptr || uid == nullptr || aid == nullptr) {
+        return nullptr;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const DesfireKeyTableEntry& entry = entries[i];
+        if (entry.keyNo == keyNo && entry.uidLength == uidLength &&
+            memcmp(entry.uid, uid, uidLength) == 0 &&
+            memcmp(entry.aid, aid, DF_DIV_AID_SIZE) == 0) {
+            return &entry;
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Build the padded message for a CMAC over both blocks
+ *
+ * @param uid Card UID
+ * @param uidLength Length of the UID
+ * @param aid Application ID (3 bytes), nullptr for none
+ * @param message Buffer to store the message (32 bytes)
+ * @return true if the message was built
+ * @return false if the input is too long
+ */
+bool DesfireKeyDiversifier::buildMessage(const uint8_t* uid,
+                                         uint8_t        uidLength,
+                                         const uint8_t* aid,
+                                         uint8_t*       message) const {
+    uint8_t aidLength = (aid != nullptr) ? DF_DIV_AID_SIZE : 0;
+    if (uid == nullptr || uidLength > DF_DIV_UID_SIZE ||
+        uidLength + aidLength + _systemIdLength > DF_DIV_INPUT_MAX) {
+        return false;
+    }
+
+    uint8_t length    = 0;
+    message[length++] = DF_DIV_CONSTANT_AES128;
+    memcpy(&message[length], uid, uidLength);
+    length += uidLength;
+    if (aid != nullptr) {
+        memcpy(&message[length], aid, DF_DIV_AID_SIZE);
+        length += DF_DIV_AID_SIZE;
+    }
+    memcpy(&message[length], _systemId, _systemIdLength);
+    length += _systemIdLength;
+
+    // Shorter messages are padded to two blocks, not to the next block. The
+    // CMAC of the full message applies K1; K1 ^ K2 folded in turns it into K2.
+    if (length < DF_DIV_MESSAGE_SIZE) {
+        message[length] = DIV_PADDING;
+        memset(&message[length + 1], 0, DF_DIV_MESSAGE_SIZE - length - 1);
+        for (uint8_t i = 0; i < DF_AES_BLOCK_SIZE; i++) {
+            message[DF_AES_BLOCK_SIZE + i] ^= _paddedMask[i];
+        }
+    }
+    return true;
+}
@@ -0,0 +1,720 @@
+/**
+ * @file DesfireECC.cpp
+ * @brief Implementation of ECDSA P-224 verification
+ *
+ * Field elements and scalars are stored as seven little-endian 32-bit limbs,
+ * which maps directly onto the 32x32->64 multiplier of the ESP32-C3 (RV32IMC).
+ * Field reduction uses the NIST special form of p, scalar arithmetic modulo n
+ * uses Montgomery multiplication. Point arithmetic is done in Jacobian
+ * coordinates, with table points kept in affine form for mixed additions.
+ */
+
+#include "DesfireECC.h"
+
+#include <string.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+
+#if defined(ESP_PLATFORM)
+#include <esp_attr.h>
+#define DF_ECC_HOT IRAM_ATTR
+#else
+#define DF_ECC_HOT
+#endif
+
+// Number of 32-bit limbs in a P-224 element
+#define P224_LIMBS 7
+
+// Number of comb columns: ceil(224 / DF_ECC_COMB_WIDTH)
+#define P224_COMB_COLUMNS ((224 + DF_ECC_COMB_WIDTH - 1) / DF_ECC_COMB_WIDTH)
+
+// Number of non-trivial points in a comb table
+#define P224_COMB_POINTS ((1 << DF_ECC_COMB_WIDTH) - 1)
+
+// Curve parameters (little-endian limbs)
+static const uint32_t P224_P[P224_LIMBS] = {
+    0x00000001, 0x00000000, 0x00000000, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF};
+static const uint32_t P224_B[P224_LIMBS] = {
+    0x2355FFB4, 0x270B3943, 0xD7BFD8BA, 0x5044B0B7, 0xF5413256, 0x0C04B3AB, 0xB4050A85};
+static const uint32_t P224_GX[P224_LIMBS] = {
+    0x115C1D21, 0x343280D6, 0x56C21122, 0x4A03C1D3, 0x321390B9, 0x6BB4BF7F, 0xB70E0CBD};
+static const uint32_t P224_GY[P224_LIMBS] = {
+    0x85007E34, 0x44D58199, 0x5A074764, 0xCD4375A0, 0x4C22DFE6, 0xB5F723FB, 0xBD376388};
+static const uint32_t P224_N[P224_LIMBS] = {
+    0x5C5C2A3D, 0x13DD2945, 0xE0B8F03E, 0xFFFF16A2, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF};
+
+// Exponents for Fermat inversion
+static const uint32_t P224_P_MINUS_2[P224_LIMBS] = {
+    0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF};
+static const uint32_t P224_N_MINUS_2[P224_LIMBS] = {
+    0x5C5C2A3B, 0x13DD2945, 0xE0B8F03E, 0xFFFF16A2, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF};
+
+// Montgomery constants for n: R^2 mod n (R = 2^224) and -n^-1 mod 2^32
+static const uint32_t P224_N_R2[P224_LIMBS] = {
+    0x3AD01289, 0x6BDAAE6C, 0x97A54552, 0x6AD09D91, 0xB1E97961, 0x1822BC47, 0xD4BAA4CF};
+static const uint32_t P224_N_INV = 0x6A1FC2EB;
+
+/**
+ * @brief Affine curve point
+ */
+struct P224Affine {
+    uint32_t x[P224_LIMBS];
+    uint32_t y[P224_LIMBS];
+};
+
+/**
+ * @brief Jacobian curve point (x = X/Z^2, y = Y/Z^3), Z = 0 is infinity
+ */
+struct P224Jacobian {
+    uint32_t x[P224_LIMBS];
+    uint32_t y[P224_LIMBS];
+    uint32_t z[P224_LIMBS];
+};
+
+/**
+ * @brief Comb table for one base point
+ */
+struct P224CombTable {
+    P224Affine points[P224_COMB_POINTS];  ///< points[i - 1] = sum of bit_t(i) * 2^(t*d) * P
+};
+
+/**
+ * @brief Cached comb table for a public key
+ */
+struct P224KeySlot {
+    bool          valid;                                ///< Slot holds a table
+    uint32_t      built;                                ///< Build stamp, oldest is replaced
+    uint8_t       publicKey[DF_ECC_PUBLIC_KEY_LENGTH];  ///< Key the table belongs to
+    P224CombTable table;                                ///< Comb table of the key
+};
+
+static P224CombTable s_generatorTable;
+static bool          s_generatorTableValid = false;
+static P224KeySlot   s_keySlots[DF_ECC_KEY_TABLE_SLOTS];
+static uint32_t      s_buildCounter = 0;
+
+#if defined(__linux__)
+// Verifications share the cache, building a table excludes them
+static pthread_rwlock_t s_cacheLock = PTHREAD_RWLOCK_INITIALIZER;
+#endif
+
+// ---------------------------------------------------------------------------
+// Multi-precision helpers
+// ---------------------------------------------------------------------------
+
+static void bnFromBytes(uint32_t* r, const uint8_t* in) {
+    // 28 big-endian bytes to little-endian limbs
+    for (uint8_t i = 0; i < P224_LIMBS; i++) {
+        const uint8_t* p = &in[(P224_LIMBS - 1 - i) * 4];
+        r[i] = (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+               (static_cast<uint32_t>(p[2]) << 8) | p[3];
+    }
+}
+
+static bool bnIsZero(const uint32_t* a) {
+    uint32_t acc = 0;
+    for (uint8_t i = 0; i < P224_LIMBS; i++) {
+        acc |= a[i];
+    }
+    return acc == 0;
+}
+
+static int bnCompare(const uint32_t* a, const uint32_t* b) {
+    for (int8_t i = P224_LIMBS - 1; i >= 0; i--) {
+        if (a[i] != b[i]) {
+            return a[i] > b[i] ? 1 : -1;
+        }
+    }
+    return 0;
+}
+
+static uint32_t bnAdd(uint32_t* r, const uint32_t* a, const uint32_t* b) {
+    uint64_t carry = 0;
+    for (uint8_t i = 0; i < P224_LIMBS; i++) {
+        carry += static_cast<uint64_t>(a[i]) + b[i];
+        r[i] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+    return static_cast<uint32_t>(carry);
+}
+
+static uint32_t bnSub(uint32_t* r, const uint32_t* a, const uint32_t* b) {
+    int64_t borrow = 0;
+    for (uint8_t i = 0; i < P224_LIMBS; i++) {
+        borrow += static_cast<int64_t>(a[i]) - b[i];
+        r[i] = static_cast<uint32_t>(borrow);
+        borrow >>= 32;
+    }
+    return static_cast<uint32_t>(-borrow);
+}
+
+static bool bnBit(const uint32_t* a, uint16_t bit) {
+    if (bit >= 32 * P224_LIMBS) {
+        return false;
+    }
+    return (a[bit / 32] >> (bit % 32)) & 1;
+}
+
+// ---------------------------------------------------------------------------
+// Field arithmetic modulo p = 2^224 - 2^96 + 1
+// ---------------------------------------------------------------------------
+
+static void fpAdd(uint32_t* r, const uint32_t* a, const uint32_t* b) {
+    uint32_t carry = bnAdd(r, a, b);
+    if (carry || bnCompare(r, P224_P) >= 0) {
+        bnSub(r, r, P224_P);
+    }
+}
+
+static void fpSub(uint32_t* r, const uint32_t* a, const uint32_t* b) {
+    if (bnSub(r, a, b)) {
+        bnAdd(r, r, P224_P);
+    }
+}
+
+/**
+ * @brief Reduce a 448-bit product using the NIST P-224 special form
+ *
+ * r = t + s1 + s2 - d1 - d2 (mod p), see FIPS 186-4 D.2.2.
+ */
+static void DF_ECC_HOT fpReduce(uint32_t* r, const uint32_t* c) {
+    int64_t acc;
+
+    acc  = static_cast<int64_t>(c[0]) - c[7] - c[11];
+    r[0] = static_cast<uint32_t>(acc);
+    acc >>= 32;
+    acc += static_cast<int64_t>(c[1]) - c[8] - c[12];
+    r[1] = static_cast<uint32_t>(acc);
+    acc >>= 32;
+    acc += static_cast<int64_t>(c[2]) - c[9] - c[13];
+    r[2] = static_cast<uint32_t>(acc);
+    acc >>= 32;
+    acc += static_cast<int64_t>(c[3]) + c[7] + c[11] - c[10];
+    r[3] = static_cast<uint32_t>(acc);
+    acc >>= 32;
+    acc += static_cast<int64_t>(c[4]) + c[8] + c[12] - c[11];
+    r[4] = static_cast<uint32_t>(acc);
+    acc >>= 32;
+    acc += static_cast<int64_t>(c[5]) + c[9] + c[13] - c[12];
+    r[5] = static_cast<uint32_t>(acc);
+    acc >>= 32;
+    acc += static_cast<int64_t>(c[6]) + c[10] - c[13];
+    r[6] = static_cast<uint32_t>(acc);
+    acc >>= 32;
+
+    // Fold the signed overflow back in using 2^224 = 2^96 - 1 (mod p)
+    while (acc != 0) {
+        int64_t top = acc;
+        acc         = static_cast<int64_t>(r[0]) - top;
+        r[0]        = static_cast<uint32_t>(acc);
+        acc >>= 32;
+        acc += r[1];
+        r[1] = static_cast<uint32_t>(acc);
+        acc >>= 32;
+        acc += r[2];
+        r[2] = static_cast<uint32_t>(acc);
+        acc >>= 32;
+        acc += static_cast<int64_t>(r[3]) + top;
+        r[3] = static_cast<uint32_t>(acc);
+        acc >>= 32;
+        for (uint8_t i = 4; i < P224_LIMBS; i++) {
+            acc += r[i];
+            r[i] = static_cast<uint32_t>(acc);
+            acc >>= 32;
+        }
+    }
+
+    if (bnCompare(r, P224_P) >= 0) {
+        bnSub(r, r, P224_P);
+    }
+}
+
+static void DF_ECC_HOT fpMul(uint32_t* r, const uint32_t* a, const uint32_t* b) {
+    uint32_t c[2 * P224_LIMBS];
+    memset(c, 0, sizeof(c));
+
+    for (uint8_t i = 0; i < P224_LIMBS; i++) {
+        uint64_t carry = 0;
+        for (uint8_t j = 0; j < P224_LIMBS; j++) {
+            carry += static_cast<uint64_t>(a[i]) * b[j] + c[i + j];
+            c[i + j] = static_cast<uint32_t>(carry);
+            carry >>= 32;
+        }
+        c[i + P224_LIMBS] = static_cast<uint32_t>(carry);
+    }
+
+    fpReduce(r, c);
+}
+
+static void fpSqr(uint32_t* r, const uint32_t* a) {
+    fpMul(r, a, a);
+}
+
+static void fpInv(uint32_t* r, const uint32_t* a) {
+    // a^(p-2), left-to-right square and multiply
+    uint32_t result[P224_LIMBS] = {1, 0, 0, 0, 0, 0, 0};
+    for (int16_t bit = 223; bit >= 0; bit--) {
+        fpSqr(result, result);
+        if (bnBit(P224_P_MINUS_2, bit)) {
+            fpMul(result, result, a);
+        }
+    }
+    memcpy(r, result, sizeof(result));
+}
+
+// ---------------------------------------------------------------------------
+// Scalar arithmetic modulo n (Montgomery form, R = 2^224)
+// ---------------------------------------------------------------------------
+
+static void mnMul(uint32_t* r, const uint32_t* a, const uint32_t* b) {
+    uint32_t t[P224_LIMBS + 2];
+    memset(t, 0, sizeof(t));
+
+    for (uint8_t i = 0; i < P224_LIMBS; i++) {
+        uint64_t carry = 0;
+        for (uint8_t j = 0; j < P224_LIMBS; j++) {
+            carry += static_cast<uint64_t>(a[j]) * b[i] + t[j];
+            t[j] = static_cast<uint32_t>(carry);
+            carry >>= 32;
+        }
+        carry += t[P224_LIMBS];
+        t[P224_LIMBS]     = static_cast<uint32_t>(carry);
+        t[P224_LIMBS + 1] = static_cast<uint32_t>(carry >> 32);
+
+        uint32_t m = t[0] * P224_N_INV;
+        carry      = (static_cast<uint64_t>(m) * P224_N[0] + t[0]) >> 32;
+        for (uint8_t j = 1; j < P224_LIMBS; j++) {
+            carry += static_cast<uint64_t>(m) * P224_N[j] + t[j];
+            t[j - 1] = static_cast<uint32_t>(carry);
+            carry >>= 32;
+        }
+        carry += t[P224_LIMBS];
+        t[P224_LIMBS - 1] = static_cast<uint32_t>(carry);
+        t[P224_LIMBS]     = t[P224_LIMBS + 1] + static_cast<uint32_t>(carry >> 32);
+    }
+
+    if (t[P224_LIMBS] || bnCompare(t, P224_N) >= 0) {
+        bnSub(t, t, P224_N);
+    }
+    memcpy(r, t, P224_LIMBS * sizeof(uint32_t));
+}
+
+/**
+ * @brief Compute the Montgomery form of a^-1 mod n
+ */
+static void mnInvToMont(uint32_t* r, const uint32_t* a) {
+    uint32_t aMont[P224_LIMBS];
+    uint32_t one[P224_LIMBS] = {1, 0, 0, 0, 0, 0, 0};
+    uint32_t result[P224_LIMBS];
+
+    mnMul(aMont, a, P224_N_R2);
+    mnMul(result, one, P224_N_R2);
+    for (int16_t bit = 223; bit >= 0; bit--) {
+        mnMul(result, result, result);
+        if (bnBit(P224_N_MINUS_2, bit)) {
+            mnMul(result, result, aMont);
+        }
+    }
+    memcpy(r, result, sizeof(result));
+}
+
+// ---------------------------------------------------------------------------
+// Point arithmetic (a = -3)
+// ---------------------------------------------------------------------------
+
+static void DF_ECC_HOT pointDouble(P224Jacobian& r, const P224Jacobian& p) {
+    if (bnIsZero(p.z)) {
+        r = p;
+        return;
+    }
+
+    uint32_t delta[P224_LIMBS], gamma[P224_LIMBS], beta[P224_LIMBS], alpha[P224_LIMBS];
+    uint32_t t1[P224_LIMBS], t2[P224_LIMBS];
+
+    fpSqr(delta, p.z);
+    fpSqr(gamma, p.y);
+    fpMul(beta, p.x, gamma);
+
+    // alpha = 3 * (X - delta) * (X + delta)
+    fpSub(t1, p.x, delta);
+    fpAdd(t2, p.x, delta);
+    fpMul(alpha, t1, t2);
+    fpAdd(t1, alpha, alpha);
+    fpAdd(alpha, t1, alpha);
+
+    // Z3 = (Y + Z)^2 - gamma - delta
+    fpAdd(t1, p.y, p.z);
+    fpSqr(t1, t1);
+    fpSub(t1, t1, gamma);
+    fpSub(r.z, t1, delta);
+
+    // X3 = alpha^2 - 8 * beta
+    fpAdd(beta, beta, beta);
+    fpAdd(beta, beta, beta);  // 4 * beta
+    fpSqr(t1, alpha);
+    fpAdd(t2, beta, beta);
+    fpSub(r.x, t1, t2);
+
+    // Y3 = alpha * (4 * beta - X3) - 8 * gamma^2
+    fpSub(t1, beta, r.x);
+    fpMul(t1, alpha, t1);
+    fpSqr(gamma, gamma);
+    fpAdd(gamma, gamma, gamma);
+    fpAdd(gamma, gamma, gamma);
+    fpAdd(gamma, gamma, gamma);
+    fpSub(r.y, t1, gamma);
+}
+
+static void DF_ECC_HOT pointAddMixed(P224Jacobian& r, const P224Jacobian& p, const P224Affine& q) {
+    if (bnIsZero(p.z)) {
+        memcpy(r.x, q.x, sizeof(r.x));
+        memcpy(r.y, q.y, sizeof(r.y));
+        memset(r.z, 0, sizeof(r.z));
+        r.z[0] = 1;
+        return;
+    }
+
+    uint32_t z1z1[P224_LIMBS], u2[P224_LIMBS], s2[P224_LIMBS], h[P224_LIMBS];
+    uint32_t hh[P224_LIMBS], i[P224_LIMBS], j[P224_LIMBS], rr[P224_LIMBS], v[P224_LIMBS];
+    uint32_t t1[P224_LIMBS];
+
+    fpSqr(z1z1, p.z);
+    fpMul(u2, q.x, z1z1);
+    fpMul(s2, q.y, p.z);
+    fpMul(s2, s2, z1z1);
+    fpSub(h, u2, p.x);
+    fpSub(rr, s2, p.y);
+
+    if (bnIsZero(h)) {
+        if (bnIsZero(rr)) {
+            pointDouble(r, p);
+        } else {
+            memset(&r, 0, sizeof(r));
+        }
+        return;
+    }
+
+    fpSqr(hh, h);
+    fpAdd(i, hh, hh);
+    fpAdd(i, i, i);
+    fpMul(j, h, i);
+    fpAdd(rr, rr, rr);
+    fpMul(v, p.x, i);
+
+    P224Jacobian out;
+
+    // X3 = r^2 - J - 2 * V
+    fpSqr(t1, rr);
+    fpSub(t1, t1, j);
+    fpSub(t1, t1, v);
+    fpSub(out.x, t1, v);
+
+    // Y3 = r * (V - X3) - 2 * Y1 * J
+    fpSub(t1, v, out.x);
+    fpMul(t1, rr, t1);
+    fpMul(j, p.y, j);
+    fpAdd(j, j, j);
+    fpSub(out.y, t1, j);
+
+    // Z3 = (Z1 + H)^2 - Z1Z1 - HH
+    fpAdd(t1, p.z, h);
+    fpSqr(t1, t1);
+    fpSub(t1, t1, z1z1);
+    fpSub(out.z, t1, hh);
+
+    r = out;
+}
+
+static void pointToAffine(P224Affine& r, const P224Jacobian& p) {
+    uint32_t zInv[P224_LIMBS], zInv2[P224_LIMBS];
+
+    fpInv(zInv, p.z);
+    fpSqr(zInv2, zInv);
+    fpMul(r.x, p.x, zInv2);
+    fpMul(zInv2, zInv2, zInv);
+    fpMul(r.y, p.y, zInv2);
+}
+
+static bool pointIsOnCurve(const P224Affine& p) {
+    if (bnCompare(p.x, P224_P) >= 0 || bnCompare(p.y, P224_P) >= 0) {
+        return false;
+    }
+
+    // y^2 = x^3 - 3x + b
+    uint32_t lhs[P224_LIMBS], rhs[P224_LIMBS], t[P224_LIMBS];
+    fpSqr(lhs, p.y);
+    fpSqr(rhs, p.x);
+    fpMul(rhs, rhs, p.x);
+    fpAdd(t, p.x, p.x);
+    fpAdd(t, t, p.x);
+    fpSub(rhs, rhs, t);
+    fpAdd(rhs, rhs, P224_B);
+
+    return bnCompare(lhs, rhs) == 0;
+}
+
+// ---------------------------------------------------------------------------
+// Comb tables
+// ---------------------------------------------------------------------------
+
+static void combBuild(P224CombTable& table, const P224Affine& base) {
+    // Column bases B_t = 2^(t * d) * P
+    P224Affine   bases[DF_ECC_COMB_WIDTH];
+    P224Jacobian acc;
+
+    bases[0] = base;
+    memcpy(acc.x, base.x, sizeof(acc.x));
+    memcpy(acc.y, base.y, sizeof(acc.y));
+    memset(acc.z, 0, sizeof(acc.z));
+    acc.z[0] = 1;
+
+    for (uint8_t t = 1; t < DF_ECC_COMB_WIDTH; t++) {
+        for (uint8_t k = 0; k < P224_COMB_COLUMNS; k++) {
+            pointDouble(acc, acc);
+        }
+        pointToAffine(bases[t], acc);
+    }
+
+    // points[i - 1] = points[i - 1 - high] + B_high, where high is the top bit of i
+    for (uint8_t index = 1; index <= P224_COMB_POINTS; index++) {
+        uint8_t high = DF_ECC_COMB_WIDTH - 1;
+        while (!(index & (1 << high))) {
+            high--;
+        }
+
+        uint8_t rest = index & ~(1 << high);
+        if (rest == 0) {
+            table.points[index - 1] = bases[high];
+            continue;
+        }
+
+        const P224Affine& prev = table.points[rest - 1];
+        memcpy(acc.x, prev.x, sizeof(acc.x));
+        memcpy(acc.y, prev.y, sizeof(acc.y));
+        memset(acc.z, 0, sizeof(acc.z));
+        acc.z[0] = 1;
+        pointAddMixed(acc, acc, bases[high]);
+        pointToAffine(table.points[index - 1], acc);
+    }
+}
+
+static uint8_t combIndex(const uint32_t* scalar, uint8_t column) {
+    uint8_t index = 0;
+    for (uint8_t t = 0; t < DF_ECC_COMB_WIDTH; t++) {
+        if (bnBit(scalar, t * P224_COMB_COLUMNS + column)) {
+            index |= 1 << t;
+        }
+    }
+    return index;
+}
+
+static const P224CombTable& generatorTable() {
+    if (!s_generatorTableValid) {
+        P224Affine g;
+        memcpy(g.x, P224_GX, sizeof(g.x));
+        memcpy(g.y, P224_GY, sizeof(g.y));
+        combBuild(s_generatorTable, g);
+        s_generatorTableValid = true;
+    }
+    return s_generatorTable;
+}
+
+static const P224CombTable* findKeyTable(const uint8_t* publicKey) {
+    // Read-only, lookups under the shared lock must not touch the slots
+    for (uint8_t i = 0; i < DF_ECC_KEY_TABLE_SLOTS; i++) {
+        const P224KeySlot& slot = s_keySlots[i];
+        if (slot.valid && memcmp(slot.publicKey, publicKey, DF_ECC_PUBLIC_KEY_LENGTH) == 0) {
+            return &slot.table;
+        }
+    }
+    return nullptr;
+}
+
+static const P224CombTable* buildKeyTable(const uint8_t* publicKey) {
+    const P224CombTable* cached = findKeyTable(publicKey);
+    if (cached != nullptr) {
+        return cached;
+    }
+    if (publicKey[0] != 0x04) {
+        return nullptr;
+    }
+
+    P224Affine q;
+    bnFromBytes(q.x, &publicKey[1]);
+    bnFromBytes(q.y, &publicKey[1 + DF_ECC_SCALAR_LENGTH]);
+    if (!pointIsOnCurve(q)) {
+        return nullptr;
+    }
+
+    P224KeySlot* victim = &s_keySlots[0];
+    for (uint8_t i = 1; i < DF_ECC_KEY_TABLE_SLOTS && victim->valid; i++) {
+        P224KeySlot& slot = s_keySlots[i];
+        if (!slot.valid || slot.built < victim->built) {
+            victim = &slot;
+        }
+    }
+
+    victim->valid = false;
+    combBuild(victim->table, q);
+    memcpy(victim->publicKey, publicKey, DF_ECC_PUBLIC_KEY_LENGTH);
+    victim->built = ++s_buildCounter;
+    victim->valid = true;
+
+    return &victim->table;
+}
+
+static void lockCache(bool exclusive) {
+#if defined(__linux__)
+    if (exclusive) {
+        pthread_rwlock_wrlock(&s_cacheLock);
+    } else {
+        pthread_rwlock_rdlock(&s_cacheLock);
+    }
+#endif
+}
+
+static void unlockCache() {
+#if defined(__linux__)
+    pthread_rwlock_unlock(&s_cacheLock);
+#endif
+}
+
+/**
+ * @brief Get the tables of a verification, building missing ones
+ *
+ * On success the cache stays locked for reading until unlockCache().
+ */
+static const P224CombTable* acquireKeyTable(const uint8_t* publicKey) {
+    for (;;) {
+        lockCache(false);
+        const P224CombTable* table = findKeyTable(publicKey);
+        if (s_generatorTableValid && table != nullptr) {
+            return table;
+        }
+        unlockCache();
+
+        lockCache(true);
+        generatorTable();
+        bool built = buildKeyTable(publicKey) != nullptr;
+        unlockCache();
+        if (!built) {
+            return nullptr;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Public API
+// ---------------------------------------------------------------------------
+
+/**
+ * @brief Build the comb tables for the generator and a public key
+ *
+ * @param publicKey Uncompressed public key (04 || X || Y, 57 bytes)
+ * @return true if the tables are available
+ * @return false if the public key is not a valid curve point
+ */
+bool DesfireECC::precompute(const uint8_t* publicKey) {
+    if (publicKey == nullptr) {
+        return false;
+    }
+
+    lockCache(true);
+    generatorTable();
+    bool built = buildKeyTable(publicKey) != nullptr;
+    unlockCache();
+    return built;
+}
+
+/**
+ * @brief Verify an ECDSA P-224 signature
+ *
+ * @param publicKey Uncompressed public key (04 || X || Y, 57 bytes)
+ * @param message Signed message
+ * @param messageLength Length of the message in bytes
+ * @param signature Raw signature (r || s, 56 bytes)
+ * @return true if the signature is valid
+ * @return false if the signature or public key is invalid
+ */
+bool DesfireECC::verify(const uint8_t* publicKey,
+                        const uint8_t* message,
+                        size_t         messageLength,
+                        const uint8_t* signature) {
+    if (publicKey == nullptr || signature == nullptr ||
+        (message == nullptr && messageLength > 0)) {
+        return false;
+    }
+
+    // r, s must be in [1, n - 1]
+    uint32_t r[P224_LIMBS], s[P224_LIMBS];
+    bnFromBytes(r, signature);
+    bnFromBytes(s, &signature[DF_ECC_SCALAR_LENGTH]);
+    if (bnIsZero(r) || bnIsZero(s) || bnCompare(r, P224_N) >= 0 || bnCompare(s, P224_N) >= 0) {
+        return false;
+    }
+
+    // e = leftmost 224 bits of the message, reduced mod n
+    uint8_t  digest[DF_ECC_SCALAR_LENGTH];
+    uint32_t e[P224_LIMBS];
+    size_t   used   = messageLength > static_cast<size_t>(DF_ECC_SCALAR_LENGTH)
+                          ? static_cast<size_t>(DF_ECC_SCALAR_LENGTH)
+                          : messageLength;
+    memset(digest, 0, sizeof(digest));
+    memcpy(&digest[DF_ECC_SCALAR_LENGTH - used], message, used);
+    bnFromBytes(e, digest);
+    if (bnCompare(e, P224_N) >= 0) {
+        bnSub(e, e, P224_N);
+    }
+
+    // u1 = e / s, u2 = r / s (mod n)
+    uint32_t w[P224_LIMBS], u1[P224_LIMBS], u2[P224_LIMBS];
+    mnInvToMont(w, s);
+    mnMul(u1, e, w);
+    mnMul(u2, r, w);
+
+    const P224CombTable* qTable = acquireKeyTable(publicKey);
+    if (qTable == nullptr) {
+        return false;
+    }
+    const P224CombTable& gTable = s_generatorTable;
+
+    // R = u1 * G + u2 * Q, both fixed-base combs share the doublings
+    P224Jacobian point;
+    memset(&point, 0, sizeof(point));
+    for (int8_t column = P224_COMB_COLUMNS - 1; column >= 0; column--) {
+        pointDouble(point, point);
+
+        uint8_t index = combIndex(u1, column);
+        if (index) {
+            pointAddMixed(point, point, gTable.points[index - 1]);
+        }
+        index = combIndex(u2, column);
+        if (index) {
+            pointAddMixed(point, point, qTable->points[index - 1]);
+        }
+    }
+    unlockCache();
+
+    if (bnIsZero(point.z)) {
+        return false;
+    }
+
+    // Check x(R) mod n == r without inverting Z: r * Z^2 == X (mod p)
+    uint32_t z2[P224_LIMBS], candidate[P224_LIMBS], t[P224_LIMBS];
+    fpSqr(z2, point.z);
+    memcpy(candidate, r, sizeof(candidate));
+    fpMul(t, candidate, z2);
+    if (bnCompare(t, point.x) == 0) {
+        return true;
+    }
+
+    // x(R) may also be r + n when that is still below p
+    if (bnAdd(candidate, r, P224_N) == 0 && bnCompare(candidate, P224_P) < 0) {
+        fpMul(t, candidate, z2);
+        return bnCompare(t, point.x) == 0;
+    }
+
+    return false;
+}
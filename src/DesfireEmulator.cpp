@@ -0,0 +1,1424 @@
+/**
+ * @file DesfireEmulator.cpp
+ * @brief Implementation of the emulated DESFire EV2 card and reader
+ */
+
+#include "DesfireEmulator.h"
+
+#include <string.h>
+#include "DesfireStatus.h"
+#include "DesfireStrategy.h"
+#include "ISO7816Constants.h"
+
+#define EMU_HEADER_SIZE 7         // File number, offset and length of ReadData and WriteData
+#define EMU_TMAC_HEADER_SIZE 5    // Plain header of CreateTransactionMACFile
+#define EMU_FACTORY_FSCI 5        // FSCI of the factory ATS (64 bytes)
+#define EMU_SW1_DESFIRE 0x91      // SW1 of a wrapped DESFire answer
+#define EMU_OPT 0x00              // PreparePC options, no PPS1
+#define EMU_PUB_RESP_TIME 0x0100  // Response time published by PreparePC
+#define EMU_DEFAULT_SEED 0x2545F491
+#define EMU_NO_KEY 0xFF           // Key number without a session
+
+#define EMU_FIRMWARE_VERSION 0x00EE0100  // Reported by getFirmwareVersion()
+#define EMU_FRAME_OVERHEAD 3             // PCB and CRC of an ISO14443-4 block
+#define EMU_BITS_PER_BYTE 9              // Data bits and parity
+#define EMU_FRAME_BITS 2                 // Start and end of frame
+#define EMU_BASE_BITRATE 106
+
+/**
+ * @brief GetVersion frames of a DESFire EV2 8k (NXP encoding)
+ */
+static const uint8_t VERSION_HARDWARE[7]   = {0x04, 0x01, 0x01, 0x12, 0x00, 0x1A, 0x05};
+static const uint8_t VERSION_SOFTWARE[7]   = {0x04, 0x01, 0x01, 0x02, 0x00, 0x1A, 0x05};
+static const uint8_t VERSION_PRODUCTION[7] = {0xBA, 0x5E, 0xBA, 0x11, 0x00, 0x20, 0x24};
+
+/**
+ * @brief GetVersion hardware and software frames of a DESFire Light
+ */
+static const uint8_t VERSION_LIGHT[7] = {0x04, 0x08, 0x01, 0x30, 0x00, 0x13, 0x05};
+
+/**
+ * @brief DF name of the DESFire Light application
+ */
+static const uint8_t LIGHT_DF_NAME[DF_LIGHT_DF_NAME_LENGTH] = {
+    0xA0, 0x00, 0x00, 0x03, 0x96, 0x56, 0x43, 0x41, 0x03, 0xF0, 0x15, 0x40, 0x00, 0x00, 0x00, 0x0B};
+
+static uint8_t code(DesfireStatus status) {
+    return static_cast<uint8_t>(status);
+}
+
+static uint32_t readLength(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+           (static_cast<uint32_t>(data[2]) << 16);
+}
+
+/**
+ * @brief Construct a card with an empty PICC level and an all-zero master key
+ *
+ * @param uid Card UID (7 bytes)
+ */
+DesfireCardEmulator::DesfireCardEmulator(const uint8_t* uid) {
+    memcpy(_uid, uid, sizeof(_uid));
+    memset(_apps, 0, sizeof(_apps));
+    memset(_storage, 0, sizeof(_storage));
+    memset(_rndB, 0, sizeof(_rndB));
+    memset(_pcInput, 0, sizeof(_pcInput));
+    _apps[0].keyCount = 1;
+    _appCount         = 1;
+    _storageUsed      = 0;
+    _selected         = 0;
+    _authKeyNo        = EMU_NO_KEY;
+    _pendingKeyNo     = 0;
+    _pending          = PENDING_NONE;
+    _versionFrame     = 0;
+    _command          = 0;
+    _inputLength      = 0;
+    _inputExpected    = 0;
+    _outputLength     = 0;
+    _outputSent       = 0;
+    _pcLength         = 0;
+    _time             = 0;
+    _present          = true;
+    _light            = false;
+    _fsci             = EMU_FACTORY_FSCI;
+    _frameSize        = DesfireStrategyCache::getFrameSize(_fsci);
+
+    _timing.frameDelay  = 86;
+    _timing.commandTime = 300;
+    _timing.cryptoTime  = 15;
+    _timing.writeTime   = 1000;
+    _timing.commitTime  = 2000;
+    _timing.extraDelay  = 0;
+
+    // Each card gets its own sequence unless seeded
+    uint32_t seed = 2166136261u;
+    for (uint8_t i = 0; i < DF_EMU_UID_SIZE; i++) {
+        seed = (seed ^ _uid[i]) * 16777619u;
+    }
+    setSeed(seed);
+}
+
+/**
+ * @brief Add an application
+ *
+ * @param aid Application ID (3 bytes, not 000000)
+ * @param key Initial value of all keys (16 bytes)
+ * @param keyCount Number of keys (1 to DF_EMU_MAX_KEYS)
+ * @return true if the application was added
+ * @return false if it exists, the key count is invalid or no slot is left
+ */
+bool DesfireCardEmulator::addApplication(const uint8_t* aid, const uint8_t* key, uint8_t keyCount) {
+    if (aid == nullptr || key == nullptr || keyCount == 0 || keyCount > DF_EMU_MAX_KEYS ||
+        _appCount > DF_EMU_MAX_APPS || findApplication(aid) >= 0) {
+        return false;
+    }
+
+    Application& app = _apps[_appCount];
+    memset(&app, 0, sizeof(app));
+    memcpy(app.aid, aid, sizeof(app.aid));
+    for (uint8_t i = 0; i < keyCount; i++) {
+        memcpy(app.keys[i], key, DF_AES_KEY_SIZE);
+    }
+    app.keyCount = keyCount;
+    _appCount++;
+    return true;
+}
+
+/**
+ * @brief Change a key
+ *
+ * @param aid Application ID (3 bytes, 000000 for the PICC master key)
+ * @param keyNo Key number
+ * @param key New key (16 bytes)
+ * @return true if the key was changed
+ * @return false if the application or key does not exist
+ */
+bool DesfireCardEmulator::setKey(const uint8_t* aid, uint8_t keyNo, const uint8_t* key) {
+    int index = findApplication(aid);
+    if (index < 0 || key == nullptr || keyNo >= _apps[index].keyCount) {
+        return false;
+    }
+
+    memcpy(_apps[index].keys[keyNo], key, DF_AES_KEY_SIZE);
+    return true;
+}
+
+/**
+ * @brief Add a data file to an application
+ *
+ * @param aid Application ID (3 bytes)
+ * @param file File settings
+ * @param contents Initial contents (size bytes), nullptr for zeros
+ * @return true if the file was added
+ * @return false if the settings are invalid or the memory is full
+ */
+bool DesfireCardEmulator::addFile(const uint8_t*             aid,
+                                  const DesfireEmulatorFile& file,
+                                  const uint8_t*             contents) {
+    int index = findApplication(aid);
+    if (index < 0 || (file.type != DF_FILE_STANDARD && file.type != DF_FILE_BACKUP) ||
+        (file.commMode != DF_COMM_PLAIN && file.commMode != DF_COMM_MAC &&
+         file.commMode != DF_COMM_ENCRYPT) ||
+        file.readKey > DF_AR_NEVER || file.writeKey > DF_AR_NEVER || file.size == 0) {
+        return false;
+    }
+
+    Application& app = _apps[index];
+    for (uint8_t i = 0; i < app.fileCount; i++) {
+        if (app.files[i].settings.fileNo == file.fileNo) {
+            return false;
+        }
+    }
+
+    // Backup files keep a second image for the uncommitted changes
+    uint32_t needed = (file.type == DF_FILE_BACKUP) ? 2 * file.size : file.size;
+    if (app.fileCount >= DF_EMU_MAX_FILES || _storageUsed + needed > sizeof(_storage)) {
+        return false;
+    }
+
+    File& entry    = app.files[app.fileCount++];
+    entry.settings = file;
+    entry.offset   = _storageUsed;
+    entry.shadow   = (file.type == DF_FILE_BACKUP) ? _storageUsed + file.size : _storageUsed;
+    entry.dirty    = false;
+    if (contents != nullptr) {
+        memcpy(&_storage[entry.offset], contents, file.size);
+        memcpy(&_storage[entry.shadow], contents, file.size);
+    }
+    _storageUsed += needed;
+    return true;
+}
+
+/**
+ * @brief Get the key of a transaction MAC file
+ *
+ * @param aid Application ID (3 bytes)
+ * @param fileNo File number of the transaction MAC file
+ * @param version Pointer to variable that will store the key version, may be nullptr
+ * @return const uint8_t* AES key (16 bytes), nullptr if there is no such file
+ */
+const uint8_t* DesfireCardEmulator::getTransactionMACKey(const uint8_t* aid,
+                                                         uint8_t        fileNo,
+                                                         uint8_t*       version) const {
+    int index = findApplication(aid);
+    if (index < 0) {
+        return nullptr;
+    }
+
+    const Application& app = _apps[index];
+    for (uint8_t i = 0; i < app.fileCount; i++) {
+        const File& file = app.files[i];
+        if (file.settings.fileNo == fileNo && file.settings.type == DF_FILE_TMAC) {
+            const uint8_t* key = &_storage[file.offset + file.settings.size];
+            if (version != nullptr) {
+                *version = key[DF_AES_KEY_SIZE];
+            }
+            return key;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Get the committed contents of a file
+ *
+ * @param aid Application ID (3 bytes)
+ * @param fileNo File number
+ * @return const uint8_t* File contents, nullptr if the file does not exist
+ */
+const uint8_t* DesfireCardEmulator::getFileData(const uint8_t* aid, uint8_t fileNo) const {
+    int index = findApplication(aid);
+    if (index < 0) {
+        return nullptr;
+    }
+
+    const Application& app = _apps[index];
+    for (uint8_t i = 0; i < app.fileCount; i++) {
+        if (app.files[i].settings.fileNo == fileNo) {
+            return &_storage[app.files[i].offset];
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Get the UID of the card
+ *
+ * @return const uint8_t* UID (DF_EMU_UID_SIZE bytes)
+ */
+const uint8_t* DesfireCardEmulator::getUID() const {
+    return _uid;
+}
+
+/**
+ * @brief Seed the generator of RndB, TI and the proximity check numbers
+ *
+ * @param seed Seed, 0 is replaced by a fixed value
+ */
+void DesfireCardEmulator::setSeed(uint32_t seed) {
+    _random = (seed != 0) ? seed : EMU_DEFAULT_SEED;
+}
+
+/**
+ * @brief Present the card as a DESFire Light
+ *
+ * @param light true for a DESFire Light, false for an EV2
+ */
+void DesfireCardEmulator::setLight(bool light) {
+    _light = light;
+}
+
+/**
+ * @brief Set the processing times
+ *
+ * @param timing Processing times
+ */
+void DesfireCardEmulator::setTiming(const DesfireEmulatorTiming& timing) {
+    _timing = timing;
+}
+
+/**
+ * @brief Get the processing times
+ *
+ * @return const DesfireEmulatorTiming& Processing times in use
+ */
+const DesfireEmulatorTiming& DesfireCardEmulator::getTiming() const {
+    return _timing;
+}
+
+/**
+ * @brief Put the card into or take it out of the field
+ *
+ * @param present true if the card is in the field
+ */
+void DesfireCardEmulator::setPresent(bool present) {
+    _present = present;
+}
+
+/**
+ * @brief Check whether the card is in the field
+ *
+ * @return true if the card is in the field
+ * @return false otherwise
+ */
+bool DesfireCardEmulator::isPresent() const {
+    return _present;
+}
+
+/**
+ * @brief Activate the card after it entered the field
+ */
+void DesfireCardEmulator::activate() {
+    discardChanges();
+    endSession();
+    _selected     = 0;
+    _outputLength = 0;
+    _outputSent   = 0;
+    _frameSize    = DesfireStrategyCache::getFrameSize(_fsci);
+}
+
+/**
+ * @brief Get the frame size (FSC) of the current activation
+ *
+ * @return uint16_t Frame size announced by the ATS at activation
+ */
+uint16_t DesfireCardEmulator::getFrameSize() const {
+    return _frameSize;
+}
+
+/**
+ * @brief Process one frame
+ *
+ * @param frame Native frame or ISO wrapped APDU
+ * @param length Length of the frame
+ * @param response Buffer to store the answer (at least DF_EMU_FRAME_DATA + 2 bytes)
+ * @return uint16_t Length of the answer, 0 if the card stays silent
+ */
+uint16_t DesfireCardEmulator::process(const uint8_t* frame, uint16_t length, uint8_t* response) {
+    _time = _timing.frameDelay + _timing.extraDelay;
+    if (!_present || frame == nullptr || response == nullptr || length == 0) {
+        return 0;
+    }
+
+    // Native frame: command code followed by the data
+    bool           wrapped    = false;
+    uint8_t        command    = frame[0];
+    const uint8_t* data       = &frame[1];
+    uint16_t       dataLength = length - 1;
+
+    if (frame[0] == ISO7816Class::ISO_CLA_DESFIRE && length >= 5) {
+        // 90 INS 00 00 [Lc data] Le
+        wrapped    = true;
+        command    = frame[1];
+        data       = &frame[5];
+        dataLength = (length > 5) ? frame[4] : 0;
+        if (length > 5 && length != dataLength + 6) {
+            return emit(code(DesfireStatus::DFST_LENGTH_ERROR), true, response);
+        }
+    } else if (frame[0] == ISO7816Class::ISO_CLA_STANDARD && length >= 4) {
+        uint16_t sw = executeISO(frame, length);
+        response[0] = sw >> 8;
+        response[1] = sw & 0xFF;
+        return 2;
+    }
+
+    // The timed proximity check rounds answer without processing time
+    if (command != DesfireEV2Command::DF_CMD_PROXIMITY_CHECK) {
+        _time += _timing.commandTime;
+    }
+
+    if (command == DesfireCommand::DF_CMD_GET_ADDITIONAL_FRAME) {
+        return emit(proceed(data, dataLength), wrapped, response);
+    }
+
+    // Any other command ends a running authentication or chained exchange
+    if (_pending == PENDING_AUTH || _pending == PENDING_AUTH_RENEW) {
+        endSession();
+    }
+    _pending = PENDING_NONE;
+
+    if (dataLength > sizeof(_input)) {
+        return emit(code(DesfireStatus::DFST_LENGTH_ERROR), wrapped, response);
+    }
+    memcpy(_input, data, dataLength);
+    _command       = command;
+    _inputLength   = dataLength;
+    _inputExpected = getExpectedLength(command, _input, dataLength);
+
+    uint8_t status;
+    if (_inputExpected > _inputLength) {
+        _pending      = PENDING_COMMAND;
+        _outputLength = 0;
+        _outputSent   = 0;
+        status        = code(DesfireStatus::DFST_MORE_FRAMES);
+    } else {
+        status = execute(command, _input, _inputLength);
+    }
+
+    return emit(status, wrapped, response);
+}
+
+/**
+ * @brief Get the time the card took for the last frame
+ *
+ * @return uint32_t Time from the end of the command to the start of the answer
+ */
+uint32_t DesfireCardEmulator::getProcessingTime() const {
+    return _time;
+}
+
+/**
+ * @brief Check whether an EV2 session is active
+ *
+ * @return true if a session is active
+ * @return false otherwise
+ */
+bool DesfireCardEmulator::isAuthenticated() const {
+    return _session.isActive();
+}
+
+/**
+ * @brief Get the command counter of the session
+ *
+ * @return uint16_t Command counter, 0 without a session
+ */
+uint16_t DesfireCardEmulator::getCommandCounter() const {
+    return _session.isActive() ? _session.getCommandCounter() : 0;
+}
+
+/**
+ * @brief Run a complete command
+ *
+ * @param command Command code
+ * @param data Command data
+ * @param length Length of the command data
+ * @return uint8_t Status code, the response data is left in _output
+ */
+uint8_t DesfireCardEmulator::execute(uint8_t command, uint8_t* data, uint16_t length) {
+    _outputLength = 0;
+    _outputSent   = 0;
+    if (command != DesfireEV2Command::DF_CMD_PROXIMITY_CHECK &&
+        command != DesfireEV2Command::DF_CMD_VERIFY_PC) {
+        _pcLength = 0;
+    }
+
+    switch (command) {
+        case DesfireCommand::DF_CMD_GET_VERSION:
+            if (length != 0) {
+                return code(DesfireStatus::DFST_LENGTH_ERROR);
+            }
+            memcpy(_output, _light ? VERSION_LIGHT : VERSION_HARDWARE, sizeof(VERSION_HARDWARE));
+            _outputLength = sizeof(VERSION_HARDWARE);
+            _versionFrame = 1;
+            _pending      = PENDING_VERSION;
+            return code(DesfireStatus::DFST_MORE_FRAMES);
+
+        case DesfireCommand::DF_CMD_SELECT_APPLICATION: {
+            if (length != 3) {
+                return code(DesfireStatus::DFST_LENGTH_ERROR);
+            }
+            int index = findApplication(data);
+            if (index < 0) {
+                return code(DesfireStatus::DFST_APPLICATION_NOT_FOUND);
+            }
+            discardChanges();
+            endSession();
+            _selected = static_cast<uint8_t>(index);
+            return code(DesfireStatus::DFST_SUCCESS);
+        }
+
+        case DesfireEV2Command::DF_CMD_AUTHENTICATE_EV2_FIRST:
+            if (length < 2) {
+                return code(DesfireStatus::DFST_LENGTH_ERROR);
+            }
+            return authenticate(data[0], true);
+
+        case DesfireEV2Command::DF_CMD_AUTHENTICATE_EV2_NONFIRST:
+            if (length != 1) {
+                return code(DesfireStatus::DFST_LENGTH_ERROR);
+            }
+            return authenticate(data[0], false);
+
+        case DesfireCommand::DF_CMD_READ_DATA:
+        case DesfireEV2Command::DF_CMD_READ_DATA_ISO:
+            return readData(command, data, length);
+
+        case DesfireCommand::DF_CMD_WRITE_DATA:
+        case DesfireEV2Command::DF_CMD_WRITE_DATA_ISO:
+            return writeData(command, data, length);
+
+        case DesfireCommand::DF_CMD_COMMIT_TRANSACTION:
+        case DesfireCommand::DF_CMD_ABORT_TRANSACTION:
+            return finishTransaction(command, data, length);
+
+        case DesfireEV2Command::DF_CMD_CREATE_TRANSACTION_MAC_FILE:
+            return createTransactionMACFile(command, data, length);
+
+        case DesfireCommand::DF_CMD_SET_CONFIGURATION:
+            return setConfiguration(command, data, length);
+
+        case DesfireCommand::DF_CMD_GET_CARD_UID:
+            if (!_session.isActive()) {
+                return code(DesfireStatus::DFST_AUTHENTICATION_ERROR);
+            }
+            if (!_session.unwrapCommand(command, data, &length, 0, DF_COMM_ENCRYPT)) {
+                return code(DesfireStatus::DFST_INTEGRITY_ERROR);
+            }
+            if (length != 0) {
+                return code(DesfireStatus::DFST_LENGTH_ERROR);
+            }
+            memcpy(_output, _uid, sizeof(_uid));
+            return protectOutput(sizeof(_uid), DF_COMM_ENCRYPT);
+
+        case DesfireEV2Command::DF_CMD_GET_COMMAND_COUNTER:
+            // Sent in plain and not counted
+            if (!_session.isActive()) {
+                return code(DesfireStatus::DFST_PERMISSION_DENIED);
+            }
+            _output[0]    = _session.getCommandCounter() & 0xFF;
+            _output[1]    = _session.getCommandCounter() >> 8;
+            _outputLength = 2;
+            return code(DesfireStatus::DFST_SUCCESS);
+
+        case DesfireEV2Command::DF_CMD_SET_COMMAND_COUNTER: {
+            if (!_session.isActive()) {
+                return code(DesfireStatus::DFST_AUTHENTICATION_ERROR);
+            }
+            if (!_session.unwrapCommand(command, data, &length, 0, DF_COMM_MAC)) {
+                return code(DesfireStatus::DFST_INTEGRITY_ERROR);
+            }
+            if (length != 2) {
+                return code(DesfireStatus::DFST_LENGTH_ERROR);
+            }
+
+            // The response is MACed with the old counter, both sides continue from the new one
+            uint16_t counter = data[0] | (data[1] << 8);
+            uint8_t  status  = protectOutput(0, DF_COMM_MAC);
+            _session.setCommandCounter(counter);
+            return status;
+        }
+
+        case DesfireEV2Command::DF_CMD_PREPARE_PC:
+        case DesfireEV2Command::DF_CMD_PROXIMITY_CHECK:
+        case DesfireEV2Command::DF_CMD_VERIFY_PC:
+            return proximityCheck(command, data, length);
+
+        default:
+            return code(DesfireStatus::DFST_ILLEGAL_COMMAND);
+    }
+}
+
+/**
+ * @brief Handle an AF frame
+ *
+ * @param data Frame data
+ * @param length Length of the frame data
+ * @return uint8_t Status code, the response data is left in _output
+ */
+uint8_t DesfireCardEmulator::proceed(const uint8_t* data, uint16_t length) {
+    // Only a chained response continues with the previous output
+    if (_pending != PENDING_RESPONSE) {
+        _outputLength = 0;
+        _outputSent   = 0;
+    }
+
+    switch (_pending) {
+        case PENDING_VERSION:
+            if (_versionFrame == 1) {
+                const uint8_t* software = _light ? VERSION_LIGHT : VERSION_SOFTWARE;
+                memcpy(_output, software, sizeof(VERSION_SOFTWARE));
+                _outputLength = sizeof(VERSION_SOFTWARE);
+                _versionFrame = 2;
+                return code(DesfireStatus::DFST_MORE_FRAMES);
+            }
+            memcpy(_output, _uid, sizeof(_uid));
+            memcpy(&_output[sizeof(_uid)], VERSION_PRODUCTION, sizeof(VERSION_PRODUCTION));
+            _outputLength = sizeof(_uid) + sizeof(VERSION_PRODUCTION);
+            _pending      = PENDING_NONE;
+            return code(DesfireStatus::DFST_SUCCESS);
+
+        case PENDING_RESPONSE:
+            // emit() continues where the previous frame ended
+            return code(DesfireStatus::DFST_SUCCESS);
+
+        case PENDING_COMMAND:
+            if (_inputLength + length > _inputExpected) {
+                return code(DesfireStatus::DFST_LENGTH_ERROR);
+            }
+            memcpy(&_input[_inputLength], data, length);
+            _inputLength += length;
+            if (_inputLength < _inputExpected) {
+                return code(DesfireStatus::DFST_MORE_FRAMES);
+            }
+            _pending = PENDING_NONE;
+            return execute(_command, _input, _inputLength);
+
+        case PENDING_AUTH:
+        case PENDING_AUTH_RENEW:
+            return completeAuthentication(data, length);
+
+        default:
+            return code(DesfireStatus::DFST_ILLEGAL_COMMAND);
+    }
+}
+
+/**
+ * @brief Run the first part of an EV2 authentication
+ *
+ * @param keyNo Key number
+ * @param first true for AuthenticateEV2First, false for NonFirst
+ * @return uint8_t Status code
+ */
+uint8_t DesfireCardEmulator::authenticate(uint8_t keyNo, bool first) {
+    const Application& app = _apps[_selected];
+    if (!first && !_session.isActive()) {
+        return code(DesfireStatus::DFST_AUTHENTICATION_ERROR);
+    }
+    if (keyNo >= app.keyCount) {
+        return code(DesfireStatus::DFST_NO_SUCH_KEY);
+    }
+    if (first) {
+        endSession();
+    }
+
+    // E(K, RndB) with a zero IV
+    fillRandom(_rndB, sizeof(_rndB));
+    DesfireAES cipher(app.keys[keyNo]);
+    uint8_t    iv[DF_AES_BLOCK_SIZE] = {0};
+    cipher.encryptCBC(iv, _rndB, _output, DF_AES_BLOCK_SIZE);
+    chargeCrypto(DF_AES_BLOCK_SIZE);
+
+    _outputLength = DF_AES_BLOCK_SIZE;
+    _pendingKeyNo = keyNo;
+    _pending      = first ? PENDING_AUTH : PENDING_AUTH_RENEW;
+    return code(DesfireStatus::DFST_MORE_FRAMES);
+}
+
+/**
+ * @brief Run the second part of an EV2 authentication
+ *
+ * @param data Encrypted RndA || RndB'
+ * @param length Length of the data
+ * @return uint8_t Status code
+ */
+uint8_t DesfireCardEmulator::completeAuthentication(const uint8_t* data, uint16_t length) {
+    bool first = (_pending == PENDING_AUTH);
+    _pending   = PENDING_NONE;
+    if (length != 2 * DF_AES_BLOCK_SIZE) {
+        return code(DesfireStatus::DFST_LENGTH_ERROR);
+    }
+
+    const uint8_t* key = _apps[_selected].keys[_pendingKeyNo];
+    DesfireAES     cipher(key);
+    uint8_t        token[2 * DF_AES_BLOCK_SIZE];
+    uint8_t        iv[DF_AES_BLOCK_SIZE] = {0};
+    cipher.decryptCBC(iv, data, token, sizeof(token));
+    chargeCrypto(sizeof(token));
+
+    // The reader proves knowledge of the key with RndB rotated left by one byte
+    const uint8_t* rndA = token;
+    if (memcmp(&token[DF_AES_BLOCK_SIZE], &_rndB[1], DF_AES_BLOCK_SIZE - 1) != 0 ||
+        token[2 * DF_AES_BLOCK_SIZE - 1] != _rndB[0]) {
+        memset(token, 0, sizeof(token));
+        return code(DesfireStatus::DFST_AUTHENTICATION_ERROR);
+    }
+
+    // First: E(K, TI || RndA' || PDcap2 || PCDcap2), NonFirst: E(K, RndA')
+    uint8_t answer[2 * DF_AES_BLOCK_SIZE];
+    uint8_t offset = 0;
+    memset(answer, 0, sizeof(answer));
+    if (first) {
+        fillRandom(answer, DF_EV2_TI_LENGTH);
+        offset = DF_EV2_TI_LENGTH;
+    }
+    memcpy(&answer[offset], &rndA[1], DF_AES_BLOCK_SIZE - 1);
+    answer[offset + DF_AES_BLOCK_SIZE - 1] = rndA[0];
+
+    _outputLength = first ? 2 * DF_AES_BLOCK_SIZE : DF_AES_BLOCK_SIZE;
+    memset(iv, 0, sizeof(iv));
+    cipher.encryptCBC(iv, answer, _output, _outputLength);
+
+    // The answer and the CMACs of both session keys
+    chargeCrypto(_outputLength + 4 * DF_AES_BLOCK_SIZE);
+    if (first) {
+        _session.begin(key, rndA, _rndB, answer);
+    } else {
+        _session.renew(key, rndA, _rndB);
+    }
+    _authKeyNo = _pendingKeyNo;
+
+    memset(token, 0, sizeof(token));
+    memset(answer, 0, sizeof(answer));
+    memset(_rndB, 0, sizeof(_rndB));
+    return code(DesfireStatus::DFST_SUCCESS);
+}
+
+/**
+ * @brief Run ReadData
+ *
+ * @param command Command code
+ * @param data Command header and MAC
+ * @param length Length of the data
+ * @return uint8_t Status code
+ */
+uint8_t DesfireCardEmulator::readData(uint8_t command, uint8_t* data, uint16_t length) {
+    if (length < EMU_HEADER_SIZE) {
+        return code(DesfireStatus::DFST_LENGTH_ERROR);
+    }
+    File* file = findFile(data[0]);
+    if (file == nullptr) {
+        return code(DesfireStatus::DFST_FILE_NOT_FOUND);
+    }
+    uint8_t status = checkAccess(file->settings.readKey);
+    if (status != code(DesfireStatus::DFST_SUCCESS)) {
+        return status;
+    }
+
+    DesfreCommunicationMode mode = getCommMode(*file, file->settings.readKey);
+    if (!_session.unwrapCommand(command, data, &length, EMU_HEADER_SIZE, mode)) {
+        return code(DesfireStatus::DFST_INTEGRITY_ERROR);
+    }
+    if (length != EMU_HEADER_SIZE) {
+        return code(DesfireStatus::DFST_LENGTH_ERROR);
+    }
+
+    // A length of zero reads up to the end of the file
+    uint32_t offset = readLength(&data[1]);
+    uint32_t count  = readLength(&data[4]);
+    if (offset >= file->settings.size) {
+        return code(DesfireStatus::DFST_BOUNDARY_ERROR);
+    }
+    if (count == 0) {
+        count = file->settings.size - offset;
+    }
+    if (offset + count > file->settings.size) {
+        return code(DesfireStatus::DFST_BOUNDARY_ERROR);
+    }
+    if (count + DF_AES_BLOCK_SIZE + DF_MACT_SIZE > sizeof(_output)) {
+        return code(DesfireStatus::DFST_LENGTH_ERROR);
+    }
+
+    memcpy(_output, &_storage[file->offset + offset], count);
+    return protectOutput(static_cast<uint16_t>(count), mode);
+}
+
+/**
+ * @brief Run WriteData
+ *
+ * @param command Command code
+ * @param data Command header, data and MAC
+ * @param length Length of the data
+ * @return uint8_t Status code
+ */
+uint8_t DesfireCardEmulator::writeData(uint8_t command, uint8_t* data, uint16_t length) {
+    if (length < EMU_HEADER_SIZE) {
+        return code(DesfireStatus::DFST_LENGTH_ERROR);
+    }
+    File* file = findFile(data[0]);
+    if (file == nullptr) {
+        return code(DesfireStatus::DFST_FILE_NOT_FOUND);
+    }
+    uint8_t status = checkAccess(file->settings.writeKey);
+    if (status != code(DesfireStatus::DFST_SUCCESS)) {
+        return status;
+    }
+
+    DesfreCommunicationMode mode = getCommMode(*file, file->settings.writeKey);
+    if (!_session.unwrapCommand(command, data, &length, EMU_HEADER_SIZE, mode)) {
+        return code(DesfireStatus::DFST_INTEGRITY_ERROR);
+    }
+
+    uint32_t offset = readLength(&data[1]);
+    uint32_t count  = readLength(&data[4]);
+    if (count == 0 || length != EMU_HEADER_SIZE + count) {
+        return code(DesfireStatus::DFST_LENGTH_ERROR);
+    }
+    if (offset + count > file->settings.size) {
+        return code(DesfireStatus::DFST_BOUNDARY_ERROR);
+    }
+
+    // Backup files change their second image until the commit
+    uint16_t target = (file->settings.type == DF_FILE_BACKUP) ? file->shadow : file->offset;
+    memcpy(&_storage[target + offset], &data[EMU_HEADER_SIZE], count);
+    file->dirty = (file->settings.type == DF_FILE_BACKUP);
+
+    uint32_t pages = (offset % DF_EMU_PAGE_SIZE + count + DF_EMU_PAGE_SIZE - 1) / DF_EMU_PAGE_SIZE;
+    _time += pages * _timing.writeTime;
+
+    return protectOutput(0, mode);
+}
+
+/**
+ * @brief Run CreateTransactionMACFile
+ *
+ * @param command Command code
+ * @param data Plain header, encrypted TMKey || TMKeyVer and MAC
+ * @param length Length of the data
+ * @return uint8_t Status code
+ */
+uint8_t DesfireCardEmulator::createTransactionMACFile(uint8_t  command,
+                                                      uint8_t* data,
+                                                      uint16_t length) {
+    if (!_session.isActive()) {
+        return code(DesfireStatus::DFST_AUTHENTICATION_ERROR);
+    }
+    if (_authKeyNo != 0) {
+        return code(DesfireStatus::DFST_PERMISSION_DENIED);
+    }
+    if (length < EMU_TMAC_HEADER_SIZE) {
+        return code(DesfireStatus::DFST_LENGTH_ERROR);
+    }
+    if (!_session.unwrapCommand(command, data, &length, EMU_TMAC_HEADER_SIZE, DF_COMM_ENCRYPT)) {
+        return code(DesfireStatus::DFST_INTEGRITY_ERROR);
+    }
+    if (length != EMU_TMAC_HEADER_SIZE + DF_AES_KEY_SIZE + 1) {
+        return code(DesfireStatus::DFST_LENGTH_ERROR);
+    }
+    if (data[4] != DF_EV2_TM_KEY_AES || (data[1] & ~0x03) != 0) {
+        return code(DesfireStatus::DFST_PARAMETER_ERROR);
+    }
+
+    // One transaction MAC file per application
+    Application& app = _apps[_selected];
+    for (uint8_t i = 0; i < app.fileCount; i++) {
+        if (app.files[i].settings.fileNo == data[0] ||
+            app.files[i].settings.type == DF_FILE_TMAC) {
+            return code(DesfireStatus::DFST_DUPLICATE_ERROR);
+        }
+    }
+
+    // TMC || TMV, followed by the key and its version
+    uint16_t size   = DF_EV2_TMC_LENGTH + DF_EV2_TMV_LENGTH;
+    uint16_t needed = size + DF_AES_KEY_SIZE + 1;
+    if (app.fileCount >= DF_EMU_MAX_FILES || _storageUsed + needed > sizeof(_storage)) {
+        return code(DesfireStatus::DFST_OUT_OF_EEPROM);
+    }
+
+    File& entry             = app.files[app.fileCount++];
+    entry.settings.fileNo   = data[0];
+    entry.settings.type     = DF_FILE_TMAC;
+    entry.settings.commMode = static_cast<DesfreCommunicationMode>(data[1]);
+    entry.settings.readKey  = data[3] >> 4;
+    entry.settings.writeKey = DF_AR_NEVER;
+    entry.settings.size     = size;
+    entry.offset            = _storageUsed;
+    entry.shadow            = _storageUsed;
+    entry.dirty             = false;
+    memset(&_storage[entry.offset], 0, size);
+    memcpy(&_storage[entry.offset + size], &data[EMU_TMAC_HEADER_SIZE], DF_AES_KEY_SIZE + 1);
+    _storageUsed += needed;
+    _time += _timing.writeTime;
+
+    return protectOutput(0, DF_COMM_MAC);
+}
+
+/**
+ * @brief Run an interindustry command, only the Light application selection is emulated
+ *
+ * @param apdu Command APDU
+ * @param length Length of the APDU
+ * @return uint16_t Status word
+ */
+uint16_t DesfireCardEmulator::executeISO(const uint8_t* apdu, uint16_t length) {
+    if (!_light || apdu[1] != ISO7816Instruction::ISO_INS_SELECT_FILE) {
+        return ISO7816StatusWord::ISO_SW_INS_NOT_SUPPORTED;
+    }
+    _time += _timing.commandTime;
+
+    // 00 A4 04 0C Lc DF name [Le]
+    if (apdu[2] != 0x04 || length < 5 + sizeof(LIGHT_DF_NAME) ||
+        apdu[4] != sizeof(LIGHT_DF_NAME) ||
+        memcmp(&apdu[5], LIGHT_DF_NAME, sizeof(LIGHT_DF_NAME)) != 0 || _appCount < 2) {
+        return ISO7816StatusWord::ISO_SW_FILE_NOT_FOUND;
+    }
+    discardChanges();
+    endSession();
+    _selected = 1;
+    return ISO7816StatusWord::ISO_SW_SUCCESS;
+}
+
+/**
+ * @brief Run SetConfiguration, only the ATS option is emulated
+ *
+ * @param command Command code
+ * @param data Option, encrypted option data and MAC
+ * @param length Length of the data
+ * @return uint8_t Status code
+ */
+uint8_t DesfireCardEmulator::setConfiguration(uint8_t command, uint8_t* data, uint16_t length) {
+    if (!_session.isActive()) {
+        return code(DesfireStatus::DFST_AUTHENTICATION_ERROR);
+    }
+    if (_selected != 0 || _authKeyNo != 0) {
+        return code(DesfireStatus::DFST_PERMISSION_DENIED);
+    }
+    if (length < 1) {
+        return code(DesfireStatus::DFST_LENGTH_ERROR);
+    }
+    if (!_session.unwrapCommand(command, data, &length, 1, DF_COMM_ENCRYPT)) {
+        return code(DesfireStatus::DFST_INTEGRITY_ERROR);
+    }
+    if (data[0] != DF_CONFIG_ATS) {
+        return code(DesfireStatus::DFST_PARAMETER_ERROR);
+    }
+
+    // TL counts the whole ATS, T0 carries FSCI
+    const uint8_t* ats       = &data[1];
+    uint16_t       atsLength = length - 1;
+    if (atsLength < 2 || atsLength > DF_CONFIG_ATS_MAX_LENGTH || ats[0] != atsLength) {
+        return code(DesfireStatus::DFST_LENGTH_ERROR);
+    }
+    _fsci = ats[1] & 0x0F;
+    _time += _timing.writeTime;
+
+    return protectOutput(0, DF_COMM_MAC);
+}
+
+/**
+ * @brief Run CommitTransaction or AbortTransaction
+ *
+ * @param command Command code
+ * @param data Option and MAC
+ * @param length Length of the data
+ * @return uint8_t Status code
+ */
+uint8_t DesfireCardEmulator::finishTransaction(uint8_t command, uint8_t* data, uint16_t length) {
+    DesfreCommunicationMode mode = _session.isActive() ? DF_COMM_MAC : DF_COMM_PLAIN;
+    if (!_session.unwrapCommand(command, data, &length, 0, mode)) {
+        return code(DesfireStatus::DFST_INTEGRITY_ERROR);
+    }
+
+    bool commit = (command == DesfireCommand::DF_CMD_COMMIT_TRANSACTION);
+    if (length > (commit ? 1 : 0)) {
+        return code(DesfireStatus::DFST_LENGTH_ERROR);
+    }
+
+    // Transaction MACs are not computed
+    if (length == 1 && (data[0] & DF_EV2_COMMIT_RETURN_TMAC)) {
+        return code(DesfireStatus::DFST_PARAMETER_ERROR);
+    }
+
+    Application& app     = _apps[_selected];
+    bool         changed = false;
+    for (uint8_t i = 0; i < app.fileCount; i++) {
+        File& file = app.files[i];
+        if (file.dirty) {
+            if (commit) {
+                memcpy(&_storage[file.offset], &_storage[file.shadow], file.settings.size);
+            } else {
+                memcpy(&_storage[file.shadow], &_storage[file.offset], file.settings.size);
+            }
+            file.dirty = false;
+            changed    = true;
+        }
+    }
+    if (changed) {
+        _time += _timing.commitTime;
+    }
+
+    return protectOutput(0, mode);
+}
+
+/**
+ * @brief Run one of the proximity check commands
+ *
+ * @param command Command code
+ * @param data Command data
+ * @param length Length of the data
+ * @return uint8_t Status code
+ */
+uint8_t DesfireCardEmulator::proximityCheck(uint8_t command, const uint8_t* data, uint16_t length) {
+    if (!_session.isActive()) {
+        return code(DesfireStatus::DFST_AUTHENTICATION_ERROR);
+    }
+
+    switch (command) {
+        case DesfireEV2Command::DF_CMD_PREPARE_PC:
+            if (length != 0) {
+                return code(DesfireStatus::DFST_LENGTH_ERROR);
+            }
+            _output[0]    = EMU_OPT;
+            _output[1]    = EMU_PUB_RESP_TIME >> 8;
+            _output[2]    = EMU_PUB_RESP_TIME & 0xFF;
+            _outputLength = 3;
+
+            // MAC input: FDh || OPT || pubRespTime, the rounds follow
+            _pcInput[0] = DesfireEV2Command::DF_CMD_VERIFY_PC;
+            memcpy(&_pcInput[1], _output, _outputLength);
+            _pcLength = 1 + _outputLength;
+            return code(DesfireStatus::DFST_SUCCESS);
+
+        case DesfireEV2Command::DF_CMD_PROXIMITY_CHECK: {
+            if (_pcLength == 0) {
+                return code(DesfireStatus::DFST_PERMISSION_DENIED);
+            }
+            uint8_t part = (length > 0) ? data[0] : 0;
+            if (part == 0 || length != 1 + part ||
+                _pcLength + 2u * part > sizeof(_pcInput)) {
+                return code(DesfireStatus::DFST_LENGTH_ERROR);
+            }
+            fillRandom(_output, part);
+            memcpy(&_pcInput[_pcLength], _output, part);
+            memcpy(&_pcInput[_pcLength + part], &data[1], part);
+            _pcLength += 2 * part;
+            _outputLength = part;
+            return code(DesfireStatus::DFST_SUCCESS);
+        }
+
+        default: {
+            if (_pcLength <= 4 || length != DF_MACT_SIZE) {
+                _pcLength = 0;
+                return code(DesfireStatus::DFST_PERMISSION_DENIED);
+            }
+
+            uint8_t mac[DF_MACT_SIZE];
+            _session.computeMAC(_pcInput, _pcLength, mac);
+            chargeCrypto(2 * _pcLength);
+            uint8_t diff = 0;
+            for (uint8_t i = 0; i < DF_MACT_SIZE; i++) {
+                diff |= mac[i] ^ data[i];
+            }
+            if (diff != 0) {
+                _pcLength = 0;
+                return code(DesfireStatus::DFST_AUTHENTICATION_ERROR);
+            }
+
+            // The card MACs the same input with 90h in front
+            _pcInput[0] = DF_PC_VERIFY_RESULT;
+            _session.computeMAC(_pcInput, _pcLength, _output);
+            _outputLength = DF_MACT_SIZE;
+            _pcLength     = 0;
+            return code(DesfireStatus::DFST_SUCCESS);
+        }
+    }
+}
+
+/**
+ * @brief Get the length of a command once all chained frames arrived
+ *
+ * Only WriteData is longer than a frame; its length follows from the
+ * header and the communication mode of the file.
+ *
+ * @param command Command code
+ * @param data Data of the first frame
+ * @param length Length of the data
+ * @return uint16_t Expected length of the command data
+ */
+uint16_t DesfireCardEmulator::getExpectedLength(uint8_t        command,
+                                                const uint8_t* data,
+                                                uint16_t       length) {
+    if ((command != DesfireCommand::DF_CMD_WRITE_DATA &&
+         command != DesfireEV2Command::DF_CMD_WRITE_DATA_ISO) ||
+        length < EMU_HEADER_SIZE) {
+        return length;
+    }
+    const File* file = findFile(data[0]);
+    if (file == nullptr) {
+        return length;
+    }
+
+    uint32_t count    = readLength(&data[4]);
+    uint32_t expected = EMU_HEADER_SIZE + count;
+    if (_session.isActive()) {
+        DesfreCommunicationMode mode = getCommMode(*file, file->settings.writeKey);
+        if (mode == DF_COMM_ENCRYPT) {
+            expected = EMU_HEADER_SIZE + (count / DF_AES_BLOCK_SIZE + 1) * DF_AES_BLOCK_SIZE;
+        }
+        if (mode != DF_COMM_PLAIN) {
+            expected += DF_MACT_SIZE;
+        }
+    }
+
+    // Oversized commands fail in writeData()
+    return (expected > sizeof(_input) || expected < length) ? length
+                                                            : static_cast<uint16_t>(expected);
+}
+
+/**
+ * @brief Check an access right against the session
+ *
+ * @param access Access right (DF_AR_KEY0 to DF_AR_NEVER)
+ * @return uint8_t Status code
+ */
+uint8_t DesfireCardEmulator::checkAccess(uint8_t access) const {
+    if (access == DF_AR_FREE) {
+        return code(DesfireStatus::DFST_SUCCESS);
+    }
+    if (access == DF_AR_NEVER) {
+        return code(DesfireStatus::DFST_PERMISSION_DENIED);
+    }
+    if (!_session.isActive()) {
+        return code(DesfireStatus::DFST_AUTHENTICATION_ERROR);
+    }
+    return (access == _authKeyNo) ? code(DesfireStatus::DFST_SUCCESS)
+                                  : code(DesfireStatus::DFST_PERMISSION_DENIED);
+}
+
+/**
+ * @brief Get the communication mode of an access
+ *
+ * @param file File
+ * @param access Access right used
+ * @return DesfreCommunicationMode Mode of the command and response
+ */
+DesfreCommunicationMode DesfireCardEmulator::getCommMode(const File& file, uint8_t access) const {
+    return (access == DF_AR_FREE) ? DF_COMM_PLAIN : file.settings.commMode;
+}
+
+/**
+ * @brief Protect the response data in _output with the session
+ *
+ * @param length Length of the plain response data
+ * @param mode Communication mode
+ * @return uint8_t Status code
+ */
+uint8_t DesfireCardEmulator::protectOutput(uint16_t length, DesfreCommunicationMode mode) {
+    uint16_t protectedLength =
+        _session.wrapResponse(0x00, _output, length, mode, _output, sizeof(_output));
+    if (protectedLength < length) {
+        return code(DesfireStatus::DFST_LENGTH_ERROR);
+    }
+    if (protectedLength > length) {
+        chargeCrypto(protectedLength);
+    }
+
+    _outputLength = protectedLength;
+    return code(DesfireStatus::DFST_SUCCESS);
+}
+
+/**
+ * @brief Build the next frame of the response
+ *
+ * @param status Status code of the command
+ * @param wrapped true for an ISO wrapped answer
+ * @param response Buffer to store the frame
+ * @return uint16_t Length of the frame
+ */
+uint16_t DesfireCardEmulator::emit(uint8_t status, bool wrapped, uint8_t* response) {
+    uint16_t chunk = 0;
+    if (status == code(DesfireStatus::DFST_SUCCESS)) {
+        // Long responses continue with AF frames
+        chunk    = _outputLength - _outputSent;
+        _pending = PENDING_NONE;
+        if (chunk > DF_EMU_FRAME_DATA) {
+            chunk    = DF_EMU_FRAME_DATA;
+            status   = code(DesfireStatus::DFST_MORE_FRAMES);
+            _pending = PENDING_RESPONSE;
+        }
+    } else if (status == code(DesfireStatus::DFST_MORE_FRAMES)) {
+        chunk = _outputLength - _outputSent;
+    } else {
+        // Errors end the session and any chained exchange
+        endSession();
+        _pcLength     = 0;
+        _outputLength = 0;
+        _outputSent   = 0;
+    }
+
+    const uint8_t* data = &_output[_outputSent];
+    _outputSent += chunk;
+
+    if (wrapped) {
+        memcpy(response, data, chunk);
+        response[chunk]     = EMU_SW1_DESFIRE;
+        response[chunk + 1] = status;
+        return chunk + 2;
+    }
+
+    response[0] = status;
+    memcpy(&response[1], data, chunk);
+    return chunk + 1;
+}
+
+/**
+ * @brief End the session and discard the running command
+ */
+void DesfireCardEmulator::endSession() {
+    _session.reset();
+    _authKeyNo = EMU_NO_KEY;
+    _pending   = PENDING_NONE;
+}
+
+/**
+ * @brief Discard the uncommitted changes of the selected application
+ */
+void DesfireCardEmulator::discardChanges() {
+    Application& app = _apps[_selected];
+    for (uint8_t i = 0; i < app.fileCount; i++) {
+        File& file = app.files[i];
+        if (file.dirty) {
+            memcpy(&_storage[file.shadow], &_storage[file.offset], file.settings.size);
+            file.dirty = false;
+        }
+    }
+}
+
+/**
+ * @brief Find an application
+ *
+ * @param aid Application ID (3 bytes)
+ * @return int Index into _apps, -1 if not found
+ */
+int DesfireCardEmulator::findApplication(const uint8_t* aid) const {
+    if (aid == nullptr) {
+        return -1;
+    }
+    for (uint8_t i = 0; i < _appCount; i++) {
+        if (memcmp(_apps[i].aid, aid, sizeof(_apps[i].aid)) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Find a file of the selected application
+ *
+ * @param fileNo File number
+ * @return File* File, nullptr if not found
+ */
+DesfireCardEmulator::File* DesfireCardEmulator::findFile(uint8_t fileNo) {
+    Application& app = _apps[_selected];
+    for (uint8_t i = 0; i < app.fileCount; i++) {
+        if (app.files[i].settings.fileNo == fileNo) {
+            return &app.files[i];
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Add the time of AES operations on a number of bytes
+ *
+ * @param length Number of bytes
+ */
+void DesfireCardEmulator::chargeCrypto(uint16_t length) {
+    // One block more for the IV or the CMAC subkey
+    _time += ((length + DF_AES_BLOCK_SIZE - 1) / DF_AES_BLOCK_SIZE + 1) * _timing.cryptoTime;
+}
+
+/**
+ * @brief Fill a buffer from the random generator (xorshift32)
+ *
+ * @param buffer Buffer to fill
+ * @param length Number of bytes
+ */
+void DesfireCardEmulator::fillRandom(uint8_t* buffer, uint8_t length) {
+    for (uint8_t i = 0; i < length; i++) {
+        _random ^= _random << 13;
+        _random ^= _random >> 17;
+        _random ^= _random << 5;
+        buffer[i] = static_cast<uint8_t>(_random >> 24);
+    }
+}
+
+/**
+ * @brief Construct a reader
+ *
+ * @param card Emulated card, must outlive the reader
+ * @param clock Clock that receives the simulated time, must outlive the reader
+ */
+DesfireEmulatedReader::DesfireEmulatedReader(DesfireCardEmulator& card, DesfireClock& clock)
+    : _card(card) {
+    _hostLatency     = DF_EMU_HOST_LATENCY;
+    _responseTimeout = 0;
+    _bitRate         = EMU_BASE_BITRATE;
+    _active          = false;
+    setClock(&clock);
+}
+
+/**
+ * @brief Initialize the reader
+ *
+ * @return true always
+ */
+bool DesfireEmulatedReader::begin() {
+    return true;
+}
+
+/**
+ * @brief Get the firmware version of the reader
+ *
+ * @return uint32_t Fixed version of the emulated reader
+ */
+uint32_t DesfireEmulatedReader::getFirmwareVersion() {
+    return EMU_FIRMWARE_VERSION;
+}
+
+/**
+ * @brief Configure the reader for card communication
+ *
+ * @return true always
+ */
+bool DesfireEmulatedReader::configure() {
+    return true;
+}
+
+/**
+ * @brief Activate the card if it is in the field
+ *
+ * @param uid Buffer to store the card UID
+ * @param uidLength Pointer to variable that will store the UID length
+ * @return true if a card was detected
+ * @return false if no card was detected
+ */
+bool DesfireEmulatedReader::detectCard(uint8_t* uid, uint8_t* uidLength) {
+    // A poll costs the same with or without a card
+    getClock().delayMicros(_hostLatency + DF_EMU_ACTIVATION_TIME);
+    _bitRate = EMU_BASE_BITRATE;
+    _active  = _card.isPresent();
+    if (!_active) {
+        return false;
+    }
+
+    _card.activate();
+    memcpy(uid, _card.getUID(), DF_EMU_UID_SIZE);
+    *uidLength = DF_EMU_UID_SIZE;
+    return true;
+}
+
+/**
+ * @brief Send a frame to the card and receive the answer
+ *
+ * @param txData Data to transmit
+ * @param txLength Length of data to transmit
+ * @param rxData Buffer to store the response
+ * @param rxLength Size of rxData in, length of the response out
+ * @return true if the card answered in time
+ * @return false if the card is gone, silent or too slow
+ */
+bool DesfireEmulatedReader::transceive(const uint8_t* txData,
+                                       uint16_t       txLength,
+                                       uint8_t*       rxData,
+                                       uint16_t*      rxLength) {
+    DesfireClock& clock = getClock();
+    uint32_t      sent  = _hostLatency + getFrameTime(txLength);
+    uint32_t      wait  = (_responseTimeout > 0) ? _responseTimeout : DF_EMU_FRAME_WAIT_TIME;
+
+    if (!_active || !_card.isPresent()) {
+        _active = false;
+        clock.delayMicros(sent + wait);
+        return false;
+    }
+
+    // Every frame goes out as one block, the card ignores blocks beyond its frame size
+    if (txLength + EMU_FRAME_OVERHEAD > _card.getFrameSize()) {
+        clock.delayMicros(sent + wait);
+        return false;
+    }
+
+    // A late answer is lost even though the card processed the command
+    uint8_t  response[DF_EMU_FRAME_DATA + 2];
+    uint16_t length   = _card.process(txData, txLength, response);
+    uint32_t cardTime = _card.getProcessingTime();
+    if (length == 0 || cardTime > wait) {
+        clock.delayMicros(sent + wait);
+        return false;
+    }
+
+    clock.delayMicros(sent + cardTime + getFrameTime(length));
+    if (length > *rxLength) {
+        return false;
+    }
+    memcpy(rxData, response, length);
+    *rxLength = length;
+    return true;
+}
+
+/**
+ * @brief Limit the time the card may take to answer
+ *
+ * @param timeout Longest accepted card response time in microseconds, 0 for the default
+ * @return true always
+ */
+bool DesfireEmulatedReader::setResponseTimeout(uint32_t timeout) {
+    _responseTimeout = timeout;
+    return true;
+}
+
+/**
+ * @brief Change the bit rate of the activated card
+ *
+ * @param kbps Bit rate in kbit/s for both directions (106, 212, 424 or 848)
+ * @return true if the bit rate is in use
+ * @return false if no card is active or the bit rate is invalid
+ */
+bool DesfireEmulatedReader::setBitRate(uint16_t kbps) {
+    if (!_active || (kbps != 106 && kbps != 212 && kbps != 424 && kbps != 848)) {
+        return false;
+    }
+
+    // PPS request and response at the old bit rate
+    getClock().delayMicros(_hostLatency + 2 * getFrameTime(2));
+    _bitRate = kbps;
+    return true;
+}
+
+/**
+ * @brief Set the latency of the host link
+ *
+ * @param latency Time added to every exchange in microseconds
+ */
+void DesfireEmulatedReader::setHostLatency(uint32_t latency) {
+    _hostLatency = latency;
+}
+
+/**
+ * @brief Get the bit rate in use
+ *
+ * @return uint16_t Bit rate in kbit/s
+ */
+uint16_t DesfireEmulatedReader::getBitRate() const {
+    return _bitRate;
+}
+
+/**
+ * @brief Get the RF time of a frame
+ *
+ * @param length Length of the frame data
+ * @return uint32_t Time in microseconds at the current bit rate
+ */
+uint32_t DesfireEmulatedReader::getFrameTime(uint16_t length) const {
+    uint32_t bits = (length + EMU_FRAME_OVERHEAD) * EMU_BITS_PER_BYTE + EMU_FRAME_BITS;
+    return bits * 1000 / _bitRate;
+}
@@ -0,0 +1,153 @@
+/**
+ * @file DesfireFileCache.cpp
+ * @brief Implementation of the counter-validated file cache
+ */
+
+#include "DesfireFileCache.h"
+
+#include <string.h>
+
+/**
+ * @brief Construct an empty cache
+ */
+DesfireFileCache::DesfireFileCache() {
+    clear();
+}
+
+/**
+ * @brief Find the entry for a file range regardless of its counter
+ *
+ * @return Entry* Matching entry, nullptr if none
+ */
+DesfireFileCache::Entry* DesfireFileCache::find(const uint8_t* uid,
+                                                uint8_t        uidLength,
+                                                const uint8_t* aid,
+                                                uint8_t        fileNo,
+                                                uint32_t       offset,
+                                                uint32_t       length) {
+    for (uint8_t i = 0; i < DF_FILE_CACHE_ENTRIES; i++) {
+        Entry& entry = _entries[i];
+        if (entry.uidLength == uidLength && entry.fileNo == fileNo && entry.offset == offset &&
+            entry.length == length && memcmp(entry.uid, uid, uidLength) == 0 &&
+            memcmp(entry.aid, aid, sizeof(entry.aid)) == 0) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Look up a cached file range
+ *
+ * @param uid Card UID
+ * @param uidLength Length of the UID
+ * @param aid Application ID (3 bytes)
+ * @param fileNo File number
+ * @param offset Offset within the file
+ * @param length Length of the range
+ * @param counter Current value of the validating counter
+ * @return const uint8_t* Cached data, nullptr if not cached or stale
+ */
+const uint8_t* DesfireFileCache::lookup(const uint8_t* uid,
+                                        uint8_t        uidLength,
+                                        const uint8_t* aid,
+                                        uint8_t        fileNo,
+                                        uint32_t       offset,
+                                        uint32_t       length,
+                                        uint32_t       counter) {
+    if (uid == nullptr || aid == nullptr || uidLength == 0 || uidLength > DF_FILE_CACHE_UID_SIZE) {
+        return nullptr;
+    }
+
+    Entry* entry = find(uid, uidLength, aid, fileNo, offset, length);
+    if (entry == nullptr) {
+        return nullptr;
+    }
+
+    // The card changed since the data was cached
+    if (entry->counter != counter) {
+        memset(entry, 0, sizeof(Entry));
+        return nullptr;
+    }
+
+    entry->lastUse = ++_useCounter;
+    return entry->data;
+}
+
+/**
+ * @brief Store a file range, replacing the least recently used entry
+ *
+ * @param uid Card UID
+ * @param uidLength Length of the UID
+ * @param aid Application ID (3 bytes)
+ * @param fileNo File number
+ * @param offset Offset within the file
+ * @param length Length of the range
+ * @param counter Value of the validating counter when the data was read
+ * @param data File data
+ * @return true if the range was stored
+ * @return false if the range is too large to be cached
+ */
+bool DesfireFileCache::store(const uint8_t* uid,
+                             uint8_t        uidLength,
+                             const uint8_t* aid,
+                             uint8_t        fileNo,
+                             uint32_t       offset,
+                             uint32_t       length,
+                             uint32_t       counter,
+                             const uint8_t* data) {
+    if (uid == nullptr || aid == nullptr || data == nullptr || uidLength == 0 ||
+        uidLength > DF_FILE_CACHE_UID_SIZE || length > DF_FILE_CACHE_DATA_SIZE) {
+        return false;
+    }
+
+    Entry* entry = find(uid, uidLength, aid, fileNo, offset, length);
+    if (entry == nullptr) {
+        // Free entries have a zero use stamp and are picked first
+        entry = &_entries[0];
+        for (uint8_t i = 1; i < DF_FILE_CACHE_ENTRIES; i++) {
+            if (_entries[i].lastUse < entry->lastUse) {
+                entry = &_entries[i];
+            }
+        }
+    }
+
+    memcpy(entry->uid, uid, uidLength);
+    entry->uidLength = uidLength;
+    memcpy(entry->aid, aid, sizeof(entry->aid));
+    entry->fileNo  = fileNo;
+    entry->offset  = offset;
+    entry->length  = length;
+    entry->counter = counter;
+    entry->lastUse = ++_useCounter;
+    memcpy(entry->data, data, length);
+
+    return true;
+}
+
+/**
+ * @brief Drop all entries of a card
+ *
+ * @param uid Card UID
+ * @param uidLength Length of the UID
+ */
+void DesfireFileCache::invalidate(const uint8_t* uid, uint8_t uidLength) {
+    if (uid == nullptr) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < DF_FILE_CACHE_ENTRIES; i++) {
+        Entry& entry = _entries[i];
+        if (entry.uidLength == uidLength && memcmp(entry.uid, uid, uidLength) == 0) {
+            memset(&entry, 0, sizeof(Entry));
+        }
+    }
+}
+
+/**
+ * @brief Drop all entries
+ */
+void DesfireFileCache::clear() {
+    memset(_entries, 0, sizeof(_entries));
+    _useCounter = 0;
+}
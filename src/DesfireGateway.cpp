@@ -0,0 +1,386 @@
+/**
+ * @file DesfireGateway.cpp
+ * @brief Implementation of the worker pool driving many readers
+ */
+
+#include "DesfireGateway.h"
+
+#if defined(__linux__)
+
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Gateway of the calling worker thread, nullptr outside workers
+ */
+static thread_local DesfireGateway* currentGateway = nullptr;
+
+/**
+ * @brief Index of the calling worker thread, -1 outside workers
+ */
+static thread_local int16_t currentIndex = -1;
+
+/**
+ * @brief Construct a gateway
+ *
+ * @param workers Number of worker threads (1 to DF_GATEWAY_MAX_WORKERS)
+ * @param pinCores Pin worker n to CPU core n modulo the number of cores
+ */
+DesfireGateway::DesfireGateway(uint8_t workers, bool pinCores) {
+    if (workers == 0) {
+        workers = 1;
+    }
+    if (workers > DF_GATEWAY_MAX_WORKERS) {
+        workers = DF_GATEWAY_MAX_WORKERS;
+    }
+
+    _workerCount = workers;
+    _pinCores    = pinCores;
+    _readerCount = 0;
+    _running.store(false);
+    _pending.store(0);
+    pthread_mutex_init(&_idleLock, nullptr);
+    pthread_cond_init(&_idle, nullptr);
+
+    for (uint8_t i = 0; i < DF_GATEWAY_MAX_WORKERS; i++) {
+        Worker& worker    = _workers[i];
+        worker.gateway    = this;
+        worker.index      = i;
+        worker.started    = false;
+        worker.queueHead  = 0;
+        worker.queueCount = 0;
+        worker.resultHead.store(0);
+        worker.resultTail.store(0);
+        pthread_mutex_init(&worker.queueLock, nullptr);
+    }
+}
+
+/**
+ * @brief Stop the workers and destroy the gateway
+ */
+DesfireGateway::~DesfireGateway() {
+    stop();
+
+    for (uint8_t i = 0; i < DF_GATEWAY_MAX_WORKERS; i++) {
+        pthread_mutex_destroy(&_workers[i].queueLock);
+    }
+    pthread_cond_destroy(&_idle);
+    pthread_mutex_destroy(&_idleLock);
+}
+
+/**
+ * @brief Add a reader before start()
+ *
+ * @param nfc DesfireNFC instance of the reader, owned by the caller
+ * @param step State machine step of the reader
+ * @param context User-provided context passed to step
+ * @return int16_t Index of the reader, -1 if full, running or step is null
+ */
+int16_t DesfireGateway::addReader(DesfireNFC& nfc, DesfireReaderStep step, void* context) {
+    if (step == nullptr || _running.load() || _readerCount >= DF_GATEWAY_MAX_READERS) {
+        return -1;
+    }
+
+    Reader& reader = _readers[_readerCount];
+    reader.nfc     = &nfc;
+    reader.step    = step;
+    reader.context = context;
+    return _readerCount++;
+}
+
+/**
+ * @brief Start the workers
+ *
+ * @return true if all workers are running
+ * @return false if already running or a thread could not be created
+ */
+bool DesfireGateway::start() {
+    if (_running.load()) {
+        return false;
+    }
+    _running.store(true);
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    for (uint8_t i = 0; i < _workerCount; i++) {
+        Worker& worker = _workers[i];
+        if (pthread_create(&worker.thread, nullptr, workerMain, &worker) != 0) {
+            stop();
+            return false;
+        }
+        worker.started = true;
+
+        if (_pinCores && cores > 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(i % cores, &set);
+            pthread_setaffinity_np(worker.thread, sizeof(set), &set);
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Stop the workers after their current step or task
+ */
+void DesfireGateway::stop() {
+    _running.store(false);
+
+    pthread_mutex_lock(&_idleLock);
+    pthread_cond_broadcast(&_idle);
+    pthread_mutex_unlock(&_idleLock);
+
+    for (uint8_t i = 0; i < _workerCount; i++) {
+        Worker& worker = _workers[i];
+        if (worker.started) {
+            pthread_join(worker.thread, nullptr);
+            worker.started = false;
+        }
+
+        pthread_mutex_lock(&worker.queueLock);
+        worker.queueCount = 0;
+        pthread_mutex_unlock(&worker.queueLock);
+    }
+    _pending.store(0);
+}
+
+/**
+ * @brief Submit a task
+ *
+ * @param task Task to run
+ * @return true if the task was queued
+ * @return false if the deque is full or the task has no function
+ */
+bool DesfireGateway::submit(const DesfireGatewayTask& task) {
+    if (task.run == nullptr) {
+        return false;
+    }
+
+    uint8_t index  = (currentGateway == this) ? currentIndex : getWorkerOf(task.reader);
+    Worker& worker = _workers[index];
+
+    pthread_mutex_lock(&worker.queueLock);
+    if (worker.queueCount >= DF_GATEWAY_QUEUE_SIZE) {
+        pthread_mutex_unlock(&worker.queueLock);
+        return false;
+    }
+    worker.queue[(worker.queueHead + worker.queueCount) % DF_GATEWAY_QUEUE_SIZE] = task;
+    worker.queueCount++;
+    _pending.fetch_add(1);
+    pthread_mutex_unlock(&worker.queueLock);
+
+    // Wake an idle worker to run or steal the task
+    pthread_mutex_lock(&_idleLock);
+    pthread_cond_signal(&_idle);
+    pthread_mutex_unlock(&_idleLock);
+    return true;
+}
+
+/**
+ * @brief Take completed task results
+ *
+ * @param results Array to store the results
+ * @param maxResults Size of the array
+ * @return uint16_t Number of results stored
+ */
+uint16_t DesfireGateway::collect(DesfireGatewayResult* results, uint16_t maxResults) {
+    if (results == nullptr) {
+        return 0;
+    }
+
+    uint16_t count = 0;
+    for (uint8_t i = 0; i < _workerCount && count < maxResults; i++) {
+        Worker&  worker = _workers[i];
+        uint32_t head   = worker.resultHead.load(std::memory_order_relaxed);
+        uint32_t tail   = worker.resultTail.load(std::memory_order_acquire);
+
+        while (head != tail && count < maxResults) {
+            results[count++] = worker.results[head % DF_GATEWAY_RESULT_SIZE];
+            head++;
+        }
+        worker.resultHead.store(head, std::memory_order_release);
+    }
+
+    return count;
+}
+
+/**
+ * @brief Get the number of worker threads
+ *
+ * @return uint8_t Number of workers
+ */
+uint8_t DesfireGateway::getWorkerCount() const {
+    return _workerCount;
+}
+
+/**
+ * @brief Get the worker owning a reader
+ *
+ * @param reader Index of the reader
+ * @return uint8_t Index of the worker
+ */
+uint8_t DesfireGateway::getWorkerOf(uint8_t reader) const {
+    return reader % _workerCount;
+}
+
+/**
+ * @brief Get the worker the calling thread belongs to
+ *
+ * @return int16_t Index of the worker, -1 outside the workers of any gateway
+ */
+int16_t DesfireGateway::currentWorker() {
+    return currentIndex;
+}
+
+/**
+ * @brief Entry point of a worker thread
+ *
+ * @param argument Worker state
+ * @return void* Always nullptr
+ */
+void* DesfireGateway::workerMain(void* argument) {
+    Worker* worker = static_cast<Worker*>(argument);
+
+    currentGateway = worker->gateway;
+    currentIndex   = worker->index;
+    worker->gateway->run(*worker);
+    currentGateway = nullptr;
+    currentIndex   = -1;
+    return nullptr;
+}
+
+/**
+ * @brief Run the loop of a worker until stop()
+ *
+ * Alternates between one task and one step of the next owned reader, so
+ * that a burst of tasks delays the readers by at most one task each.
+ *
+ * @param worker Worker state
+ */
+void DesfireGateway::run(Worker& worker) {
+    uint8_t next = worker.index;
+
+    while (_running.load(std::memory_order_acquire)) {
+        bool               busy = false;
+        DesfireGatewayTask task;
+
+        if (hasResultSpace(worker) && (popTask(worker, task) || stealTask(worker, task))) {
+            uint32_t              tail   = worker.resultTail.load(std::memory_order_relaxed);
+            DesfireGatewayResult& result = worker.results[tail % DF_GATEWAY_RESULT_SIZE];
+            result.status                = task.run(task.context);
+            result.context               = task.context;
+            result.reader                = task.reader;
+            worker.resultTail.store(tail + 1, std::memory_order_release);
+            busy = true;
+        }
+
+        if (next < _readerCount) {
+            Reader& reader = _readers[next];
+            reader.step(*this, *reader.nfc, next, reader.context);
+
+            // Readers n, n + workers, n + 2 * workers, ... belong to worker n
+            next = (next + _workerCount < _readerCount) ? next + _workerCount : worker.index;
+            busy = true;
+        }
+
+        if (!busy) {
+            waitIdle(worker);
+        }
+    }
+}
+
+/**
+ * @brief Take the newest task of a worker's own deque
+ *
+ * @param worker Worker state
+ * @param task Task taken
+ * @return true if a task was taken
+ * @return false if the deque is empty
+ */
+bool DesfireGateway::popTask(Worker& worker, DesfireGatewayTask& task) {
+    if (_pending.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+
+    bool taken = false;
+    pthread_mutex_lock(&worker.queueLock);
+    if (worker.queueCount > 0) {
+        worker.queueCount--;
+        task  = worker.queue[(worker.queueHead + worker.queueCount) % DF_GATEWAY_QUEUE_SIZE];
+        taken = true;
+        _pending.fetch_sub(1);
+    }
+    pthread_mutex_unlock(&worker.queueLock);
+    return taken;
+}
+
+/**
+ * @brief Take the oldest task of another worker's deque
+ *
+ * @param worker Worker state of the thief
+ * @param task Task taken
+ * @return true if a task was taken
+ * @return false if all other deques are empty
+ */
+bool DesfireGateway::stealTask(Worker& worker, DesfireGatewayTask& task) {
+    for (uint8_t i = 1; i < _workerCount; i++) {
+        if (_pending.load(std::memory_order_relaxed) == 0) {
+            return false;
+        }
+
+        Worker& victim = _workers[(worker.index + i) % _workerCount];
+        bool    taken  = false;
+        pthread_mutex_lock(&victim.queueLock);
+        if (victim.queueCount > 0) {
+            task             = victim.queue[victim.queueHead];
+            victim.queueHead = (victim.queueHead + 1) % DF_GATEWAY_QUEUE_SIZE;
+            victim.queueCount--;
+            taken = true;
+            _pending.fetch_sub(1);
+        }
+        pthread_mutex_unlock(&victim.queueLock);
+
+        if (taken) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Check whether a worker's result ring has room for a result
+ *
+ * @param worker Worker state
+ * @return true if a result can be stored
+ * @return false if the ring is full
+ */
+bool DesfireGateway::hasResultSpace(const Worker& worker) {
+    uint32_t head = worker.resultHead.load(std::memory_order_acquire);
+    uint32_t tail = worker.resultTail.load(std::memory_order_relaxed);
+    return tail - head < DF_GATEWAY_RESULT_SIZE;
+}
+
+/**
+ * @brief Wait for a submitted task, a collected result or stop()
+ *
+ * @param worker Worker state
+ */
+void DesfireGateway::waitIdle(const Worker& worker) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += DF_GATEWAY_IDLE_WAIT * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&_idleLock);
+    if ((_pending.load() == 0 || !hasResultSpace(worker)) && _running.load()) {
+        pthread_cond_timedwait(&_idle, &_idleLock, &deadline);
+    }
+    pthread_mutex_unlock(&_idleLock);
+}
+
+#endif  // __linux__
@@ -0,0 +1,369 @@
+/**
+ * @file DesfireImpairment.cpp
+ * @brief Implementation of the impaired reader
+ */
+
+#include "DesfireImpairment.h"
+
+#include <string.h>
+
+#define IMPAIR_HALF (DF_IMPAIR_SCALE / 2)  // Probability that a torn command is executed
+
+/**
+ * @brief Construct a reader with a clean channel
+ *
+ * @param reader Wrapped reader, must outlive this reader
+ * @param seed Seed of the generator, 0 for a fixed default
+ */
+DesfireImpairedReader::DesfireImpairedReader(NFCReaderInterface& reader, uint32_t seed)
+    : _reader(reader) {
+    _impairment      = getPreset(DF_IMPAIR_CLEAN);
+    _responseTimeout = 0;
+    _removed         = false;
+    _returnTime      = 0;
+    _tearPending     = false;
+    _tearExecuted    = false;
+    setSeed(seed);
+    resetStats();
+    setClock(&reader.getClock());
+}
+
+/**
+ * @brief Get the settings of a predefined profile
+ *
+ * @param preset Profile
+ * @return DesfireImpairment Settings of the profile
+ */
+DesfireImpairment DesfireImpairedReader::getPreset(DesfireImpairmentPreset preset) {
+    DesfireImpairment impairment;
+    memset(&impairment, 0, sizeof(impairment));
+    impairment.crcCheck    = true;
+    impairment.removalTime = DF_IMPAIR_REMOVAL_TIME;
+    impairment.timeout     = DF_IMPAIR_TIMEOUT;
+
+    switch (preset) {
+        case DF_IMPAIR_NOISY:
+            impairment.commandLoss  = 2000;
+            impairment.responseLoss = 2000;
+            impairment.bitErrorRate = 20;
+            impairment.jitter       = 500;
+            break;
+
+        case DF_IMPAIR_EDGE:
+            impairment.commandLoss  = 20000;
+            impairment.responseLoss = 20000;
+            impairment.bitErrorRate = 200;
+            impairment.jitter       = 3000;
+            impairment.removalRate  = 5000;
+            break;
+
+        case DF_IMPAIR_TEARING:
+            impairment.jitter      = 200;
+            impairment.removalRate = 30000;
+            break;
+
+        default:
+            break;
+    }
+    return impairment;
+}
+
+/**
+ * @brief Set the impairment of the channel
+ *
+ * @param impairment Settings to use
+ */
+void DesfireImpairedReader::setImpairment(const DesfireImpairment& impairment) {
+    _impairment = impairment;
+}
+
+/**
+ * @brief Get the impairment of the channel
+ *
+ * @return const DesfireImpairment& Settings in use
+ */
+const DesfireImpairment& DesfireImpairedReader::getImpairment() const {
+    return _impairment;
+}
+
+/**
+ * @brief Restart the generator
+ *
+ * @param seed Seed of the generator, 0 for a fixed default
+ */
+void DesfireImpairedReader::setSeed(uint32_t seed) {
+    _random = (seed != 0) ? seed : DF_IMPAIR_SEED;
+}
+
+/**
+ * @brief Remove the card during the next exchange
+ *
+ * @param executed true if the card executes the command before it leaves
+ */
+void DesfireImpairedReader::tearNextExchange(bool executed) {
+    _tearPending  = true;
+    _tearExecuted = executed;
+}
+
+/**
+ * @brief Check whether a removed card is away
+ *
+ * @return true if the card left the field and was not detected again
+ * @return false otherwise
+ */
+bool DesfireImpairedReader::isRemoved() const {
+    return _removed;
+}
+
+/**
+ * @brief Get the counts and times of the channel
+ *
+ * @return const DesfireImpairmentStats& Statistics since the last reset
+ */
+const DesfireImpairmentStats& DesfireImpairedReader::getStats() const {
+    return _stats;
+}
+
+/**
+ * @brief Get the effective throughput of the channel
+ *
+ * @return uint32_t Delivered bytes per second of exchange time
+ */
+uint32_t DesfireImpairedReader::getThroughput() const {
+    if (_stats.time == 0) {
+        return 0;
+    }
+    return static_cast<uint32_t>(_stats.bytes * DF_IMPAIR_SCALE / _stats.time);
+}
+
+/**
+ * @brief Clear the statistics
+ */
+void DesfireImpairedReader::resetStats() {
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+/**
+ * @brief Initialize the wrapped reader
+ *
+ * @return true if initialization was successful
+ * @return false if initialization failed
+ */
+bool DesfireImpairedReader::begin() {
+    return _reader.begin();
+}
+
+/**
+ * @brief Get the firmware version of the wrapped reader
+ *
+ * @return uint32_t Version information (0 if failed)
+ */
+uint32_t DesfireImpairedReader::getFirmwareVersion() {
+    return _reader.getFirmwareVersion();
+}
+
+/**
+ * @brief Configure the wrapped reader
+ *
+ * @return true if configuration was successful
+ * @return false if configuration failed
+ */
+bool DesfireImpairedReader::configure() {
+    return _reader.configure();
+}
+
+/**
+ * @brief Detect a card with the wrapped reader
+ *
+ * @param uid Buffer to store the card UID
+ * @param uidLength Pointer to variable that will store the UID length
+ * @return true if a card was detected
+ * @return false if no card was detected
+ */
+bool DesfireImpairedReader::detectCard(uint8_t* uid, uint8_t* uidLength) {
+    // The poll costs its time even while the card is away
+    bool detected = _reader.detectCard(uid, uidLength);
+    if (_removed) {
+        if (static_cast<int32_t>(clockMicros() - _returnTime) < 0) {
+            return false;
+        }
+        _removed = false;
+    }
+    return detected;
+}
+
+/**
+ * @brief Exchange a frame over the impaired channel
+ *
+ * @param txData Data to transmit
+ * @param txLength Length of data to transmit
+ * @param rxData Buffer to store the response
+ * @param rxLength Pointer to variable that will store the response length
+ * @return true if an answer was delivered, possibly with bit errors
+ * @return false if a frame was lost, rejected or the card is away
+ */
+bool DesfireImpairedReader::transceive(const uint8_t* txData,
+                                       uint16_t       txLength,
+                                       uint8_t*       rxData,
+                                       uint16_t*      rxLength) {
+    uint32_t start  = clockMicros();
+    bool     result = false;
+    _stats.exchanges++;
+
+    if (_impairment.jitter > 0) {
+        getClock().delayMicros(nextRandom() % (_impairment.jitter + 1));
+    }
+
+    bool tear     = _tearPending || chance(_impairment.removalRate);
+    bool executed = _tearPending ? _tearExecuted : (tear && chance(IMPAIR_HALF));
+    _tearPending  = false;
+
+    if (_removed) {
+        waitTimeout();
+    } else if (tear) {
+        // The card may execute the command, its answer never arrives
+        if (executed) {
+            _reader.transceive(txData, txLength, rxData, rxLength);
+        }
+        removeCard();
+        waitTimeout();
+    } else if (chance(_impairment.commandLoss)) {
+        _stats.lostCommands++;
+        waitTimeout();
+    } else if (!_reader.transceive(txData, txLength, rxData, rxLength)) {
+        // Failures of the wrapped reader have spent their own time
+    } else if (chance(_impairment.responseLoss)) {
+        _stats.lostResponses++;
+        waitTimeout();
+    } else if (corrupt(rxData, *rxLength) && _impairment.crcCheck) {
+        // The reader drops the frame on the CRC error
+    } else {
+        _stats.delivered++;
+        _stats.bytes += txLength + *rxLength;
+        result = true;
+    }
+
+    _stats.time += clockMicros() - start;
+    return result;
+}
+
+/**
+ * @brief Limit the time the card may take to answer
+ *
+ * @param timeout Longest accepted card response time in microseconds, 0 for the default
+ * @return true if the wrapped reader enforces the limit
+ * @return false otherwise
+ */
+bool DesfireImpairedReader::setResponseTimeout(uint32_t timeout) {
+    _responseTimeout = timeout;
+    return _reader.setResponseTimeout(timeout);
+}
+
+/**
+ * @brief Get the largest command of the wrapped reader
+ *
+ * @return uint16_t Maximum length of txData in bytes
+ */
+uint16_t DesfireImpairedReader::getMaxTransmitLength() {
+    return _reader.getMaxTransmitLength();
+}
+
+/**
+ * @brief Get the largest response of the wrapped reader
+ *
+ * @return uint16_t Maximum length of rxData in bytes, status word included
+ */
+uint16_t DesfireImpairedReader::getMaxReceiveLength() {
+    return _reader.getMaxReceiveLength();
+}
+
+/**
+ * @brief Change the bit rate with the wrapped reader
+ *
+ * @param kbps Bit rate in kbit/s for both directions (106, 212, 424 or 848)
+ * @return true if the bit rate is in use
+ * @return false if the reader or the card does not support it
+ */
+bool DesfireImpairedReader::setBitRate(uint16_t kbps) {
+    return !_removed && _reader.setBitRate(kbps);
+}
+
+/**
+ * @brief Check whether the wrapped reader passes native DESFire frames
+ *
+ * @return true if any frame is sent to the card unchanged
+ * @return false if only APDUs are accepted
+ */
+bool DesfireImpairedReader::supportsNativeFrames() {
+    return _reader.supportsNativeFrames();
+}
+
+/**
+ * @brief Get the next number of the generator
+ *
+ * @return uint32_t Pseudo random number
+ */
+uint32_t DesfireImpairedReader::nextRandom() {
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    return _random;
+}
+
+/**
+ * @brief Decide an event
+ *
+ * @param probability Probability per million
+ * @return true if the event happens
+ * @return false otherwise
+ */
+bool DesfireImpairedReader::chance(uint32_t probability) {
+    // No draw for disabled events keeps the sequence of the others
+    return probability > 0 && nextRandom() % DF_IMPAIR_SCALE < probability;
+}
+
+/**
+ * @brief Flip bits of an answer at the bit error rate
+ *
+ * One draw per byte with eight times the bit error rate; exact enough for
+ * the low rates of a working link and cheap for long runs.
+ *
+ * @param data Answer
+ * @param length Length of the answer
+ * @return true if a bit was flipped
+ * @return false if the answer is unchanged
+ */
+bool DesfireImpairedReader::corrupt(uint8_t* data, uint16_t length) {
+    if (_impairment.bitErrorRate == 0) {
+        return false;
+    }
+
+    uint32_t byteErrorRate = 8 * _impairment.bitErrorRate;
+    bool     flipped       = false;
+    for (uint16_t i = 0; i < length; i++) {
+        if (chance(byteErrorRate)) {
+            data[i] ^= static_cast<uint8_t>(1 << (nextRandom() & 0x07));
+            flipped = true;
+        }
+    }
+    if (flipped) {
+        _stats.corrupted++;
+    }
+    return flipped;
+}
+
+/**
+ * @brief Take the card out of the field
+ */
+void DesfireImpairedReader::removeCard() {
+    _stats.removals++;
+    _removed    = true;
+    _returnTime = clockMicros() + _impairment.removalTime;
+}
+
+/**
+ * @brief Wait for a frame that does not arrive
+ */
+void DesfireImpairedReader::waitTimeout() {
+    getClock().delayMicros((_responseTimeout > 0) ? _responseTimeout : _impairment.timeout);
+}
@@ -0,0 +1,357 @@
+/**
+ * @file DesfireNDEF.cpp
+ * @brief Implementation of the capability container and streaming NDEF parser
+ */
+
+#include "DesfireNDEF.h"
+
+#include <string.h>
+
+// Record header flags
+#define NDEF_FLAG_MB 0x80  // Message begin
+#define NDEF_FLAG_ME 0x40  // Message end
+#define NDEF_FLAG_CF 0x20  // Chunked record
+#define NDEF_FLAG_SR 0x10  // Short record (1-byte payload length)
+#define NDEF_FLAG_IL 0x08  // ID length present
+#define NDEF_TNF_MASK 0x07
+
+// Text record status byte
+#define NDEF_TEXT_UTF16 0x80
+#define NDEF_TEXT_LANG_MASK 0x3F
+
+/**
+ * @brief URI identifier codes of the URI record type definition
+ */
+static const char* const URI_PREFIXES[] = {"",
+                                           "http://www.",
+                                           "https://www.",
+                                           "http://",
+                                           "https://",
+                                           "tel:",
+                                           "mailto:",
+                                           "ftp://anonymous:anonymous@",
+                                           "ftp://ftp.",
+                                           "ftps://",
+                                           "sftp://",
+                                           "smb://",
+                                           "nfs://",
+                                           "ftp://",
+                                           "dav://",
+                                           "news:",
+                                           "telnet://",
+                                           "imap:",
+                                           "rtsp://",
+                                           "urn:",
+                                           "pop:",
+                                           "sip:",
+                                           "sips:",
+                                           "tftp:",
+                                           "btspp://",
+                                           "btl2cap://",
+                                           "btgoep://",
+                                           "tcpobex://",
+                                           "irdaobex://",
+                                           "file://",
+                                           "urn:epc:id:",
+                                           "urn:epc:tag:",
+                                           "urn:epc:pat:",
+                                           "urn:epc:raw:",
+                                           "urn:epc:",
+                                           "urn:nfc:"};
+
+/**
+ * @brief Construct a parser
+ *
+ * @param callback Function called for every complete record
+ * @param context Context pointer passed to the callback
+ */
+NDEFParser::NDEFParser(NDEFRecordCallback callback, void* context)
+    : _callback(callback), _context(context) {
+    reset();
+}
+
+/**
+ * @brief Prepare the parser for a new message
+ */
+void NDEFParser::reset() {
+    _state     = STATE_HEADER;
+    _header    = 0;
+    _remaining = 0;
+    _idLength  = 0;
+    _first     = true;
+    memset(&_record, 0, sizeof(_record));
+}
+
+/**
+ * @brief Parse the next piece of the NDEF message
+ *
+ * @param data Message data
+ * @param length Length of the data
+ * @return true if the data was parsed
+ * @return false if the message is malformed
+ */
+bool NDEFParser::feed(const uint8_t* data, size_t length) {
+    if (data == nullptr && length > 0) {
+        return false;
+    }
+
+    size_t pos = 0;
+    while (pos < length && _state != STATE_DONE && _state != STATE_ERROR) {
+        uint8_t value = data[pos];
+
+        switch (_state) {
+            case STATE_HEADER:
+                // Every message starts with MB, chunked records would need reassembly
+                if ((value & NDEF_FLAG_CF) || ((value & NDEF_FLAG_MB) != 0) != _first) {
+                    _state = STATE_ERROR;
+                    return false;
+                }
+                _header               = value;
+                _record.tnf           = static_cast<NDEFTypeNameFormat>(value & NDEF_TNF_MASK);
+                _record.payloadLength = 0;
+                _state                = STATE_TYPE_LENGTH;
+                pos++;
+                break;
+
+            case STATE_TYPE_LENGTH:
+                _record.typeLength = value;
+                _state             = STATE_PAYLOAD_LENGTH;
+                _remaining         = (_header & NDEF_FLAG_SR) ? 1 : 4;
+                pos++;
+                break;
+
+            case STATE_PAYLOAD_LENGTH:
+                _record.payloadLength = (_record.payloadLength << 8) | value;
+                pos++;
+                if (--_remaining == 0) {
+                    nextField();
+                }
+                break;
+
+            case STATE_ID_LENGTH:
+                _idLength = value;
+                pos++;
+                nextField();
+                break;
+
+            case STATE_TYPE: {
+                uint8_t offset = _record.typeLength - _remaining;
+                if (offset < NDEF_TYPE_MAX_LENGTH) {
+                    _record.type[offset] = value;
+                }
+                pos++;
+                if (--_remaining == 0) {
+                    nextField();
+                }
+                break;
+            }
+
+            case STATE_ID:
+                // The record ID is not kept
+                pos++;
+                if (--_remaining == 0) {
+                    nextField();
+                }
+                break;
+
+            case STATE_PAYLOAD: {
+                // Copy as much of the payload as this piece holds
+                uint32_t offset = _record.payloadLength - _remaining;
+                uint32_t chunk  = length - pos;
+                if (chunk > _remaining) {
+                    chunk = _remaining;
+                }
+                if (offset < NDEF_PAYLOAD_MAX) {
+                    uint32_t kept = NDEF_PAYLOAD_MAX - offset;
+                    memcpy(&_payload[offset], &data[pos], chunk < kept ? chunk : kept);
+                }
+                pos += chunk;
+                _remaining -= chunk;
+                if (_remaining == 0) {
+                    nextField();
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    return _state != STATE_ERROR;
+}
+
+/**
+ * @brief Check whether parsing has finished
+ *
+ * @return true after the last record or when the callback stopped parsing
+ * @return false if more data is needed
+ */
+bool NDEFParser::isComplete() const {
+    return _state == STATE_DONE;
+}
+
+/**
+ * @brief Move on after a field, skipping empty fields
+ */
+void NDEFParser::nextField() {
+    switch (_state) {
+        case STATE_PAYLOAD_LENGTH:
+            if (_header & NDEF_FLAG_IL) {
+                _state = STATE_ID_LENGTH;
+                return;
+            }
+            _idLength = 0;
+            // fall through
+
+        case STATE_ID_LENGTH:
+            _state     = STATE_TYPE;
+            _remaining = _record.typeLength;
+            if (_remaining > 0) {
+                return;
+            }
+            // fall through
+
+        case STATE_TYPE:
+            _state     = STATE_ID;
+            _remaining = _idLength;
+            if (_remaining > 0) {
+                return;
+            }
+            // fall through
+
+        case STATE_ID:
+            _state     = STATE_PAYLOAD;
+            _remaining = _record.payloadLength;
+            if (_remaining > 0) {
+                return;
+            }
+            // fall through
+
+        case STATE_PAYLOAD:
+            completeRecord();
+            return;
+
+        default:
+            return;
+    }
+}
+
+/**
+ * @brief Hand the current record to the callback
+ */
+void NDEFParser::completeRecord() {
+    _record.payload      = (_record.payloadLength <= NDEF_PAYLOAD_MAX) ? _payload : nullptr;
+    _record.messageBegin = _first;
+    _record.messageEnd   = (_header & NDEF_FLAG_ME) != 0;
+    _first               = false;
+
+    bool more = true;
+    if (_callback != nullptr) {
+        more = _callback(_record, _context);
+    }
+
+    _state = (!more || _record.messageEnd) ? STATE_DONE : STATE_HEADER;
+}
+
+/**
+ * @brief Parse a capability container
+ *
+ * @param data Capability container (at least NDEF_CC_LENGTH bytes)
+ * @param length Length of the data
+ * @param cc Structure to store the parsed capability container
+ * @return true if the capability container is valid
+ * @return false otherwise
+ */
+bool NDEFParser::parseCapabilityContainer(const uint8_t*           data,
+                                          size_t                   length,
+                                          NDEFCapabilityContainer* cc) {
+    if (data == nullptr || cc == nullptr || length < NDEF_CC_LENGTH) {
+        return false;
+    }
+
+    uint16_t ccLength = (data[0] << 8) | data[1];
+    if (ccLength < NDEF_CC_LENGTH || (data[2] >> 4) != 2) {
+        return false;
+    }
+
+    // The NDEF file control TLV follows MLe and MLc
+    if (data[7] != NDEF_TLV_FILE_CONTROL || data[8] != 6) {
+        return false;
+    }
+
+    cc->mappingVersion   = data[2];
+    cc->maxReadLength    = (data[3] << 8) | data[4];
+    cc->maxCommandLength = (data[5] << 8) | data[6];
+    cc->fileId           = (data[9] << 8) | data[10];
+    cc->maxNdefSize      = (data[11] << 8) | data[12];
+    cc->readAccess       = data[13];
+    cc->writeAccess      = data[14];
+
+    return cc->maxReadLength > 0 && cc->maxNdefSize > NDEF_NLEN_LENGTH;
+}
+
+/**
+ * @brief Decode a well-known URI record
+ *
+ * @param record Record of type "U"
+ * @param uri Buffer to store the NUL-terminated URI
+ * @param size Size of the buffer
+ * @return true if the record is a URI record and the URI fits
+ * @return false otherwise
+ */
+bool NDEFParser::decodeURI(const NDEFRecord& record, char* uri, size_t size) {
+    if (uri == nullptr || record.tnf != NDEF_TNF_WELL_KNOWN || record.typeLength != 1 ||
+        record.type[0] != 'U' || record.payload == nullptr || record.payloadLength == 0) {
+        return false;
+    }
+
+    uint8_t code = record.payload[0];
+    if (code >= sizeof(URI_PREFIXES) / sizeof(URI_PREFIXES[0])) {
+        code = 0;
+    }
+
+    size_t prefixLength = strlen(URI_PREFIXES[code]);
+    size_t restLength   = record.payloadLength - 1;
+    if (prefixLength + restLength + 1 > size) {
+        return false;
+    }
+
+    memcpy(uri, URI_PREFIXES[code], prefixLength);
+    memcpy(&uri[prefixLength], &record.payload[1], restLength);
+    uri[prefixLength + restLength] = '\0';
+
+    return true;
+}
+
+/**
+ * @brief Decode a well-known text record
+ *
+ * @param record Record of type "T"
+ * @param text Buffer to store the NUL-terminated text (UTF-8 records only)
+ * @param size Size of the buffer
+ * @return true if the record is a UTF-8 text record and the text fits
+ * @return false otherwise
+ */
+bool NDEFParser::decodeText(const NDEFRecord& record, char* text, size_t size) {
+    if (text == nullptr || record.tnf != NDEF_TNF_WELL_KNOWN || record.typeLength != 1 ||
+        record.type[0] != 'T' || record.payload == nullptr || record.payloadLength == 0) {
+        return false;
+    }
+
+    uint8_t status = record.payload[0];
+    size_t  skip   = 1 + (status & NDEF_TEXT_LANG_MASK);
+    if ((status & NDEF_TEXT_UTF16) || skip > record.payloadLength) {
+        return false;
+    }
+
+    size_t textLength = record.payloadLength - skip;
+    if (textLength + 1 > size) {
+        return false;
+    }
+
+    memcpy(text, &record.payload[skip], textLength);
+    text[textLength] = '\0';
+
+    return true;
+}
@@ -17,6 +17,31 @@
 // DESFire constants
 #define DF_PICC_MAX_FRAME 40  // Maximum number of frames for a complete command
 #define MIFARE_DESFIRE 0x01   // Type of card
+#define DF_FRAME_APDU_OVERHEAD 6    // CLA, INS, P1, P2, Lc and Le around the command data
+#define DF_FRAME_NATIVE_OVERHEAD 1  // Command code of a native frame
+#define DF_FRAME_ISODEP_OVERHEAD 3  // PCB and CRC of an ISO14443-4 block
+#define DF_DEFAULT_CARD_FSC 64      // Frame size of the DESFire default ATS (FSCI 5)
+#define DF_READ_CHUNK_SIZE 224  // ReadData length per command, fits padding and MAC in a buffer
+#define DF_WRITE_CHUNK_SIZE 224  // WriteData length per command, fits padding and MAC in a buffer
+#define DF_WRITE_HEADER_SIZE 7  // File number, offset and length of WriteData
+
+/**
+ * @brief Precomputed ISOSelectFile of the DESFire Light application (by DF name, no FCI)
+ */
+static const uint8_t LIGHT_SELECT_APDU[] = {
+    0x00, 0xA4, 0x04, 0x0C, DF_LIGHT_DF_NAME_LENGTH, 0xA0, 0x00, 0x00, 0x03, 0x96, 0x56,
+    0x43, 0x41, 0x03, 0xF0, 0x15, 0x40, 0x00, 0x00, 0x00, 0x0B};
+
+/**
+ * @brief Factory file set of the DESFire Light
+ */
+static const DesfireFileInfo LIGHT_FILES[DF_LIGHT_FILE_COUNT] = {
+    {0x00, 0xEF00, DF_FILE_STANDARD, 256},
+    {0x01, 0xEF01, DF_FILE_CYCLIC, 16},
+    {0x03, 0xEF03, DF_FILE_VALUE, 4},
+    {0x04, 0xEF04, DF_FILE_STANDARD, 256},
+    {0x0F, 0xEF0F, DF_FILE_TMAC, DF_EV2_TMC_LENGTH + DF_EV2_TMV_LENGTH},
+    {0x1F, 0xEF1F, DF_FILE_STANDARD, 32}};
 
 // DESFire Commands - REMOVED, using DesfireCommand enum instead
 // #define DF_CMD_GET_VERSION            0x60
@@ -34,9 +59,19 @@
 DesfireNFC::DesfireNFC(NFCReaderInterface& reader) : _reader(reader) {
     _authenticated = false;
     _cardDetected  = false;
+    _randomUID     = false;
+    _realUIDLength = 0;
+    _cardFrameSize = DF_DEFAULT_CARD_FSC;
+    _profile       = DF_PROFILE_GENERIC;
+    _strategy      = DesfireStrategyCache::getDefault();
+    _counterResync = false;
     _cryptoMode    = DesfreCryptoMode::DF_CRYPTO_DES;  // Using proper enum reference
     memset(_sessionKey, 0, sizeof(_sessionKey));
+    memset(_rndA, 0, sizeof(_rndA));
     memset(_uid, 0, sizeof(_uid));
+    memset(_realUID, 0, sizeof(_realUID));
+    memset(_selectedAID, 0, sizeof(_selectedAID));
+    memset(&_exchangeStats, 0, sizeof(_exchangeStats));
     _uidLength = 0;
 }
 
@@ -58,7 +93,22 @@ bool DesfireNFC::initialize() {
     }
 
     // Configure the reader for card communication
-    return _reader.configure();
+    if (!_reader.configure()) {
+        return false;
+    }
+
+    // Pre-generate authentication challenges before the first card arrives
+    _noncePool.refill();
+
+    return true;
+}
+
+/**
+ * @brief Perform background work while no card is being processed
+ */
+void DesfireNFC::idle() {
+    _noncePool.refill();
+    _originality.precomputeNext();
 }
 
 /**
@@ -68,13 +118,42 @@ bool DesfireNFC::initialize() {
  * @return false if no card was detected
  */
 bool DesfireNFC::detectCard() {
+    uint8_t previousUID[sizeof(_uid)];
+    uint8_t previousLength = _uidLength;
+    memcpy(previousUID, _uid, sizeof(previousUID));
+
     // Store UID in member variables for later use
     _cardDetected = _reader.detectCard(_uid, &_uidLength);
 
-    // DESFire cards have 7-byte UIDs
-    if (_cardDetected && _uidLength != 7) {
+    // Any session belonged to the previous card
+    resetAuthentication();
+
+    // DESFire cards have 7-byte UIDs, or a 4-byte random ID starting with 08h
+    _randomUID = (_uidLength == 4 && _uid[0] == 0x08);
+    if (_cardDetected && _uidLength != 7 && !_randomUID) {
         _cardDetected = false;
-        return false;
+    }
+
+    // A random ID only maps to the resolved real UID during the same activation
+    if (!_cardDetected || !_randomUID || _uidLength != previousLength ||
+        memcmp(_uid, previousUID, _uidLength) != 0) {
+        memset(_realUID, 0, sizeof(_realUID));
+        _realUIDLength = 0;
+    }
+
+    // Known cards get their strategy before the first command, others ISO framing and the
+    // factory frame size, nothing of the previous card carries over
+    DesfireCardStrategy strategy;
+    uint8_t             identityLength = 0;
+    const uint8_t*      identity       = getIdentityUID(&identityLength);
+    _profile                           = DF_PROFILE_GENERIC;
+    if (_cardDetected && identity != nullptr &&
+        _strategyCache.lookup(identity, identityLength, &strategy)) {
+        applyStrategy(strategy, true);
+    } else {
+        _cardFrameSize      = DF_DEFAULT_CARD_FSC;
+        _strategy           = DesfireStrategyCache::getDefault();
+        _strategy.frameSize = _cardFrameSize;
     }
 
     return _cardDetected;
@@ -112,6 +191,68 @@ bool DesfireNFC::getCardUID(uint8_t* uid, uint8_t* uidLength) {
     return false;
 }
 
+/**
+ * @brief Check whether the detected card presented a random UID
+ *
+ * @return true if the UID of the detected card is random
+ * @return false otherwise
+ */
+bool DesfireNFC::hasRandomUID() const {
+    return _cardDetected && _randomUID;
+}
+
+/**
+ * @brief Get the real UID of the card with GetCardUID
+ *
+ * @param uid Buffer to store the UID (should be at least 10 bytes)
+ * @param uidLength Pointer to variable that will store the UID length
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::getRealCardUID(uint8_t* uid, uint8_t* uidLength) {
+    if (!uid || !uidLength) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
+
+    // Resolved earlier during this activation
+    if (_realUIDLength > 0) {
+        memcpy(uid, _realUID, _realUIDLength);
+        *uidLength = _realUIDLength;
+        return DesfireStatus::DFST_SUCCESS;
+    }
+
+    // GetCardUID answers only inside a session, encrypted
+    if (!_secureMessaging.isActive()) {
+        return DesfireStatus::DFST_AUTHENTICATION_ERROR;
+    }
+
+    uint8_t  response[2 * DF_AES_BLOCK_SIZE + DF_MACT_SIZE];
+    uint16_t responseLen = 0;
+
+    DesfireStatus status = transmitSecure(DesfireCommand::DF_CMD_GET_CARD_UID,
+                                          nullptr,
+                                          0,
+                                          nullptr,
+                                          0,
+                                          DF_COMM_ENCRYPT,
+                                          response,
+                                          responseLen,
+                                          sizeof(response));
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        return status;
+    }
+
+    if (responseLen != 4 && responseLen != 7 && responseLen != 10) {
+        return DesfireStatus::DFST_LENGTH_ERROR;
+    }
+
+    memcpy(_realUID, response, responseLen);
+    _realUIDLength = static_cast<uint8_t>(responseLen);
+
+    memcpy(uid, _realUID, _realUIDLength);
+    *uidLength = _realUIDLength;
+    return DesfireStatus::DFST_SUCCESS;
+}
+
 /**
  * @brief Get version information from the card
  *
@@ -165,6 +306,9 @@ bool DesfireNFC::getVersion(DESFireCardVersion* version) {
         return false;
     }
 
+    // Known card families get their own command profile
+    _profile = version->isLight() ? DF_PROFILE_LIGHT : DF_PROFILE_GENERIC;
+
     // If more data is expected, get the second frame with software version info
     if (status == DesfireStatus::DFST_MORE_FRAMES) {
         uint8_t  response2[32];
@@ -231,6 +375,52 @@ bool DesfireNFC::getVersion(DESFireCardVersion* version) {
     return true;
 }
 
+/**
+ * @brief Select the fastest supported options for the detected card
+ *
+ * @param strategy Structure to store the selected strategy (optional)
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::selectStrategy(DesfireCardStrategy* strategy) {
+    DESFireCardVersion version;
+    if (!getVersion(&version)) {
+        return DesfireStatus::DFST_COMMUNICATION_ERROR;
+    }
+
+    // The bit rate of this activation is fixed, it is raised on the next detection. The frame
+    // size comes from the ATS, not from the version, and stays as activated.
+    DesfireCardStrategy selected = DesfireStrategyCache::select(version);
+    selected.frameSize           = _cardFrameSize;
+    applyStrategy(selected, false);
+
+    // A frame size configured for the next activation is kept
+    uint8_t        uidLength = 0;
+    const uint8_t* uid       = getIdentityUID(&uidLength);
+    if (uid != nullptr) {
+        DesfireCardStrategy cached;
+        DesfireCardStrategy next = selected;
+        if (_strategyCache.lookup(uid, uidLength, &cached)) {
+            next.frameSize = cached.frameSize;
+        }
+        _strategyCache.store(uid, uidLength, next);
+    }
+
+    if (strategy) {
+        *strategy = selected;
+    }
+
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief Get the strategy in use for the detected card
+ *
+ * @return const DesfireCardStrategy& Current strategy
+ */
+const DesfireCardStrategy& DesfireNFC::getStrategy() const {
+    return _strategy;
+}
+
 /**
  * @brief Transmit a DESFire command and receive the response
  *
@@ -239,116 +429,164 @@ bool DesfireNFC::getVersion(DESFireCardVersion* version) {
  * @param dataLen Length of command data
  * @param response Buffer to store the response
  * @param responseLen Reference to variable that will hold response length
+ * @param roundTrip Pointer to variable that will store the round trip time (optional)
  * @return DesfireStatus Status code of the operation
  */
 DesfireStatus DesfireNFC::transmit(DesfireCommand command,
                                    const uint8_t* data,
                                    uint8_t        dataLen,
                                    uint8_t*       response,
-                                   uint16_t&      responseLen) {
+                                   uint16_t&      responseLen,
+                                   uint32_t*      roundTrip) {
     if (!response) {
         return DesfireStatus::DFST_PARAMETER_NULL;
     }
 
-    // Prepare command data: command code + data
-    uint8_t commandData[ISO7816Constants::ISO_MAX_DATA_SIZE];
-    uint8_t commandLen = 1;  // Start with command code
+    responseLen = 0;
 
-    // Add command code
-    commandData[0] = static_cast<uint8_t>(command);
-
-    // Add command data (if any)
-    if (data && dataLen > 0) {
-        if (dataLen > ISO7816Constants::ISO_MAX_DATA_SIZE - 1) {
-            return DesfireStatus::DFST_BUFFER_OVERFLOW;
+    // Native framing: command code followed by the data, no APDU header
+    if (_strategy.nativeFraming) {
+        uint8_t frame[ISO7816Constants::ISO_MAX_APDU_SIZE];
+        if (data && dataLen > 0) {
+            memcpy(&frame[1], data, dataLen);
+        } else {
+            dataLen = 0;
         }
-        memcpy(&commandData[commandLen], data, dataLen);
-        commandLen += dataLen;
+        frame[0] = static_cast<uint8_t>(command);
+
+        return transceiveNative(frame, dataLen + 1, response, responseLen, roundTrip);
     }
 
-    // Build APDU
+    // ISO7816-4 wrapping: CLA 90, INS = command code, P1 = P2 = 00, Lc + data, Le = 00
     uint8_t  apdu[ISO7816Constants::ISO_MAX_APDU_SIZE];
     uint16_t apduLen = buildAPDU(ISO7816Class::ISO_CLA_DESFIRE,
-                                 ISO7816Instruction::ISO_INS_DESFIRE_NATIVE,
+                                 static_cast<ISO7816Instruction>(command),
                                  0,
                                  0,
-                                 commandData,
-                                 commandLen,
+                                 data,
+                                 data ? dataLen : 0,
                                  0,
                                  apdu);
 
     if (apduLen == 0) {
         return DesfireStatus::DFST_BUFFER_OVERFLOW;
     }
+    apdu[apduLen++] = 0x00;  // Le: accept any response length
 
-    // Transmit APDU and get response
+    return transceiveAPDU(apdu, apduLen, response, responseLen, roundTrip);
+}
+
+/**
+ * @brief Transmit an interindustry ISO7816-4 command (CLA 00)
+ *
+ * @param ins Instruction byte
+ * @param p1 Parameter 1
+ * @param p2 Parameter 2
+ * @param data Command data
+ * @param dataLen Length of command data
+ * @param le Expected response length (0 for none)
+ * @param response Buffer to store the response
+ * @param responseLen Reference to variable that will hold response length
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::transmitISO(ISO7816Instruction ins,
+                                      uint8_t            p1,
+                                      uint8_t            p2,
+                                      const uint8_t*     data,
+                                      uint8_t            dataLen,
+                                      uint8_t            le,
+                                      uint8_t*           response,
+                                      uint16_t&          responseLen) {
+    if (!response) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
+
+    responseLen = 0;
+
+    uint8_t  apdu[ISO7816Constants::ISO_MAX_APDU_SIZE];
+    uint16_t apduLen = buildAPDU(
+        ISO7816Class::ISO_CLA_STANDARD, ins, p1, p2, data, data ? dataLen : 0, le, apdu);
+
+    return transceiveAPDU(apdu, apduLen, response, responseLen);
+}
+
+/**
+ * @brief Send a native frame and split the response into status and data
+ *
+ * @param frame Command code followed by the command data
+ * @param frameLen Length of the frame
+ * @param response Buffer to store the response data
+ * @param responseLen Reference to variable that will hold response length
+ * @param roundTrip Pointer to variable that will store the round trip time (optional)
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::transceiveNative(const uint8_t* frame,
+                                           uint16_t       frameLen,
+                                           uint8_t*       response,
+                                           uint16_t&      responseLen,
+                                           uint32_t*      roundTrip) {
     uint8_t  responseBuffer[ISO7816Constants::ISO_MAX_APDU_SIZE];
     uint16_t responseBufferLen = sizeof(responseBuffer);
 
-    if (!_reader.transceive(apdu, apduLen, responseBuffer, &responseBufferLen)) {
+    if (!transceiveCounted(frame, frameLen, responseBuffer, &responseBufferLen, roundTrip)) {
         return DesfireStatus::DFST_COMMUNICATION_ERROR;
     }
 
-    // Parse response
-    if (responseBufferLen < ISO7816Constants::ISO_STATUS_LENGTH) {
+    // The status code comes first, the same code as SW2 of a wrapped response
+    if (responseBufferLen < 1) {
         return DesfireStatus::DFST_LENGTH_ERROR;
     }
 
-    // Extract status word
-    uint16_t statusWord =
-        (responseBuffer[responseBufferLen - 2] << 8) | responseBuffer[responseBufferLen - 1];
-
-    // Convert ISO7816 status to DesfireStatus
-    DesfireStatus status;
-    switch (statusWord) {
-        case static_cast<uint16_t>(ISO7816StatusWord::ISO_SW_SUCCESS):
-        case static_cast<uint16_t>(ISO7816StatusWord::ISO_SW_SUCCESS_DESFIRE):
-            status = DesfireStatus::DFST_SUCCESS;
-            break;
-
-        case static_cast<uint16_t>(ISO7816StatusWord::ISO_SW_WRONG_LENGTH):
-            status = DesfireStatus::DFST_ISO_WRONG_LENGTH;
-            break;
-
-        case static_cast<uint16_t>(ISO7816StatusWord::ISO_SW_SECURITY_NOT_SATISFIED):
-            status = DesfireStatus::DFST_ISO_SECURITY_STATUS_ERROR;
-            break;
-
-        case static_cast<uint16_t>(ISO7816StatusWord::ISO_SW_AUTH_METHOD_BLOCKED):
-            status = DesfireStatus::DFST_ISO_AUTHENTICATION_BLOCKED;
-            break;
+    DesfireStatus status = ISO7816APDU::convertStatus((ISO7816_SW1_SUCCESS << 8) |
+                                                      responseBuffer[0]);
 
-        case static_cast<uint16_t>(ISO7816StatusWord::ISO_SW_DATA_INVALID):
-            status = DesfireStatus::DFST_ISO_DATA_INVALID;
-            break;
+    if (status == DesfireStatus::DFST_SUCCESS || status == DesfireStatus::DFST_MORE_FRAMES) {
+        responseLen = responseBufferLen - 1;
+        if (responseLen > 0) {
+            memcpy(response, &responseBuffer[1], responseLen);
+        }
+    }
 
-        case static_cast<uint16_t>(ISO7816StatusWord::ISO_SW_CONDITIONS_NOT_SATISFIED):
-            status = DesfireStatus::DFST_ISO_CONDITION_NOT_SATISFIED;
-            break;
+    return status;
+}
 
-        case static_cast<uint16_t>(ISO7816StatusWord::ISO_SW_FILE_NOT_FOUND):
-            status = DesfireStatus::DFST_ISO_FILE_NOT_FOUND;
-            break;
+/**
+ * @brief Send an APDU and split the response into data and status
+ *
+ * @param apdu Complete APDU
+ * @param apduLen Length of the APDU
+ * @param response Buffer to store the response data
+ * @param responseLen Reference to variable that will hold response length
+ * @param roundTrip Pointer to variable that will store the round trip time (optional)
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::transceiveAPDU(const uint8_t* apdu,
+                                         uint16_t       apduLen,
+                                         uint8_t*       response,
+                                         uint16_t&      responseLen,
+                                         uint32_t*      roundTrip) {
+    // Transmit APDU and get response
+    uint8_t  responseBuffer[ISO7816Constants::ISO_MAX_APDU_SIZE];
+    uint16_t responseBufferLen = sizeof(responseBuffer);
 
-        case static_cast<uint16_t>(ISO7816StatusWord::ISO_SW_WRONG_P1P2):
-            status = DesfireStatus::DFST_ISO_WRONG_PARAMS;
-            break;
+    if (!transceiveCounted(apdu, apduLen, responseBuffer, &responseBufferLen, roundTrip)) {
+        return DesfireStatus::DFST_COMMUNICATION_ERROR;
+    }
 
-        case static_cast<uint16_t>(ISO7816StatusWord::ISO_SW_INS_NOT_SUPPORTED):
-            status = DesfireStatus::DFST_ISO_UNKNOWN_INSTRUCTION;
-            break;
+    // Parse response
+    if (responseBufferLen < ISO7816Constants::ISO_STATUS_LENGTH) {
+        return DesfireStatus::DFST_LENGTH_ERROR;
+    }
 
-        case static_cast<uint16_t>(ISO7816StatusWord::ISO_SW_CLASS_NOT_SUPPORTED):
-            status = DesfireStatus::DFST_ISO_WRONG_CLA;
-            break;
+    // Extract status word
+    uint16_t statusWord =
+        (responseBuffer[responseBufferLen - 2] << 8) | responseBuffer[responseBufferLen - 1];
 
-        default:
-            status = DesfireStatus::DFST_LIBRARY_ERROR;
-            break;
-    }
+    // Convert ISO7816 status to DesfireStatus (covers 91xx DESFire codes and 91AF chaining)
+    DesfireStatus status = ISO7816APDU::convertStatus(statusWord);
 
-    // If successful, copy response data to output buffer
-    if (status == DesfireStatus::DFST_SUCCESS) {
+    // Response data accompanies both final and chained (more frames) responses
+    if (status == DesfireStatus::DFST_SUCCESS || status == DesfireStatus::DFST_MORE_FRAMES) {
         responseLen = responseBufferLen - ISO7816Constants::ISO_STATUS_LENGTH;
         if (responseLen > 0) {
             memcpy(response, responseBuffer, responseLen);
@@ -372,57 +610,352 @@ DesfireStatus DesfireNFC::selectApplication(uint8_t* aid) {
     uint8_t  response[32];
     uint16_t responseLen = 0;  // Changed to uint16_t for consistency
 
-    return transmit(DesfireCommand::DF_CMD_SELECT_APPLICATION, aid, 3, response, responseLen);
+    // Selecting an application always drops the authentication state
+    resetAuthentication();
+
+    // The Light has a single application, selected by DF name
+    if (_profile == DF_PROFILE_LIGHT) {
+        memset(_selectedAID, 0, sizeof(_selectedAID));
+        return transceiveAPDU(LIGHT_SELECT_APDU, sizeof(LIGHT_SELECT_APDU), response, responseLen);
+    }
+
+    DesfireStatus status =
+        transmit(DesfireCommand::DF_CMD_SELECT_APPLICATION, aid, 3, response, responseLen);
+    if (status == DesfireStatus::DFST_SUCCESS) {
+        memcpy(_selectedAID, aid, sizeof(_selectedAID));
+    }
+
+    return status;
 }
 
 /**
- * @brief Authenticate with the specified key
+ * @brief Get the command profile of the card
  *
- * @param keyNo Key number to authenticate with
- * @param key Pointer to the key data
- * @param keySize Size of the key in bytes
+ * @return DesfireCardProfile Current profile
+ */
+DesfireCardProfile DesfireNFC::getCardProfile() const {
+    return _profile;
+}
+
+/**
+ * @brief Set the command profile of the card
+ *
+ * @param profile Profile to use
+ */
+void DesfireNFC::setCardProfile(DesfireCardProfile profile) {
+    _profile = profile;
+}
+
+/**
+ * @brief Get the description of a DESFire Light file
+ *
+ * @param fileNo File number
+ * @return const DesfireFileInfo* File description, nullptr if not part of the file set
+ */
+const DesfireFileInfo* DesfireNFC::getLightFileInfo(uint8_t fileNo) {
+    for (uint8_t i = 0; i < DF_LIGHT_FILE_COUNT; i++) {
+        if (LIGHT_FILES[i].fileNo == fileNo) {
+            return &LIGHT_FILES[i];
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Read a complete data file of a DESFire Light
+ *
+ * @param fileNo Standard data or transaction MAC file number
+ * @param data Buffer to store the file contents
+ * @param length Pointer to the buffer size, updated with the file size
+ * @param commMode Communication mode of the file
  * @return DesfireStatus Status code of the operation
  */
-DesfireStatus DesfireNFC::authenticate(uint8_t keyNo, const uint8_t* key, uint8_t keySize) {
-    if (!key) {
+DesfireStatus DesfireNFC::readLightFile(uint8_t                 fileNo,
+                                        uint8_t*                data,
+                                        uint16_t*               length,
+                                        DesfreCommunicationMode commMode) {
+    if (!data || !length) {
         return DesfireStatus::DFST_PARAMETER_NULL;
     }
+    if (_profile != DF_PROFILE_LIGHT) {
+        return DesfireStatus::DFST_ILLEGAL_COMMAND;
+    }
 
-    // Check key size based on crypto mode
-    switch (_cryptoMode) {
-        case DesfreCryptoMode::DF_CRYPTO_DES:
-            if (keySize != 8) {
-                return DesfireStatus::DFST_PARAMETER_ERROR;
-            }
-            break;
+    const DesfireFileInfo* file = getLightFileInfo(fileNo);
+    if (!file || (file->type != DF_FILE_STANDARD && file->type != DF_FILE_TMAC)) {
+        return DesfireStatus::DFST_FILE_NOT_FOUND;
+    }
+    if (*length < file->size) {
+        return DesfireStatus::DFST_BUFFER_TOO_SMALL;
+    }
 
-        case DesfreCryptoMode::DF_CRYPTO_3K3DES:  // Corrected enum member name
-            if (keySize != 16) {
-                return DesfireStatus::DFST_PARAMETER_ERROR;
+    *length = file->size;
+    return readData(fileNo, 0, file->size, data, commMode);
+}
+
+/**
+ * @brief Read the NDEF message of a Type 4 Tag
+ *
+ * @param parser Parser that receives the NDEF message
+ * @param cc Structure to store the capability container (optional)
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::readNDEF(NDEFParser& parser, NDEFCapabilityContainer* cc) {
+    static const uint8_t NDEF_APPLICATION_NAME[] = {0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01};
+
+    NDEFCapabilityContainer capabilities;
+    uint16_t                responseLen = 0;
+    uint8_t                 fileId[2]   = {NDEF_CC_FILE_ID >> 8, NDEF_CC_FILE_ID & 0xFF};
+
+    // An ISO select leaves the native application and its authentication
+    resetAuthentication();
+    memset(_selectedAID, 0, sizeof(_selectedAID));
+    parser.reset();
+
+    // Select by DF name, then the CC file by file identifier, without FCI
+    DesfireStatus status = transmitISO(ISO7816Instruction::ISO_INS_SELECT_FILE,
+                                       0x04,
+                                       0x0C,
+                                       NDEF_APPLICATION_NAME,
+                                       sizeof(NDEF_APPLICATION_NAME),
+                                       0,
+                                       _responseBuffer,
+                                       responseLen);
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        return status;
+    }
+
+    status = transmitISO(ISO7816Instruction::ISO_INS_SELECT_FILE,
+                         0x00,
+                         0x0C,
+                         fileId,
+                         sizeof(fileId),
+                         0,
+                         _responseBuffer,
+                         responseLen);
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        return status;
+    }
+
+    status = transmitISO(ISO7816Instruction::ISO_INS_READ_BINARY,
+                         0x00,
+                         0x00,
+                         nullptr,
+                         0,
+                         NDEF_CC_LENGTH,
+                         _responseBuffer,
+                         responseLen);
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        return status;
+    }
+    if (!NDEFParser::parseCapabilityContainer(_responseBuffer, responseLen, &capabilities)) {
+        return DesfireStatus::DFST_FILE_INTEGRITY_ERROR;
+    }
+    if (cc) {
+        *cc = capabilities;
+    }
+    if (capabilities.readAccess != 0x00) {
+        return DesfireStatus::DFST_PERMISSION_DENIED;
+    }
+
+    fileId[0] = capabilities.fileId >> 8;
+    fileId[1] = capabilities.fileId & 0xFF;
+
+    status = transmitISO(ISO7816Instruction::ISO_INS_SELECT_FILE,
+                         0x00,
+                         0x0C,
+                         fileId,
+                         sizeof(fileId),
+                         0,
+                         _responseBuffer,
+                         responseLen);
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        return status;
+    }
+
+    // Largest read that fits the CC limit, the reader and a short APDU
+    uint16_t maxRead = _reader.getMaxReceiveLength() - ISO7816Constants::ISO_STATUS_LENGTH;
+    if (maxRead > capabilities.maxReadLength) {
+        maxRead = capabilities.maxReadLength;
+    }
+    if (maxRead > ISO7816Constants::ISO_MAX_DATA_SIZE) {
+        maxRead = ISO7816Constants::ISO_MAX_DATA_SIZE;
+    }
+
+    // The first read also carries NLEN, the end of the message is known after it
+    uint16_t offset = 0;
+    uint16_t end    = capabilities.maxNdefSize;
+    while (offset < end && !parser.isComplete()) {
+        uint16_t chunk = end - offset;
+        if (chunk > maxRead) {
+            chunk = maxRead;
+        }
+
+        status = transmitISO(ISO7816Instruction::ISO_INS_READ_BINARY,
+                             offset >> 8,
+                             offset & 0xFF,
+                             nullptr,
+                             0,
+                             static_cast<uint8_t>(chunk),
+                             _responseBuffer,
+                             responseLen);
+        if (status != DesfireStatus::DFST_SUCCESS) {
+            return status;
+        }
+        if (responseLen == 0 || responseLen > chunk) {
+            return DesfireStatus::DFST_LENGTH_ERROR;
+        }
+
+        const uint8_t* message       = _responseBuffer;
+        uint16_t       messageLength = responseLen;
+        if (offset == 0) {
+            if (responseLen < NDEF_NLEN_LENGTH) {
+                return DesfireStatus::DFST_LENGTH_ERROR;
             }
-            break;
 
-        case DesfreCryptoMode::DF_CRYPTO_AES:
-            if (keySize != 16) {
-                return DesfireStatus::DFST_PARAMETER_ERROR;
+            uint16_t nlen = (_responseBuffer[0] << 8) | _responseBuffer[1];
+            if (nlen > capabilities.maxNdefSize - NDEF_NLEN_LENGTH) {
+                return DesfireStatus::DFST_FILE_INTEGRITY_ERROR;
+            }
+            if (nlen == 0) {
+                return DesfireStatus::DFST_SUCCESS;
             }
-            break;
 
-        default:
-            return DesfireStatus::DFST_PARAMETER_ERROR;
+            end = NDEF_NLEN_LENGTH + nlen;
+            message += NDEF_NLEN_LENGTH;
+            messageLength -= NDEF_NLEN_LENGTH;
+        }
+        if (offset + responseLen > end) {
+            messageLength -= offset + responseLen - end;
+        }
+
+        if (!parser.feed(message, messageLength)) {
+            return DesfireStatus::DFST_FILE_INTEGRITY_ERROR;
+        }
+        offset += responseLen;
     }
 
-    // Prepare command data
-    uint8_t cmdData[2];
-    cmdData[0] = keyNo;
-    cmdData[1] = static_cast<uint8_t>(_cryptoMode);  // Proper static_cast of enum to uint8_t
+    return parser.isComplete() ? DesfireStatus::DFST_SUCCESS : DesfireStatus::DFST_LENGTH_ERROR;
+}
 
-    uint8_t  response[32];
-    uint16_t responseLen = 0;  // Changed to uint16_t to match method parameter
+/**
+ * @brief Read the NXP originality signature (Read_Sig)
+ *
+ * @param signature Buffer to store the signature (56 bytes)
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::readSignature(uint8_t* signature) {
+    if (!signature) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
 
-    // Send authentication command
-    DesfireStatus status =
-        transmit(DesfireCommand::DF_CMD_AUTHENTICATE, cmdData, 2, response, responseLen);
+    uint8_t  address = 0x00;  // Signature is stored at address 00h
+    uint8_t  response[ISO7816Constants::ISO_MAX_APDU_SIZE];
+    uint16_t responseLen = 0;
+
+    DesfireStatus status = transmit(static_cast<DesfireCommand>(DesfireEV2Command::DF_CMD_READ_SIG),
+                                    &address,
+                                    1,
+                                    response,
+                                    responseLen);
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        return status;
+    }
+
+    if (responseLen != DF_ECC_SIGNATURE_LENGTH) {
+        return DesfireStatus::DFST_LENGTH_ERROR;
+    }
+
+    memcpy(signature, response, DF_ECC_SIGNATURE_LENGTH);
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief Verify that the card is a genuine NXP DESFire
+ *
+ * @param version Version information returned by getVersion()
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::verifyOriginality(const DESFireCardVersion& version) {
+    if (DesfireOriginality::getPublicKey(version) == nullptr) {
+        return DesfireStatus::DFST_PARAMETER_ERROR;
+    }
+
+    // Each card is checked only once
+    if (_originality.isVerified(version.uid)) {
+        return DesfireStatus::DFST_SUCCESS;
+    }
+
+    uint8_t       signature[DF_ECC_SIGNATURE_LENGTH];
+    DesfireStatus status = readSignature(signature);
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        return status;
+    }
+
+    if (!_originality.verify(version, signature)) {
+        return DesfireStatus::DFST_ORIGINALITY_ERROR;
+    }
+
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief Authenticate with the specified key
+ *
+ * @param keyNo Key number to authenticate with
+ * @param key Pointer to the key data
+ * @param keySize Size of the key in bytes
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::authenticate(uint8_t keyNo, const uint8_t* key, uint8_t keySize) {
+    if (!key) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
+    if (_profile == DF_PROFILE_LIGHT) {
+        return DesfireStatus::DFST_ILLEGAL_COMMAND;
+    }
+
+    // Check key size based on crypto mode
+    switch (_cryptoMode) {
+        case DesfreCryptoMode::DF_CRYPTO_DES:
+            if (keySize != 8) {
+                return DesfireStatus::DFST_PARAMETER_ERROR;
+            }
+            break;
+
+        case DesfreCryptoMode::DF_CRYPTO_3K3DES:  // Corrected enum member name
+            if (keySize != 16) {
+                return DesfireStatus::DFST_PARAMETER_ERROR;
+            }
+            break;
+
+        case DesfreCryptoMode::DF_CRYPTO_AES:
+            if (keySize != 16) {
+                return DesfireStatus::DFST_PARAMETER_ERROR;
+            }
+            break;
+
+        default:
+            return DesfireStatus::DFST_PARAMETER_ERROR;
+    }
+
+    // Take RndA from the pre-generated pool (8 bytes for DES, 16 for 3K3DES/AES)
+    uint8_t rndALength = (_cryptoMode == DesfreCryptoMode::DF_CRYPTO_DES) ? 8 : 16;
+    if (!_noncePool.take(_rndA, rndALength)) {
+        return DesfireStatus::DFST_CRYPTO_ERROR;
+    }
+
+    // Prepare command data
+    uint8_t cmdData[2];
+    cmdData[0] = keyNo;
+    cmdData[1] = static_cast<uint8_t>(_cryptoMode);  // Proper static_cast of enum to uint8_t
+
+    uint8_t  response[32];
+    uint16_t responseLen = 0;  // Changed to uint16_t to match method parameter
+
+    // Send authentication command
+    DesfireStatus status =
+        transmit(DesfireCommand::DF_CMD_AUTHENTICATE, cmdData, 2, response, responseLen);
     if (status != DesfireStatus::DFST_SUCCESS) {
         return status;
     }
@@ -434,6 +967,1497 @@ DesfireStatus DesfireNFC::authenticate(uint8_t keyNo, const uint8_t* key, uint8_
     return DesfireStatus::DFST_SUCCESS;
 }
 
+/**
+ * @brief Authenticate with an AES key using AuthenticateEV2First
+ *
+ * @param keyNo Key number to authenticate with
+ * @param key AES-128 key (16 bytes)
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::authenticateEV2First(uint8_t keyNo, const uint8_t* key) {
+    if (!key) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
+
+    resetAuthentication();
+
+    if (!_noncePool.take(_rndA, DF_AES_BLOCK_SIZE)) {
+        return DesfireStatus::DFST_CRYPTO_ERROR;
+    }
+
+    // KeyNo, LenCap = 0 (no PCDcap2)
+    uint8_t  cmdData[2] = {keyNo, 0x00};
+    uint8_t  response[ISO7816Constants::ISO_MAX_APDU_SIZE];
+    uint16_t responseLen = 0;
+
+    // Part 1: the card answers with E(K, RndB)
+    DesfireStatus status =
+        transmit(static_cast<DesfireCommand>(DesfireEV2Command::DF_CMD_AUTHENTICATE_EV2_FIRST),
+                 cmdData,
+                 sizeof(cmdData),
+                 response,
+                 responseLen);
+    if (status != DesfireStatus::DFST_MORE_FRAMES) {
+        return (status == DesfireStatus::DFST_SUCCESS) ? DesfireStatus::DFST_AUTHENTICATION_ERROR
+                                                       : status;
+    }
+    if (responseLen != DF_AES_BLOCK_SIZE) {
+        return DesfireStatus::DFST_LENGTH_ERROR;
+    }
+
+    DesfireAES cipher(key);
+    uint8_t    iv[DF_AES_BLOCK_SIZE] = {0};
+    uint8_t    rndB[DF_AES_BLOCK_SIZE];
+    cipher.decryptCBC(iv, response, rndB, DF_AES_BLOCK_SIZE);
+
+    // Part 2: send E(K, RndA || RndB'), RndB' is RndB rotated left by one byte
+    uint8_t token[2 * DF_AES_BLOCK_SIZE];
+    memcpy(token, _rndA, DF_AES_BLOCK_SIZE);
+    memcpy(&token[DF_AES_BLOCK_SIZE], &rndB[1], DF_AES_BLOCK_SIZE - 1);
+    token[2 * DF_AES_BLOCK_SIZE - 1] = rndB[0];
+
+    memset(iv, 0, sizeof(iv));
+    cipher.encryptCBC(iv, token, token, sizeof(token));
+
+    status = transmit(
+        DesfireCommand::DF_CMD_GET_ADDITIONAL_FRAME, token, sizeof(token), response, responseLen);
+    memset(token, 0, sizeof(token));
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        memset(rndB, 0, sizeof(rndB));
+        return status;
+    }
+    if (responseLen != 2 * DF_AES_BLOCK_SIZE) {
+        memset(rndB, 0, sizeof(rndB));
+        return DesfireStatus::DFST_LENGTH_ERROR;
+    }
+
+    // The card answers with E(K, TI || RndA' || PDcap2 || PCDcap2)
+    memset(iv, 0, sizeof(iv));
+    cipher.decryptCBC(iv, response, response, 2 * DF_AES_BLOCK_SIZE);
+
+    const uint8_t* rndARotated = &response[DF_EV2_TI_LENGTH];
+    if (memcmp(rndARotated, &_rndA[1], DF_AES_BLOCK_SIZE - 1) != 0 ||
+        rndARotated[DF_AES_BLOCK_SIZE - 1] != _rndA[0]) {
+        memset(rndB, 0, sizeof(rndB));
+        return DesfireStatus::DFST_AUTHENTICATION_ERROR;
+    }
+
+    _secureMessaging.begin(key, _rndA, rndB, response);
+    memset(rndB, 0, sizeof(rndB));
+    memset(response, 0, sizeof(response));
+
+    _cryptoMode    = DesfreCryptoMode::DF_CRYPTO_AES;
+    _authenticated = true;
+
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief Authenticate with an AES key using EV1 AuthenticateAES
+ *
+ * @param keyNo Key number to authenticate with
+ * @param key AES-128 key (16 bytes)
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::authenticateAES(uint8_t keyNo, const uint8_t* key) {
+    if (!key) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
+    if (_profile == DF_PROFILE_LIGHT) {
+        return DesfireStatus::DFST_ILLEGAL_COMMAND;
+    }
+
+    resetAuthentication();
+
+    if (!_noncePool.take(_rndA, DF_AES_BLOCK_SIZE)) {
+        return DesfireStatus::DFST_CRYPTO_ERROR;
+    }
+
+    uint8_t  response[ISO7816Constants::ISO_MAX_APDU_SIZE];
+    uint16_t responseLen = 0;
+
+    // Part 1: the card answers with E(K, RndB)
+    DesfireStatus status =
+        transmit(DesfireCommand::DF_CMD_AUTHENTICATE_AES, &keyNo, 1, response, responseLen);
+    if (status != DesfireStatus::DFST_MORE_FRAMES) {
+        return (status == DesfireStatus::DFST_SUCCESS) ? DesfireStatus::DFST_AUTHENTICATION_ERROR
+                                                       : status;
+    }
+    if (responseLen != DF_AES_BLOCK_SIZE) {
+        return DesfireStatus::DFST_LENGTH_ERROR;
+    }
+
+    // EV1 chains the IV over all authentication messages
+    DesfireAES cipher(key);
+    uint8_t    iv[DF_AES_BLOCK_SIZE] = {0};
+    uint8_t    rndB[DF_AES_BLOCK_SIZE];
+    cipher.decryptCBC(iv, response, rndB, DF_AES_BLOCK_SIZE);
+
+    // Part 2: send E(K, RndA || RndB'), RndB' is RndB rotated left by one byte
+    uint8_t token[2 * DF_AES_BLOCK_SIZE];
+    memcpy(token, _rndA, DF_AES_BLOCK_SIZE);
+    memcpy(&token[DF_AES_BLOCK_SIZE], &rndB[1], DF_AES_BLOCK_SIZE - 1);
+    token[2 * DF_AES_BLOCK_SIZE - 1] = rndB[0];
+    cipher.encryptCBC(iv, token, token, sizeof(token));
+
+    status = transmit(
+        DesfireCommand::DF_CMD_GET_ADDITIONAL_FRAME, token, sizeof(token), response, responseLen);
+    memset(token, 0, sizeof(token));
+    if (status != DesfireStatus::DFST_SUCCESS || responseLen != DF_AES_BLOCK_SIZE) {
+        memset(rndB, 0, sizeof(rndB));
+        return (status != DesfireStatus::DFST_SUCCESS) ? status : DesfireStatus::DFST_LENGTH_ERROR;
+    }
+
+    // The card answers with E(K, RndA')
+    cipher.decryptCBC(iv, response, response, DF_AES_BLOCK_SIZE);
+    if (memcmp(response, &_rndA[1], DF_AES_BLOCK_SIZE - 1) != 0 ||
+        response[DF_AES_BLOCK_SIZE - 1] != _rndA[0]) {
+        memset(rndB, 0, sizeof(rndB));
+        return DesfireStatus::DFST_AUTHENTICATION_ERROR;
+    }
+
+    // Session key = RndA[0..3] || RndB[0..3] || RndA[12..15] || RndB[12..15]
+    memcpy(&_sessionKey[0], &_rndA[0], 4);
+    memcpy(&_sessionKey[4], &rndB[0], 4);
+    memcpy(&_sessionKey[8], &_rndA[12], 4);
+    memcpy(&_sessionKey[12], &rndB[12], 4);
+    memset(rndB, 0, sizeof(rndB));
+    memset(response, 0, sizeof(response));
+
+    _cryptoMode    = DesfreCryptoMode::DF_CRYPTO_AES;
+    _authenticated = true;
+
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief Authenticate with another key using AuthenticateEV2NonFirst
+ *
+ * @param keyNo Key number to authenticate with
+ * @param key AES-128 key (16 bytes)
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::authenticateEV2NonFirst(uint8_t keyNo, const uint8_t* key) {
+    if (!key) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
+    if (!_secureMessaging.isActive()) {
+        return DesfireStatus::DFST_AUTHENTICATION_ERROR;
+    }
+
+    if (!_noncePool.take(_rndA, DF_AES_BLOCK_SIZE)) {
+        return DesfireStatus::DFST_CRYPTO_ERROR;
+    }
+
+    uint8_t  response[ISO7816Constants::ISO_MAX_APDU_SIZE];
+    uint16_t responseLen = 0;
+
+    // Part 1: the card answers with E(K, RndB), no capabilities are exchanged
+    DesfireStatus status =
+        transmit(static_cast<DesfireCommand>(DesfireEV2Command::DF_CMD_AUTHENTICATE_EV2_NONFIRST),
+                 &keyNo,
+                 1,
+                 response,
+                 responseLen);
+    if (status != DesfireStatus::DFST_MORE_FRAMES || responseLen != DF_AES_BLOCK_SIZE) {
+        resetAuthentication();
+        if (status == DesfireStatus::DFST_MORE_FRAMES) {
+            return DesfireStatus::DFST_LENGTH_ERROR;
+        }
+        return (status == DesfireStatus::DFST_SUCCESS) ? DesfireStatus::DFST_AUTHENTICATION_ERROR
+                                                       : status;
+    }
+
+    DesfireAES cipher(key);
+    uint8_t    iv[DF_AES_BLOCK_SIZE] = {0};
+    uint8_t    rndB[DF_AES_BLOCK_SIZE];
+    cipher.decryptCBC(iv, response, rndB, DF_AES_BLOCK_SIZE);
+
+    // Part 2: send E(K, RndA || RndB')
+    uint8_t token[2 * DF_AES_BLOCK_SIZE];
+    memcpy(token, _rndA, DF_AES_BLOCK_SIZE);
+    memcpy(&token[DF_AES_BLOCK_SIZE], &rndB[1], DF_AES_BLOCK_SIZE - 1);
+    token[2 * DF_AES_BLOCK_SIZE - 1] = rndB[0];
+
+    memset(iv, 0, sizeof(iv));
+    cipher.encryptCBC(iv, token, token, sizeof(token));
+
+    status = transmit(
+        DesfireCommand::DF_CMD_GET_ADDITIONAL_FRAME, token, sizeof(token), response, responseLen);
+    memset(token, 0, sizeof(token));
+    if (status != DesfireStatus::DFST_SUCCESS || responseLen != DF_AES_BLOCK_SIZE) {
+        memset(rndB, 0, sizeof(rndB));
+        resetAuthentication();
+        return (status != DesfireStatus::DFST_SUCCESS) ? status : DesfireStatus::DFST_LENGTH_ERROR;
+    }
+
+    // The card answers with E(K, RndA') only, TI and counter continue
+    memset(iv, 0, sizeof(iv));
+    cipher.decryptCBC(iv, response, response, DF_AES_BLOCK_SIZE);
+    if (memcmp(response, &_rndA[1], DF_AES_BLOCK_SIZE - 1) != 0 ||
+        response[DF_AES_BLOCK_SIZE - 1] != _rndA[0]) {
+        memset(rndB, 0, sizeof(rndB));
+        resetAuthentication();
+        return DesfireStatus::DFST_AUTHENTICATION_ERROR;
+    }
+
+    _secureMessaging.renew(key, _rndA, rndB);
+    memset(rndB, 0, sizeof(rndB));
+    memset(response, 0, sizeof(response));
+
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief Authenticate with an AES key using the method of the strategy
+ *
+ * @param keyNo Key number to authenticate with
+ * @param key AES-128 key (16 bytes)
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::authenticateWithStrategy(uint8_t keyNo, const uint8_t* key) {
+    switch (_strategy.authMethod) {
+        case DF_AUTH_METHOD_EV2:
+            if (_secureMessaging.isActive()) {
+                return authenticateEV2NonFirst(keyNo, key);
+            }
+            return authenticateEV2First(keyNo, key);
+
+        case DF_AUTH_METHOD_AES:
+            return authenticateAES(keyNo, key);
+
+        default:
+            return DesfireStatus::DFST_ILLEGAL_COMMAND;
+    }
+}
+
+/**
+ * @brief Change a card configuration option with SetConfiguration
+ *
+ * @param option Configuration option
+ * @param data Option data
+ * @param dataLen Length of the option data
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::setConfiguration(DesfireConfigOption option,
+                                           const uint8_t*      data,
+                                           uint8_t             dataLen) {
+    if (!data) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
+
+    // Option data is only accepted encrypted
+    if (!_secureMessaging.isActive()) {
+        return DesfireStatus::DFST_AUTHENTICATION_ERROR;
+    }
+
+    uint8_t  header   = static_cast<uint8_t>(option);
+    uint8_t  response[DF_MACT_SIZE];
+    uint16_t responseLen = 0;
+
+    DesfireStatus status = transmitSecure(DesfireCommand::DF_CMD_SET_CONFIGURATION,
+                                          &header,
+                                          1,
+                                          data,
+                                          dataLen,
+                                          DF_COMM_ENCRYPT,
+                                          response,
+                                          responseLen,
+                                          sizeof(response));
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        return status;
+    }
+
+    // The lower nibble of T0 is FSCI, the new frame size applies from the next activation
+    // and the current one keeps the frame size it was activated with
+    if (option == DF_CONFIG_ATS && dataLen >= 2) {
+        uint8_t        uidLength = 0;
+        const uint8_t* uid       = getIdentityUID(&uidLength);
+        if (uid != nullptr) {
+            DesfireCardStrategy next = _strategy;
+            next.frameSize           = DesfireStrategyCache::getFrameSize(data[1] & 0x0F);
+            _strategyCache.store(uid, uidLength, next);
+        }
+    }
+
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief Apply a card configuration within the current session
+ *
+ * @param config Configuration to apply
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::applyConfiguration(const DesfireConfiguration& config) {
+    DesfireStatus status = DesfireStatus::DFST_SUCCESS;
+
+    if (config.options & (1 << DF_CONFIG_DEFAULT_KEY)) {
+        uint8_t keyData[DF_CONFIG_DEFAULT_KEY_SIZE + 1];
+        memcpy(keyData, config.defaultKey, DF_CONFIG_DEFAULT_KEY_SIZE);
+        keyData[DF_CONFIG_DEFAULT_KEY_SIZE] = config.defaultKeyVersion;
+
+        status = setConfiguration(DF_CONFIG_DEFAULT_KEY, keyData, sizeof(keyData));
+        memset(keyData, 0, sizeof(keyData));
+        if (status != DesfireStatus::DFST_SUCCESS) {
+            return status;
+        }
+    }
+
+    if (config.options & (1 << DF_CONFIG_ATS)) {
+        // TL (the first byte) is the length of the ATS including itself
+        if (config.atsLength == 0 || config.atsLength > DF_CONFIG_ATS_MAX_LENGTH ||
+            config.ats[0] != config.atsLength) {
+            return DesfireStatus::DFST_PARAMETER_ERROR;
+        }
+
+        status = setConfiguration(DF_CONFIG_ATS, config.ats, config.atsLength);
+        if (status != DesfireStatus::DFST_SUCCESS) {
+            return status;
+        }
+    }
+
+    // Last, random ID changes how the card is seen on the next activation
+    if (config.options & (1 << DF_CONFIG_PICC)) {
+        status = setConfiguration(DF_CONFIG_PICC, &config.piccFlags, 1);
+    }
+
+    return status;
+}
+
+/**
+ * @brief Set the frame size (FSC) the cards accept
+ *
+ * @param frameSize Card frame size in bytes (16 to 256)
+ */
+void DesfireNFC::setCardFrameSize(uint16_t frameSize) {
+    if (frameSize < 16) {
+        frameSize = 16;
+    }
+    if (frameSize > 256) {
+        frameSize = 256;
+    }
+    _cardFrameSize = frameSize;
+}
+
+/**
+ * @brief Read data from a standard, backup or transaction MAC file
+ *
+ * @param fileNo File number
+ * @param offset Offset within the file
+ * @param length Number of bytes to read (must be greater than 0)
+ * @param data Buffer to store the data (at least length bytes)
+ * @param commMode Communication mode of the file
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::readData(uint8_t                 fileNo,
+                                   uint32_t                offset,
+                                   uint32_t                length,
+                                   uint8_t*                data,
+                                   DesfreCommunicationMode commMode) {
+    if (!data) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
+    if (length == 0 || offset + length > 0xFFFFFF) {
+        return DesfireStatus::DFST_PARAMETER_ERROR;
+    }
+
+    // Long reads are split so that padding and MAC of each response fit the buffer
+    uint8_t  command;
+    uint32_t chunkSize = getReadChunkSize(commMode, &command);
+
+    uint32_t done = 0;
+    while (done < length) {
+        uint32_t chunk = length - done;
+        if (chunk > chunkSize) {
+            chunk = chunkSize;
+        }
+
+        uint32_t chunkOffset = offset + done;
+        uint8_t  header[7];
+        header[0] = fileNo;
+        header[1] = chunkOffset & 0xFF;
+        header[2] = (chunkOffset >> 8) & 0xFF;
+        header[3] = (chunkOffset >> 16) & 0xFF;
+        header[4] = chunk & 0xFF;
+        header[5] = (chunk >> 8) & 0xFF;
+        header[6] = (chunk >> 16) & 0xFF;
+
+        uint16_t responseLen = 0;
+
+        DesfireStatus status = transmitSecure(command,
+                                              header,
+                                              sizeof(header),
+                                              nullptr,
+                                              0,
+                                              commMode,
+                                              _responseBuffer,
+                                              responseLen,
+                                              sizeof(_responseBuffer));
+        if (status != DesfireStatus::DFST_SUCCESS) {
+            return status;
+        }
+        if (responseLen != chunk) {
+            return DesfireStatus::DFST_LENGTH_ERROR;
+        }
+
+        memcpy(&data[done], _responseBuffer, chunk);
+        done += chunk;
+    }
+
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief Read several ranges of files of the selected application
+ *
+ * @param requests Ranges to read (at most DF_READ_PLAN_MAX_REQUESTS)
+ * @param count Number of requests
+ * @param maxGap Largest gap between two ranges that is read through
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::readDataRanges(const DesfireReadRequest* requests,
+                                         uint8_t                   count,
+                                         uint32_t                  maxGap) {
+    if (!requests) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        if (!requests[i].data) {
+            return DesfireStatus::DFST_PARAMETER_NULL;
+        }
+        // Written so that offset + length cannot wrap around
+        if (requests[i].length > 0xFFFFFF || requests[i].offset > 0xFFFFFF - requests[i].length) {
+            return DesfireStatus::DFST_PARAMETER_ERROR;
+        }
+    }
+    if (count == 0) {
+        return DesfireStatus::DFST_SUCCESS;
+    }
+
+    // Spans are sized for the smallest chunk, so that each takes one command in any mode
+    uint8_t         command;
+    uint32_t        maxSpan = getReadChunkSize(DF_COMM_ENCRYPT, &command);
+    DesfireReadSpan spans[DF_READ_PLAN_MAX_REQUESTS];
+    uint8_t         spanCount = DesfireReadPlanner::plan(requests, count, maxSpan, maxGap, spans);
+    if (spanCount == 0) {
+        return DesfireStatus::DFST_PARAMETER_ERROR;
+    }
+
+    uint8_t buffer[DF_READ_CHUNK_SIZE];
+    for (uint8_t i = 0; i < spanCount; i++) {
+        const DesfireReadSpan& span   = spans[i];
+        uint8_t*               source = buffer;
+
+        // A range too long for one command has its own span, read it in place
+        if (span.length > sizeof(buffer)) {
+            for (uint8_t j = 0; j < count; j++) {
+                if (requests[j].offset == span.offset && requests[j].length == span.length &&
+                    DesfireReadPlanner::covers(span, requests[j])) {
+                    source = requests[j].data;
+                    break;
+                }
+            }
+        }
+
+        DesfireStatus status =
+            readData(span.fileNo, span.offset, span.length, source, span.commMode);
+        if (status != DesfireStatus::DFST_SUCCESS) {
+            return status;
+        }
+
+        for (uint8_t j = 0; j < count; j++) {
+            const DesfireReadRequest& request = requests[j];
+            if (request.data != source && DesfireReadPlanner::covers(span, request)) {
+                memcpy(request.data, &source[request.offset - span.offset], request.length);
+            }
+        }
+    }
+
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief Read a file range from each of several applications in one pass
+ *
+ * @param entries File ranges to read
+ * @param results Array of count results, in the order of the entries
+ * @param count Number of entries
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::readApplicationFiles(const DesfireSweepEntry* entries,
+                                               DesfireSweepResult*      results,
+                                               uint8_t                  count) {
+    if (!entries || !results) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
+
+    // Known cards already have their strategy from detectCard(), a card that does not answer
+    // GetVersion fails every entry
+    DesfireStatus first = DesfireStatus::DFST_SUCCESS;
+    if (_strategy.generation == DF_GEN_UNKNOWN) {
+        first = selectStrategy();
+    }
+
+    bool                     lost     = (first != DesfireStatus::DFST_SUCCESS);
+    const DesfireSweepEntry* selected = nullptr;  // Entry whose application is selected
+    const DesfireSweepEntry* session  = nullptr;  // Entry whose key is authenticated
+    for (uint8_t i = 0; i < count; i++) {
+        const DesfireSweepEntry& entry  = entries[i];
+        DesfireSweepResult&      result = results[i];
+        result.length                   = 0;
+
+        if (lost) {
+            // Without the card every further exchange would only wait for a timeout
+            result.status = DesfireStatus::DFST_COMMUNICATION_ERROR;
+        } else if (entry.length == 0 || entry.length > DF_SWEEP_DATA_SIZE) {
+            result.status = DesfireStatus::DFST_PARAMETER_ERROR;
+        } else {
+            result.status = DesfireStatus::DFST_SUCCESS;
+
+            if (selected == nullptr || memcmp(selected->aid, entry.aid, 3) != 0) {
+                uint8_t aid[3];
+                memcpy(aid, entry.aid, sizeof(aid));
+
+                session       = nullptr;
+                result.status = selectApplication(aid);
+                selected      = (result.status == DesfireStatus::DFST_SUCCESS) ? &entry : nullptr;
+            }
+
+            // Another key of the selected application takes over the session, which the
+            // strategy does with AuthenticateEV2NonFirst where the card has it
+            if (result.status == DesfireStatus::DFST_SUCCESS && entry.key != nullptr &&
+                (session == nullptr || session->keyNo != entry.keyNo ||
+                 session->key != entry.key)) {
+                session       = nullptr;
+                result.status = authenticateWithStrategy(entry.keyNo, entry.key);
+                if (result.status == DesfireStatus::DFST_SUCCESS) {
+                    session = &entry;
+                }
+            }
+
+            if (result.status == DesfireStatus::DFST_SUCCESS) {
+                result.status =
+                    readData(entry.fileNo, entry.offset, entry.length, result.data, entry.commMode);
+            }
+
+            // A failed command ends the session on the card, the application stays selected
+            if (result.status != DesfireStatus::DFST_SUCCESS) {
+                session = nullptr;
+                lost    = (result.status == DesfireStatus::DFST_COMMUNICATION_ERROR);
+            }
+        }
+
+        if (result.status == DesfireStatus::DFST_SUCCESS) {
+            result.length = entry.length;
+        } else if (first == DesfireStatus::DFST_SUCCESS) {
+            first = result.status;
+        }
+    }
+
+    return first;
+}
+
+/**
+ * @brief Read data, reusing contents cached on an earlier tap
+ *
+ * @param fileNo File number
+ * @param offset Offset within the file
+ * @param length Number of bytes to read (must be greater than 0)
+ * @param data Buffer to store the data (at least length bytes)
+ * @param commMode Communication mode of the file
+ * @param validator Counter that the card changes whenever the file changes
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::readDataCached(uint8_t                      fileNo,
+                                         uint32_t                     offset,
+                                         uint32_t                     length,
+                                         uint8_t*                     data,
+                                         DesfreCommunicationMode      commMode,
+                                         const DesfireCacheValidator& validator) {
+    if (!data) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
+    if (validator.length == 0 || validator.length > 4) {
+        return DesfireStatus::DFST_PARAMETER_ERROR;
+    }
+
+    // Random-ID cards are cached under their real UID once it is resolved
+    uint8_t        uidLength = 0;
+    const uint8_t* uid       = getIdentityUID(&uidLength);
+    if (uid == nullptr) {
+        return readData(fileNo, offset, length, data, commMode);
+    }
+
+    // One short read decides whether the cached contents are still current
+    uint8_t       counterBytes[4];
+    DesfireStatus status = readData(validator.fileNo,
+                                    validator.offset,
+                                    validator.length,
+                                    counterBytes,
+                                    validator.commMode);
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        return status;
+    }
+
+    uint32_t counter = 0;
+    for (uint8_t i = validator.length; i > 0; i--) {
+        counter = (counter << 8) | counterBytes[i - 1];
+    }
+
+    const uint8_t* cached =
+        _fileCache.lookup(uid, uidLength, _selectedAID, fileNo, offset, length, counter);
+    if (cached != nullptr) {
+        memcpy(data, cached, length);
+        return DesfireStatus::DFST_SUCCESS;
+    }
+
+    status = readData(fileNo, offset, length, data, commMode);
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        return status;
+    }
+
+    _fileCache.store(uid, uidLength, _selectedAID, fileNo, offset, length, counter, data);
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief Write data to a standard or backup file
+ *
+ * @param fileNo File number
+ * @param offset Offset within the file
+ * @param length Number of bytes to write (must be greater than 0)
+ * @param data Data to write
+ * @param commMode Communication mode of the file
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::writeData(uint8_t                 fileNo,
+                                    uint32_t                offset,
+                                    uint32_t                length,
+                                    const uint8_t*          data,
+                                    DesfreCommunicationMode commMode) {
+    if (!data) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
+    if (length == 0 || offset + length > 0xFFFFFF) {
+        return DesfireStatus::DFST_PARAMETER_ERROR;
+    }
+
+    // Cached ranges of this card may cover the written bytes
+    uint8_t        uidLength = 0;
+    const uint8_t* uid       = getIdentityUID(&uidLength);
+    if (uid != nullptr) {
+        _fileCache.invalidate(uid, uidLength);
+    }
+
+    uint8_t  command;
+    uint32_t chunkSize = getWriteChunkSize(commMode, &command);
+
+    uint32_t done = 0;
+    while (done < length) {
+        uint32_t chunk = length - done;
+        if (chunk > chunkSize) {
+            chunk = chunkSize;
+        }
+
+        uint32_t chunkOffset = offset + done;
+        uint8_t  header[DF_WRITE_HEADER_SIZE];
+        header[0] = fileNo;
+        header[1] = chunkOffset & 0xFF;
+        header[2] = (chunkOffset >> 8) & 0xFF;
+        header[3] = (chunkOffset >> 16) & 0xFF;
+        header[4] = chunk & 0xFF;
+        header[5] = (chunk >> 8) & 0xFF;
+        header[6] = (chunk >> 16) & 0xFF;
+
+        uint16_t responseLen = 0;
+
+        DesfireStatus status = transmitSecure(command,
+                                              header,
+                                              sizeof(header),
+                                              &data[done],
+                                              static_cast<uint16_t>(chunk),
+                                              commMode,
+                                              _responseBuffer,
+                                              responseLen,
+                                              sizeof(_responseBuffer));
+        if (status != DesfireStatus::DFST_SUCCESS) {
+            return status;
+        }
+
+        done += chunk;
+    }
+
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief Write only the bytes that differ from the previous contents
+ *
+ * @param fileNo File number
+ * @param offset Offset of the range within the file
+ * @param length Length of the range
+ * @param previous Contents of the range on the card (shadow copy)
+ * @param data New contents of the range
+ * @param commMode Communication mode of the file
+ * @param maxGap Largest unchanged run that is rewritten to join two changes
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::writeDataDelta(uint8_t                 fileNo,
+                                         uint32_t                offset,
+                                         uint32_t                length,
+                                         const uint8_t*          previous,
+                                         const uint8_t*          data,
+                                         DesfreCommunicationMode commMode,
+                                         uint32_t                maxGap) {
+    if (!previous || !data) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
+    if (length == 0 || offset + length > 0xFFFFFF) {
+        return DesfireStatus::DFST_PARAMETER_ERROR;
+    }
+
+    DesfireWriteSpan spans[DF_WRITE_PLAN_MAX_SPANS];
+    uint8_t          spanCount =
+        DesfireWritePlanner::plan(previous, data, length, maxGap, spans, DF_WRITE_PLAN_MAX_SPANS);
+
+    for (uint8_t i = 0; i < spanCount; i++) {
+        DesfireStatus status = writeData(fileNo,
+                                         offset + spans[i].offset,
+                                         spans[i].length,
+                                         &data[spans[i].offset],
+                                         commMode);
+        if (status != DesfireStatus::DFST_SUCCESS) {
+            return status;
+        }
+    }
+
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief Create a transaction MAC file in the selected application
+ *
+ * @param fileNo File number
+ * @param commMode Communication mode for reading the file
+ * @param readAccess Key number for read access (DF_AR_*)
+ * @param commitReaderIdAccess Key number for CommitReaderID (DF_AR_*)
+ * @param changeAccess Key number for changing the file settings (DF_AR_*)
+ * @param tmKey AES transaction MAC key (16 bytes)
+ * @param tmKeyVersion Version of the transaction MAC key
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::createTransactionMACFile(uint8_t                 fileNo,
+                                                   DesfreCommunicationMode commMode,
+                                                   uint8_t                 readAccess,
+                                                   uint8_t                 commitReaderIdAccess,
+                                                   uint8_t                 changeAccess,
+                                                   const uint8_t*          tmKey,
+                                                   uint8_t                 tmKeyVersion) {
+    if (!tmKey) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
+
+    // The TMAC key must never be sent in plain
+    if (!_secureMessaging.isActive()) {
+        return DesfireStatus::DFST_AUTHENTICATION_ERROR;
+    }
+
+    // FileNo, FileOption, AccessRights (Read | Write, CommitReaderID | Change), TMKeyOption;
+    // write is never
+    uint8_t header[5];
+    header[0] = fileNo;
+    header[1] = static_cast<uint8_t>(commMode);
+    header[2] = static_cast<uint8_t>(((commitReaderIdAccess & 0x0F) << 4) | (changeAccess & 0x0F));
+    header[3] = static_cast<uint8_t>(((readAccess & 0x0F) << 4) | DF_AR_NEVER);
+    header[4] = DF_EV2_TM_KEY_AES;
+
+    // Only TMKey || TMKeyVer is encrypted
+    uint8_t keyData[DF_AES_KEY_SIZE + 1];
+    memcpy(keyData, tmKey, DF_AES_KEY_SIZE);
+    keyData[DF_AES_KEY_SIZE] = tmKeyVersion;
+
+    uint8_t       response[DF_MACT_SIZE];
+    uint16_t      responseLen = 0;
+    DesfireStatus status =
+        transmitSecure(DesfireEV2Command::DF_CMD_CREATE_TRANSACTION_MAC_FILE,
+                       header,
+                       sizeof(header),
+                       keyData,
+                       sizeof(keyData),
+                       DF_COMM_ENCRYPT,
+                       response,
+                       responseLen,
+                       sizeof(response));
+    memset(keyData, 0, sizeof(keyData));
+
+    return status;
+}
+
+/**
+ * @brief Parse TMC (little endian) || TMV as returned by the card
+ */
+static void parseTransactionMAC(const uint8_t* data, DesfireTransactionMAC* tmac) {
+    tmac->counter = static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+                    (static_cast<uint32_t>(data[2]) << 16) |
+                    (static_cast<uint32_t>(data[3]) << 24);
+    memcpy(tmac->value, &data[DF_EV2_TMC_LENGTH], DF_EV2_TMV_LENGTH);
+}
+
+/**
+ * @brief Read the last transaction MAC from a transaction MAC file
+ *
+ * @param fileNo File number of the transaction MAC file
+ * @param tmac Pointer to a DesfireTransactionMAC struct to store TMC and TMV
+ * @param commMode Communication mode of the file
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::readTransactionMAC(uint8_t                 fileNo,
+                                             DesfireTransactionMAC*  tmac,
+                                             DesfreCommunicationMode commMode) {
+    if (!tmac) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
+
+    uint8_t       data[DF_EV2_TMC_LENGTH + DF_EV2_TMV_LENGTH];
+    DesfireStatus status = readData(fileNo, 0, sizeof(data), data, commMode);
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        return status;
+    }
+
+    parseTransactionMAC(data, tmac);
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief Commit the current transaction
+ *
+ * @param tmac Pointer to a DesfireTransactionMAC struct to store TMC and
+ *        TMV, nullptr to commit without requesting them
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::commitTransaction(DesfireTransactionMAC* tmac) {
+    uint8_t  option = DF_EV2_COMMIT_RETURN_TMAC;
+    uint8_t  response[DF_EV2_TMC_LENGTH + DF_EV2_TMV_LENGTH + DF_MACT_SIZE];
+    uint16_t responseLen = 0;
+
+    // Inside an EV2 session the commit and the returned TMAC are MAC protected
+    DesfreCommunicationMode commMode = _secureMessaging.isActive() ? DF_COMM_MAC : DF_COMM_PLAIN;
+
+    DesfireStatus status = transmitSecure(DesfireCommand::DF_CMD_COMMIT_TRANSACTION,
+                                          &option,
+                                          tmac ? 1 : 0,
+                                          nullptr,
+                                          0,
+                                          commMode,
+                                          response,
+                                          responseLen,
+                                          sizeof(response));
+    if (status != DesfireStatus::DFST_SUCCESS || !tmac) {
+        return status;
+    }
+
+    if (responseLen != DF_EV2_TMC_LENGTH + DF_EV2_TMV_LENGTH) {
+        return DesfireStatus::DFST_LENGTH_ERROR;
+    }
+
+    parseTransactionMAC(response, tmac);
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief Abort the current transaction
+ *
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::abortTransaction() {
+    uint8_t  response[DF_MACT_SIZE];
+    uint16_t responseLen = 0;
+
+    DesfreCommunicationMode commMode = _secureMessaging.isActive() ? DF_COMM_MAC : DF_COMM_PLAIN;
+
+    return transmitSecure(DesfireCommand::DF_CMD_ABORT_TRANSACTION,
+                          nullptr,
+                          0,
+                          nullptr,
+                          0,
+                          commMode,
+                          response,
+                          responseLen,
+                          sizeof(response));
+}
+
+/**
+ * @brief Check that the card is close to the reader (EV2 proximity check)
+ *
+ * @param maxRoundTrip Longest accepted round trip time in microseconds
+ * @param result Structure to store the measured times (optional)
+ * @param rounds Number of timed rounds (1, 2, 4 or 8)
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::proximityCheck(uint32_t               maxRoundTrip,
+                                         DesfireProximityCheck* result,
+                                         uint8_t                rounds) {
+    // VerifyPC is MACed with the session MAC key
+    if (!_secureMessaging.isActive()) {
+        return DesfireStatus::DFST_AUTHENTICATION_ERROR;
+    }
+    if (rounds != 1 && rounds != 2 && rounds != 4 && rounds != 8) {
+        return DesfireStatus::DFST_PARAMETER_ERROR;
+    }
+
+    DesfireProximityCheck check;
+    memset(&check, 0, sizeof(check));
+    check.rounds = rounds;
+
+    uint8_t  response[ISO7816Constants::ISO_MAX_APDU_SIZE];
+    uint16_t responseLen = 0;
+
+    // PreparePC: OPT || pubRespTime || [PPS1]
+    DesfireStatus status =
+        transmit(static_cast<DesfireCommand>(DesfireEV2Command::DF_CMD_PREPARE_PC),
+                 nullptr,
+                 0,
+                 response,
+                 responseLen);
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        return status;
+    }
+    if (responseLen < 3 || ((response[0] & DF_PC_OPT_PPS1) && responseLen < 4)) {
+        return DesfireStatus::DFST_LENGTH_ERROR;
+    }
+    check.opt         = response[0];
+    check.pubRespTime = (response[1] << 8) | response[2];
+    check.pps1        = (check.opt & DF_PC_OPT_PPS1) ? response[3] : 0;
+
+    // A fresh challenge, so a relay cannot answer ahead of time
+    uint8_t rndC[DF_PC_RND_SIZE];
+    if (!_noncePool.take(rndC, sizeof(rndC))) {
+        return DesfireStatus::DFST_CRYPTO_ERROR;
+    }
+
+    // MAC input: FDh || OPT || pubRespTime || [PPS1] || RndR1 || RndC1 || ... || RndRn || RndCn
+    uint8_t macInput[5 + 2 * DF_PC_RND_SIZE];
+    uint8_t macLength     = 0;
+    macInput[macLength++] = DesfireEV2Command::DF_CMD_VERIFY_PC;
+    macInput[macLength++] = check.opt;
+    macInput[macLength++] = check.pubRespTime >> 8;
+    macInput[macLength++] = check.pubRespTime & 0xFF;
+    if (check.opt & DF_PC_OPT_PPS1) {
+        macInput[macLength++] = check.pps1;
+    }
+
+    // The reader rejects late answers in hardware where it can
+    bool    limited = _reader.setResponseTimeout(maxRoundTrip);
+    uint8_t part    = DF_PC_RND_SIZE / rounds;
+    for (uint8_t i = 0; i < rounds; i++) {
+        uint8_t cmdData[1 + DF_PC_RND_SIZE];
+        cmdData[0] = part;
+        memcpy(&cmdData[1], &rndC[i * part], part);
+
+        status = transmit(static_cast<DesfireCommand>(DesfireEV2Command::DF_CMD_PROXIMITY_CHECK),
+                          cmdData,
+                          1 + part,
+                          response,
+                          responseLen,
+                          &check.roundTrip[i]);
+        if (status == DesfireStatus::DFST_SUCCESS && responseLen != part) {
+            status = DesfireStatus::DFST_LENGTH_ERROR;
+        }
+        if (status != DesfireStatus::DFST_SUCCESS) {
+            break;
+        }
+
+        memcpy(&macInput[macLength], response, part);
+        memcpy(&macInput[macLength + part], &rndC[i * part], part);
+        macLength += 2 * part;
+        if (check.roundTrip[i] > check.maxRoundTrip) {
+            check.maxRoundTrip = check.roundTrip[i];
+        }
+    }
+    if (limited) {
+        _reader.setResponseTimeout(0);
+    }
+
+    if (result) {
+        *result = check;
+    }
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        // With a hardware limit a relayed answer never arrives
+        return (limited && status == DesfireStatus::DFST_COMMUNICATION_ERROR)
+                   ? DesfireStatus::DFST_PROXIMITY_ERROR
+                   : status;
+    }
+
+    // VerifyPC proves that the card saw the same challenges
+    uint8_t mac[DF_MACT_SIZE];
+    _secureMessaging.computeMAC(macInput, macLength, mac);
+    status = transmit(static_cast<DesfireCommand>(DesfireEV2Command::DF_CMD_VERIFY_PC),
+                      mac,
+                      sizeof(mac),
+                      response,
+                      responseLen);
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        return status;
+    }
+    if (responseLen != DF_MACT_SIZE) {
+        return DesfireStatus::DFST_LENGTH_ERROR;
+    }
+
+    // The card MACs the same input with 90h in front
+    macInput[0] = DF_PC_VERIFY_RESULT;
+    _secureMessaging.computeMAC(macInput, macLength, mac);
+
+    uint8_t diff = 0;
+    for (uint8_t i = 0; i < DF_MACT_SIZE; i++) {
+        diff |= mac[i] ^ response[i];
+    }
+    if (diff != 0) {
+        resetAuthentication();
+        return DesfireStatus::DFST_AUTHENTICATION_ERROR;
+    }
+
+    return (check.maxRoundTrip > maxRoundTrip) ? DesfireStatus::DFST_PROXIMITY_ERROR
+                                               : DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief Read the command counter of the card with GetCommandCounter
+ *
+ * @param counter Pointer to variable that will store the counter
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::getCommandCounter(uint16_t* counter) {
+    if (!counter) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
+
+    uint8_t  response[2];
+    uint16_t responseLen = 0;
+
+    DesfireStatus status = exchange(DesfireEV2Command::DF_CMD_GET_COMMAND_COUNTER,
+                                    nullptr,
+                                    0,
+                                    response,
+                                    responseLen,
+                                    sizeof(response));
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        return status;
+    }
+    if (responseLen != sizeof(response)) {
+        return DesfireStatus::DFST_LENGTH_ERROR;
+    }
+
+    *counter = response[0] | (response[1] << 8);
+
+    // The reply is not MACed. Only the local value, or one more after a
+    // command whose response was lost, is taken over; anything else could
+    // roll the counter back and let older responses be replayed.
+    if (_secureMessaging.isActive()) {
+        uint32_t local = _secureMessaging.getCommandCounter();
+        if (*counter != local && !(_counterResync && *counter == local + 1)) {
+            resetAuthentication();
+            return DesfireStatus::DFST_INTEGRITY_ERROR;
+        }
+        _secureMessaging.setCommandCounter(*counter);
+        _counterResync = false;
+    }
+
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief Set the command counter of the card with SetCommandCounter
+ *
+ * @param counter New command counter
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::setCommandCounter(uint16_t counter) {
+    if (!_secureMessaging.isActive()) {
+        return DesfireStatus::DFST_AUTHENTICATION_ERROR;
+    }
+
+    uint8_t  data[2] = {static_cast<uint8_t>(counter & 0xFF), static_cast<uint8_t>(counter >> 8)};
+    uint8_t  response[DF_MACT_SIZE];
+    uint16_t responseLen = 0;
+
+    DesfireStatus status = transmitSecure(DesfireEV2Command::DF_CMD_SET_COMMAND_COUNTER,
+                                          nullptr,
+                                          0,
+                                          data,
+                                          sizeof(data),
+                                          DF_COMM_MAC,
+                                          response,
+                                          responseLen,
+                                          sizeof(response));
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        return status;
+    }
+
+    _secureMessaging.setCommandCounter(counter);
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief Get the local command counter of the EV2 session
+ *
+ * @return uint16_t Command counter, 0 without an EV2 session
+ */
+uint16_t DesfireNFC::getSessionCounter() const {
+    return _secureMessaging.isActive() ? _secureMessaging.getCommandCounter() : 0;
+}
+
+/**
+ * @brief Get the counts and times of the exchanges with the reader
+ *
+ * @return const DesfireExchangeStats& Statistics since the last reset
+ */
+const DesfireExchangeStats& DesfireNFC::getExchangeStats() const {
+    return _exchangeStats;
+}
+
+/**
+ * @brief Clear the exchange statistics
+ */
+void DesfireNFC::resetExchangeStats() {
+    memset(&_exchangeStats, 0, sizeof(_exchangeStats));
+}
+
+/**
+ * @brief Exchange a complete command, following command and response chaining
+ *
+ * @param command DESFire command code
+ * @param data Pointer to command data
+ * @param dataLen Length of command data
+ * @param response Buffer to store the complete response
+ * @param responseLen Reference to variable that will hold response length
+ * @param responseSize Size of the response buffer
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::exchange(uint8_t        command,
+                                   const uint8_t* data,
+                                   uint16_t       dataLen,
+                                   uint8_t*       response,
+                                   uint16_t&      responseLen,
+                                   uint16_t       responseSize) {
+    if (!response) {
+        return DesfireStatus::DFST_PARAMETER_NULL;
+    }
+
+    uint8_t       frame[ISO7816Constants::ISO_MAX_APDU_SIZE];
+    uint16_t      frameLen      = 0;
+    uint16_t      sent          = 0;
+    uint8_t       frameCommand  = command;
+    uint8_t       frameDataSize = getFrameDataSize();
+    bool          overflow      = false;
+    DesfireStatus status;
+
+    responseLen = 0;
+
+    // Command chaining: the first frame carries the command code, the rest follow with AF
+    while (true) {
+        uint16_t chunk = dataLen - sent;
+        if (chunk > frameDataSize) {
+            chunk = frameDataSize;
+        }
+
+        status = transmit(static_cast<DesfireCommand>(frameCommand),
+                          data ? &data[sent] : nullptr,
+                          static_cast<uint8_t>(chunk),
+                          frame,
+                          frameLen);
+        sent += chunk;
+
+        if (sent >= dataLen) {
+            break;
+        }
+        if (status != DesfireStatus::DFST_MORE_FRAMES) {
+            return (status == DesfireStatus::DFST_SUCCESS) ? DesfireStatus::DFST_LENGTH_ERROR
+                                                           : status;
+        }
+        frameCommand = DesfireCommand::DF_CMD_GET_ADDITIONAL_FRAME;
+    }
+
+    // Response chaining: request frames until the card signals completion
+    for (uint8_t frames = 0; frames < DF_PICC_MAX_FRAME; frames++) {
+        if (status != DesfireStatus::DFST_SUCCESS && status != DesfireStatus::DFST_MORE_FRAMES) {
+            return status;
+        }
+
+        // Keep draining so that the card completes the command
+        if (overflow || responseLen + frameLen > responseSize) {
+            overflow = true;
+        } else {
+            memcpy(&response[responseLen], frame, frameLen);
+            responseLen += frameLen;
+        }
+
+        if (status == DesfireStatus::DFST_SUCCESS) {
+            return overflow ? DesfireStatus::DFST_BUFFER_TOO_SMALL : DesfireStatus::DFST_SUCCESS;
+        }
+
+        status =
+            transmit(DesfireCommand::DF_CMD_GET_ADDITIONAL_FRAME, nullptr, 0, frame, frameLen);
+    }
+
+    return DesfireStatus::DFST_LENGTH_ERROR;
+}
+
+/**
+ * @brief Exchange a command with EV2 secure messaging applied
+ *
+ * @param command DESFire command code
+ * @param header Command header (never encrypted)
+ * @param headerLen Length of the command header
+ * @param data Command data (encrypted in DF_COMM_ENCRYPT)
+ * @param dataLen Length of command data
+ * @param commMode Communication mode
+ * @param response Buffer to store the plain response
+ * @param responseLen Reference to variable that will hold response length
+ * @param responseSize Size of the response buffer
+ * @return DesfireStatus Status code of the operation
+ */
+DesfireStatus DesfireNFC::transmitSecure(uint8_t                 command,
+                                         const uint8_t*          header,
+                                         uint8_t                 headerLen,
+                                         const uint8_t*          data,
+                                         uint16_t                dataLen,
+                                         DesfreCommunicationMode commMode,
+                                         uint8_t*                response,
+                                         uint16_t&               responseLen,
+                                         uint16_t                responseSize) {
+    uint16_t commandLen = _secureMessaging.wrapCommand(command,
+                                                       header,
+                                                       headerLen,
+                                                       data,
+                                                       dataLen,
+                                                       commMode,
+                                                       _apduBuffer,
+                                                       sizeof(_apduBuffer));
+    if (commandLen == 0 && headerLen + dataLen > 0) {
+        return DesfireStatus::DFST_BUFFER_OVERFLOW;
+    }
+
+    DesfireStatus status;
+    if (_secureMessaging.isActive()) {
+        if (_secureMessaging.isCommandCounterExhausted()) {
+            resetAuthentication();
+            return DesfireStatus::DFST_AUTHENTICATION_ERROR;
+        }
+
+        // A lost response leaves the counter unknown, ask the card instead of re-authenticating
+        if (_counterResync) {
+            uint16_t counter;
+            status = getCommandCounter(&counter);
+            if (status != DesfireStatus::DFST_SUCCESS) {
+                resetAuthentication();
+                return status;
+            }
+
+            // The command was protected with the old counter
+            commandLen = _secureMessaging.wrapCommand(command,
+                                                      header,
+                                                      headerLen,
+                                                      data,
+                                                      dataLen,
+                                                      commMode,
+                                                      _apduBuffer,
+                                                      sizeof(_apduBuffer));
+        }
+    }
+
+    status = exchange(command, _apduBuffer, commandLen, response, responseLen, responseSize);
+    if (status != DesfireStatus::DFST_SUCCESS && _secureMessaging.isActive()) {
+        if (status == DesfireStatus::DFST_BUFFER_TOO_SMALL) {
+            // The card completed the command, only its response was dropped
+            _secureMessaging.setCommandCounter(_secureMessaging.getCommandCounter() + 1);
+        } else if (status == DesfireStatus::DFST_COMMUNICATION_ERROR) {
+            // The card may or may not have received the command
+            _counterResync = true;
+        } else {
+            // The card ends the session on errors
+            resetAuthentication();
+        }
+    }
+    if (status != DesfireStatus::DFST_SUCCESS) {
+        return status;
+    }
+
+    if (!_secureMessaging.unwrapResponse(0x00, response, &responseLen, commMode)) {
+        resetAuthentication();
+        return DesfireStatus::DFST_INTEGRITY_ERROR;
+    }
+
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+/**
+ * @brief End the current authentication and secure messaging session
+ */
+void DesfireNFC::resetAuthentication() {
+    _secureMessaging.reset();
+    _counterResync = false;
+    _authenticated = false;
+    memset(_sessionKey, 0, sizeof(_sessionKey));
+}
+
+/**
+ * @brief Switch to the options of a strategy
+ *
+ * @param strategy Strategy to apply
+ * @param activation True right after activation, when the bit rate may change
+ */
+void DesfireNFC::applyStrategy(const DesfireCardStrategy& strategy, bool activation) {
+    _strategy = strategy;
+    if (!_reader.supportsNativeFrames()) {
+        _strategy.nativeFraming = false;
+    }
+    if (strategy.generation != DF_GEN_UNKNOWN) {
+        _profile = (strategy.generation == DF_GEN_LIGHT) ? DF_PROFILE_LIGHT : DF_PROFILE_GENERIC;
+    }
+    setCardFrameSize(strategy.frameSize);
+
+    // Step down from the highest bit rate until the reader accepts one
+    if (activation) {
+        uint16_t bitRate = strategy.bitRate;
+        while (bitRate > DF_STRATEGY_BITRATE_BASE && !_reader.setBitRate(bitRate)) {
+            bitRate /= 2;
+        }
+    }
+}
+
+/**
+ * @brief Send a frame to the reader and count it in the exchange statistics
+ *
+ * @param txData Frame to transmit
+ * @param txLength Length of the frame
+ * @param rxData Buffer to store the response
+ * @param rxLength Size of rxData in, length of the response out
+ * @param roundTrip Pointer to variable that will store the round trip time (optional)
+ * @return true if a response was received
+ * @return false if the exchange failed
+ */
+bool DesfireNFC::transceiveCounted(const uint8_t* txData,
+                                   uint16_t       txLength,
+                                   uint8_t*       rxData,
+                                   uint16_t*      rxLength,
+                                   uint32_t*      roundTrip) {
+    uint32_t elapsed  = 0;
+    bool     received = _reader.transceiveTimed(txData, txLength, rxData, rxLength, &elapsed);
+
+    _exchangeStats.exchanges++;
+    _exchangeStats.totalTime += elapsed;
+    if (elapsed > _exchangeStats.maxTime) {
+        _exchangeStats.maxTime = elapsed;
+    }
+    if (!received) {
+        _exchangeStats.failures++;
+    }
+
+    if (roundTrip) {
+        *roundTrip = elapsed;
+    }
+    return received;
+}
+
+/**
+ * @brief Get the UID that identifies the card in per-card caches
+ *
+ * @param uidLength Pointer to variable that will store the UID length
+ * @return const uint8_t* Identity UID, nullptr if a random-ID card is not resolved
+ */
+const uint8_t* DesfireNFC::getIdentityUID(uint8_t* uidLength) const {
+    if (!_randomUID) {
+        *uidLength = _uidLength;
+        return _uid;
+    }
+
+    *uidLength = _realUIDLength;
+    return (_realUIDLength > 0) ? _realUID : nullptr;
+}
+
+/**
+ * @brief Get the command data sent per frame
+ *
+ * @return uint8_t Number of command data bytes that fit one frame
+ */
+uint8_t DesfireNFC::getFrameDataSize() {
+    // Native frames only carry the command code in front of the data
+    uint16_t overhead =
+        _strategy.nativeFraming ? DF_FRAME_NATIVE_OVERHEAD : DF_FRAME_APDU_OVERHEAD;
+
+    uint16_t cardLimit   = _cardFrameSize - DF_FRAME_ISODEP_OVERHEAD - overhead;
+    uint16_t readerLimit = _reader.getMaxTransmitLength();
+    readerLimit          = (readerLimit > overhead) ? readerLimit - overhead : 1;
+
+    uint16_t size = (cardLimit < readerLimit) ? cardLimit : readerLimit;
+    return static_cast<uint8_t>(size > ISO7816Constants::ISO_MAX_DATA_SIZE
+                                    ? static_cast<uint16_t>(ISO7816Constants::ISO_MAX_DATA_SIZE)
+                                    : size);
+}
+
+/**
+ * @brief Get the ReadData length of one command
+ *
+ * @param commMode Communication mode of the file
+ * @param command Pointer to variable that will store the read command code
+ * @return uint32_t Number of file bytes read per command
+ */
+uint32_t DesfireNFC::getReadChunkSize(DesfreCommunicationMode commMode, uint8_t* command) {
+    *command = DesfireCommand::DF_CMD_READ_DATA;
+    if (_profile != DF_PROFILE_LIGHT) {
+        return DF_READ_CHUNK_SIZE;
+    }
+
+    // Without additional frames every response must fit one reader exchange
+    int32_t chunkSize = _reader.getMaxReceiveLength() - ISO7816Constants::ISO_STATUS_LENGTH;
+    if (commMode != DF_COMM_PLAIN) {
+        chunkSize -= DF_MACT_SIZE;
+    }
+    if (commMode == DF_COMM_ENCRYPT) {
+        chunkSize = chunkSize / DF_AES_BLOCK_SIZE * DF_AES_BLOCK_SIZE - 1;
+    }
+    if (chunkSize < 1) {
+        chunkSize = 1;
+    }
+    if (chunkSize > DF_READ_CHUNK_SIZE) {
+        chunkSize = DF_READ_CHUNK_SIZE;
+    }
+    *command = DesfireEV2Command::DF_CMD_READ_DATA_ISO;
+    return static_cast<uint32_t>(chunkSize);
+}
+
+/**
+ * @brief Get the WriteData length of one command
+ *
+ * @param commMode Communication mode of the file
+ * @param command Pointer to variable that will store the write command code
+ * @return uint32_t Number of file bytes written per command
+ */
+uint32_t DesfireNFC::getWriteChunkSize(DesfreCommunicationMode commMode, uint8_t* command) {
+    *command = DesfireCommand::DF_CMD_WRITE_DATA;
+    if (_profile != DF_PROFILE_LIGHT) {
+        return DF_WRITE_CHUNK_SIZE;
+    }
+
+    // Without additional frames every command must fit one frame
+    int32_t chunkSize = getFrameDataSize() - DF_WRITE_HEADER_SIZE;
+    if (commMode != DF_COMM_PLAIN) {
+        chunkSize -= DF_MACT_SIZE;
+    }
+    if (commMode == DF_COMM_ENCRYPT) {
+        chunkSize = chunkSize / DF_AES_BLOCK_SIZE * DF_AES_BLOCK_SIZE - 1;
+    }
+    if (chunkSize < 1) {
+        chunkSize = 1;
+    }
+    if (chunkSize > DF_WRITE_CHUNK_SIZE) {
+        chunkSize = DF_WRITE_CHUNK_SIZE;
+    }
+    *command = DesfireEV2Command::DF_CMD_WRITE_DATA_ISO;
+    return static_cast<uint32_t>(chunkSize);
+}
+
 /**
  * @brief Build an ISO7816-4 APDU
  *
@@ -0,0 +1,132 @@
+/**
+ * @file DesfireOriginality.cpp
+ * @brief Implementation of the NXP originality signature check
+ */
+
+#include "DesfireOriginality.h"
+
+// NXP originality public keys (secp224r1, uncompressed)
+static const uint8_t NXP_KEY_DESFIRE_EV2[DF_ECC_PUBLIC_KEY_LENGTH] = {
+    0x04, 0xB3, 0x04, 0xDC, 0x4C, 0x61, 0x5F, 0x53, 0x26, 0xFE, 0x93, 0x83, 0xDD, 0xEC, 0x9A,
+    0xA8, 0x92, 0xDF, 0x3A, 0x57, 0xFA, 0x7F, 0xFB, 0x32, 0x76, 0x19, 0x2B, 0xC0, 0xEA, 0xA2,
+    0x52, 0xED, 0x45, 0xA8, 0x65, 0xE3, 0xB0, 0x93, 0xA3, 0xD0, 0xDC, 0xE5, 0xBE, 0x29, 0xE9,
+    0x2F, 0x13, 0x92, 0xCE, 0x7D, 0xE3, 0x21, 0xE3, 0xE5, 0xC5, 0x2B, 0x3A};
+
+static const uint8_t NXP_KEY_DESFIRE_EV3[DF_ECC_PUBLIC_KEY_LENGTH] = {
+    0x04, 0x1D, 0xB4, 0x6C, 0x14, 0x5D, 0x0A, 0x36, 0x53, 0x9C, 0x65, 0x44, 0xBD, 0x6D, 0x9B,
+    0x0A, 0xA6, 0x2F, 0xF9, 0x1E, 0xC4, 0x8C, 0xBC, 0x6A, 0xBA, 0xE3, 0x6E, 0x00, 0x89, 0xA4,
+    0x6F, 0x0D, 0x08, 0xC8, 0xA7, 0x15, 0xEA, 0x40, 0xA6, 0x33, 0x13, 0xB9, 0x2E, 0x90, 0xDD,
+    0xC1, 0x73, 0x02, 0x30, 0xE0, 0x45, 0x8A, 0x33, 0x27, 0x6F, 0xB7, 0x43};
+
+static const uint8_t NXP_KEY_DESFIRE_LIGHT[DF_ECC_PUBLIC_KEY_LENGTH] = {
+    0x04, 0x0E, 0x98, 0xE1, 0x17, 0xAA, 0xA3, 0x64, 0x57, 0xF4, 0x31, 0x73, 0xDC, 0x92, 0x0A,
+    0x87, 0x57, 0x26, 0x7F, 0x44, 0xCE, 0x4E, 0xC5, 0xAD, 0xD3, 0xC5, 0x40, 0x75, 0x57, 0x1A,
+    0xEB, 0xBF, 0x7B, 0x94, 0x2A, 0x97, 0x74, 0xA1, 0xD9, 0x4A, 0xD0, 0x25, 0x72, 0x42, 0x7E,
+    0x5A, 0xE0, 0xA2, 0xDD, 0x36, 0x59, 0x1B, 0x1F, 0xB3, 0x4F, 0xCF, 0x3D};
+
+static const uint8_t* const NXP_KEYS[] = {
+    NXP_KEY_DESFIRE_EV2, NXP_KEY_DESFIRE_EV3, NXP_KEY_DESFIRE_LIGHT};
+
+/**
+ * @brief Construct a verifier with an empty cache
+ */
+DesfireOriginality::DesfireOriginality() {
+    _precomputed = 0;
+    clear();
+}
+
+/**
+ * @brief Get the NXP public key for a card type
+ *
+ * @param version Version information of the card
+ * @return const uint8_t* Public key (57 bytes), nullptr if the card type has no known key
+ */
+const uint8_t* DesfireOriginality::getPublicKey(const DESFireCardVersion& version) {
+    switch (version.getGeneration()) {
+        case DF_GEN_EV2:
+            return NXP_KEY_DESFIRE_EV2;
+        case DF_GEN_EV3:
+            return NXP_KEY_DESFIRE_EV3;
+        case DF_GEN_LIGHT:
+            return NXP_KEY_DESFIRE_LIGHT;
+        default:
+            break;
+    }
+
+    // DESFire and EV1 have no originality signature
+    return nullptr;
+}
+
+/**
+ * @brief Check whether a UID already passed the originality check
+ *
+ * @param uid Card UID (7 bytes)
+ * @return true if the UID is in the verified cache
+ * @return false otherwise
+ */
+bool DesfireOriginality::isVerified(const uint8_t* uid) const {
+    if (uid == nullptr) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < _count; i++) {
+        if (memcmp(_verified[i], uid, DF_ORIGINALITY_UID_LENGTH) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Verify a Read_Sig signature and remember the UID on success
+ *
+ * @param version Version information of the card (provides type and UID)
+ * @param signature Signature returned by Read_Sig (56 bytes)
+ * @return true if the signature is genuine
+ * @return false if the signature is invalid or the card type is unknown
+ */
+bool DesfireOriginality::verify(const DESFireCardVersion& version, const uint8_t* signature) {
+    const uint8_t* publicKey = getPublicKey(version);
+    if (publicKey == nullptr || signature == nullptr) {
+        return false;
+    }
+
+    if (!DesfireECC::verify(publicKey, version.uid, DF_ORIGINALITY_UID_LENGTH, signature)) {
+        return false;
+    }
+
+    memcpy(_verified[_next], version.uid, DF_ORIGINALITY_UID_LENGTH);
+    _next = (_next + 1) % DF_ORIGINALITY_CACHE_SIZE;
+    if (_count < DF_ORIGINALITY_CACHE_SIZE) {
+        _count++;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Build the next missing comb table for the NXP public keys
+ *
+ * @return true if more tables remain to be built
+ * @return false if all tables are ready
+ */
+bool DesfireOriginality::precomputeNext() {
+    const uint8_t keyCount = sizeof(NXP_KEYS) / sizeof(NXP_KEYS[0]);
+    if (_precomputed >= keyCount) {
+        return false;
+    }
+
+    DesfireECC::precompute(NXP_KEYS[_precomputed]);
+    _precomputed++;
+
+    return _precomputed < keyCount;
+}
+
+/**
+ * @brief Forget all verified UIDs
+ */
+void DesfireOriginality::clear() {
+    memset(_verified, 0, sizeof(_verified));
+    _count = 0;
+    _next  = 0;
+}
@@ -0,0 +1,145 @@
+/**
+ * @file DesfireRandom.cpp
+ * @brief Implementation of the random number source and challenge pool
+ */
+
+#include "DesfireRandom.h"
+
+#include <string.h>
+
+#if defined(ESP_PLATFORM)
+#if __has_include(<esp_random.h>)
+#include <esp_random.h>
+#else
+#include <esp_system.h>
+#endif
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/** Source set by setSource(), nullptr for the platform generator */
+static DesfireRandomSource randomSource = nullptr;
+
+/**
+ * @brief Fill a buffer with random bytes
+ *
+ * @param buffer Buffer to fill
+ * @param length Number of bytes to generate
+ * @return true if the buffer was filled
+ * @return false if the random source is unavailable
+ */
+bool DesfireRandom::fill(uint8_t* buffer, size_t length) {
+    if (buffer == nullptr) {
+        return false;
+    }
+    if (randomSource != nullptr) {
+        return randomSource(buffer, length);
+    }
+
+#if defined(ESP_PLATFORM)
+    esp_fill_random(buffer, length);
+    return true;
+#else
+    // Keep the descriptor open, refills happen repeatedly while idle. The
+    // static initializer runs once even when several threads refill pools.
+    static const int urandom = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (urandom < 0) {
+        return false;
+    }
+
+    size_t offset = 0;
+    while (offset < length) {
+        ssize_t n = read(urandom, buffer + offset, length - offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        offset += static_cast<size_t>(n);
+    }
+    return true;
+#endif
+}
+
+/**
+ * @brief Replace the platform random number generator
+ *
+ * @param source Replacement source, nullptr for the platform generator
+ */
+void DesfireRandom::setSource(DesfireRandomSource source) {
+    randomSource = source;
+}
+
+/**
+ * @brief Construct an empty pool
+ */
+DesfireNoncePool::DesfireNoncePool() : _head(0), _count(0) {
+    memset(_pool, 0, sizeof(_pool));
+}
+
+/**
+ * @brief Destroy the pool, wiping any unused random bytes
+ */
+DesfireNoncePool::~DesfireNoncePool() {
+    volatile uint8_t* p = _pool;
+    for (uint16_t i = 0; i < sizeof(_pool); i++) {
+        p[i] = 0;
+    }
+}
+
+/**
+ * @brief Top up the pool from the random source
+ *
+ * @return uint16_t Number of bytes added to the pool
+ */
+uint16_t DesfireNoncePool::refill() {
+    uint16_t added = 0;
+
+    // The free space may wrap around the end of the ring buffer
+    while (_count < DF_NONCE_POOL_SIZE) {
+        uint16_t tail  = (_head + _count) % DF_NONCE_POOL_SIZE;
+        uint16_t chunk = DF_NONCE_POOL_SIZE - _count;
+        if (tail + chunk > DF_NONCE_POOL_SIZE) {
+            chunk = DF_NONCE_POOL_SIZE - tail;
+        }
+
+        if (!DesfireRandom::fill(&_pool[tail], chunk)) {
+            break;
+        }
+        _count += chunk;
+        added += chunk;
+    }
+
+    return added;
+}
+
+/**
+ * @brief Take a challenge from the pool
+ *
+ * @param nonce Buffer to store the challenge
+ * @param length Length of the challenge (at most DF_NONCE_MAX_LENGTH)
+ * @return true if the challenge was generated
+ * @return false if the length is invalid or no random bytes are available
+ */
+bool DesfireNoncePool::take(uint8_t* nonce, uint8_t length) {
+    if (nonce == nullptr || length == 0 || length > DF_NONCE_MAX_LENGTH) {
+        return false;
+    }
+
+    // Slow path: pool exhausted, generate the challenge directly
+    if (_count < length) {
+        return DesfireRandom::fill(nonce, length);
+    }
+
+    for (uint8_t i = 0; i < length; i++) {
+        nonce[i]     = _pool[_head];
+        _pool[_head] = 0;
+        _head        = (_head + 1) % DF_NONCE_POOL_SIZE;
+    }
+    _count -= length;
+
+    return true;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file DesfireReadPlan.cpp
+ * @brief Implementation of the coalescing of file range reads
+ */
+
+#include "DesfireReadPlan.h"
+
+/**
+ * @brief Check whether a request sorts before another
+ *
+ * @return true if a is read before b
+ */
+static bool readsBefore(const DesfireReadRequest& a, const DesfireReadRequest& b) {
+    if (a.fileNo != b.fileNo) {
+        return a.fileNo < b.fileNo;
+    }
+    if (a.commMode != b.commMode) {
+        return a.commMode < b.commMode;
+    }
+    if (a.offset != b.offset) {
+        return a.offset < b.offset;
+    }
+
+    // The longer range first, so that the ranges it contains join its span
+    return a.length > b.length;
+}
+
+/**
+ * @brief Merge requested ranges into spans
+ *
+ * @param requests Requested ranges
+ * @param count Number of requests (at most DF_READ_PLAN_MAX_REQUESTS)
+ * @param maxSpan Largest span read with one command
+ * @param maxGap Largest gap between two ranges that is read through
+ * @param spans Array of at least count spans to store the plan
+ * @return uint8_t Number of spans, 0 if the requests are not valid
+ */
+uint8_t DesfireReadPlanner::plan(const DesfireReadRequest* requests,
+                                 uint8_t                   count,
+                                 uint32_t                  maxSpan,
+                                 uint32_t                  maxGap,
+                                 DesfireReadSpan*          spans) {
+    if (requests == nullptr || spans == nullptr || count > DF_READ_PLAN_MAX_REQUESTS ||
+        maxSpan == 0) {
+        return 0;
+    }
+
+    // Sort by file and offset, the list is short enough for an insertion sort
+    uint8_t order[DF_READ_PLAN_MAX_REQUESTS];
+    for (uint8_t i = 0; i < count; i++) {
+        if (requests[i].length == 0) {
+            return 0;
+        }
+
+        uint8_t j = i;
+        while (j > 0 && readsBefore(requests[i], requests[order[j - 1]])) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    uint8_t spanCount = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        const DesfireReadRequest& request = requests[order[i]];
+        uint32_t                  end     = request.offset + request.length;
+
+        if (spanCount > 0) {
+            DesfireReadSpan& last    = spans[spanCount - 1];
+            uint32_t         lastEnd = last.offset + last.length;
+
+            if (last.fileNo == request.fileNo && last.commMode == request.commMode) {
+                if (end <= lastEnd) {
+                    continue;
+                }
+                if (request.offset <= lastEnd + maxGap && end - last.offset <= maxSpan) {
+                    last.length = end - last.offset;
+                    continue;
+                }
+            }
+        }
+
+        DesfireReadSpan& span = spans[spanCount++];
+        span.fileNo           = request.fileNo;
+        span.offset           = request.offset;
+        span.length           = request.length;
+        span.commMode         = request.commMode;
+    }
+
+    return spanCount;
+}
+
+/**
+ * @brief Check whether a span covers a requested range
+ *
+ * @param span Planned span
+ * @param request Requested range
+ * @return true if the range lies within the span
+ * @return false otherwise
+ */
+bool DesfireReadPlanner::covers(const DesfireReadSpan& span, const DesfireReadRequest& request) {
+    return span.fileNo == request.fileNo && span.commMode == request.commMode &&
+           request.offset >= span.offset &&
+           request.offset + request.length <= span.offset + span.length;
+}
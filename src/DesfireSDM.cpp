@@ -0,0 +1,253 @@
+/**
+ * @file DesfireSDM.cpp
+ * @brief Implementation of Secure Dynamic Messaging (SUN) verification
+ */
+
+#include "DesfireSDM.h"
+
+#include <string.h>
+
+// Session vector labels
+#define SDM_LABEL_ENC 0xC33C
+#define SDM_LABEL_MAC 0x3CC3
+
+/**
+ * @brief Construct a verifier without keys
+ */
+DesfireSDM::DesfireSDM() {
+}
+
+/**
+ * @brief Construct a verifier and set its keys
+ *
+ * @param metaReadKey SDM meta read key (16 bytes)
+ * @param fileReadKey SDM file read key (16 bytes)
+ */
+DesfireSDM::DesfireSDM(const uint8_t* metaReadKey, const uint8_t* fileReadKey) {
+    setKeys(metaReadKey, fileReadKey);
+}
+
+/**
+ * @brief Set the SDM keys
+ *
+ * @param metaReadKey SDM meta read key (16 bytes)
+ * @param fileReadKey SDM file read key (16 bytes)
+ */
+void DesfireSDM::setKeys(const uint8_t* metaReadKey, const uint8_t* fileReadKey) {
+    _metaReadKey.setKey(metaReadKey);
+    _fileReadKey.setKey(fileReadKey);
+}
+
+/**
+ * @brief Decrypt the mirrored PICC data
+ *
+ * @param encrypted Encrypted PICC data (16 bytes)
+ * @param sun Structure to store the UID and read counter
+ * @return true if the PICC data tag is valid
+ * @return false otherwise
+ */
+bool DesfireSDM::decryptPICCData(const uint8_t* encrypted, DesfireSUN* sun) const {
+    if (encrypted == nullptr || sun == nullptr) {
+        return false;
+    }
+
+    // A single block, CBC with a zero IV reduces to ECB
+    uint8_t plain[DF_SDM_PICC_DATA_SIZE];
+    _metaReadKey.decryptBlock(encrypted, plain);
+
+    // PICCDataTag || UID || SDMReadCtr (LSB first) || random padding
+    uint8_t tag       = plain[0];
+    uint8_t uidLength = (tag & DF_SDM_TAG_UID) ? (tag & DF_SDM_TAG_UID_LENGTH) : 0;
+    if ((tag & DF_SDM_TAG_UID) && uidLength != DF_SDM_UID_SIZE) {
+        memset(plain, 0, sizeof(plain));
+        return false;
+    }
+
+    memset(sun, 0, sizeof(DesfireSUN));
+    memcpy(sun->uid, &plain[1], uidLength);
+    sun->uidLength  = uidLength;
+    sun->hasCounter = (tag & DF_SDM_TAG_COUNTER) != 0;
+    if (sun->hasCounter) {
+        const uint8_t* counter = &plain[1 + uidLength];
+        sun->counter           = counter[0] | (counter[1] << 8) | (counter[2] << 16);
+    }
+
+    memset(plain, 0, sizeof(plain));
+    return true;
+}
+
+/**
+ * @brief Derive a session key from the file read key
+ *
+ * @param label Session vector label (0xC33C for encryption, 0x3CC3 for MAC)
+ * @param sun UID and read counter of the read
+ * @param sessionKey Cipher to set the session key on
+ */
+void DesfireSDM::deriveSessionKey(uint16_t          label,
+                                  const DesfireSUN& sun,
+                                  DesfireAES*       sessionKey) const {
+    // SV = label || 00 01 00 80 || UID || SDMReadCtr, zero padded to a block
+    uint8_t sv[2 * DF_AES_BLOCK_SIZE];
+    uint8_t length = 0;
+
+    memset(sv, 0, sizeof(sv));
+    sv[length++] = label >> 8;
+    sv[length++] = label & 0xFF;
+    sv[length++] = 0x00;
+    sv[length++] = 0x01;
+    sv[length++] = 0x00;
+    sv[length++] = 0x80;
+    memcpy(&sv[length], sun.uid, sun.uidLength);
+    length += sun.uidLength;
+    if (sun.hasCounter) {
+        sv[length++] = sun.counter & 0xFF;
+        sv[length++] = (sun.counter >> 8) & 0xFF;
+        sv[length++] = (sun.counter >> 16) & 0xFF;
+    }
+    length = (length + DF_AES_BLOCK_SIZE - 1) / DF_AES_BLOCK_SIZE * DF_AES_BLOCK_SIZE;
+
+    uint8_t key[DF_AES_KEY_SIZE];
+    DesfireCMAC::compute(_fileReadKey, sv, length, key);
+    sessionKey->setKey(key);
+
+    memset(key, 0, sizeof(key));
+    memset(sv, 0, sizeof(sv));
+}
+
+/**
+ * @brief Check the SDM MAC of a read
+ *
+ * @param sun UID and read counter of the read
+ * @param macInput Mirrored data from SDMMACInputOffset up to the MAC (may be empty)
+ * @param macInputLength Length of the MAC input
+ * @param mac Mirrored MAC (8 bytes)
+ * @return true if the MAC is valid
+ * @return false otherwise
+ */
+bool DesfireSDM::verifyMAC(const DesfireSUN& sun,
+                           const uint8_t*    macInput,
+                           size_t            macInputLength,
+                           const uint8_t*    mac) const {
+    if (mac == nullptr || (macInput == nullptr && macInputLength > 0)) {
+        return false;
+    }
+
+    DesfireAES macKey;
+    deriveSessionKey(SDM_LABEL_MAC, sun, &macKey);
+
+    uint8_t full[DF_CMAC_SIZE];
+    uint8_t expected[DF_MACT_SIZE];
+    DesfireCMAC::compute(macKey, macInput, macInputLength, full);
+    DesfireCMAC::truncate(full, expected);
+
+    // Compare without an early exit
+    uint8_t diff = 0;
+    for (uint8_t i = 0; i < DF_MACT_SIZE; i++) {
+        diff |= expected[i] ^ mac[i];
+    }
+    return diff == 0;
+}
+
+/**
+ * @brief Derive the MAC session key of a read
+ *
+ * @param sun UID and read counter of the read
+ * @param sessionKey Cipher to set KSesSDMFileReadMAC on
+ */
+void DesfireSDM::deriveMACKey(const DesfireSUN& sun, DesfireAES* sessionKey) const {
+    if (sessionKey != nullptr) {
+        deriveSessionKey(SDM_LABEL_MAC, sun, sessionKey);
+    }
+}
+
+/**
+ * @brief Decrypt mirrored encrypted file data
+ *
+ * @param sun UID and read counter of the read
+ * @param encrypted Encrypted file data (multiple of 16 bytes)
+ * @param plain Buffer to store the plain file data (may equal encrypted)
+ * @param length Length of the data
+ * @return true if the data was decrypted
+ * @return false if the length is not a multiple of the block size
+ */
+bool DesfireSDM::decryptFileData(const DesfireSUN& sun,
+                                 const uint8_t*    encrypted,
+                                 uint8_t*          plain,
+                                 size_t            length) const {
+    if (encrypted == nullptr || plain == nullptr || length % DF_AES_BLOCK_SIZE) {
+        return false;
+    }
+
+    DesfireAES encKey;
+    deriveSessionKey(SDM_LABEL_ENC, sun, &encKey);
+
+    // IV = E(KSesSDMFileReadENC, SDMReadCtr || zero padding)
+    uint8_t iv[DF_AES_BLOCK_SIZE];
+    memset(iv, 0, sizeof(iv));
+    iv[0] = sun.counter & 0xFF;
+    iv[1] = (sun.counter >> 8) & 0xFF;
+    iv[2] = (sun.counter >> 16) & 0xFF;
+    encKey.encryptBlock(iv, iv);
+
+    return encKey.decryptCBC(iv, encrypted, plain, length);
+}
+
+/**
+ * @brief Decrypt the PICC data and check the MAC in one step
+ *
+ * @param encryptedPICCData Encrypted PICC data (16 bytes)
+ * @param macInput Mirrored data from SDMMACInputOffset up to the MAC (may be empty)
+ * @param macInputLength Length of the MAC input
+ * @param mac Mirrored MAC (8 bytes)
+ * @param sun Structure to store the UID and read counter
+ * @return true if the message is authentic
+ * @return false otherwise
+ */
+bool DesfireSDM::verify(const uint8_t* encryptedPICCData,
+                        const uint8_t* macInput,
+                        size_t         macInputLength,
+                        const uint8_t* mac,
+                        DesfireSUN*    sun) const {
+    if (!decryptPICCData(encryptedPICCData, sun)) {
+        return false;
+    }
+
+    return verifyMAC(*sun, macInput, macInputLength, mac);
+}
+
+/**
+ * @brief Convert a hex string of the NDEF mirror to bytes
+ *
+ * @param text Hex characters (upper or lower case)
+ * @param textLength Number of characters (even)
+ * @param data Buffer to store the bytes
+ * @param dataSize Size of the buffer
+ * @return size_t Number of bytes stored, 0 if the text is not valid hex or too long
+ */
+size_t DesfireSDM::parseHex(const char* text, size_t textLength, uint8_t* data, size_t dataSize) {
+    if (text == nullptr || data == nullptr || textLength % 2 || textLength / 2 > dataSize) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < textLength; i++) {
+        char    c = text[i];
+        uint8_t nibble;
+        if (c >= '0' && c <= '9') {
+            nibble = c - '0';
+        } else if (c >= 'A' && c <= 'F') {
+            nibble = c - 'A' + 10;
+        } else if (c >= 'a' && c <= 'f') {
+            nibble = c - 'a' + 10;
+        } else {
+            return 0;
+        }
+
+        if (i % 2 == 0) {
+            data[i / 2] = nibble << 4;
+        } else {
+            data[i / 2] |= nibble;
+        }
+    }
+
+    return textLength / 2;
+}
@@ -0,0 +1,463 @@
+/**
+ * @file DesfireSecureMessaging.cpp
+ * @brief Implementation of EV2 secure messaging
+ */
+
+#include "DesfireSecureMessaging.h"
+
+#include <string.h>
+
+// Session vector and IV labels
+#define SM_LABEL_ENC 0xA55A
+#define SM_LABEL_MAC 0x5AA5
+
+/**
+ * @brief Compute the truncated MAC of Code || Counter || TI || Data
+ */
+static void computeSessionMAC(const DesfireAES& macKey,
+                              uint8_t           code,
+                              uint16_t          counter,
+                              const uint8_t*    ti,
+                              const uint8_t*    data,
+                              uint16_t          length,
+                              uint8_t*          mact) {
+    uint8_t prefix[1 + 2 + DF_EV2_TI_LENGTH];
+    prefix[0] = code;
+    prefix[1] = counter & 0xFF;
+    prefix[2] = counter >> 8;
+    memcpy(&prefix[3], ti, DF_EV2_TI_LENGTH);
+
+    uint8_t     mac[DF_CMAC_SIZE];
+    DesfireCMAC cmac(macKey);
+    cmac.update(prefix, sizeof(prefix));
+    cmac.update(data, length);
+    cmac.finish(mac);
+    DesfireCMAC::truncate(mac, mact);
+}
+
+/**
+ * @brief Construct an inactive session
+ */
+DesfireSecureMessaging::DesfireSecureMessaging() {
+    memset(_ti, 0, sizeof(_ti));
+    _cmdCtr = 0;
+    _active = false;
+}
+
+/**
+ * @brief Derive the session encryption and MAC keys
+ *
+ * @param key Authentication key (16 bytes)
+ * @param rndA Reader challenge (16 bytes)
+ * @param rndB Card challenge (16 bytes)
+ */
+void DesfireSecureMessaging::deriveKeys(const uint8_t* key,
+                                        const uint8_t* rndA,
+                                        const uint8_t* rndB) {
+    // SV = label || 00 01 00 80 || RndA[15..14] || (RndA[13..8] ^ RndB[15..10]) ||
+    //      RndB[9..0] || RndA[7..0]
+    uint8_t sv[32];
+    sv[0] = SM_LABEL_ENC >> 8;
+    sv[1] = SM_LABEL_ENC & 0xFF;
+    sv[2] = 0x00;
+    sv[3] = 0x01;
+    sv[4] = 0x00;
+    sv[5] = 0x80;
+    sv[6] = rndA[0];
+    sv[7] = rndA[1];
+    for (uint8_t i = 0; i < 6; i++) {
+        sv[8 + i] = rndA[2 + i] ^ rndB[i];
+    }
+    memcpy(&sv[14], &rndB[6], 10);
+    memcpy(&sv[24], &rndA[8], 8);
+
+    DesfireAES authKey(key);
+    uint8_t    sessionKey[DF_AES_KEY_SIZE];
+
+    DesfireCMAC::compute(authKey, sv, sizeof(sv), sessionKey);
+    _encKey.setKey(sessionKey);
+
+    sv[0] = SM_LABEL_MAC >> 8;
+    sv[1] = SM_LABEL_MAC & 0xFF;
+    DesfireCMAC::compute(authKey, sv, sizeof(sv), sessionKey);
+    _macKey.setKey(sessionKey);
+
+    memset(sessionKey, 0, sizeof(sessionKey));
+    memset(sv, 0, sizeof(sv));
+}
+
+/**
+ * @brief Start a session after a successful AuthenticateEV2First
+ *
+ * @param key Authentication key (16 bytes)
+ * @param rndA Reader challenge (16 bytes)
+ * @param rndB Card challenge (16 bytes)
+ * @param ti Transaction identifier returned by the card (4 bytes)
+ */
+void DesfireSecureMessaging::begin(const uint8_t* key,
+                                   const uint8_t* rndA,
+                                   const uint8_t* rndB,
+                                   const uint8_t* ti) {
+    deriveKeys(key, rndA, rndB);
+
+    memcpy(_ti, ti, DF_EV2_TI_LENGTH);
+    _cmdCtr = 0;
+    _active = true;
+}
+
+/**
+ * @brief Continue the session after a successful AuthenticateEV2NonFirst
+ *
+ * @param key Authentication key (16 bytes)
+ * @param rndA Reader challenge (16 bytes)
+ * @param rndB Card challenge (16 bytes)
+ */
+void DesfireSecureMessaging::renew(const uint8_t* key, const uint8_t* rndA, const uint8_t* rndB) {
+    deriveKeys(key, rndA, rndB);
+}
+
+/**
+ * @brief End the session and wipe the session keys
+ */
+void DesfireSecureMessaging::reset() {
+    _encKey.clear();
+    _macKey.clear();
+    memset(_ti, 0, sizeof(_ti));
+    _cmdCtr = 0;
+    _active = false;
+}
+
+/**
+ * @brief Check whether a session is active
+ *
+ * @return true if a session is active
+ * @return false otherwise
+ */
+bool DesfireSecureMessaging::isActive() const {
+    return _active;
+}
+
+/**
+ * @brief Get the current command counter
+ *
+ * @return uint16_t Command counter
+ */
+uint16_t DesfireSecureMessaging::getCommandCounter() const {
+    return _cmdCtr;
+}
+
+/**
+ * @brief Set the command counter
+ *
+ * @param counter New command counter
+ */
+void DesfireSecureMessaging::setCommandCounter(uint16_t counter) {
+    _cmdCtr = counter;
+}
+
+/**
+ * @brief Check whether the command counter has reached its limit
+ *
+ * @return true if no further command can be protected
+ * @return false otherwise
+ */
+bool DesfireSecureMessaging::isCommandCounterExhausted() const {
+    return _cmdCtr == 0xFFFF;
+}
+
+/**
+ * @brief Get the transaction identifier of the session
+ *
+ * @return const uint8_t* Transaction identifier (4 bytes)
+ */
+const uint8_t* DesfireSecureMessaging::getTransactionIdentifier() const {
+    return _ti;
+}
+
+/**
+ * @brief Compute the IV for command or response encryption
+ *
+ * @param label Label (0xA55A for commands, 0x5AA5 for responses)
+ * @param counter Command counter to use
+ * @param iv Buffer to store the IV (16 bytes)
+ */
+void DesfireSecureMessaging::computeIV(uint16_t label, uint16_t counter, uint8_t* iv) const {
+    memset(iv, 0, DF_AES_BLOCK_SIZE);
+    iv[0] = label >> 8;
+    iv[1] = label & 0xFF;
+    memcpy(&iv[2], _ti, DF_EV2_TI_LENGTH);
+    iv[6] = counter & 0xFF;
+    iv[7] = counter >> 8;
+    _encKey.encryptBlock(iv, iv);
+}
+
+/**
+ * @brief Compute a truncated MAC with the session MAC key
+ *
+ * @param data MAC input
+ * @param length Length of the MAC input
+ * @param mac Buffer to store the MAC (8 bytes)
+ * @return true if the MAC was computed
+ * @return false if no session is active
+ */
+bool DesfireSecureMessaging::computeMAC(const uint8_t* data, size_t length, uint8_t* mac) const {
+    if (!_active) {
+        return false;
+    }
+
+    uint8_t full[DF_CMAC_SIZE];
+    DesfireCMAC::compute(_macKey, data, length, full);
+    DesfireCMAC::truncate(full, mac);
+    memset(full, 0, sizeof(full));
+
+    return true;
+}
+
+/**
+ * @brief Protect a command
+ *
+ * @param command Command code
+ * @param header Command header (sent in plain in every mode)
+ * @param headerLength Length of the command header
+ * @param data Command data
+ * @param dataLength Length of the command data
+ * @param mode Communication mode
+ * @param output Buffer to store the protected command
+ * @param outputSize Size of the output buffer
+ * @return uint16_t Length of the protected command, 0 if the buffer is too small
+ */
+uint16_t DesfireSecureMessaging::wrapCommand(uint8_t                 command,
+                                             const uint8_t*          header,
+                                             uint8_t                 headerLength,
+                                             const uint8_t*          data,
+                                             uint16_t                dataLength,
+                                             DesfreCommunicationMode mode,
+                                             uint8_t*                output,
+                                             uint16_t                outputSize) const {
+    uint16_t payloadLength = dataLength;
+    if (_active && mode == DF_COMM_ENCRYPT && dataLength > 0) {
+        // ISO/IEC 9797-1 padding method 2 always adds at least one byte
+        payloadLength = (dataLength / DF_AES_BLOCK_SIZE + 1) * DF_AES_BLOCK_SIZE;
+    }
+
+    uint16_t macLength = (_active && mode != DF_COMM_PLAIN) ? DF_MACT_SIZE : 0;
+    if (static_cast<uint32_t>(headerLength) + payloadLength + macLength > outputSize) {
+        return 0;
+    }
+
+    uint16_t length = 0;
+    if (headerLength > 0) {
+        memcpy(output, header, headerLength);
+        length = headerLength;
+    }
+
+    if (dataLength > 0) {
+        memcpy(&output[length], data, dataLength);
+    }
+
+    if (payloadLength != dataLength) {
+        output[length + dataLength] = 0x80;
+        memset(&output[length + dataLength + 1], 0, payloadLength - dataLength - 1);
+
+        uint8_t iv[DF_AES_BLOCK_SIZE];
+        computeIV(SM_LABEL_ENC, _cmdCtr, iv);
+        _encKey.encryptCBC(iv, &output[length], &output[length], payloadLength);
+    }
+    length += payloadLength;
+
+    if (macLength > 0) {
+        // MAC over Cmd || CmdCtr || TI || CmdHeader || CmdData
+        computeSessionMAC(_macKey, command, _cmdCtr, _ti, output, length, &output[length]);
+        length += DF_MACT_SIZE;
+    }
+
+    return length;
+}
+
+/**
+ * @brief Verify and decrypt a response in place
+ *
+ * @param returnCode Return code of the response (0x00 for success)
+ * @param data Response data, replaced by the plain response data
+ * @param dataLength Length of the response data, updated
+ * @param mode Communication mode
+ * @return true if the response is authentic
+ * @return false if the MAC or padding does not verify
+ */
+bool DesfireSecureMessaging::unwrapResponse(uint8_t                 returnCode,
+                                            uint8_t*                data,
+                                            uint16_t*               dataLength,
+                                            DesfreCommunicationMode mode) {
+    if (!_active) {
+        return true;
+    }
+
+    uint16_t responseCounter = _cmdCtr + 1;
+
+    if (mode != DF_COMM_PLAIN) {
+        if (*dataLength < DF_MACT_SIZE) {
+            return false;
+        }
+        uint16_t length = *dataLength - DF_MACT_SIZE;
+
+        // MAC over RC || CmdCtr + 1 || TI || RespData
+        uint8_t expected[DF_MACT_SIZE];
+        computeSessionMAC(_macKey, returnCode, responseCounter, _ti, data, length, expected);
+
+        // Compare without an early exit
+        uint8_t diff = 0;
+        for (uint8_t i = 0; i < DF_MACT_SIZE; i++) {
+            diff |= expected[i] ^ data[length + i];
+        }
+        if (diff != 0) {
+            return false;
+        }
+
+        if (mode == DF_COMM_ENCRYPT && length > 0) {
+            if (length % DF_AES_BLOCK_SIZE) {
+                return false;
+            }
+
+            uint8_t iv[DF_AES_BLOCK_SIZE];
+            computeIV(SM_LABEL_MAC, responseCounter, iv);
+            _encKey.decryptCBC(iv, data, data, length);
+
+            // Strip ISO/IEC 9797-1 padding method 2 (contained in the last block)
+            uint16_t lastBlock = length - DF_AES_BLOCK_SIZE;
+            while (length > lastBlock + 1 && data[length - 1] == 0x00) {
+                length--;
+            }
+            if (data[length - 1] != 0x80) {
+                return false;
+            }
+            length--;
+        }
+
+        *dataLength = length;
+    }
+
+    _cmdCtr = responseCounter;
+    return true;
+}
+
+/**
+ * @brief Verify and decrypt a protected command in place (card side)
+ *
+ * @param command Command code
+ * @param data Protected command (header || data || MACt), replaced by header || data
+ * @param dataLength Length of the protected command, updated
+ * @param headerLength Length of the command header
+ * @param mode Communication mode
+ * @return true if the command is authentic
+ * @return false if the MAC or padding does not verify
+ */
+bool DesfireSecureMessaging::unwrapCommand(uint8_t                 command,
+                                           uint8_t*                data,
+                                           uint16_t*               dataLength,
+                                           uint8_t                 headerLength,
+                                           DesfreCommunicationMode mode) const {
+    if (!_active || mode == DF_COMM_PLAIN) {
+        return true;
+    }
+    if (*dataLength < headerLength + DF_MACT_SIZE) {
+        return false;
+    }
+    uint16_t length = *dataLength - DF_MACT_SIZE;
+
+    // MAC over Cmd || CmdCtr || TI || CmdHeader || CmdData
+    uint8_t expected[DF_MACT_SIZE];
+    computeSessionMAC(_macKey, command, _cmdCtr, _ti, data, length, expected);
+
+    uint8_t diff = 0;
+    for (uint8_t i = 0; i < DF_MACT_SIZE; i++) {
+        diff |= expected[i] ^ data[length + i];
+    }
+    if (diff != 0) {
+        return false;
+    }
+
+    uint16_t payloadLength = length - headerLength;
+    if (mode == DF_COMM_ENCRYPT && payloadLength > 0) {
+        if (payloadLength % DF_AES_BLOCK_SIZE) {
+            return false;
+        }
+
+        uint8_t* payload = &data[headerLength];
+        uint8_t  iv[DF_AES_BLOCK_SIZE];
+        computeIV(SM_LABEL_ENC, _cmdCtr, iv);
+        _encKey.decryptCBC(iv, payload, payload, payloadLength);
+
+        // Strip ISO/IEC 9797-1 padding method 2 (contained in the last block)
+        uint16_t lastBlock = payloadLength - DF_AES_BLOCK_SIZE;
+        while (payloadLength > lastBlock + 1 && payload[payloadLength - 1] == 0x00) {
+            payloadLength--;
+        }
+        if (payload[payloadLength - 1] != 0x80) {
+            return false;
+        }
+        payloadLength--;
+    }
+
+    *dataLength = headerLength + payloadLength;
+    return true;
+}
+
+/**
+ * @brief Protect a response (card side)
+ *
+ * @param returnCode Return code of the response (0x00 for success)
+ * @param data Response data
+ * @param dataLength Length of the response data
+ * @param mode Communication mode
+ * @param output Buffer to store the protected response
+ * @param outputSize Size of the output buffer
+ * @return uint16_t Length of the protected response, 0 if the buffer is too small
+ */
+uint16_t DesfireSecureMessaging::wrapResponse(uint8_t                 returnCode,
+                                              const uint8_t*          data,
+                                              uint16_t                dataLength,
+                                              DesfreCommunicationMode mode,
+                                              uint8_t*                output,
+                                              uint16_t                outputSize) {
+    bool     protect       = _active && mode != DF_COMM_PLAIN;
+    uint16_t payloadLength = dataLength;
+    if (protect && mode == DF_COMM_ENCRYPT && dataLength > 0) {
+        payloadLength = (dataLength / DF_AES_BLOCK_SIZE + 1) * DF_AES_BLOCK_SIZE;
+    }
+
+    uint16_t macLength = protect ? DF_MACT_SIZE : 0;
+    if (static_cast<uint32_t>(payloadLength) + macLength > outputSize) {
+        return 0;
+    }
+
+    if (dataLength > 0) {
+        memmove(output, data, dataLength);
+    }
+    if (!_active) {
+        return dataLength;
+    }
+
+    uint16_t responseCounter = _cmdCtr + 1;
+    if (payloadLength != dataLength) {
+        output[dataLength] = 0x80;
+        memset(&output[dataLength + 1], 0, payloadLength - dataLength - 1);
+
+        uint8_t iv[DF_AES_BLOCK_SIZE];
+        computeIV(SM_LABEL_MAC, responseCounter, iv);
+        _encKey.encryptCBC(iv, output, output, payloadLength);
+    }
+
+    // MAC over RC || CmdCtr + 1 || TI || RespData
+    if (macLength > 0) {
+        computeSessionMAC(_macKey,
+                          returnCode,
+                          responseCounter,
+                          _ti,
+                          output,
+                          payloadLength,
+                          &output[payloadLength]);
+    }
+
+    _cmdCtr = responseCounter;
+    return payloadLength + macLength;
+}
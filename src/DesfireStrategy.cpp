@@ -0,0 +1,183 @@
+/**
+ * @file DesfireStrategy.cpp
+ * @brief Implementation of the strategy selection and per-UID strategy cache
+ */
+
+#include "DesfireStrategy.h"
+
+#include <string.h>
+
+/**
+ * @brief Construct an empty cache
+ */
+DesfireStrategyCache::DesfireStrategyCache() {
+    clear();
+}
+
+/**
+ * @brief Get the strategy used for cards of unknown generation
+ *
+ * @return DesfireCardStrategy Strategy for unknown cards
+ */
+DesfireCardStrategy DesfireStrategyCache::getDefault() {
+    DesfireCardStrategy strategy;
+    strategy.generation    = DF_GEN_UNKNOWN;
+    strategy.authMethod    = DF_AUTH_METHOD_LEGACY;
+    strategy.nativeFraming = false;
+    strategy.frameSize     = DF_STRATEGY_FRAME_SIZE;
+    strategy.bitRate       = DF_STRATEGY_BITRATE_BASE;
+    return strategy;
+}
+
+/**
+ * @brief Get the frame size announced by an ATS
+ *
+ * @param fsci FSCI, the lower nibble of the ATS format byte T0
+ * @return uint16_t Frame size (FSC) in bytes, RFU values map to 256
+ */
+uint16_t DesfireStrategyCache::getFrameSize(uint8_t fsci) {
+    static const uint16_t FSC_TABLE[] = {16, 24, 32, 40, 48, 64, 96, 128, 256};
+    return FSC_TABLE[fsci < 8 ? fsci : 8];
+}
+
+/**
+ * @brief Select the strategy for a card generation
+ *
+ * @param version Version information returned by GetVersion
+ * @return DesfireCardStrategy Fastest options supported by the card
+ */
+DesfireCardStrategy DesfireStrategyCache::select(const DESFireCardVersion& version) {
+    DesfireCardStrategy strategy = getDefault();
+    strategy.generation          = version.getGeneration();
+
+    switch (strategy.generation) {
+        case DF_GEN_D40:
+            strategy.nativeFraming = true;
+            break;
+
+        case DF_GEN_EV1:
+            strategy.authMethod    = DF_AUTH_METHOD_AES;
+            strategy.nativeFraming = true;
+            break;
+
+        case DF_GEN_EV2:
+        case DF_GEN_EV3:
+            strategy.authMethod    = DF_AUTH_METHOD_EV2;
+            strategy.nativeFraming = true;
+            break;
+
+        case DF_GEN_LIGHT:
+            // The Light only accepts ISO wrapped commands
+            strategy.authMethod = DF_AUTH_METHOD_EV2;
+            break;
+
+        default:
+            return strategy;
+    }
+
+    // All generations run 106 to 848 kbit/s, the reader limits what is used
+    strategy.bitRate = DF_STRATEGY_BITRATE_MAX;
+    return strategy;
+}
+
+/**
+ * @brief Find the entry of a card
+ *
+ * @return Entry* Matching entry, nullptr if none
+ */
+DesfireStrategyCache::Entry* DesfireStrategyCache::find(const uint8_t* uid, uint8_t uidLength) {
+    for (uint8_t i = 0; i < DF_STRATEGY_CACHE_ENTRIES; i++) {
+        Entry& entry = _entries[i];
+        if (entry.uidLength == uidLength && memcmp(entry.uid, uid, uidLength) == 0) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Look up the strategy of a card
+ *
+ * @param uid Card UID
+ * @param uidLength Length of the UID
+ * @param strategy Structure to store the cached strategy
+ * @return true if the card is cached
+ * @return false otherwise
+ */
+bool DesfireStrategyCache::lookup(const uint8_t*       uid,
+                                  uint8_t              uidLength,
+                                  DesfireCardStrategy* strategy) {
+    if (uid == nullptr || strategy == nullptr || uidLength == 0 ||
+        uidLength > DF_STRATEGY_UID_SIZE) {
+        return false;
+    }
+
+    Entry* entry = find(uid, uidLength);
+    if (entry == nullptr) {
+        return false;
+    }
+
+    entry->lastUse = ++_useCounter;
+    *strategy      = entry->strategy;
+    return true;
+}
+
+/**
+ * @brief Store the strategy of a card, replacing the least recently used entry
+ *
+ * @param uid Card UID
+ * @param uidLength Length of the UID
+ * @param strategy Strategy of the card
+ * @return true if the strategy was stored
+ * @return false if the UID is not valid
+ */
+bool DesfireStrategyCache::store(const uint8_t*             uid,
+                                 uint8_t                    uidLength,
+                                 const DesfireCardStrategy& strategy) {
+    if (uid == nullptr || uidLength == 0 || uidLength > DF_STRATEGY_UID_SIZE) {
+        return false;
+    }
+
+    Entry* entry = find(uid, uidLength);
+    if (entry == nullptr) {
+        // Free entries have a zero use stamp and are picked first
+        entry = &_entries[0];
+        for (uint8_t i = 1; i < DF_STRATEGY_CACHE_ENTRIES; i++) {
+            if (_entries[i].lastUse < entry->lastUse) {
+                entry = &_entries[i];
+            }
+        }
+    }
+
+    memcpy(entry->uid, uid, uidLength);
+    entry->uidLength = uidLength;
+    entry->lastUse   = ++_useCounter;
+    entry->strategy  = strategy;
+
+    return true;
+}
+
+/**
+ * @brief Drop the strategy of a card
+ *
+ * @param uid Card UID
+ * @param uidLength Length of the UID
+ */
+void DesfireStrategyCache::invalidate(const uint8_t* uid, uint8_t uidLength) {
+    if (uid == nullptr) {
+        return;
+    }
+
+    Entry* entry = find(uid, uidLength);
+    if (entry != nullptr) {
+        memset(entry, 0, sizeof(Entry));
+    }
+}
+
+/**
+ * @brief Drop all entries
+ */
+void DesfireStrategyCache::clear() {
+    memset(_entries, 0, sizeof(_entries));
+    _useCounter = 0;
+}
@@ -0,0 +1,618 @@
+/**
+ * @file DesfireVerify.cpp
+ * @brief Implementation of bulk transaction MAC and SUN verification
+ */
+
+#include "DesfireVerify.h"
+
+#include <string.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+
+// Session vector of the transaction MAC session key
+#define TM_SV_LABEL 0x5A
+#define TM_SV_SIZE 16
+
+#define VERIFY_FIELD_SEPARATOR ','
+#define VERIFY_COMMENT '#'
+#define VERIFY_MAX_FIELDS 5
+#define VERIFY_TMC_DIGITS 8
+#define VERIFY_READ_SIZE 4096
+
+/**
+ * @brief Parse a hex field of an expected or maximum length
+ *
+ * @param text Hex characters
+ * @param length Number of characters
+ * @param data Buffer to store the bytes
+ * @param size Size of the buffer
+ * @return int32_t Number of bytes stored, -1 if the field is not valid hex or too long
+ */
+static int32_t parseHexField(const char* text, size_t length, uint8_t* data, size_t size) {
+    if (length == 0) {
+        return 0;
+    }
+
+    size_t parsed = DesfireSDM::parseHex(text, length, data, size);
+    return (parsed == 0) ? -1 : static_cast<int32_t>(parsed);
+}
+
+/**
+ * @brief Parse a hex number of up to 32 bits
+ *
+ * @param text Hex digits
+ * @param length Number of digits (1 to 8)
+ * @param value Parsed number
+ * @return true if the number is valid
+ * @return false otherwise
+ */
+static bool parseHexNumber(const char* text, size_t length, uint32_t* value) {
+    if (length == 0 || length > VERIFY_TMC_DIGITS) {
+        return false;
+    }
+
+    *value = 0;
+    for (size_t i = 0; i < length; i++) {
+        char c = text[i];
+        *value <<= 4;
+        if (c >= '0' && c <= '9') {
+            *value |= c - '0';
+        } else if (c >= 'A' && c <= 'F') {
+            *value |= c - 'A' + 10;
+        } else if (c >= 'a' && c <= 'f') {
+            *value |= c - 'a' + 10;
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Construct a parser
+ *
+ * @param callback Function called for every record line
+ * @param context Context pointer passed to the callback
+ */
+DesfireRecordParser::DesfireRecordParser(DesfireVerifyCallback callback, void* context)
+    : _callback(callback), _context(context) {
+    reset();
+}
+
+/**
+ * @brief Prepare the parser for a new stream
+ */
+void DesfireRecordParser::reset() {
+    _length    = 0;
+    _overflow  = false;
+    _lineCount = 0;
+}
+
+/**
+ * @brief Parse the next piece of the stream
+ *
+ * @param data Stream data
+ * @param length Length of the data
+ * @return true if the data was parsed
+ * @return false if the callback stopped parsing
+ */
+bool DesfireRecordParser::feed(const char* data, size_t length) {
+    if (data == nullptr) {
+        return length == 0;
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] == '\n') {
+            _lineCount++;
+            bool more = emitLine();
+            _length   = 0;
+            _overflow = false;
+            if (!more) {
+                return false;
+            }
+        } else if (_length < sizeof(_line)) {
+            _line[_length++] = data[i];
+        } else {
+            _overflow = true;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Parse a last line without a line break
+ *
+ * @return true if the stream was parsed
+ * @return false if the callback stopped parsing
+ */
+bool DesfireRecordParser::finish() {
+    if (_length == 0 && !_overflow) {
+        return true;
+    }
+
+    _lineCount++;
+    bool more = emitLine();
+    _length   = 0;
+    _overflow = false;
+    return more;
+}
+
+/**
+ * @brief Get the number of lines parsed so far
+ *
+ * @return uint32_t Number of complete lines
+ */
+uint32_t DesfireRecordParser::getLineCount() const {
+    return _lineCount;
+}
+
+/**
+ * @brief Parse one record line
+ *
+ * @param line Line without the line break
+ * @param length Length of the line
+ * @param record Record to fill, its result is DF_VERIFY_MALFORMED on failure
+ * @return true if the line is a valid record
+ * @return false otherwise
+ */
+bool DesfireRecordParser::parseLine(const char* line, size_t length, DesfireVerifyRecord* record) {
+    if (record == nullptr) {
+        return false;
+    }
+
+    record->type        = DF_VERIFY_TYPE_NONE;
+    record->result      = DF_VERIFY_MALFORMED;
+    record->counter     = 0;
+    record->inputLength = 0;
+    if (line == nullptr) {
+        return false;
+    }
+
+    // Split into at most VERIFY_MAX_FIELDS comma-separated fields
+    const char* fields[VERIFY_MAX_FIELDS];
+    size_t      lengths[VERIFY_MAX_FIELDS];
+    uint8_t     fieldCount = 0;
+    size_t      start      = 0;
+    for (size_t i = 0; i <= length; i++) {
+        if (i == length || line[i] == VERIFY_FIELD_SEPARATOR) {
+            if (fieldCount == VERIFY_MAX_FIELDS) {
+                return false;
+            }
+            fields[fieldCount]    = &line[start];
+            lengths[fieldCount++] = i - start;
+            start                 = i + 1;
+        }
+    }
+
+    if (lengths[0] != 1) {
+        return false;
+    }
+
+    int32_t inputLength;
+    if (fields[0][0] == DF_VERIFY_TYPE_TMAC && fieldCount == 5) {
+        inputLength = parseHexField(fields[3], lengths[3], record->input, DF_VERIFY_INPUT_SIZE);
+        if (parseHexField(fields[1], lengths[1], record->uid, DF_VERIFY_UID_SIZE) !=
+                DF_VERIFY_UID_SIZE ||
+            !parseHexNumber(fields[2], lengths[2], &record->counter) || inputLength < 0 ||
+            parseHexField(fields[4], lengths[4], record->mac, DF_MACT_SIZE) != DF_MACT_SIZE) {
+            return false;
+        }
+        record->type = DF_VERIFY_TYPE_TMAC;
+    } else if (fields[0][0] == DF_VERIFY_TYPE_SUN && fieldCount == 4) {
+        inputLength = parseHexField(fields[2], lengths[2], record->input, DF_VERIFY_INPUT_SIZE);
+        if (parseHexField(fields[1], lengths[1], record->piccData, DF_SDM_PICC_DATA_SIZE) !=
+                DF_SDM_PICC_DATA_SIZE ||
+            inputLength < 0 ||
+            parseHexField(fields[3], lengths[3], record->mac, DF_MACT_SIZE) != DF_MACT_SIZE) {
+            return false;
+        }
+        record->type = DF_VERIFY_TYPE_SUN;
+    } else {
+        return false;
+    }
+
+    record->inputLength = static_cast<uint16_t>(inputLength);
+    record->result      = DF_VERIFY_PENDING;
+    return true;
+}
+
+/**
+ * @brief Parse the assembled line and pass it to the callback
+ *
+ * @return true to continue
+ * @return false if the callback stopped parsing
+ */
+bool DesfireRecordParser::emitLine() {
+    uint16_t length = _length;
+    if (length > 0 && _line[length - 1] == '\r') {
+        length--;
+    }
+    if (!_overflow && (length == 0 || _line[0] == VERIFY_COMMENT)) {
+        return true;
+    }
+
+    if (_overflow) {
+        parseLine(nullptr, 0, &_record);
+    } else {
+        parseLine(_line, length, &_record);
+    }
+    _record.line = _lineCount;
+
+    return (_callback == nullptr) || _callback(_record, _context);
+}
+
+/**
+ * @brief Construct a verifier without keys
+ */
+DesfireTransactionVerifier::DesfireTransactionVerifier()
+    : _hasTMKey(false), _diversifier(nullptr), _hasAID(false), _sdm(nullptr) {
+    memset(_aid, 0, sizeof(_aid));
+}
+
+/**
+ * @brief Set one transaction MAC key for all cards
+ *
+ * @param key AppTransactionMACKey (16 bytes)
+ */
+void DesfireTransactionVerifier::setTransactionMACKey(const uint8_t* key) {
+    if (key == nullptr) {
+        _hasTMKey = false;
+        return;
+    }
+
+    _tmKey.setKey(key);
+    _hasTMKey    = true;
+    _diversifier = nullptr;
+}
+
+/**
+ * @brief Derive the transaction MAC key of every card from its UID
+ *
+ * @param diversifier Diversifier holding the master key, must outlive the verifier
+ * @param aid Application ID used as diversification input (3 bytes), nullptr for none
+ */
+void DesfireTransactionVerifier::setKeyDiversifier(const DesfireKeyDiversifier* diversifier,
+                                                   const uint8_t*               aid) {
+    _diversifier = diversifier;
+    _hasAID      = (aid != nullptr);
+    if (_hasAID) {
+        memcpy(_aid, aid, sizeof(_aid));
+    }
+    if (diversifier != nullptr) {
+        _hasTMKey = false;
+    }
+}
+
+/**
+ * @brief Set the key set of SUN records
+ *
+ * @param sdm SDM verifier, must outlive the verifier, nullptr to reject SUN records
+ */
+void DesfireTransactionVerifier::setSDM(const DesfireSDM* sdm) {
+    _sdm = sdm;
+}
+
+#if defined(__linux__)
+/**
+ * @brief Slice of a batch verified by one thread
+ */
+struct VerifySlice {
+    const DesfireTransactionVerifier* verifier;  ///< Verifier
+    DesfireVerifyRecord*              records;   ///< First record of the slice
+    size_t                            count;     ///< Number of records
+};
+
+/**
+ * @brief Entry point of a verification thread
+ *
+ * @param argument Slice to verify
+ * @return void* Always nullptr
+ */
+void* DesfireTransactionVerifier::threadMain(void* argument) {
+    VerifySlice* slice = static_cast<VerifySlice*>(argument);
+    slice->verifier->verifySlice(slice->records, slice->count);
+    return nullptr;
+}
+#endif
+
+/**
+ * @brief Verify a batch of records
+ *
+ * @param records Records to verify
+ * @param count Number of records
+ * @param threads Number of threads (1 to DF_VERIFY_MAX_THREADS, Linux only)
+ * @return size_t Number of records with a valid MAC
+ */
+size_t DesfireTransactionVerifier::verifyBatch(DesfireVerifyRecord* records,
+                                               size_t               count,
+                                               uint8_t              threads) const {
+    if (records == nullptr) {
+        return 0;
+    }
+
+#if defined(__linux__)
+    if (threads > DF_VERIFY_MAX_THREADS) {
+        threads = DF_VERIFY_MAX_THREADS;
+    }
+
+    // Slices of whole lane groups, the last one shorter
+    size_t groups   = (count + DF_VERIFY_LANES - 1) / DF_VERIFY_LANES;
+    size_t perSlice = (threads > 1) ? (groups + threads - 1) / threads * DF_VERIFY_LANES : count;
+    if (threads > 1 && perSlice < count) {
+        VerifySlice slices[DF_VERIFY_MAX_THREADS];
+        pthread_t   handles[DF_VERIFY_MAX_THREADS];
+        bool        started[DF_VERIFY_MAX_THREADS];
+        uint8_t     sliceCount = 0;
+
+        for (size_t offset = 0; offset < count; offset += perSlice) {
+            VerifySlice& slice = slices[sliceCount];
+            slice.verifier     = this;
+            slice.records      = &records[offset];
+            slice.count        = (count - offset < perSlice) ? count - offset : perSlice;
+
+            // The first slice runs on the calling thread, as does any slice without a thread
+            started[sliceCount] =
+                sliceCount > 0 &&
+                pthread_create(&handles[sliceCount], nullptr, threadMain, &slice) == 0;
+            sliceCount++;
+        }
+
+        for (uint8_t i = 0; i < sliceCount; i++) {
+            if (!started[i]) {
+                verifySlice(slices[i].records, slices[i].count);
+            }
+        }
+        for (uint8_t i = 0; i < sliceCount; i++) {
+            if (started[i]) {
+                pthread_join(handles[i], nullptr);
+            }
+        }
+    } else {
+        verifySlice(records, count);
+    }
+#else
+    (void)threads;
+    verifySlice(records, count);
+#endif
+
+    size_t valid = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (records[i].result == DF_VERIFY_OK) {
+            valid++;
+        }
+    }
+    return valid;
+}
+
+#ifndef ARDUINO
+/**
+ * @brief State of a stream verification
+ */
+struct VerifyStream {
+    const DesfireTransactionVerifier* verifier;   ///< Verifier
+    DesfireVerifyRecord*              batch;      ///< Record buffer
+    size_t                            batchSize;  ///< Size of the buffer
+    size_t                            used;       ///< Records in the buffer
+    DesfireVerifyCallback             callback;   ///< Result callback
+    void*                             context;    ///< Result callback context
+    uint8_t                           threads;    ///< Verification threads
+    size_t                            valid;      ///< Records with a valid MAC
+    bool                              stopped;    ///< Result callback stopped
+};
+
+/**
+ * @brief Verify the buffered records and report them
+ *
+ * @param stream Stream state
+ */
+static void flushStream(VerifyStream* stream) {
+    stream->valid += stream->verifier->verifyBatch(stream->batch, stream->used, stream->threads);
+
+    for (size_t i = 0; i < stream->used && !stream->stopped; i++) {
+        if (stream->callback != nullptr && !stream->callback(stream->batch[i], stream->context)) {
+            stream->stopped = true;
+        }
+    }
+    stream->used = 0;
+}
+
+/**
+ * @brief Collect a parsed record, verifying the buffer when it is full
+ *
+ * @param record Parsed record
+ * @param context Stream state
+ * @return true to continue
+ * @return false if the result callback stopped
+ */
+static bool collectRecord(const DesfireVerifyRecord& record, void* context) {
+    VerifyStream* stream          = static_cast<VerifyStream*>(context);
+    stream->batch[stream->used++] = record;
+    if (stream->used == stream->batchSize) {
+        flushStream(stream);
+    }
+    return !stream->stopped;
+}
+
+/**
+ * @brief Verify all records of a stream
+ *
+ * @param input Stream of record lines
+ * @param batch Buffer of records
+ * @param batchSize Number of records in the buffer
+ * @param callback Function called for every verified record
+ * @param context Context pointer passed to the callback
+ * @param threads Number of threads (1 to DF_VERIFY_MAX_THREADS, Linux only)
+ * @return size_t Number of records with a valid MAC
+ */
+size_t DesfireTransactionVerifier::verifyStream(FILE*                 input,
+                                                DesfireVerifyRecord*  batch,
+                                                size_t                batchSize,
+                                                DesfireVerifyCallback callback,
+                                                void*                 context,
+                                                uint8_t               threads) const {
+    if (input == nullptr || batch == nullptr || batchSize == 0) {
+        return 0;
+    }
+
+    VerifyStream stream;
+    stream.verifier  = this;
+    stream.batch     = batch;
+    stream.batchSize = batchSize;
+    stream.used      = 0;
+    stream.callback  = callback;
+    stream.context   = context;
+    stream.threads   = threads;
+    stream.valid     = 0;
+    stream.stopped   = false;
+
+    DesfireRecordParser parser(collectRecord, &stream);
+    char                buffer[VERIFY_READ_SIZE];
+    size_t              length;
+    bool                more = true;
+    while (more && (length = fread(buffer, 1, sizeof(buffer), input)) > 0) {
+        more = parser.feed(buffer, length);
+    }
+    if (more) {
+        parser.finish();
+    }
+    if (stream.used > 0) {
+        flushStream(&stream);
+    }
+
+    return stream.valid;
+}
+#endif
+
+/**
+ * @brief Verify a slice of a batch
+ *
+ * @param records Records to verify
+ * @param count Number of records
+ */
+void DesfireTransactionVerifier::verifySlice(DesfireVerifyRecord* records, size_t count) const {
+    for (size_t offset = 0; offset < count; offset += DF_VERIFY_LANES) {
+        size_t lanes = count - offset;
+        if (lanes > DF_VERIFY_LANES) {
+            lanes = DF_VERIFY_LANES;
+        }
+        verifyLanes(&records[offset], static_cast<uint8_t>(lanes));
+    }
+}
+
+/**
+ * @brief Verify up to DF_VERIFY_LANES records together
+ *
+ * Transaction MAC session keys are derived in one batch, SUN session keys
+ * through DesfireSDM, then the MACs of all records run as one batch.
+ *
+ * @param records Records to verify
+ * @param count Number of records
+ */
+void DesfireTransactionVerifier::verifyLanes(DesfireVerifyRecord* records, uint8_t count) const {
+    DesfireAES        cardKeys[DF_VERIFY_LANES];
+    DesfireAES        sessionKeys[DF_VERIFY_LANES];
+    const DesfireAES* ciphers[DF_VERIFY_LANES];
+    const uint8_t*    messages[DF_VERIFY_LANES];
+    size_t            lengths[DF_VERIFY_LANES];
+    uint8_t           lanes[DF_VERIFY_LANES];
+    uint8_t           sv[DF_VERIFY_LANES * TM_SV_SIZE];
+    uint8_t           macs[DF_VERIFY_LANES * DF_CMAC_SIZE];
+    uint8_t           laneCount = 0;
+
+    // SesTMMACKey = CMAC(AppTransactionMACKey, 5A 00 01 00 80 || TMC || UID)
+    for (uint8_t i = 0; i < count; i++) {
+        DesfireVerifyRecord& record = records[i];
+        if (record.result != DF_VERIFY_PENDING || record.type != DF_VERIFY_TYPE_TMAC) {
+            continue;
+        }
+
+        const DesfireAES* key = &_tmKey;
+        if (_diversifier != nullptr) {
+            uint8_t cardKey[DF_AES_KEY_SIZE];
+            if (!_diversifier->diversify(
+                    record.uid, DF_VERIFY_UID_SIZE, _hasAID ? _aid : nullptr, cardKey)) {
+                record.result = DF_VERIFY_NO_KEY;
+                continue;
+            }
+            cardKeys[i].setKey(cardKey);
+            DesfireAES::wipe(cardKey, sizeof(cardKey));
+            key = &cardKeys[i];
+        } else if (!_hasTMKey) {
+            record.result = DF_VERIFY_NO_KEY;
+            continue;
+        }
+
+        uint8_t* vector = &sv[laneCount * TM_SV_SIZE];
+        vector[0]       = TM_SV_LABEL;
+        vector[1]       = 0x00;
+        vector[2]       = 0x01;
+        vector[3]       = 0x00;
+        vector[4]       = 0x80;
+        vector[5]       = record.counter & 0xFF;
+        vector[6]       = (record.counter >> 8) & 0xFF;
+        vector[7]       = (record.counter >> 16) & 0xFF;
+        vector[8]       = (record.counter >> 24) & 0xFF;
+        memcpy(&vector[9], record.uid, DF_VERIFY_UID_SIZE);
+
+        ciphers[laneCount]  = key;
+        messages[laneCount] = vector;
+        lengths[laneCount]  = TM_SV_SIZE;
+        lanes[laneCount++]  = i;
+    }
+
+    DesfireCMAC::computeBatch(ciphers, messages, lengths, macs, laneCount);
+    for (uint8_t l = 0; l < laneCount; l++) {
+        sessionKeys[lanes[l]].setKey(&macs[l * DF_CMAC_SIZE]);
+    }
+
+    // KSesSDMFileReadMAC of every SUN record
+    for (uint8_t i = 0; i < count; i++) {
+        DesfireVerifyRecord& record = records[i];
+        if (record.result != DF_VERIFY_PENDING || record.type != DF_VERIFY_TYPE_SUN) {
+            continue;
+        }
+
+        if (_sdm == nullptr) {
+            record.result = DF_VERIFY_NO_KEY;
+        } else if (!_sdm->decryptPICCData(record.piccData, &record.sun)) {
+            record.result = DF_VERIFY_BAD_MAC;
+        } else {
+            _sdm->deriveMACKey(record.sun, &sessionKeys[i]);
+        }
+    }
+
+    // MACt over the TMI or the SDM MAC input of every record left
+    laneCount = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        DesfireVerifyRecord& record = records[i];
+        if (record.result != DF_VERIFY_PENDING) {
+            continue;
+        }
+
+        ciphers[laneCount]  = &sessionKeys[i];
+        messages[laneCount] = record.input;
+        lengths[laneCount]  = record.inputLength;
+        lanes[laneCount++]  = i;
+    }
+
+    DesfireCMAC::computeBatch(ciphers, messages, lengths, macs, laneCount);
+    for (uint8_t l = 0; l < laneCount; l++) {
+        DesfireVerifyRecord& record = records[lanes[l]];
+        uint8_t              expected[DF_MACT_SIZE];
+        DesfireCMAC::truncate(&macs[l * DF_CMAC_SIZE], expected);
+
+        // Compare without an early exit
+        uint8_t diff = 0;
+        for (uint8_t i = 0; i < DF_MACT_SIZE; i++) {
+            diff |= expected[i] ^ record.mac[i];
+        }
+        record.result = (diff == 0) ? DF_VERIFY_OK : DF_VERIFY_BAD_MAC;
+    }
+
+    DesfireAES::wipe(sv, sizeof(sv));
+    DesfireAES::wipe(macs, sizeof(macs));
+}
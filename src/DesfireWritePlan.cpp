@@ -0,0 +1,58 @@
+/**
+ * @file DesfireWritePlan.cpp
+ * @brief Implementation of the delta planning of file writes
+ */
+
+#include "DesfireWritePlan.h"
+
+/**
+ * @brief Find the ranges that differ from the previous contents
+ *
+ * @param previous Previous contents (shadow copy)
+ * @param data New contents
+ * @param length Length of the contents
+ * @param maxGap Largest unchanged run that is rewritten to join two changes
+ * @param spans Array to store the plan
+ * @param maxSpans Size of the span array (at least 1)
+ * @return uint8_t Number of spans, 0 if nothing changed
+ */
+uint8_t DesfireWritePlanner::plan(const uint8_t*    previous,
+                                  const uint8_t*    data,
+                                  uint32_t          length,
+                                  uint32_t          maxGap,
+                                  DesfireWriteSpan* spans,
+                                  uint8_t           maxSpans) {
+    if (previous == nullptr || data == nullptr || spans == nullptr || maxSpans == 0) {
+        return 0;
+    }
+
+    uint8_t  spanCount = 0;
+    uint32_t i         = 0;
+    while (i < length) {
+        if (previous[i] == data[i]) {
+            i++;
+            continue;
+        }
+
+        // Extent of this run of changed bytes
+        uint32_t start = i;
+        while (i < length && previous[i] != data[i]) {
+            i++;
+        }
+
+        if (spanCount > 0) {
+            DesfireWriteSpan& last = spans[spanCount - 1];
+            uint32_t          gap  = start - (last.offset + last.length);
+            if (gap <= maxGap || spanCount == maxSpans) {
+                last.length = i - last.offset;
+                continue;
+            }
+        }
+
+        spans[spanCount].offset = start;
+        spans[spanCount].length = i - start;
+        spanCount++;
+    }
+
+    return spanCount;
+}
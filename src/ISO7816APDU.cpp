@@ -77,6 +77,8 @@ DesfireStatus ISO7816APDU::convertStatus(uint16_t status) {
             return DesfireStatus::DFST_SUCCESS;
         case static_cast<uint16_t>(ISO7816StatusWord::ISO_SW_SUCCESS_DESFIRE):
             return DesfireStatus::DFST_SUCCESS;
+        case static_cast<uint16_t>(ISO7816StatusWord::ISO_SW_SUCCESS_READ_SIG):
+            return DesfireStatus::DFST_SUCCESS;
         case 0x91AF:
             return DesfireStatus::DFST_MORE_FRAMES;
         case 0x91AE:
@@ -0,0 +1,309 @@
+/**
+ * @file PCSCReader.cpp
+ * @brief Implementation of the contactless reader over PC/SC
+ */
+
+#ifdef DESFIRE_PCSC
+
+#include "PCSCReader.h"
+#include <string.h>
+
+// Reader attributes (PC/SC part 3)
+#define PCSC_ATTR_VENDOR_IFD_VERSION 0x00010102
+#define PCSC_ATTR_BUFFER_SIZE 32
+
+// GET DATA for the UID of a contactless card
+#define PCSC_UID_SIZE 10
+#define PCSC_SW_SIZE 2
+#define PCSC_SW1_OK 0x90
+#define PCSC_SW2_OK 0x00
+
+/**
+ * @brief PC/SC GET DATA command returning the UID
+ */
+static const uint8_t GET_UID[] = {0xFF, 0xCA, 0x00, 0x00, 0x00};
+
+/**
+ * @brief Construct a reader
+ *
+ * @param readerName Part of the PC/SC reader name to use, nullptr for the first reader
+ */
+PCSCReader::PCSCReader(const char* readerName) {
+    strncpy(_filter, readerName ? readerName : "", sizeof(_filter) - 1);
+    _filter[sizeof(_filter) - 1] = '\0';
+    _readerName[0]               = '\0';
+    _context                     = 0;
+    _hasContext                  = false;
+    _card                        = 0;
+    _connected                   = false;
+    _protocol                    = 0;
+    _firmwareVersion             = 0;
+}
+
+/**
+ * @brief Destroy the reader and release the PC/SC context
+ */
+PCSCReader::~PCSCReader() {
+    end();
+}
+
+/**
+ * @brief Connect to the PC/SC service, select the reader and read its features
+ *
+ * @return true if a matching reader was found
+ * @return false if the service is not running or no reader matches
+ */
+bool PCSCReader::begin() {
+    end();
+
+    if (SCardEstablishContext(SCARD_SCOPE_SYSTEM, nullptr, nullptr, &_context) !=
+        SCARD_S_SUCCESS) {
+        return false;
+    }
+    _hasContext = true;
+
+    if (!selectReader()) {
+        end();
+        return false;
+    }
+
+    readVersion();
+    return true;
+}
+
+/**
+ * @brief Get the firmware version of the reader
+ *
+ * @return uint32_t Vendor IFD version, 1 if the reader does not report it, 0 without reader
+ */
+uint32_t PCSCReader::getFirmwareVersion() {
+    return (_readerName[0] != '\0') ? _firmwareVersion : 0;
+}
+
+/**
+ * @brief Configure the reader for card communication
+ *
+ * @return true if a reader is selected
+ * @return false otherwise
+ */
+bool PCSCReader::configure() {
+    return _hasContext && _readerName[0] != '\0';
+}
+
+/**
+ * @brief Detect a card and connect to it
+ *
+ * @param uid Buffer to store the card UID (10 bytes)
+ * @param uidLength Pointer to variable that will store the UID length
+ * @return true if a card is connected
+ * @return false if no card was detected
+ */
+bool PCSCReader::detectCard(uint8_t* uid, uint8_t* uidLength) {
+    if (!configure() || uid == nullptr || uidLength == nullptr) {
+        return false;
+    }
+
+    // Reset a connected card so that it starts from a fresh activation
+    disconnect(SCARD_RESET_CARD);
+
+    SCARD_READERSTATE state;
+    memset(&state, 0, sizeof(state));
+    state.szReader       = _readerName;
+    state.dwCurrentState = SCARD_STATE_UNAWARE;
+
+    if (SCardGetStatusChange(_context, 0, &state, 1) != SCARD_S_SUCCESS) {
+        return false;
+    }
+    if (!(state.dwEventState & SCARD_STATE_PRESENT)) {
+        state.dwCurrentState = state.dwEventState;
+        if (SCardGetStatusChange(_context, PCSC_DETECT_TIMEOUT, &state, 1) != SCARD_S_SUCCESS ||
+            !(state.dwEventState & SCARD_STATE_PRESENT)) {
+            return false;
+        }
+    }
+
+    if (SCardConnect(_context,
+                     _readerName,
+                     SCARD_SHARE_SHARED,
+                     SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1,
+                     &_card,
+                     &_protocol) != SCARD_S_SUCCESS) {
+        return false;
+    }
+    _connected = true;
+
+    uint8_t  response[PCSC_UID_SIZE + PCSC_SW_SIZE];
+    uint16_t responseLength = sizeof(response);
+
+    *uidLength = 0;
+    if (transceive(GET_UID, sizeof(GET_UID), response, &responseLength) &&
+        responseLength >= PCSC_SW_SIZE && response[responseLength - 2] == PCSC_SW1_OK &&
+        response[responseLength - 1] == PCSC_SW2_OK) {
+        *uidLength = responseLength - PCSC_SW_SIZE;
+        memcpy(uid, response, *uidLength);
+    }
+
+    return _connected;
+}
+
+/**
+ * @brief Send an APDU to the card and receive the response
+ *
+ * @param txData APDU to transmit
+ * @param txLength Length of the APDU
+ * @param rxData Buffer to store the response
+ * @param rxLength Size of rxData in, length of the response out
+ * @return true if transmission was successful
+ * @return false if transmission failed
+ */
+bool PCSCReader::transceive(const uint8_t* txData,
+                            uint16_t       txLength,
+                            uint8_t*       rxData,
+                            uint16_t*      rxLength) {
+    if (!_connected || txData == nullptr || rxData == nullptr || rxLength == nullptr) {
+        return false;
+    }
+
+    const SCARD_IO_REQUEST* pci    = (_protocol == SCARD_PROTOCOL_T0) ? SCARD_PCI_T0 : SCARD_PCI_T1;
+    DWORD                   length = *rxLength;
+
+    LONG result = SCardTransmit(_card, pci, txData, txLength, nullptr, rxData, &length);
+    if (result != SCARD_S_SUCCESS) {
+        // A removed or reset card needs a new detectCard()
+        if (result == SCARD_W_REMOVED_CARD || result == SCARD_W_RESET_CARD ||
+            result == SCARD_E_NO_SMARTCARD) {
+            disconnect(SCARD_LEAVE_CARD);
+        }
+        return false;
+    }
+
+    *rxLength = static_cast<uint16_t>(length);
+    return true;
+}
+
+/**
+ * @brief Get the largest command the reader can transmit in one exchange
+ *
+ * @return uint16_t Length of a short APDU
+ */
+uint16_t PCSCReader::getMaxTransmitLength() {
+    return PCSC_SHORT_APDU_SIZE;
+}
+
+/**
+ * @brief Get the largest response the reader can return in one exchange
+ *
+ * @return uint16_t Length of a short response, status word included
+ */
+uint16_t PCSCReader::getMaxReceiveLength() {
+    return PCSC_SHORT_RESPONSE;
+}
+
+/**
+ * @brief Accept the bit rate of the card
+ *
+ * @param kbps Bit rate in kbit/s
+ * @return true always
+ */
+bool PCSCReader::setBitRate(uint16_t kbps) {
+    (void)kbps;
+    return true;
+}
+
+/**
+ * @brief Check whether the reader passes native DESFire frames to the card
+ *
+ * @return false always
+ */
+bool PCSCReader::supportsNativeFrames() {
+    return false;
+}
+
+/**
+ * @brief Get the name of the selected reader
+ *
+ * @return const char* Reader name, empty before begin()
+ */
+const char* PCSCReader::getReaderName() const {
+    return _readerName;
+}
+
+/**
+ * @brief Disconnect the card and release the PC/SC context
+ */
+void PCSCReader::end() {
+    disconnect(SCARD_LEAVE_CARD);
+
+    if (_hasContext) {
+        SCardReleaseContext(_context);
+        _hasContext = false;
+    }
+    _readerName[0]   = '\0';
+    _firmwareVersion = 0;
+}
+
+/**
+ * @brief Select the first reader whose name contains the filter
+ *
+ * @return true if a reader was selected
+ * @return false otherwise
+ */
+bool PCSCReader::selectReader() {
+    char  readers[PCSC_READER_LIST_SIZE];
+    DWORD length = sizeof(readers);
+
+    if (SCardListReaders(_context, nullptr, readers, &length) != SCARD_S_SUCCESS) {
+        return false;
+    }
+
+    // The list is a sequence of null-terminated names ending with an empty name
+    for (const char* name = readers; name < readers + length && *name != '\0';
+         name += strlen(name) + 1) {
+        if (strstr(name, _filter) != nullptr && strlen(name) < sizeof(_readerName)) {
+            strcpy(_readerName, name);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Read the version of the reader
+ */
+void PCSCReader::readVersion() {
+    _firmwareVersion = 1;
+
+    SCARDHANDLE handle;
+    DWORD       protocol;
+    if (SCardConnect(_context, _readerName, SCARD_SHARE_DIRECT, 0, &handle, &protocol) !=
+        SCARD_S_SUCCESS) {
+        return;
+    }
+
+    uint8_t buffer[PCSC_ATTR_BUFFER_SIZE];
+    DWORD   length = sizeof(buffer);
+
+    if (SCardGetAttrib(handle, PCSC_ATTR_VENDOR_IFD_VERSION, buffer, &length) ==
+            SCARD_S_SUCCESS &&
+        length >= 4) {
+        _firmwareVersion = buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) |
+                           (static_cast<uint32_t>(buffer[3]) << 24);
+    }
+
+    SCardDisconnect(handle, SCARD_LEAVE_CARD);
+}
+
+/**
+ * @brief Disconnect the connected card
+ *
+ * @param disposition SCARD_LEAVE_CARD or SCARD_RESET_CARD
+ */
+void PCSCReader::disconnect(DWORD disposition) {
+    if (_connected) {
+        SCardDisconnect(_card, disposition);
+        _connected = false;
+    }
+}
+
+#endif  // DESFIRE_PCSC
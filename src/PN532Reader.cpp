@@ -5,11 +5,32 @@
 
 #include "PN532Reader.h"
 
+#include <SPI.h>
+#include <Wire.h>
+
 // Constants
 #define PN532_CONN_I2C 0
 #define PN532_CONN_SPI 1
 #define PN532_CONN_HSU 2
 
+// RFConfiguration item 02h: ATR_RES timeout and communication timeout
+#define PN532_CMD_RF_CONFIGURATION 0x32
+#define PN532_CFG_TIMINGS 0x02
+#define PN532_TIMEOUT_ATR_RES 0x0B  // 102.4 ms
+#define PN532_TIMEOUT_DEFAULT 0x0A  // 51.2 ms
+#define PN532_TIMEOUT_MAX 0x10      // 3.28 s
+#define PN532_TIMEOUT_STEP_US 100   // Timeout of code 01h, doubling with every code
+
+// Answer frames read from the bus after the driver has taken the ACK
+#define PN532_I2C_DEVICE 0x24        // 7-bit I2C address
+#define PN532_SPI_STATUS 0x02        // SPI: read the status byte
+#define PN532_SPI_DATA 0x03          // SPI: read the ready frame
+#define PN532_SPI_CLOCK 1000000      // SPI clock of the Adafruit driver
+#define PN532_READY 0x01             // Status byte: a frame is ready
+#define PN532_TFI_ANSWER 0xD5        // TFI of frames from the PN532
+#define PN532_EMPTY_ANSWER_SIZE 9    // 00 00 FF 02 FE D5 Cmd+1 DCS 00
+#define PN532_ANSWER_TIMEOUT_MS 100  // Same wait as sendCommandCheckAck()
+
 /**
  * @brief Construct a new PN532Reader object with I2C communication
  *
@@ -21,6 +42,8 @@ PN532Reader::PN532Reader(uint8_t irq, uint8_t reset, TwoWire& wire) {
     _nfc            = new Adafruit_PN532(irq, reset, &wire);
     _ownNFC         = true;
     _connectionType = PN532_CONN_I2C;
+    _wire           = &wire;
+    _ss             = 0;
 }
 
 /**
@@ -32,6 +55,8 @@ PN532Reader::PN532Reader(uint8_t ss) {
     _nfc            = new Adafruit_PN532(ss);
     _ownNFC         = true;
     _connectionType = PN532_CONN_SPI;
+    _wire           = nullptr;
+    _ss             = ss;
 }
 
 /**
@@ -44,6 +69,8 @@ PN532Reader::PN532Reader(uint8_t tx, uint8_t rx) {
     _nfc            = new Adafruit_PN532(tx, rx);
     _ownNFC         = true;
     _connectionType = PN532_CONN_HSU;
+    _wire           = nullptr;
+    _ss             = 0;
 }
 
 /**
@@ -135,4 +162,141 @@ bool PN532Reader::transceive(const uint8_t* txData,
                                        &rxLen8);
     *rxLength      = rxLen8;
     return result;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Send data to the card and measure the round trip time
+ *
+ * @param txData Data to transmit
+ * @param txLength Length of data to transmit
+ * @param rxData Buffer to store the response
+ * @param rxLength Pointer to variable that will store the response length
+ * @param roundTrip Pointer to variable that will store the round trip time in microseconds
+ * @return true if transmission was successful
+ * @return false if transmission failed
+ */
+bool PN532Reader::transceiveTimed(const uint8_t* txData,
+                                  uint16_t       txLength,
+                                  uint8_t*       rxData,
+                                  uint16_t*      rxLength,
+                                  uint32_t*      roundTrip) {
+#if defined(ARDUINO_ARCH_ESP32)
+    // The cycle counter resolves a few nanoseconds and costs no call into the timer
+    uint32_t start  = ESP.getCycleCount();
+    bool     result = transceive(txData, txLength, rxData, rxLength);
+    *roundTrip      = (ESP.getCycleCount() - start) / ESP.getCpuFreqMHz();
+#else
+    uint32_t start  = micros();
+    bool     result = transceive(txData, txLength, rxData, rxLength);
+    *roundTrip      = micros() - start;
+#endif
+    return result;
+}
+
+/**
+ * @brief Limit the time the card may take to answer
+ *
+ * @param timeout Longest accepted card response time in microseconds, 0 for the default
+ * @return true if the limit is enforced
+ * @return false if the PN532 did not confirm the configuration
+ */
+bool PN532Reader::setResponseTimeout(uint32_t timeout) {
+    // The answer is read from the bus, the serial port of the driver is not reachable
+    if (_connectionType == PN532_CONN_HSU) {
+        return false;
+    }
+
+    // Smallest timeout code that still accepts the given time
+    uint8_t code = PN532_TIMEOUT_DEFAULT;
+    if (timeout > 0) {
+        uint32_t step = PN532_TIMEOUT_STEP_US;
+        code          = 0x01;
+        while (step < timeout && code < PN532_TIMEOUT_MAX) {
+            step *= 2;
+            code++;
+        }
+    }
+
+    uint8_t command[] = {
+        PN532_CMD_RF_CONFIGURATION, PN532_CFG_TIMINGS, 0x00, PN532_TIMEOUT_ATR_RES, code};
+    return _nfc->sendCommandCheckAck(command, sizeof(command)) &&
+           readEmptyAnswer(PN532_CMD_RF_CONFIGURATION);
+}
+
+/**
+ * @brief Read and check the answer to a command that returns no data
+ *
+ * sendCommandCheckAck() only takes the ACK. An answer left on the PN532
+ * would be read as the answer to the next command.
+ *
+ * @param command Command code that was sent
+ * @return true if the PN532 answered the command
+ * @return false if no answer or a different frame arrived in time
+ */
+bool PN532Reader::readEmptyAnswer(uint8_t command) {
+    uint8_t  frame[PN532_EMPTY_ANSWER_SIZE];
+    uint32_t start = millis();
+
+    while (true) {
+        bool ready = false;
+        if (_connectionType == PN532_CONN_SPI) {
+            SPI.beginTransaction(SPISettings(PN532_SPI_CLOCK, LSBFIRST, SPI_MODE0));
+            digitalWrite(_ss, LOW);
+            SPI.transfer(PN532_SPI_STATUS);
+            ready = (SPI.transfer(0x00) & PN532_READY) != 0;
+            digitalWrite(_ss, HIGH);
+
+            if (ready) {
+                digitalWrite(_ss, LOW);
+                SPI.transfer(PN532_SPI_DATA);
+                for (uint8_t i = 0; i < sizeof(frame); i++) {
+                    frame[i] = SPI.transfer(0x00);
+                }
+                digitalWrite(_ss, HIGH);
+            }
+            SPI.endTransaction();
+        } else {
+            // I2C reads start with the status byte
+            _wire->requestFrom(static_cast<uint8_t>(PN532_I2C_DEVICE),
+                               static_cast<uint8_t>(1 + sizeof(frame)));
+            ready = (_wire->read() & PN532_READY) != 0;
+            for (uint8_t i = 0; i < sizeof(frame); i++) {
+                frame[i] = static_cast<uint8_t>(_wire->read());
+            }
+        }
+
+        if (ready) {
+            break;
+        }
+        if (millis() - start > PN532_ANSWER_TIMEOUT_MS) {
+            return false;
+        }
+        delay(1);
+    }
+
+    // 00 00 FF, LEN 2 and LCS, TFI and Cmd + 1, DCS
+    uint8_t answer = command + 1;
+    return frame[0] == 0x00 && frame[1] == 0x00 && frame[2] == 0xFF && frame[3] == 0x02 &&
+           frame[4] == 0xFE && frame[5] == PN532_TFI_ANSWER && frame[6] == answer &&
+           static_cast<uint8_t>(frame[5] + frame[6] + frame[7]) == 0x00;
+}
+
+/**
+ * @brief Get the largest command the reader can transmit in one exchange
+ *
+ * @return uint16_t Maximum length of txData in bytes
+ */
+uint16_t PN532Reader::getMaxTransmitLength() {
+    // inDataExchange() packs the command into a 64-byte buffer after two header bytes
+    return 62;
+}
+
+/**
+ * @brief Get the largest response the reader can return in one exchange
+ *
+ * @return uint16_t Maximum length of rxData in bytes
+ */
+uint16_t PN532Reader::getMaxReceiveLength() {
+    // inDataExchange() reads the response into a 64-byte buffer after an 8-byte frame header
+    return 56;
+}
@@ -0,0 +1,739 @@
+/**
+ * @file PN532SerialReader.cpp
+ * @brief Implementation of the PN532 reader on a POSIX serial port
+ */
+
+#include "PN532SerialReader.h"
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+// Frame layout
+#define PN532_START_CODE_1 0x00
+#define PN532_START_CODE_2 0xFF
+#define PN532_EXTENDED_LENGTH 0xFF  // LEN and LCS of an extended frame
+#define PN532_TFI_HOST 0xD4         // Frame from the host to the PN532
+#define PN532_TFI_PN532 0xD5        // Frame from the PN532 to the host
+#define PN532_TFI_ERROR 0x7F        // Syntax error frame
+#define PN532_FRAME_HEADER 8        // Preamble, start code and extended length
+#define PN532_FRAME_NORMAL 255      // Largest TFI and data of a normal frame
+
+// Commands
+#define PN532_CMD_GET_FIRMWARE_VERSION 0x02
+#define PN532_CMD_SET_SERIAL_BAUD_RATE 0x10
+#define PN532_CMD_SAM_CONFIGURATION 0x14
+#define PN532_CMD_RF_CONFIGURATION 0x32
+#define PN532_CMD_IN_DATA_EXCHANGE 0x40
+#define PN532_CMD_IN_LIST_PASSIVE_TARGET 0x4A
+#define PN532_CMD_IN_PSL 0x4E
+#define PN532_STATUS_MASK 0x3F  // Error code bits of the status byte
+
+// SAMConfiguration: normal mode, no SAM
+#define PN532_SAM_NORMAL 0x01
+#define PN532_SAM_TIMEOUT 0x14  // 1 s in 50 ms steps
+#define PN532_SAM_USE_IRQ 0x01
+
+// RFConfiguration items
+#define PN532_CFG_TIMINGS 0x02
+#define PN532_CFG_MAX_RETRIES 0x05
+#define PN532_PASSIVE_RETRIES 0x10  // InListPassiveTarget returns empty within the answer timeout
+#define PN532_TIMEOUT_ATR_RES 0x0B  // 102.4 ms
+#define PN532_TIMEOUT_DEFAULT 0x0A  // 51.2 ms
+#define PN532_TIMEOUT_MAX 0x10      // 3.28 s
+#define PN532_TIMEOUT_STEP_US 100   // Timeout of code 01h, doubling with every code
+
+// InListPassiveTarget: one ISO14443A target
+#define PN532_MAX_TARGETS 1
+#define PN532_BRTY_106A 0x00
+#define PN532_UID_SIZE 10
+
+/**
+ * @brief Wake-up sequence for a PN532 in power down, sent before the first frame
+ */
+static const uint8_t WAKE_UP[] = {0x55, 0x55, 0x00, 0x00, 0x00};
+
+/**
+ * @brief ACK frame
+ */
+static const uint8_t ACK_FRAME[] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+
+/**
+ * @brief Baud rates supported by both the PN532 and Linux
+ */
+static const struct {
+    uint32_t baudRate;  // Baud rate
+    uint8_t  code;      // SetSerialBaudRate code
+    speed_t  speed;     // termios speed
+} BAUD_RATES[] = {{9600, 0x00, B9600},
+                  {19200, 0x01, B19200},
+                  {38400, 0x02, B38400},
+                  {57600, 0x03, B57600},
+                  {115200, 0x04, B115200},
+                  {230400, 0x05, B230400},
+                  {460800, 0x06, B460800},
+                  {921600, 0x07, B921600}};
+
+/**
+ * @brief Construct a reader for a serial device
+ *
+ * @param device Path of the serial device, e.g. /dev/ttyUSB0
+ * @param baudRate Baud rate used after initialization
+ */
+PN532SerialReader::PN532SerialReader(const char* device, uint32_t baudRate) {
+    strncpy(_device, device ? device : "", sizeof(_device) - 1);
+    _device[sizeof(_device) - 1] = '\0';
+    _baudRate                    = baudRate;
+    _lineRate                    = PN532_HSU_BAUD_DEFAULT;
+    _fd                          = -1;
+    _epoll                       = -1;
+    _asleep                      = true;
+    _target                      = 1;
+    _inputStart                  = 0;
+    _inputEnd                    = 0;
+}
+
+/**
+ * @brief Destroy the reader and close the device
+ */
+PN532SerialReader::~PN532SerialReader() {
+    end();
+}
+
+/**
+ * @brief Open the device, wake the PN532 and switch to the baud rate
+ *
+ * @return true if the PN532 answered
+ * @return false if the device could not be opened or the PN532 is silent
+ */
+bool PN532SerialReader::begin() {
+    end();
+
+    _fd = open(_device, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (_fd < 0) {
+        return false;
+    }
+
+    struct termios tty;
+    if (tcgetattr(_fd, &tty) != 0) {
+        end();
+        return false;
+    }
+    cfmakeraw(&tty);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cflag &= ~CRTSCTS;
+    if (tcsetattr(_fd, TCSANOW, &tty) != 0) {
+        end();
+        return false;
+    }
+    tcflush(_fd, TCIOFLUSH);
+
+    _epoll = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    if (_epoll < 0 || epoll_ctl(_epoll, EPOLL_CTL_ADD, _fd, &event) != 0) {
+        end();
+        return false;
+    }
+
+    // A PN532 left at the higher rate by an earlier run only answers there
+    bool switched = false;
+    if (!setLocalBaudRate(PN532_HSU_BAUD_DEFAULT) || !wake()) {
+        if (_baudRate == PN532_HSU_BAUD_DEFAULT || !setLocalBaudRate(_baudRate) || !wake()) {
+            end();
+            return false;
+        }
+        switched = true;
+    }
+
+    if (getFirmwareVersion() == 0) {
+        end();
+        return false;
+    }
+
+    if (_baudRate != PN532_HSU_BAUD_DEFAULT && !switched) {
+        uint8_t code = 0xFF;
+        for (size_t i = 0; i < sizeof(BAUD_RATES) / sizeof(BAUD_RATES[0]); i++) {
+            if (BAUD_RATES[i].baudRate == _baudRate) {
+                code = BAUD_RATES[i].code;
+            }
+        }
+
+        // The PN532 switches once the host acknowledges the answer
+        uint8_t  command[] = {PN532_CMD_SET_SERIAL_BAUD_RATE, code};
+        uint16_t length    = 0;
+        if (code == 0xFF || !sendCommand(command, sizeof(command), nullptr, &length) ||
+            !writeAck() || !setLocalBaudRate(_baudRate)) {
+            end();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Close the device
+ */
+void PN532SerialReader::end() {
+    if (_epoll >= 0) {
+        close(_epoll);
+        _epoll = -1;
+    }
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+    _asleep     = true;
+    _inputStart = 0;
+    _inputEnd   = 0;
+}
+
+/**
+ * @brief Wake the PN532 and leave its low power mode
+ *
+ * @return true if the PN532 answered
+ * @return false otherwise
+ */
+bool PN532SerialReader::wake() {
+    uint8_t  command[] = {PN532_CMD_SAM_CONFIGURATION,
+                         PN532_SAM_NORMAL,
+                         PN532_SAM_TIMEOUT,
+                         PN532_SAM_USE_IRQ};
+    uint16_t length    = 0;
+
+    _asleep = true;
+    return sendCommand(command, sizeof(command), nullptr, &length);
+}
+
+/**
+ * @brief Get the firmware version of the PN532
+ *
+ * @return uint32_t IC, version, revision and support bytes (0 if failed)
+ */
+uint32_t PN532SerialReader::getFirmwareVersion() {
+    uint8_t  command[] = {PN532_CMD_GET_FIRMWARE_VERSION};
+    uint8_t  answer[4];
+    uint16_t length = sizeof(answer);
+
+    if (!sendCommand(command, sizeof(command), answer, &length) || length != sizeof(answer)) {
+        return 0;
+    }
+
+    return (static_cast<uint32_t>(answer[0]) << 24) | (static_cast<uint32_t>(answer[1]) << 16) |
+           (static_cast<uint32_t>(answer[2]) << 8) | answer[3];
+}
+
+/**
+ * @brief Configure the PN532 for card communication
+ *
+ * @return true if configuration was successful
+ * @return false if configuration failed
+ */
+bool PN532SerialReader::configure() {
+    if (!wake()) {
+        return false;
+    }
+
+    // Give up on an empty field, detectCard() is polled
+    uint8_t  command[] = {PN532_CMD_RF_CONFIGURATION,
+                         PN532_CFG_MAX_RETRIES,
+                         0xFF,
+                         0x01,
+                         PN532_PASSIVE_RETRIES};
+    uint16_t length    = 0;
+    return sendCommand(command, sizeof(command), nullptr, &length);
+}
+
+/**
+ * @brief Detect if an ISO14443A card is present
+ *
+ * @param uid Buffer to store the card UID
+ * @param uidLength Pointer to variable that will store the UID length
+ * @return true if a card was detected
+ * @return false if no card was detected
+ */
+bool PN532SerialReader::detectCard(uint8_t* uid, uint8_t* uidLength) {
+    if (!uid || !uidLength) {
+        return false;
+    }
+
+    uint8_t  command[] = {PN532_CMD_IN_LIST_PASSIVE_TARGET, PN532_MAX_TARGETS, PN532_BRTY_106A};
+    uint8_t  answer[PN532_HSU_MAX_DATA];
+    uint16_t length = sizeof(answer);
+
+    if (!sendCommand(command, sizeof(command), answer, &length)) {
+        return false;
+    }
+
+    // NbTg || Tg || SENS_RES (2) || SEL_RES || NFCIDLength || NFCID || ATS
+    if (length < 6 || answer[0] == 0 || answer[5] > PN532_UID_SIZE || length < 6 + answer[5]) {
+        return false;
+    }
+
+    _target    = answer[1];
+    *uidLength = answer[5];
+    memcpy(uid, &answer[6], answer[5]);
+    return true;
+}
+
+/**
+ * @brief Send data to the card and receive the response
+ *
+ * @param txData Data to transmit
+ * @param txLength Length of data to transmit
+ * @param rxData Buffer to store the response
+ * @param rxLength Size of rxData in, length of the response out
+ * @return true if transmission was successful
+ * @return false if transmission failed
+ */
+bool PN532SerialReader::transceive(const uint8_t* txData,
+                                   uint16_t       txLength,
+                                   uint8_t*       rxData,
+                                   uint16_t*      rxLength) {
+    if (!txData || !rxData || !rxLength || txLength > PN532_HSU_MAX_DATA) {
+        return false;
+    }
+
+    uint8_t command[2 + PN532_HSU_MAX_DATA];
+    command[0] = PN532_CMD_IN_DATA_EXCHANGE;
+    command[1] = _target;
+    memcpy(&command[2], txData, txLength);
+
+    // Status byte followed by the card response
+    uint8_t  answer[1 + PN532_HSU_MAX_DATA];
+    uint16_t length = sizeof(answer);
+    if (!sendCommand(command, 2 + txLength, answer, &length) || length < 1 ||
+        (answer[0] & PN532_STATUS_MASK) != 0 || length - 1 > *rxLength) {
+        return false;
+    }
+
+    *rxLength = length - 1;
+    memcpy(rxData, &answer[1], *rxLength);
+    return true;
+}
+
+/**
+ * @brief Limit the time the card may take to answer
+ *
+ * @param timeout Longest accepted card response time in microseconds, 0 for the default
+ * @return true if the limit is enforced
+ * @return false if the PN532 rejected the configuration
+ */
+bool PN532SerialReader::setResponseTimeout(uint32_t timeout) {
+    // Smallest timeout code that still accepts the given time
+    uint8_t code = PN532_TIMEOUT_DEFAULT;
+    if (timeout > 0) {
+        uint32_t step = PN532_TIMEOUT_STEP_US;
+        code          = 0x01;
+        while (step < timeout && code < PN532_TIMEOUT_MAX) {
+            step *= 2;
+            code++;
+        }
+    }
+
+    uint8_t  command[] = {
+        PN532_CMD_RF_CONFIGURATION, PN532_CFG_TIMINGS, 0x00, PN532_TIMEOUT_ATR_RES, code};
+    uint16_t length = 0;
+    return sendCommand(command, sizeof(command), nullptr, &length);
+}
+
+/**
+ * @brief Change the bit rate of the activated card with InPSL
+ *
+ * @param kbps Bit rate in kbit/s for both directions (106, 212, 424 or 848)
+ * @return true if the bit rate is in use
+ * @return false if the PN532 or the card rejected it
+ */
+bool PN532SerialReader::setBitRate(uint16_t kbps) {
+    uint8_t rate;
+    switch (kbps) {
+        case 106:
+            rate = 0x00;
+            break;
+        case 212:
+            rate = 0x01;
+            break;
+        case 424:
+            rate = 0x02;
+            break;
+        case 848:
+            rate = 0x03;
+            break;
+        default:
+            return false;
+    }
+
+    uint8_t  command[] = {PN532_CMD_IN_PSL, _target, rate, rate};
+    uint8_t  answer[1];
+    uint16_t length = sizeof(answer);
+    return sendCommand(command, sizeof(command), answer, &length) && length == 1 &&
+           (answer[0] & PN532_STATUS_MASK) == 0;
+}
+
+/**
+ * @brief Get the largest command the reader can transmit in one exchange
+ *
+ * @return uint16_t Maximum length of txData in bytes
+ */
+uint16_t PN532SerialReader::getMaxTransmitLength() {
+    // Extended frames carry a full InDataExchange, the PN532 chains to the card frame size
+    return PN532_HSU_MAX_DATA;
+}
+
+/**
+ * @brief Get the largest response the reader can return in one exchange
+ *
+ * @return uint16_t Maximum length of rxData in bytes
+ */
+uint16_t PN532SerialReader::getMaxReceiveLength() {
+    return PN532_HSU_MAX_DATA;
+}
+
+/**
+ * @brief Set the local baud rate of the device
+ *
+ * @param baudRate Baud rate
+ * @return true if the rate was set
+ * @return false if the rate is not supported
+ */
+bool PN532SerialReader::setLocalBaudRate(uint32_t baudRate) {
+    for (size_t i = 0; i < sizeof(BAUD_RATES) / sizeof(BAUD_RATES[0]); i++) {
+        if (BAUD_RATES[i].baudRate != baudRate) {
+            continue;
+        }
+
+        struct termios tty;
+        if (tcgetattr(_fd, &tty) != 0) {
+            return false;
+        }
+        cfsetispeed(&tty, BAUD_RATES[i].speed);
+        cfsetospeed(&tty, BAUD_RATES[i].speed);
+
+        // Let pending output leave at the old rate
+        if (tcsetattr(_fd, TCSADRAIN, &tty) != 0) {
+            return false;
+        }
+        _lineRate = baudRate;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Send a command and receive its answer
+ *
+ * @param command Command code and parameters, without TFI
+ * @param commandLength Length of the command
+ * @param answer Buffer to store the answer parameters, without TFI and code
+ * @param answerLength Size of answer in, length of the parameters out
+ * @param timeout Time the PN532 may take to answer (ms)
+ * @return true if the PN532 answered the command
+ * @return false on timeout, NACK, error frame or a corrupt frame
+ */
+bool PN532SerialReader::sendCommand(const uint8_t* command,
+                                    uint16_t       commandLength,
+                                    uint8_t*       answer,
+                                    uint16_t*      answerLength,
+                                    uint32_t       timeout) {
+    if (_fd < 0 || commandLength == 0) {
+        return false;
+    }
+
+    // Whatever arrived since the last exchange belongs to an earlier command
+    discardInput();
+    if (!writeFrame(command, commandLength)) {
+        return false;
+    }
+
+    // The ACK follows once the whole frame is on the line, 10 bits per byte
+    uint32_t frameSize = sizeof(WAKE_UP) + PN532_FRAME_HEADER + commandLength + 3;
+    uint32_t transfer  = frameSize * 10000 / _lineRate;
+
+    uint16_t length = sizeof(_frame);
+    if (!readFrame(_frame, &length, now() + PN532_HSU_ACK_TIMEOUT + transfer) || length != 0) {
+        return false;
+    }
+
+    length = sizeof(_frame);
+    if (!readFrame(_frame, &length, now() + timeout)) {
+        // Abort the command so that the next one is not answered with this one's result
+        writeAck();
+        return false;
+    }
+    _asleep = false;
+
+    // TFI || command code + 1 || parameters
+    if (length < 2 || _frame[0] != PN532_TFI_PN532 || _frame[1] != command[0] + 1) {
+        return false;
+    }
+    if (length - 2 > *answerLength) {
+        return false;
+    }
+
+    *answerLength = length - 2;
+    if (answer) {
+        memcpy(answer, &_frame[2], *answerLength);
+    }
+    return true;
+}
+
+/**
+ * @brief Drop unparsed and pending input, such as the late answer of an aborted command
+ */
+void PN532SerialReader::discardInput() {
+    _inputStart = 0;
+    _inputEnd   = 0;
+    tcflush(_fd, TCIFLUSH);
+}
+
+/**
+ * @brief Send a command frame
+ *
+ * @param command Command code and parameters, without TFI
+ * @param commandLength Length of the command
+ * @return true if the frame was written
+ * @return false otherwise
+ */
+bool PN532SerialReader::writeFrame(const uint8_t* command, uint16_t commandLength) {
+    uint16_t dataLength = commandLength + 1;
+    if (dataLength + PN532_FRAME_HEADER + 2u > sizeof(_frame)) {
+        return false;
+    }
+
+    uint64_t deadline = now() + PN532_HSU_ACK_TIMEOUT;
+    if (_asleep && !writeAll(WAKE_UP, sizeof(WAKE_UP), deadline)) {
+        return false;
+    }
+
+    uint16_t length  = 0;
+    _frame[length++] = 0x00;
+    _frame[length++] = PN532_START_CODE_1;
+    _frame[length++] = PN532_START_CODE_2;
+    if (dataLength > PN532_FRAME_NORMAL) {
+        _frame[length++] = PN532_EXTENDED_LENGTH;
+        _frame[length++] = PN532_EXTENDED_LENGTH;
+        _frame[length++] = dataLength >> 8;
+        _frame[length++] = dataLength & 0xFF;
+        _frame[length++] = static_cast<uint8_t>(-((dataLength >> 8) + (dataLength & 0xFF)));
+    } else {
+        _frame[length++] = static_cast<uint8_t>(dataLength);
+        _frame[length++] = static_cast<uint8_t>(-dataLength);
+    }
+
+    uint8_t sum      = PN532_TFI_HOST;
+    _frame[length++] = PN532_TFI_HOST;
+    for (uint16_t i = 0; i < commandLength; i++) {
+        sum += command[i];
+        _frame[length++] = command[i];
+    }
+    _frame[length++] = static_cast<uint8_t>(-sum);
+    _frame[length++] = 0x00;
+
+    return writeAll(_frame, length, deadline);
+}
+
+/**
+ * @brief Send an ACK frame, which aborts the current command
+ *
+ * @return true if the frame was written
+ * @return false otherwise
+ */
+bool PN532SerialReader::writeAck() {
+    return writeAll(ACK_FRAME, sizeof(ACK_FRAME), now() + PN532_HSU_ACK_TIMEOUT);
+}
+
+/**
+ * @brief Receive a frame
+ *
+ * @param data Buffer to store TFI and data of the frame
+ * @param length Size of data in, length of the frame data out
+ * @param deadline Time at which to give up (ms, monotonic clock)
+ * @return true if a complete frame with valid checksums was received
+ * @return false otherwise
+ */
+bool PN532SerialReader::readFrame(uint8_t* data, uint16_t* length, uint64_t deadline) {
+    // Any number of preamble bytes may precede the start code
+    uint8_t previous = 0xFF;
+    uint8_t current  = 0xFF;
+    while (previous != PN532_START_CODE_1 || current != PN532_START_CODE_2) {
+        previous = current;
+        if (!readAll(&current, 1, deadline)) {
+            return false;
+        }
+    }
+
+    uint8_t header[3];
+    if (!readAll(header, 2, deadline)) {
+        return false;
+    }
+
+    uint16_t dataLength;
+    if (header[0] == 0x00 && header[1] == 0xFF) {
+        // ACK, the postamble follows
+        *length = 0;
+        return readAll(header, 1, deadline);
+    } else if (header[0] == 0xFF && header[1] == 0x00) {
+        // NACK
+        return false;
+    } else if (header[0] == PN532_EXTENDED_LENGTH && header[1] == PN532_EXTENDED_LENGTH) {
+        if (!readAll(header, 3, deadline) ||
+            static_cast<uint8_t>(header[0] + header[1] + header[2]) != 0) {
+            return false;
+        }
+        dataLength = (header[0] << 8) | header[1];
+    } else {
+        if (static_cast<uint8_t>(header[0] + header[1]) != 0) {
+            return false;
+        }
+        dataLength = header[0];
+    }
+
+    if (dataLength == 0 || dataLength > *length || !readAll(data, dataLength, deadline)) {
+        return false;
+    }
+
+    // DCS and postamble
+    uint8_t trailer[2];
+    if (!readAll(trailer, sizeof(trailer), deadline)) {
+        return false;
+    }
+
+    uint8_t sum = trailer[0];
+    for (uint16_t i = 0; i < dataLength; i++) {
+        sum += data[i];
+    }
+    if (sum != 0 || data[0] == PN532_TFI_ERROR) {
+        return false;
+    }
+
+    *length = dataLength;
+    return true;
+}
+
+/**
+ * @brief Write bytes, waiting for the device to accept them
+ *
+ * @param data Bytes to write
+ * @param length Number of bytes
+ * @param deadline Time at which to give up (ms, monotonic clock)
+ * @return true if all bytes were written
+ * @return false otherwise
+ */
+bool PN532SerialReader::writeAll(const uint8_t* data, size_t length, uint64_t deadline) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = write(_fd, data + done, length - done);
+        if (n > 0) {
+            done += static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            return false;
+        }
+        if (!waitReady(EPOLLOUT, deadline)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Read bytes, waiting for the device to deliver them
+ *
+ * @param data Buffer to store the bytes
+ * @param length Number of bytes
+ * @param deadline Time at which to give up (ms, monotonic clock)
+ * @return true if all bytes were read
+ * @return false otherwise
+ */
+bool PN532SerialReader::readAll(uint8_t* data, size_t length, uint64_t deadline) {
+    size_t done = 0;
+    while (done < length) {
+        // Serve from what an earlier read already fetched
+        if (_inputStart < _inputEnd) {
+            size_t chunk = _inputEnd - _inputStart;
+            if (chunk > length - done) {
+                chunk = length - done;
+            }
+            memcpy(data + done, &_input[_inputStart], chunk);
+            _inputStart += chunk;
+            done += chunk;
+            continue;
+        }
+
+        ssize_t n = read(_fd, _input, sizeof(_input));
+        if (n > 0) {
+            _inputStart = 0;
+            _inputEnd   = static_cast<uint16_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            return false;
+        }
+        if (!waitReady(EPOLLIN, deadline)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Wait until the device is ready
+ *
+ * @param events EPOLLIN or EPOLLOUT
+ * @param deadline Time at which to give up (ms, monotonic clock)
+ * @return true if the device is ready
+ * @return false on timeout or error
+ */
+bool PN532SerialReader::waitReady(uint32_t events, uint64_t deadline) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    if (epoll_ctl(_epoll, EPOLL_CTL_MOD, _fd, &event) != 0) {
+        return false;
+    }
+
+    while (true) {
+        uint64_t current = now();
+        if (current >= deadline) {
+            return false;
+        }
+
+        int ready = epoll_wait(_epoll, &event, 1, static_cast<int>(deadline - current));
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0 || (event.events & (EPOLLERR | EPOLLHUP))) {
+            return false;
+        }
+        return true;
+    }
+}
+
+/**
+ * @brief Get the time of the monotonic clock in milliseconds
+ *
+ * @return uint64_t Time in milliseconds
+ */
+uint64_t PN532SerialReader::now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return static_cast<uint64_t>(time.tv_sec) * 1000 + time.tv_nsec / 1000000;
+}
+
+#endif  // __linux__
@@ -0,0 +1,727 @@
+/**
+ * @file PN532Simulator.cpp
+ * @brief Implementation of the PN532 host interface simulator
+ */
+
+#include "PN532Simulator.h"
+
+#include <string.h>
+
+// Frame layout
+#define SIM_START_CODE_1 0x00
+#define SIM_START_CODE_2 0xFF
+#define SIM_EXTENDED_LENGTH 0xFF  // LEN and LCS of an extended frame
+#define SIM_TFI_HOST 0xD4         // Frame from the host to the PN532
+#define SIM_TFI_PN532 0xD5        // Frame from the PN532 to the host
+#define SIM_TFI_ERROR 0x7F        // Syntax error frame
+#define SIM_NORMAL_HEADER 4       // Start code, LEN and LCS
+#define SIM_EXTENDED_HEADER 7     // Start code, extended marker, LENM, LENL and LCS
+#define SIM_FRAME_NORMAL 255      // Largest TFI and data of a normal frame
+
+// Commands
+#define SIM_CMD_GET_FIRMWARE_VERSION 0x02
+#define SIM_CMD_SET_SERIAL_BAUD_RATE 0x10
+#define SIM_CMD_SAM_CONFIGURATION 0x14
+#define SIM_CMD_RF_CONFIGURATION 0x32
+#define SIM_CMD_IN_DATA_EXCHANGE 0x40
+#define SIM_CMD_IN_DESELECT 0x44
+#define SIM_CMD_IN_LIST_PASSIVE_TARGET 0x4A
+#define SIM_CMD_IN_PSL 0x4E
+#define SIM_CMD_IN_RELEASE 0x52
+
+// RFConfiguration items
+#define SIM_CFG_TIMINGS 0x02
+#define SIM_CFG_MAX_RETRIES 0x05
+#define SIM_TIMEOUT_DEFAULT 0x0A  // 51.2 ms
+#define SIM_TIMEOUT_STEP_US 100   // Timeout of code 01h, doubling with every code
+#define SIM_TIMEOUT_MAX 0x10
+
+// Status byte of InDataExchange, InPSL and InDeselect
+#define SIM_STATUS_OK 0x00
+#define SIM_STATUS_TIMEOUT 0x01
+#define SIM_STATUS_CONTEXT 0x27  // No target activated
+
+// Time of the RF side
+#define SIM_POLL_TIME 1000            // One InListPassiveTarget attempt on an empty field
+#define SIM_BITS_PER_BYTE 9           // Data bits and parity
+#define SIM_FRAME_OVERHEAD 3          // PCB and CRC of an ISO14443-4 block
+#define SIM_FRAME_BITS 2              // Start and end of frame
+#define SIM_FIRMWARE_VERSION_IC 0x32  // PN532
+#define SIM_FIRMWARE_VERSION 0x01
+#define SIM_FIRMWARE_REVISION 0x06
+#define SIM_FIRMWARE_SUPPORT 0x07  // ISO14443A, ISO14443B and ISO18092
+
+/**
+ * @brief ACK frame
+ */
+static const uint8_t ACK_FRAME[] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+
+/**
+ * @brief SetSerialBaudRate codes 00h to 08h
+ */
+static const uint32_t BAUD_RATES[] = {
+    9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600, 1288000};
+
+/**
+ * @brief InPSL and PPS bit rate codes 00h to 03h
+ */
+static const uint16_t BIT_RATES[] = {106, 212, 424, 848};
+
+/**
+ * @brief ATS of a DESFire EV1 and later (FSCI 8, 848 kbit/s both ways)
+ */
+static const uint8_t DESFIRE_ATS[] = {0x06, 0x75, 0x77, 0x81, 0x02, 0x80};
+
+/**
+ * @brief Construct the adapter
+ *
+ * @param card Emulated card, must outlive the adapter
+ */
+PN532EmulatedCard::PN532EmulatedCard(DesfireCardEmulator& card) : _card(card) {
+}
+
+/**
+ * @brief Activate the emulated card if it is in the field
+ *
+ * @param target Structure to store the activation data
+ * @return true if the card is present
+ * @return false otherwise
+ */
+bool PN532EmulatedCard::activate(PN532TargetInfo* target) {
+    if (!_card.isPresent()) {
+        return false;
+    }
+
+    _card.activate();
+    target->sensRes[0] = 0x03;
+    target->sensRes[1] = 0x44;
+    target->selRes     = 0x20;
+    target->uidLength  = DF_EMU_UID_SIZE;
+    target->atsLength  = sizeof(DESFIRE_ATS);
+    memcpy(target->uid, _card.getUID(), DF_EMU_UID_SIZE);
+    memcpy(target->ats, DESFIRE_ATS, sizeof(DESFIRE_ATS));
+    return true;
+}
+
+/**
+ * @brief Pass a frame to the emulated card
+ *
+ * @param command Command frame
+ * @param length Length of the command
+ * @param response Buffer to store the answer
+ * @param size Size of the buffer
+ * @param time Pointer to variable that will store the card processing time (microseconds)
+ * @return uint16_t Length of the answer, 0 if the card stays silent
+ */
+uint16_t PN532EmulatedCard::exchange(const uint8_t* command,
+                                     uint16_t       length,
+                                     uint8_t*       response,
+                                     uint16_t       size,
+                                     uint32_t*      time) {
+    uint8_t  answer[DF_EMU_FRAME_DATA + 2];
+    uint16_t answerLength = _card.process(command, length, answer);
+    *time                 = _card.getProcessingTime();
+    if (answerLength > size) {
+        return 0;
+    }
+
+    memcpy(response, answer, answerLength);
+    return answerLength;
+}
+
+/**
+ * @brief Accept any ISO14443A bit rate
+ *
+ * @param kbps Bit rate in kbit/s for both directions
+ * @return true if the bit rate is 106, 212, 424 or 848
+ * @return false otherwise
+ */
+bool PN532EmulatedCard::setBitRate(uint16_t kbps) {
+    return kbps == 106 || kbps == 212 || kbps == 424 || kbps == 848;
+}
+
+/**
+ * @brief Construct a simulator
+ *
+ * @param card Card in the field, nullptr for an empty field
+ * @param host Host interface
+ */
+PN532Simulator::PN532Simulator(PN532SimulatedCard* card, PN532HostInterface host) {
+    _card  = card;
+    _host  = host;
+    _clock = nullptr;
+    reset();
+}
+
+/**
+ * @brief Set the clock that receives the link and RF time
+ *
+ * @param clock Clock to use, nullptr to spend no time
+ */
+void PN532Simulator::setClock(DesfireClock* clock) {
+    _clock = clock;
+}
+
+/**
+ * @brief Replace the card in the field
+ *
+ * @param card Card in the field, nullptr for an empty field
+ */
+void PN532Simulator::setCard(PN532SimulatedCard* card) {
+    _card         = card;
+    _targetActive = false;
+}
+
+/**
+ * @brief Reset to the power-up state
+ */
+void PN532Simulator::reset() {
+    memset(&_stats, 0, sizeof(_stats));
+    memset(&_target, 0, sizeof(_target));
+    _inputLength    = 0;
+    _answerLength   = 0;
+    _ackPending     = false;
+    _answerPending  = false;
+    _sent           = 0;
+    _targetActive   = false;
+    _baudRate       = PN532_SIM_HSU_BAUD;
+    _nextBaudRate   = 0;
+    _bitRate        = BIT_RATES[0];
+    _timeoutCode    = SIM_TIMEOUT_DEFAULT;
+    _passiveRetries = 0xFF;
+}
+
+/**
+ * @brief Receive bytes from the host (HSU)
+ *
+ * @param data Bytes written by the host
+ * @param length Number of bytes
+ */
+void PN532Simulator::write(const uint8_t* data, uint16_t length) {
+    for (uint16_t i = 0; i < length; i++) {
+        receiveByte(data[i]);
+    }
+}
+
+/**
+ * @brief Send bytes to the host (HSU)
+ *
+ * @param data Buffer to store the bytes
+ * @param size Size of the buffer
+ * @return uint16_t Number of bytes stored, 0 if nothing is pending
+ */
+uint16_t PN532Simulator::read(uint8_t* data, uint16_t size) {
+    uint16_t count = 0;
+    while (count < size) {
+        uint16_t       length;
+        const uint8_t* frame = getReadyFrame(&length);
+        if (frame == nullptr) {
+            break;
+        }
+
+        uint16_t chunk = length - _sent;
+        if (chunk > size - count) {
+            chunk = size - count;
+        }
+        memcpy(&data[count], &frame[_sent], chunk);
+        count += chunk;
+        _sent += chunk;
+        if (_sent == length) {
+            consumeFrame();
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Run an I2C write transaction
+ *
+ * @param data Bytes written by the host
+ * @param length Number of bytes
+ */
+void PN532Simulator::i2cWrite(const uint8_t* data, uint16_t length) {
+    write(data, length);
+}
+
+/**
+ * @brief Run an I2C read transaction
+ *
+ * @param data Buffer to store the bytes
+ * @param length Number of bytes read by the host
+ */
+void PN532Simulator::i2cRead(uint8_t* data, uint16_t length) {
+    if (length == 0) {
+        return;
+    }
+
+    uint16_t       frameLength = 0;
+    const uint8_t* frame       = getReadyFrame(&frameLength);
+    memset(data, 0, length);
+    data[0] = (frame != nullptr) ? PN532_STATUS_READY : PN532_STATUS_BUSY;
+
+    // A status poll leaves the frame for the next read
+    if (frame != nullptr && length > 1) {
+        uint16_t count = (length - 1 < frameLength) ? length - 1 : frameLength;
+        memcpy(&data[1], frame, count);
+        consumeFrame();
+    }
+}
+
+/**
+ * @brief Run a full-duplex SPI transaction (chip select low to high)
+ *
+ * @param tx Bytes sent by the host, starting with the direction byte
+ * @param rx Buffer to store the bytes returned to the host
+ * @param length Length of the transaction
+ */
+void PN532Simulator::spiTransfer(const uint8_t* tx, uint8_t* rx, uint16_t length) {
+    if (length == 0) {
+        return;
+    }
+    memset(rx, 0, length);
+
+    uint16_t       frameLength = 0;
+    const uint8_t* frame       = getReadyFrame(&frameLength);
+    switch (tx[0]) {
+        case PN532_SPI_DATA_WRITE:
+            write(&tx[1], length - 1);
+            break;
+
+        case PN532_SPI_STATUS_READ:
+            if (length > 1) {
+                rx[1] = (frame != nullptr) ? PN532_STATUS_READY : PN532_STATUS_BUSY;
+            }
+            break;
+
+        case PN532_SPI_DATA_READ:
+            if (frame != nullptr && length > 1) {
+                uint16_t count = (length - 1 < frameLength) ? length - 1 : frameLength;
+                memcpy(&rx[1], frame, count);
+                consumeFrame();
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Check whether a frame is ready (IRQ line low)
+ *
+ * @return true if the ACK or an answer can be read
+ * @return false otherwise
+ */
+bool PN532Simulator::isReady() const {
+    return _ackPending || _answerPending;
+}
+
+/**
+ * @brief Get the counts of the link
+ *
+ * @return const PN532SimulatorStats& Counts since the last reset
+ */
+const PN532SimulatorStats& PN532Simulator::getStats() const {
+    return _stats;
+}
+
+/**
+ * @brief Get the HSU baud rate in use
+ *
+ * @return uint32_t Baud rate
+ */
+uint32_t PN532Simulator::getBaudRate() const {
+    return _baudRate;
+}
+
+/**
+ * @brief Get the RF bit rate in use
+ *
+ * @return uint16_t Bit rate in kbit/s
+ */
+uint16_t PN532Simulator::getBitRate() const {
+    return _bitRate;
+}
+
+/**
+ * @brief Parse one byte from the host
+ *
+ * @param value Byte
+ */
+void PN532Simulator::receiveByte(uint8_t value) {
+    // Preamble, wake-up bytes and postambles are skipped until 00h FFh
+    if (_inputLength < 2) {
+        if (value == SIM_START_CODE_2 && _inputLength == 1) {
+            _input[_inputLength++] = value;
+        } else if (value == SIM_START_CODE_1) {
+            _input[0]    = value;
+            _inputLength = 1;
+        } else {
+            _inputLength = 0;
+        }
+        return;
+    }
+
+    _input[_inputLength++] = value;
+    bool extended = (_input[2] == SIM_EXTENDED_LENGTH && _input[3] == SIM_EXTENDED_LENGTH);
+
+    if (_inputLength == SIM_NORMAL_HEADER) {
+        if (_input[2] == 0x00 && _input[3] == 0xFF) {
+            // ACK: aborts the running command
+            _stats.acks++;
+            _ackPending    = false;
+            _answerPending = false;
+            _sent          = 0;
+            if (_nextBaudRate != 0) {
+                _baudRate     = _nextBaudRate;
+                _nextBaudRate = 0;
+            }
+            _inputLength = 0;
+        } else if (_input[2] == 0xFF && _input[3] == 0x00) {
+            // NACK: send the last answer again
+            _stats.nacks++;
+            _answerPending = (_answerLength > 0);
+            _sent          = 0;
+            _inputLength   = 0;
+        } else if (!extended &&
+                   (_input[2] == 0 || static_cast<uint8_t>(_input[2] + _input[3]) != 0)) {
+            _stats.errors++;
+            _inputLength = 0;
+        }
+        return;
+    }
+
+    uint16_t header = extended ? SIM_EXTENDED_HEADER : SIM_NORMAL_HEADER;
+    if (extended && _inputLength == SIM_EXTENDED_HEADER) {
+        uint16_t dataLength = (_input[4] << 8) | _input[5];
+        if (static_cast<uint8_t>(_input[4] + _input[5] + _input[6]) != 0 || dataLength == 0 ||
+            dataLength > PN532_SIM_FRAME_DATA) {
+            _stats.errors++;
+            _inputLength = 0;
+        }
+        return;
+    }
+    if (_inputLength <= header) {
+        return;
+    }
+
+    // TFI and data, then DCS
+    uint16_t dataLength = extended ? ((_input[4] << 8) | _input[5]) : _input[2];
+    if (_inputLength == header + dataLength + 1) {
+        handleFrame();
+        _inputLength = 0;
+    }
+}
+
+/**
+ * @brief Handle a complete host frame
+ */
+void PN532Simulator::handleFrame() {
+    bool           extended   = (_input[2] == SIM_EXTENDED_LENGTH);
+    const uint8_t* data       = &_input[extended ? SIM_EXTENDED_HEADER : SIM_NORMAL_HEADER];
+    uint16_t       dataLength = extended ? ((_input[4] << 8) | _input[5]) : _input[2];
+
+    // A frame with a wrong checksum is not acknowledged
+    uint8_t sum = data[dataLength];
+    for (uint16_t i = 0; i < dataLength; i++) {
+        sum += data[i];
+    }
+    if (sum != 0) {
+        _stats.errors++;
+        return;
+    }
+
+    _stats.commands++;
+    _ackPending    = true;
+    _answerPending = false;
+    _sent          = 0;
+    if (dataLength < 2 || data[0] != SIM_TFI_HOST) {
+        answerError();
+    } else {
+        execute(&data[1], dataLength - 1);
+    }
+
+    // Host frame, ACK and answer on the host link
+    spend(getLinkTime(_inputLength + sizeof(ACK_FRAME) + _answerLength));
+}
+
+/**
+ * @brief Execute a command
+ *
+ * @param command Command code and parameters
+ * @param length Length of the command
+ */
+void PN532Simulator::execute(const uint8_t* command, uint16_t length) {
+    uint8_t  answerData[1 + PN532_SIM_MAX_DATA];
+    uint16_t answerLength = 0;
+
+    switch (command[0]) {
+        case SIM_CMD_GET_FIRMWARE_VERSION:
+            answerData[0] = SIM_FIRMWARE_VERSION_IC;
+            answerData[1] = SIM_FIRMWARE_VERSION;
+            answerData[2] = SIM_FIRMWARE_REVISION;
+            answerData[3] = SIM_FIRMWARE_SUPPORT;
+            answerLength  = 4;
+            break;
+
+        case SIM_CMD_SET_SERIAL_BAUD_RATE:
+            // The new rate applies once the host acknowledges the answer
+            if (_host != PN532_HOST_HSU || length != 2 ||
+                command[1] >= sizeof(BAUD_RATES) / sizeof(BAUD_RATES[0])) {
+                answerError();
+                return;
+            }
+            _nextBaudRate = BAUD_RATES[command[1]];
+            break;
+
+        case SIM_CMD_SAM_CONFIGURATION:
+            if (length < 2) {
+                answerError();
+                return;
+            }
+            break;
+
+        case SIM_CMD_RF_CONFIGURATION:
+            if (length < 2) {
+                answerError();
+                return;
+            }
+            if (command[1] == SIM_CFG_TIMINGS && length == 5) {
+                _timeoutCode = command[4];
+            } else if (command[1] == SIM_CFG_MAX_RETRIES && length == 5) {
+                _passiveRetries = command[4];
+            }
+            break;
+
+        case SIM_CMD_IN_LIST_PASSIVE_TARGET: {
+            if (length != 3 || command[1] == 0 || command[1] > 2 || command[2] != 0x00) {
+                answerError();
+                return;
+            }
+
+            _targetActive = (_card != nullptr && _card->activate(&_target));
+            _bitRate      = BIT_RATES[0];
+            if (!_targetActive) {
+                // Retries FFh poll until a card arrives, the host aborts
+                uint32_t attempts = (_passiveRetries == 0xFF) ? 1 : _passiveRetries + 1;
+                spend(attempts * SIM_POLL_TIME);
+                answerData[answerLength++] = 0;
+                break;
+            }
+
+            spend(DF_EMU_ACTIVATION_TIME);
+            answerData[answerLength++] = 1;
+            answerData[answerLength++] = 1;
+            answerData[answerLength++] = _target.sensRes[0];
+            answerData[answerLength++] = _target.sensRes[1];
+            answerData[answerLength++] = _target.selRes;
+            answerData[answerLength++] = _target.uidLength;
+            memcpy(&answerData[answerLength], _target.uid, _target.uidLength);
+            answerLength += _target.uidLength;
+            memcpy(&answerData[answerLength], _target.ats, _target.atsLength);
+            answerLength += _target.atsLength;
+            break;
+        }
+
+        case SIM_CMD_IN_DATA_EXCHANGE: {
+            // The frame size limits the data to PN532_SIM_MAX_DATA
+            if (length < 2) {
+                answerError();
+                return;
+            }
+            if (!_targetActive || command[1] != 1) {
+                answerData[answerLength++] = SIM_STATUS_CONTEXT;
+                break;
+            }
+
+            // A card answering after the communication timeout is lost
+            uint32_t time     = 0;
+            uint16_t received = _card->exchange(
+                &command[2], length - 2, &answerData[1], PN532_SIM_MAX_DATA, &time);
+            uint32_t limit    = getTimeout();
+            spend(getFrameTime(length - 2));
+            if (received == 0 || time > limit) {
+                _stats.timeouts++;
+                spend(limit);
+                answerData[answerLength++] = SIM_STATUS_TIMEOUT;
+                break;
+            }
+
+            spend(time + getFrameTime(received));
+            answerData[0] = SIM_STATUS_OK;
+            answerLength  = 1 + received;
+            break;
+        }
+
+        case SIM_CMD_IN_PSL: {
+            if (length != 4 || command[2] != command[3] ||
+                command[2] >= sizeof(BIT_RATES) / sizeof(BIT_RATES[0])) {
+                answerError();
+                return;
+            }
+            if (!_targetActive || command[1] != 1) {
+                answerData[answerLength++] = SIM_STATUS_CONTEXT;
+                break;
+            }
+
+            // PPS request and response at the old bit rate
+            spend(2 * getFrameTime(2));
+            bool accepted = _card->setBitRate(BIT_RATES[command[2]]);
+            if (accepted) {
+                _bitRate = BIT_RATES[command[2]];
+            }
+            answerData[answerLength++] = accepted ? SIM_STATUS_OK : SIM_STATUS_TIMEOUT;
+            break;
+        }
+
+        case SIM_CMD_IN_DESELECT:
+        case SIM_CMD_IN_RELEASE:
+            if (length != 2) {
+                answerError();
+                return;
+            }
+            answerData[answerLength++] = _targetActive ? SIM_STATUS_OK : SIM_STATUS_CONTEXT;
+            _targetActive              = false;
+            break;
+
+        default:
+            answerError();
+            return;
+    }
+
+    answer(command[0] + 1, answerData, answerLength);
+}
+
+/**
+ * @brief Queue an answer frame
+ *
+ * @param code Command code of the answer (command code + 1)
+ * @param data Answer parameters
+ * @param length Length of the parameters
+ */
+void PN532Simulator::answer(uint8_t code, const uint8_t* data, uint16_t length) {
+    uint16_t dataLength = length + 2;
+    uint16_t pos        = 0;
+
+    _answer[pos++] = 0x00;
+    _answer[pos++] = SIM_START_CODE_1;
+    _answer[pos++] = SIM_START_CODE_2;
+    if (dataLength > SIM_FRAME_NORMAL) {
+        _answer[pos++] = SIM_EXTENDED_LENGTH;
+        _answer[pos++] = SIM_EXTENDED_LENGTH;
+        _answer[pos++] = dataLength >> 8;
+        _answer[pos++] = dataLength & 0xFF;
+        _answer[pos++] = static_cast<uint8_t>(-((dataLength >> 8) + (dataLength & 0xFF)));
+    } else {
+        _answer[pos++] = static_cast<uint8_t>(dataLength);
+        _answer[pos++] = static_cast<uint8_t>(-dataLength);
+    }
+
+    uint8_t sum    = SIM_TFI_PN532 + code;
+    _answer[pos++] = SIM_TFI_PN532;
+    _answer[pos++] = code;
+    for (uint16_t i = 0; i < length; i++) {
+        sum += data[i];
+        _answer[pos++] = data[i];
+    }
+    _answer[pos++] = static_cast<uint8_t>(-sum);
+    _answer[pos++] = 0x00;
+
+    _answerLength  = pos;
+    _answerPending = true;
+}
+
+/**
+ * @brief Queue the syntax error frame
+ */
+void PN532Simulator::answerError() {
+    static const uint8_t ERROR_FRAME[] = {0x00, 0x00, 0xFF, 0x01, 0xFF, SIM_TFI_ERROR, 0x81, 0x00};
+
+    memcpy(_answer, ERROR_FRAME, sizeof(ERROR_FRAME));
+    _answerLength  = sizeof(ERROR_FRAME);
+    _answerPending = true;
+}
+
+/**
+ * @brief Get the frame that is ready to be read
+ *
+ * @param length Pointer to variable that will store the length of the frame
+ * @return const uint8_t* Frame, nullptr if none is ready
+ */
+const uint8_t* PN532Simulator::getReadyFrame(uint16_t* length) const {
+    if (_ackPending) {
+        *length = sizeof(ACK_FRAME);
+        return ACK_FRAME;
+    }
+    if (_answerPending) {
+        *length = _answerLength;
+        return _answer;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Mark the ready frame as read
+ */
+void PN532Simulator::consumeFrame() {
+    if (_ackPending) {
+        _ackPending = false;
+    } else {
+        _answerPending = false;
+    }
+    _sent = 0;
+}
+
+/**
+ * @brief Spend time on the clock
+ *
+ * @param duration Time in microseconds
+ */
+void PN532Simulator::spend(uint32_t duration) {
+    if (_clock != nullptr && duration > 0) {
+        _clock->delayMicros(duration);
+    }
+}
+
+/**
+ * @brief Get the communication timeout
+ *
+ * @return uint32_t Longest card response time in microseconds
+ */
+uint32_t PN532Simulator::getTimeout() const {
+    // Code 00h disables the timeout
+    if (_timeoutCode == 0) {
+        return 0xFFFFFFFF;
+    }
+    uint8_t code = (_timeoutCode > SIM_TIMEOUT_MAX) ? SIM_TIMEOUT_MAX : _timeoutCode;
+    return static_cast<uint32_t>(SIM_TIMEOUT_STEP_US) << (code - 1);
+}
+
+/**
+ * @brief Get the time to move bytes over the host link
+ *
+ * @param bytes Number of bytes
+ * @return uint32_t Time in microseconds
+ */
+uint32_t PN532Simulator::getLinkTime(uint32_t bytes) const {
+    // UART: start and stop bit, I2C: acknowledge bit, SPI: data bits only
+    switch (_host) {
+        case PN532_HOST_I2C:
+            return static_cast<uint32_t>(bytes * 9ULL * 1000000 / PN532_SIM_I2C_CLOCK);
+        case PN532_HOST_SPI:
+            return static_cast<uint32_t>(bytes * 8ULL * 1000000 / PN532_SIM_SPI_CLOCK);
+        default:
+            return static_cast<uint32_t>(bytes * 10ULL * 1000000 / _baudRate);
+    }
+}
+
+/**
+ * @brief Get the RF time of a frame
+ *
+ * @param length Length of the frame data
+ * @return uint32_t Time in microseconds at the current bit rate
+ */
+uint32_t PN532Simulator::getFrameTime(uint16_t length) const {
+    uint32_t bits = (length + SIM_FRAME_OVERHEAD) * SIM_BITS_PER_BYTE + SIM_FRAME_BITS;
+    return bits * 1000 / _bitRate;
+}
@@ -0,0 +1,294 @@
+/**
+ * @file test_main.cpp
+ * @brief Unit tests for AES, CMAC and EV2 secure messaging
+ */
+
+#include <string.h>
+#include <unity.h>
+#include "DesfireCrypto.h"
+#include "DesfireSecureMessaging.h"
+
+// RFC 4493 key and message
+static const uint8_t CMAC_KEY[DF_AES_KEY_SIZE] = {0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+                                                  0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C};
+
+static const uint8_t CMAC_MESSAGE[64] = {
+    0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F, 0x96, 0xE9, 0x3D, 0x7E, 0x11, 0x73, 0x93, 0x17, 0x2A,
+    0xAE, 0x2D, 0x8A, 0x57, 0x1E, 0x03, 0xAC, 0x9C, 0x9E, 0xB7, 0x6F, 0xAC, 0x45, 0xAF, 0x8E, 0x51,
+    0x30, 0xC8, 0x1C, 0x46, 0xA3, 0x5C, 0xE4, 0x11, 0xE5, 0xFB, 0xC1, 0x19, 0x1A, 0x0A, 0x52, 0xEF,
+    0xF6, 0x9F, 0x24, 0x45, 0xDF, 0x4F, 0x9B, 0x17, 0xAD, 0x2B, 0x41, 0x7B, 0xE6, 0x6C, 0x37, 0x10};
+
+// AN12196 EV2 authentication example (all-zero key)
+static const uint8_t EV2_RND_A[16] = {0x13, 0xC5, 0xDB, 0x8A, 0x59, 0x30, 0x43, 0x9F,
+                                      0xC3, 0xDE, 0xF9, 0xA4, 0xC6, 0x75, 0x36, 0x0F};
+
+static const uint8_t EV2_RND_B[16] = {0xB9, 0xE2, 0xFC, 0x78, 0x9B, 0x64, 0xBF, 0x23,
+                                      0x7C, 0xCC, 0xAA, 0x20, 0xEC, 0x7E, 0x6E, 0x48};
+
+static const uint8_t EV2_SES_ENC[16] = {0x13, 0x09, 0xC8, 0x77, 0x50, 0x9E, 0x5A, 0x21,
+                                        0x50, 0x07, 0xFF, 0x0E, 0xD1, 0x9C, 0xA5, 0x64};
+
+static const uint8_t EV2_SES_MAC[16] = {0x4C, 0x66, 0x26, 0xF5, 0xE7, 0x2E, 0xA6, 0x94,
+                                        0x20, 0x21, 0x39, 0x29, 0x5C, 0x7A, 0x7F, 0xC7};
+
+static const uint8_t EV2_TI[4] = {0x9D, 0x00, 0xC4, 0xDF};
+
+static const uint8_t ZERO_KEY[DF_AES_KEY_SIZE] = {0};
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_aes_block(void) {
+    // FIPS-197 appendix C.1
+    uint8_t key[DF_AES_KEY_SIZE];
+    uint8_t plain[DF_AES_BLOCK_SIZE];
+    for (uint8_t i = 0; i < DF_AES_BLOCK_SIZE; i++) {
+        key[i]   = i;
+        plain[i] = i * 0x11;
+    }
+    const uint8_t expected[DF_AES_BLOCK_SIZE] = {0x69, 0xC4, 0xE0, 0xD8, 0x6A, 0x7B, 0x04, 0x30,
+                                                 0xD8, 0xCD, 0xB7, 0x80, 0x70, 0xB4, 0xC5, 0x5A};
+
+    DesfireAES aes(key);
+    uint8_t    block[DF_AES_BLOCK_SIZE];
+    aes.encryptBlock(plain, block);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, block, DF_AES_BLOCK_SIZE);
+
+    aes.decryptBlock(block, block);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(plain, block, DF_AES_BLOCK_SIZE);
+}
+
+void test_aes_cbc_roundtrip(void) {
+    DesfireAES aes(CMAC_KEY);
+    uint8_t    iv[DF_AES_BLOCK_SIZE] = {0};
+    uint8_t    buffer[sizeof(CMAC_MESSAGE)];
+
+    TEST_ASSERT_TRUE(aes.encryptCBC(iv, CMAC_MESSAGE, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(&buffer[48], iv, DF_AES_BLOCK_SIZE);
+
+    memset(iv, 0, sizeof(iv));
+    TEST_ASSERT_TRUE(aes.decryptCBC(iv, buffer, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(CMAC_MESSAGE, buffer, sizeof(buffer));
+
+    TEST_ASSERT_FALSE(aes.encryptCBC(iv, CMAC_MESSAGE, buffer, 15));
+}
+
+/**
+ * @brief Run blocks through every operation, 7 blocks cover parallel and single block paths
+ */
+static void runAESOperations(const DesfireAES& aes, uint8_t* ecb, uint8_t* cbc, uint8_t* iv) {
+    uint8_t plain[7 * DF_AES_BLOCK_SIZE];
+    for (uint8_t i = 0; i < sizeof(plain); i++) {
+        plain[i] = i * 37 + 1;
+    }
+
+    aes.encryptBlocks(plain, ecb, 7);
+    for (uint8_t i = 0; i < 7; i++) {
+        uint8_t block[DF_AES_BLOCK_SIZE];
+        aes.encryptBlock(&plain[i * DF_AES_BLOCK_SIZE], block);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(block, &ecb[i * DF_AES_BLOCK_SIZE], DF_AES_BLOCK_SIZE);
+        aes.decryptBlock(block, block);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(&plain[i * DF_AES_BLOCK_SIZE], block, DF_AES_BLOCK_SIZE);
+    }
+
+    memset(iv, 0xA5, DF_AES_BLOCK_SIZE);
+    TEST_ASSERT_TRUE(aes.encryptCBC(iv, plain, cbc, sizeof(plain)));
+
+    uint8_t decrypted[sizeof(plain)];
+    uint8_t decryptIV[DF_AES_BLOCK_SIZE];
+    memset(decryptIV, 0xA5, sizeof(decryptIV));
+    memcpy(decrypted, cbc, sizeof(decrypted));
+    TEST_ASSERT_TRUE(aes.decryptCBC(decryptIV, decrypted, decrypted, sizeof(decrypted)));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(plain, decrypted, sizeof(plain));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(iv, decryptIV, DF_AES_BLOCK_SIZE);
+}
+
+void test_aes_hardware_matches_portable(void) {
+    uint8_t hardwareECB[7 * DF_AES_BLOCK_SIZE];
+    uint8_t hardwareCBC[7 * DF_AES_BLOCK_SIZE];
+    uint8_t hardwareIV[DF_AES_BLOCK_SIZE];
+    uint8_t portableECB[7 * DF_AES_BLOCK_SIZE];
+    uint8_t portableCBC[7 * DF_AES_BLOCK_SIZE];
+    uint8_t portableIV[DF_AES_BLOCK_SIZE];
+
+    // Keys expanded before a switch keep working in both paths
+    DesfireAES aes(CMAC_KEY);
+    bool       accelerated = DesfireAES::setAccelerated(true);
+    runAESOperations(aes, hardwareECB, hardwareCBC, hardwareIV);
+
+    TEST_ASSERT_FALSE(DesfireAES::setAccelerated(false));
+    runAESOperations(aes, portableECB, portableCBC, portableIV);
+    TEST_ASSERT_EQUAL(accelerated, DesfireAES::setAccelerated(true));
+
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(portableECB, hardwareECB, sizeof(portableECB));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(portableCBC, hardwareCBC, sizeof(portableCBC));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(portableIV, hardwareIV, sizeof(portableIV));
+}
+
+void test_cmac_rfc4493(void) {
+    const uint8_t expected[4][DF_CMAC_SIZE] = {
+        {0xBB, 0x1D, 0x69, 0x29, 0xE9, 0x59, 0x37, 0x28,
+         0x7F, 0xA3, 0x7D, 0x12, 0x9B, 0x75, 0x67, 0x46},
+        {0x07, 0x0A, 0x16, 0xB4, 0x6B, 0x4D, 0x41, 0x44,
+         0xF7, 0x9B, 0xDD, 0x9D, 0xD0, 0x4A, 0x28, 0x7C},
+        {0xDF, 0xA6, 0x67, 0x47, 0xDE, 0x9A, 0xE6, 0x30,
+         0x30, 0xCA, 0x32, 0x61, 0x14, 0x97, 0xC8, 0x27},
+        {0x51, 0xF0, 0xBE, 0xBF, 0x7E, 0x3B, 0x9D, 0x92,
+         0xFC, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3C, 0xFE}};
+    const size_t lengths[4] = {0, 16, 40, 64};
+
+    DesfireAES aes(CMAC_KEY);
+    uint8_t    mac[DF_CMAC_SIZE];
+
+    for (uint8_t i = 0; i < 4; i++) {
+        DesfireCMAC::compute(aes, CMAC_MESSAGE, lengths[i], mac);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected[i], mac, DF_CMAC_SIZE);
+    }
+
+    // Same result when the message is fed in uneven pieces
+    DesfireCMAC cmac(aes);
+    cmac.update(CMAC_MESSAGE, 7);
+    cmac.update(&CMAC_MESSAGE[7], 25);
+    cmac.update(&CMAC_MESSAGE[32], 32);
+    cmac.finish(mac);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected[3], mac, DF_CMAC_SIZE);
+}
+
+/**
+ * @brief Compute a MACt the way the card does, from the known session MAC key
+ */
+static void cardMac(const uint8_t* prefix,
+                    size_t         prefixLength,
+                    const uint8_t* data,
+                    size_t         length,
+                    uint8_t*       mact) {
+    DesfireAES  macKey(EV2_SES_MAC);
+    DesfireCMAC cmac(macKey);
+    uint8_t     mac[DF_CMAC_SIZE];
+    cmac.update(prefix, prefixLength);
+    cmac.update(data, length);
+    cmac.finish(mac);
+    DesfireCMAC::truncate(mac, mact);
+}
+
+void test_secure_messaging_command_mac(void) {
+    DesfireSecureMessaging sm;
+    sm.begin(ZERO_KEY, EV2_RND_A, EV2_RND_B, EV2_TI);
+    TEST_ASSERT_TRUE(sm.isActive());
+    TEST_ASSERT_EQUAL_UINT16(0, sm.getCommandCounter());
+
+    // AN12196 ChangeFileSettings example: file 02, CmdCtr 0001, CommMode.Full
+    const uint8_t header[1] = {0x02};
+    const uint8_t data[15]  = {0x40, 0x00, 0xE0, 0xC1, 0xF1, 0x21, 0x20, 0x00,
+                               0x00, 0x43, 0x00, 0x00, 0x43, 0x00, 0x00};
+    const uint8_t apdu[25]  = {0x02, 0x61, 0xB6, 0xD9, 0x79, 0x03, 0x56, 0x6E, 0x84,
+                               0xC3, 0xAE, 0x52, 0x74, 0x46, 0x7E, 0x89, 0xEA, 0xD7,
+                               0x99, 0xB7, 0xC1, 0xA0, 0xEF, 0x7A, 0x04};
+    uint8_t       output[32];
+    sm.setCommandCounter(1);
+    uint16_t length = sm.wrapCommand(
+        0x5F, header, 1, data, sizeof(data), DF_COMM_ENCRYPT, output, sizeof(output));
+    TEST_ASSERT_EQUAL_UINT16(sizeof(apdu), length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(apdu, output, sizeof(apdu));
+
+    // Output buffer too small
+    length = sm.wrapCommand(
+        0x5F, header, 1, data, sizeof(data), DF_COMM_ENCRYPT, output, sizeof(apdu) - 1);
+    TEST_ASSERT_EQUAL_UINT16(0, length);
+}
+
+void test_secure_messaging_encrypted_response(void) {
+    DesfireSecureMessaging sm;
+    sm.begin(ZERO_KEY, EV2_RND_A, EV2_RND_B, EV2_TI);
+
+    // Card side: encrypt 12 bytes of TMC || TMV with IV = E(KSesAuthENC, 5AA5 || TI || 0100)
+    const uint8_t plain[12] = {
+        0x05, 0x00, 0x00, 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88};
+    DesfireAES    encKey(EV2_SES_ENC);
+    uint8_t       iv[DF_AES_BLOCK_SIZE] = {0x5A, 0xA5, 0x9D, 0x00, 0xC4, 0xDF, 0x01, 0x00};
+    encKey.encryptBlock(iv, iv);
+
+    uint8_t response[DF_AES_BLOCK_SIZE + DF_MACT_SIZE];
+    memcpy(response, plain, sizeof(plain));
+    response[12] = 0x80;
+    memset(&response[13], 0, 3);
+    encKey.encryptCBC(iv, response, response, DF_AES_BLOCK_SIZE);
+
+    const uint8_t prefix[7] = {0x00, 0x01, 0x00, 0x9D, 0x00, 0xC4, 0xDF};
+    cardMac(prefix, sizeof(prefix), response, DF_AES_BLOCK_SIZE, &response[DF_AES_BLOCK_SIZE]);
+
+    // A modified response is rejected and does not advance the counter
+    uint8_t tampered[sizeof(response)];
+    memcpy(tampered, response, sizeof(response));
+    tampered[3] ^= 0x01;
+    uint16_t length = sizeof(tampered);
+    TEST_ASSERT_FALSE(sm.unwrapResponse(0x00, tampered, &length, DF_COMM_ENCRYPT));
+    TEST_ASSERT_EQUAL_UINT16(0, sm.getCommandCounter());
+
+    length = sizeof(response);
+    TEST_ASSERT_TRUE(sm.unwrapResponse(0x00, response, &length, DF_COMM_ENCRYPT));
+    TEST_ASSERT_EQUAL_UINT16(sizeof(plain), length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(plain, response, sizeof(plain));
+    TEST_ASSERT_EQUAL_UINT16(1, sm.getCommandCounter());
+}
+
+void test_secure_messaging_encrypted_command(void) {
+    DesfireSecureMessaging sm;
+    sm.begin(ZERO_KEY, EV2_RND_A, EV2_RND_B, EV2_TI);
+
+    // 16 bytes of data gain a full padding block
+    uint8_t data[DF_AES_BLOCK_SIZE];
+    uint8_t output[64];
+    memset(data, 0xA5, sizeof(data));
+
+    uint16_t length = sm.wrapCommand(
+        0xCE, nullptr, 0, data, sizeof(data), DF_COMM_ENCRYPT, output, sizeof(output));
+    TEST_ASSERT_EQUAL_UINT16(2 * DF_AES_BLOCK_SIZE + DF_MACT_SIZE, length);
+
+    // Card side decryption with IV = E(KSesAuthENC, A55A || TI || 0000)
+    DesfireAES encKey(EV2_SES_ENC);
+    uint8_t    iv[DF_AES_BLOCK_SIZE] = {0xA5, 0x5A, 0x9D, 0x00, 0xC4, 0xDF, 0x00, 0x00};
+    encKey.encryptBlock(iv, iv);
+    uint8_t plain[2 * DF_AES_BLOCK_SIZE];
+    encKey.decryptCBC(iv, output, plain, sizeof(plain));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, plain, sizeof(data));
+    TEST_ASSERT_EQUAL_HEX8(0x80, plain[DF_AES_BLOCK_SIZE]);
+
+    sm.reset();
+    TEST_ASSERT_FALSE(sm.isActive());
+}
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_aes_block);
+    RUN_TEST(test_aes_cbc_roundtrip);
+    RUN_TEST(test_aes_hardware_matches_portable);
+    RUN_TEST(test_cmac_rfc4493);
+    RUN_TEST(test_secure_messaging_command_mac);
+    RUN_TEST(test_secure_messaging_encrypted_response);
+    RUN_TEST(test_secure_messaging_encrypted_command);
+
+    UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif
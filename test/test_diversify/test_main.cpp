@@ -0,0 +1,122 @@
+/**
+ * @file test_main.cpp
+ * @brief Unit tests for AN10922 key diversification
+ */
+
+#include <string.h>
+#include <unity.h>
+#include "DesfireDiversify.h"
+
+// AN10922 AES-128 example
+static const uint8_t MASTER_KEY[DF_AES_KEY_SIZE] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+                                                    0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF};
+
+static const uint8_t UID[7] = {0x04, 0x78, 0x2E, 0x21, 0x80, 0x1D, 0x80};
+
+static const uint8_t AID[DF_DIV_AID_SIZE] = {0x30, 0x42, 0xF5};
+
+static const uint8_t SYSTEM_ID[7] = {0x4E, 0x58, 0x50, 0x20, 0x41, 0x62, 0x75};
+
+static const uint8_t DIVERSIFIED_KEY[DF_AES_KEY_SIZE] = {0xA8, 0xDD, 0x63, 0xA3, 0xB8, 0x9D,
+                                                         0x54, 0xB3, 0x7C, 0xA8, 0x02, 0x47,
+                                                         0x3F, 0xDA, 0x91, 0x75};
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_an10922_example(void) {
+    DesfireKeyDiversifier diversifier(MASTER_KEY, SYSTEM_ID, sizeof(SYSTEM_ID));
+    uint8_t               key[DF_AES_KEY_SIZE];
+
+    TEST_ASSERT_TRUE(diversifier.diversify(UID, sizeof(UID), AID, key));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(DIVERSIFIED_KEY, key, sizeof(key));
+}
+
+void test_full_message_uses_plain_cmac(void) {
+    // A 10-byte UID, the AID and an 18-byte identifier fill both blocks
+    uint8_t message[DF_DIV_MESSAGE_SIZE];
+    message[0] = DF_DIV_CONSTANT_AES128;
+    for (uint8_t i = 1; i <= 10; i++) {
+        message[i] = i;
+    }
+    memcpy(&message[11], AID, sizeof(AID));
+    memset(&message[14], 0x5A, 18);
+
+    DesfireAES cipher(MASTER_KEY);
+    uint8_t    expected[DF_CMAC_SIZE];
+    uint8_t    key[DF_AES_KEY_SIZE];
+    DesfireCMAC::compute(cipher, message, sizeof(message), expected);
+
+    DesfireKeyDiversifier full(MASTER_KEY, &message[14], 18);
+    TEST_ASSERT_TRUE(full.diversify(&message[1], 10, AID, key));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, key, sizeof(key));
+
+    // One byte more does not fit
+    DesfireKeyDiversifier tooLong(MASTER_KEY, &message[13], 19);
+    TEST_ASSERT_FALSE(tooLong.diversify(&message[1], 10, AID, key));
+}
+
+void test_table_matches_single_derivation(void) {
+    static DesfireKeyTableEntry table[2 * DF_DIV_BATCH_LANES + 5];
+    const size_t                count = sizeof(table) / sizeof(table[0]);
+    DesfireKeyDiversifier       diversifier(MASTER_KEY, SYSTEM_ID, sizeof(SYSTEM_ID));
+
+    for (size_t i = 0; i < count; i++) {
+        memcpy(table[i].uid, UID, sizeof(UID));
+        table[i].uid[6]    = static_cast<uint8_t>(i / 2);
+        table[i].uidLength = (i % 5 == 4) ? 4 : sizeof(UID);
+        memcpy(table[i].aid, AID, sizeof(AID));
+        table[i].keyNo = i % 2;
+        memset(table[i].key, 0xEE, sizeof(table[i].key));
+    }
+
+    // Key 1 entries are left for another master key
+    TEST_ASSERT_EQUAL_UINT32((count + 1) / 2, diversifier.deriveTable(table, count, 0));
+    for (size_t i = 0; i < count; i++) {
+        uint8_t key[DF_AES_KEY_SIZE];
+        if (table[i].keyNo == 0) {
+            TEST_ASSERT_TRUE(
+                diversifier.diversify(table[i].uid, table[i].uidLength, table[i].aid, key));
+        } else {
+            memset(key, 0xEE, sizeof(key));
+        }
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(key, table[i].key, sizeof(key));
+    }
+
+    table[0].uid[6] = UID[6];
+    const DesfireKeyTableEntry* entry =
+        DesfireKeyDiversifier::find(table, count, UID, sizeof(UID), AID, 0);
+    TEST_ASSERT_EQUAL_PTR(&table[0], entry);
+    TEST_ASSERT_NULL(DesfireKeyDiversifier::find(table, count, UID, sizeof(UID), AID, 2));
+}
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_an10922_example);
+    RUN_TEST(test_full_message_uses_plain_cmac);
+    RUN_TEST(test_table_matches_single_derivation);
+
+    UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif
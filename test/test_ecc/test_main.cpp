@@ -0,0 +1,144 @@
+/**
+ * @file test_main.cpp
+ * @brief Unit tests for the ECDSA P-224 verifier
+ */
+
+#include <string.h>
+#include <unity.h>
+#include "DesfireECC.h"
+
+// Test key pair generated offline, signature over TEST_UID (no hashing, as NXP does)
+static const uint8_t TEST_PUBLIC_KEY[DF_ECC_PUBLIC_KEY_LENGTH] = {
+    0x04, 0x21, 0x81, 0x24, 0xD1, 0x80, 0xA7, 0xCA, 0x6B, 0xE9, 0x0A, 0x07, 0x3A, 0x06, 0x87,
+    0x4A, 0xF1, 0x52, 0x24, 0x5C, 0x83, 0xCA, 0xC8, 0xCE, 0x14, 0x16, 0xC5, 0x84, 0xEF, 0x42,
+    0x11, 0x51, 0xCD, 0x22, 0xE0, 0x31, 0x9B, 0xB2, 0x28, 0x14, 0x55, 0xCD, 0xF7, 0x6D, 0xD1,
+    0x03, 0xF2, 0x89, 0xF4, 0x98, 0x9D, 0x7D, 0x24, 0xCE, 0x4E, 0x9A, 0xFE};
+
+static const uint8_t TEST_SIGNATURE[DF_ECC_SIGNATURE_LENGTH] = {
+    0x0A, 0xFC, 0x56, 0x02, 0x7A, 0x11, 0x40, 0x29, 0x37, 0x40, 0x41, 0x22, 0x29, 0x4C,
+    0x4B, 0x5F, 0x41, 0xBB, 0xA7, 0xB4, 0x45, 0x71, 0x35, 0x9A, 0xF3, 0x43, 0xB6, 0x24,
+    0x55, 0x45, 0xA1, 0x81, 0x12, 0x47, 0xA4, 0x62, 0xB5, 0xA9, 0xC0, 0xB6, 0x8A, 0x6F,
+    0xB7, 0x44, 0xFA, 0x3E, 0x4A, 0xC1, 0xD7, 0xD1, 0x97, 0xDD, 0x4E, 0xB5, 0xEE, 0xF8};
+
+static const uint8_t TEST_UID[7] = {0x04, 0xE5, 0xF2, 0x3A, 0x89, 0xC5, 0xD1};
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_valid_signature(void) {
+    TEST_ASSERT_TRUE(
+        DesfireECC::verify(TEST_PUBLIC_KEY, TEST_UID, sizeof(TEST_UID), TEST_SIGNATURE));
+
+    // Second run uses the cached comb tables
+    TEST_ASSERT_TRUE(
+        DesfireECC::verify(TEST_PUBLIC_KEY, TEST_UID, sizeof(TEST_UID), TEST_SIGNATURE));
+}
+
+void test_wrong_uid(void) {
+    uint8_t uid[7];
+    memcpy(uid, TEST_UID, sizeof(uid));
+    uid[6] ^= 0x01;
+
+    TEST_ASSERT_FALSE(DesfireECC::verify(TEST_PUBLIC_KEY, uid, sizeof(uid), TEST_SIGNATURE));
+}
+
+void test_tampered_signature(void) {
+    uint8_t signature[DF_ECC_SIGNATURE_LENGTH];
+
+    memcpy(signature, TEST_SIGNATURE, sizeof(signature));
+    signature[3] ^= 0x80;  // r
+    TEST_ASSERT_FALSE(DesfireECC::verify(TEST_PUBLIC_KEY, TEST_UID, sizeof(TEST_UID), signature));
+
+    memcpy(signature, TEST_SIGNATURE, sizeof(signature));
+    signature[50] ^= 0x01;  // s
+    TEST_ASSERT_FALSE(DesfireECC::verify(TEST_PUBLIC_KEY, TEST_UID, sizeof(TEST_UID), signature));
+}
+
+void test_out_of_range_signature(void) {
+    uint8_t signature[DF_ECC_SIGNATURE_LENGTH];
+
+    // r = 0
+    memcpy(signature, TEST_SIGNATURE, sizeof(signature));
+    memset(signature, 0x00, DF_ECC_SCALAR_LENGTH);
+    TEST_ASSERT_FALSE(DesfireECC::verify(TEST_PUBLIC_KEY, TEST_UID, sizeof(TEST_UID), signature));
+
+    // s >= n
+    memcpy(signature, TEST_SIGNATURE, sizeof(signature));
+    memset(&signature[DF_ECC_SCALAR_LENGTH], 0xFF, DF_ECC_SCALAR_LENGTH);
+    TEST_ASSERT_FALSE(DesfireECC::verify(TEST_PUBLIC_KEY, TEST_UID, sizeof(TEST_UID), signature));
+}
+
+void test_invalid_public_key(void) {
+    uint8_t publicKey[DF_ECC_PUBLIC_KEY_LENGTH];
+
+    // Point not on the curve
+    memcpy(publicKey, TEST_PUBLIC_KEY, sizeof(publicKey));
+    publicKey[DF_ECC_PUBLIC_KEY_LENGTH - 1] ^= 0x01;
+    TEST_ASSERT_FALSE(DesfireECC::precompute(publicKey));
+    TEST_ASSERT_FALSE(DesfireECC::verify(publicKey, TEST_UID, sizeof(TEST_UID), TEST_SIGNATURE));
+
+    // Compressed keys are not supported
+    memcpy(publicKey, TEST_PUBLIC_KEY, sizeof(publicKey));
+    publicKey[0] = 0x02;
+    TEST_ASSERT_FALSE(DesfireECC::verify(publicKey, TEST_UID, sizeof(TEST_UID), TEST_SIGNATURE));
+}
+
+void test_key_table_eviction(void) {
+    // Evict the test key from every table slot, its table must be rebuilt correctly
+    static const uint8_t NXP_KEY_DESFIRE_EV2[DF_ECC_PUBLIC_KEY_LENGTH] = {
+        0x04, 0xB3, 0x04, 0xDC, 0x4C, 0x61, 0x5F, 0x53, 0x26, 0xFE, 0x93, 0x83, 0xDD, 0xEC, 0x9A,
+        0xA8, 0x92, 0xDF, 0x3A, 0x57, 0xFA, 0x7F, 0xFB, 0x32, 0x76, 0x19, 0x2B, 0xC0, 0xEA, 0xA2,
+        0x52, 0xED, 0x45, 0xA8, 0x65, 0xE3, 0xB0, 0x93, 0xA3, 0xD0, 0xDC, 0xE5, 0xBE, 0x29, 0xE9,
+        0x2F, 0x13, 0x92, 0xCE, 0x7D, 0xE3, 0x21, 0xE3, 0xE5, 0xC5, 0x2B, 0x3A};
+    static const uint8_t NXP_KEY_DESFIRE_EV3[DF_ECC_PUBLIC_KEY_LENGTH] = {
+        0x04, 0x1D, 0xB4, 0x6C, 0x14, 0x5D, 0x0A, 0x36, 0x53, 0x9C, 0x65, 0x44, 0xBD, 0x6D, 0x9B,
+        0x0A, 0xA6, 0x2F, 0xF9, 0x1E, 0xC4, 0x8C, 0xBC, 0x6A, 0xBA, 0xE3, 0x6E, 0x00, 0x89, 0xA4,
+        0x6F, 0x0D, 0x08, 0xC8, 0xA7, 0x15, 0xEA, 0x40, 0xA6, 0x33, 0x13, 0xB9, 0x2E, 0x90, 0xDD,
+        0xC1, 0x73, 0x02, 0x30, 0xE0, 0x45, 0x8A, 0x33, 0x27, 0x6F, 0xB7, 0x43};
+    static const uint8_t GENERATOR[DF_ECC_PUBLIC_KEY_LENGTH] = {
+        0x04, 0xB7, 0x0E, 0x0C, 0xBD, 0x6B, 0xB4, 0xBF, 0x7F, 0x32, 0x13, 0x90, 0xB9, 0x4A, 0x03,
+        0xC1, 0xD3, 0x56, 0xC2, 0x11, 0x22, 0x34, 0x32, 0x80, 0xD6, 0x11, 0x5C, 0x1D, 0x21, 0xBD,
+        0x37, 0x63, 0x88, 0xB5, 0xF7, 0x23, 0xFB, 0x4C, 0x22, 0xDF, 0xE6, 0xCD, 0x43, 0x75, 0xA0,
+        0x5A, 0x07, 0x47, 0x64, 0x44, 0xD5, 0x81, 0x99, 0x85, 0x00, 0x7E, 0x34};
+
+    TEST_ASSERT_TRUE(DesfireECC::precompute(NXP_KEY_DESFIRE_EV2));
+    TEST_ASSERT_TRUE(DesfireECC::precompute(NXP_KEY_DESFIRE_EV3));
+    TEST_ASSERT_TRUE(DesfireECC::precompute(GENERATOR));
+
+    TEST_ASSERT_TRUE(
+        DesfireECC::verify(TEST_PUBLIC_KEY, TEST_UID, sizeof(TEST_UID), TEST_SIGNATURE));
+}
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_valid_signature);
+    RUN_TEST(test_wrong_uid);
+    RUN_TEST(test_tampered_signature);
+    RUN_TEST(test_out_of_range_signature);
+    RUN_TEST(test_invalid_public_key);
+    RUN_TEST(test_key_table_eviction);
+
+    UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif
@@ -0,0 +1,698 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the library against the emulated card on a virtual clock
+ */
+
+#include <string.h>
+#include <time.h>
+#include <unity.h>
+#include "DesfireEmulator.h"
+#include "DesfireNFC.h"
+
+static const uint8_t UID[DF_EMU_UID_SIZE] = {0x04, 0x52, 0x1C, 0x8A, 0x3B, 0x61, 0x80};
+static const uint8_t AID[3]               = {0x01, 0x02, 0x03};
+static const uint8_t KEY0[DF_AES_KEY_SIZE] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+                                              0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF};
+static const uint8_t KEY1[DF_AES_KEY_SIZE] = {0x01};
+
+enum TestFile : uint8_t {
+    FILE_PLAIN   = 0x01,
+    FILE_MAC     = 0x02,
+    FILE_ENC     = 0x03,
+    FILE_BACKUP  = 0x04,
+    FILE_PRIVATE = 0x05,
+    FILE_TMAC    = 0x0F
+};
+
+/**
+ * @brief Emulated reader with adjustable buffers that records the frames sent
+ */
+class RecordingReader : public DesfireEmulatedReader {
+public:
+    RecordingReader(DesfireCardEmulator& card, DesfireClock& clock)
+        : DesfireEmulatedReader(card, clock), maxReceive(64) {
+        reset();
+    }
+
+    static const int16_t NONE = -1;
+
+    virtual uint16_t getMaxTransmitLength() override {
+        return 255;
+    }
+
+    virtual uint16_t getMaxReceiveLength() override {
+        return maxReceive;
+    }
+
+    virtual bool transceive(const uint8_t* txData,
+                            uint16_t       txLength,
+                            uint8_t*       rxData,
+                            uint16_t*      rxLength) override {
+        // Native frames start with the command, wrapped ones with 90h
+        bool    wrapped = (txData[0] == ISO7816Class::ISO_CLA_DESFIRE && txLength >= 5);
+        uint8_t command = wrapped ? txData[1] : txData[0];
+        frames++;
+        commands[command]++;
+        if (command == DesfireEV2Command::DF_CMD_READ_DATA_ISO && wrapped && txLength >= 12) {
+            uint16_t readLength = txData[9] | (txData[10] << 8);
+            reads++;
+            longestRead = (readLength > longestRead) ? readLength : longestRead;
+        }
+        longest    = (txLength > longest) ? txLength : longest;
+        lastLength = (txLength < sizeof(last)) ? txLength : sizeof(last);
+        memcpy(last, txData, lastLength);
+
+        if (*rxLength > maxReceive) {
+            *rxLength = maxReceive;
+        }
+        if (command == loseCommand) {
+            loseCommand = NONE;
+            return false;
+        }
+        if (!DesfireEmulatedReader::transceive(txData, txLength, rxData, rxLength)) {
+            return false;
+        }
+        if (command == loseResponse) {
+            loseResponse = NONE;
+            return false;
+        }
+
+        // Replace the counter of a GetCommandCounter reply (data, then 91 00 when wrapped)
+        if (command == DesfireEV2Command::DF_CMD_GET_COMMAND_COUNTER && forgedCounter >= 0) {
+            uint8_t offset     = wrapped ? 0 : 1;
+            rxData[offset]     = forgedCounter & 0xFF;
+            rxData[offset + 1] = forgedCounter >> 8;
+            forgedCounter      = NONE;
+        }
+        return true;
+    }
+
+    void reset() {
+        longest     = 0;
+        lastLength  = 0;
+        reads       = 0;
+        longestRead = 0;
+        frames      = 0;
+        memset(commands, 0, sizeof(commands));
+        loseCommand   = NONE;
+        loseResponse  = NONE;
+        forgedCounter = NONE;
+    }
+
+    uint16_t maxReceive;     ///< Receive buffer of the reader
+    uint16_t longest;        ///< Longest frame sent
+    uint8_t  last[32];       ///< Start of the last frame sent
+    uint16_t lastLength;     ///< Bytes in last
+    uint16_t reads;          ///< Wrapped ReadData commands (ADh)
+    uint16_t longestRead;    ///< Longest length requested by one ReadData
+    uint16_t frames;         ///< Frames sent
+    uint16_t commands[256];  ///< Frames sent per command code
+    int16_t  loseCommand;    ///< Next frame of this command never reaches the card
+    int16_t  loseResponse;   ///< Response to the next frame of this command is lost
+    int32_t  forgedCounter;  ///< Counter in the next GetCommandCounter reply
+};
+
+static void addFile(DesfireCardEmulator&    card,
+                    uint8_t                 fileNo,
+                    DesfreFileType          type,
+                    DesfreCommunicationMode commMode,
+                    uint8_t                 readKey,
+                    uint16_t                size,
+                    const uint8_t*          contents = nullptr) {
+    DesfireEmulatorFile file;
+    file.fileNo   = fileNo;
+    file.type     = type;
+    file.commMode = commMode;
+    file.readKey  = readKey;
+    file.writeKey = readKey;
+    file.size     = size;
+    TEST_ASSERT_TRUE(card.addFile(AID, file, contents));
+}
+
+static void setUpCard(DesfireCardEmulator& card) {
+    TEST_ASSERT_TRUE(card.addApplication(AID, KEY0, 2));
+    TEST_ASSERT_TRUE(card.setKey(AID, 1, KEY1));
+    addFile(card, FILE_PLAIN, DF_FILE_STANDARD, DF_COMM_PLAIN, DF_AR_FREE, 32);
+    addFile(card, FILE_MAC, DF_FILE_STANDARD, DF_COMM_MAC, DF_AR_KEY0, 256);
+    addFile(card, FILE_ENC, DF_FILE_STANDARD, DF_COMM_ENCRYPT, DF_AR_KEY0, 64);
+    addFile(card, FILE_BACKUP, DF_FILE_BACKUP, DF_COMM_MAC, DF_AR_KEY0, 32);
+    addFile(card, FILE_PRIVATE, DF_FILE_STANDARD, DF_COMM_ENCRYPT, DF_AR_KEY1, 16);
+    card.setSeed(1);
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_tap_flow(void) {
+    DesfireCardEmulator   card(UID);
+    DesfireVirtualClock   clock;
+    DesfireEmulatedReader reader(card, clock);
+    DesfireNFC            nfc(reader);
+    setUpCard(card);
+
+    uint8_t aid[3];
+    memcpy(aid, AID, sizeof(aid));
+    TEST_ASSERT_TRUE(nfc.initialize());
+    TEST_ASSERT_TRUE(nfc.detectCard());
+
+    DesfireCardStrategy strategy;
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectStrategy(&strategy));
+    TEST_ASSERT_EQUAL_UINT8(DF_AUTH_METHOD_EV2, strategy.authMethod);
+
+    // The cached strategy raises the bit rate on the next activation
+    TEST_ASSERT_EQUAL_UINT16(106, reader.getBitRate());
+    TEST_ASSERT_TRUE(nfc.detectCard());
+    TEST_ASSERT_EQUAL_UINT16(strategy.bitRate, reader.getBitRate());
+
+    // Free access without a session, keyed access needs one
+    uint8_t data[224];
+    uint8_t readBack[224];
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectApplication(aid));
+    memset(data, 0x5A, 32);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.writeData(FILE_PLAIN, 0, 32, data));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.readData(FILE_PLAIN, 0, 32, readBack));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, readBack, 32);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_AUTHENTICATION_ERROR,
+                      nfc.readData(FILE_MAC, 0, 16, readBack, DF_COMM_MAC));
+
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateWithStrategy(0, KEY0));
+    TEST_ASSERT_TRUE(card.isAuthenticated());
+
+    // Chained MAC write and read
+    for (uint16_t i = 0; i < sizeof(data); i++) {
+        data[i] = static_cast<uint8_t>(i * 7);
+    }
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.writeData(FILE_MAC, 16, sizeof(data), data, DF_COMM_MAC));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.readData(FILE_MAC, 16, sizeof(data), readBack, DF_COMM_MAC));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, readBack, sizeof(data));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, card.getFileData(AID, FILE_MAC) + 16, sizeof(data));
+
+    // Encrypted write and read
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.writeData(FILE_ENC, 3, 45, data, DF_COMM_ENCRYPT));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.readData(FILE_ENC, 3, 45, readBack, DF_COMM_ENCRYPT));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, readBack, 45);
+
+    // Backup file: abort restores, commit applies
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.writeData(FILE_BACKUP, 0, 8, data, DF_COMM_MAC));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.abortTransaction());
+    TEST_ASSERT_EQUAL_HEX8(0x00, card.getFileData(AID, FILE_BACKUP)[1]);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.writeData(FILE_BACKUP, 0, 8, data, DF_COMM_MAC));
+    TEST_ASSERT_EQUAL_HEX8(0x00, card.getFileData(AID, FILE_BACKUP)[1]);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.commitTransaction());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, card.getFileData(AID, FILE_BACKUP), 8);
+
+    uint8_t uid[10];
+    uint8_t uidLength = 0;
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.getRealCardUID(uid, &uidLength));
+    TEST_ASSERT_EQUAL_UINT8(DF_EMU_UID_SIZE, uidLength);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(UID, uid, DF_EMU_UID_SIZE);
+
+    uint16_t counter = 0;
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.getCommandCounter(&counter));
+    TEST_ASSERT_EQUAL_UINT16(card.getCommandCounter(), counter);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.setCommandCounter(counter + 100));
+    TEST_ASSERT_EQUAL_UINT16(counter + 100, card.getCommandCounter());
+
+    // Key 1 protects the private file, NonFirst keeps the counter
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_PERMISSION_DENIED,
+                      nfc.readData(FILE_PRIVATE, 0, 16, readBack, DF_COMM_ENCRYPT));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, KEY0));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2NonFirst(1, KEY1));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.readData(FILE_PRIVATE, 0, 16, readBack, DF_COMM_ENCRYPT));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_AUTHENTICATION_ERROR, nfc.authenticateEV2First(1, KEY0));
+    TEST_ASSERT_FALSE(card.isAuthenticated());
+}
+
+void test_virtual_time(void) {
+    DesfireCardEmulator   card(UID);
+    DesfireVirtualClock   virtualClock;
+    DesfireEmulatedReader reader(card, virtualClock);
+    DesfireNFC            nfc(reader);
+    setUpCard(card);
+
+    uint8_t aid[3];
+    uint8_t data[64] = {0};
+    memcpy(aid, AID, sizeof(aid));
+    clock_t start = clock();
+
+    const uint16_t taps = 200;
+    for (uint16_t tap = 0; tap < taps; tap++) {
+        TEST_ASSERT_TRUE(nfc.detectCard());
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectApplication(aid));
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, KEY0));
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                          nfc.readData(FILE_ENC, 0, sizeof(data), data, DF_COMM_ENCRYPT));
+    }
+
+    // Every microsecond spent is either polling or an exchange timed on the clock
+    const DesfireExchangeStats& stats = nfc.getExchangeStats();
+    uint64_t polling = taps * static_cast<uint64_t>(DF_EMU_HOST_LATENCY + DF_EMU_ACTIVATION_TIME);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.failures);
+    TEST_ASSERT_EQUAL_UINT32(taps * 5, stats.exchanges);
+    TEST_ASSERT_TRUE(virtualClock.getElapsed() == polling + stats.totalTime);
+    TEST_ASSERT_TRUE(stats.maxTime > stats.totalTime / stats.exchanges);
+
+    // Seconds of simulated traffic in a fraction of that on the host
+    uint64_t simulated = virtualClock.getElapsed();
+    uint64_t host      = static_cast<uint64_t>(clock() - start) * 1000000 / CLOCKS_PER_SEC;
+    TEST_ASSERT_TRUE(simulated > 2000000);
+    TEST_ASSERT_TRUE(host < simulated);
+
+    // A card that leaves the field costs the frame waiting time
+    nfc.resetExchangeStats();
+    card.setPresent(false);
+    TEST_ASSERT_NOT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                          nfc.readData(FILE_ENC, 0, sizeof(data), data, DF_COMM_ENCRYPT));
+    TEST_ASSERT_EQUAL_UINT32(1, nfc.getExchangeStats().failures);
+    TEST_ASSERT_TRUE(nfc.getExchangeStats().maxTime >= DF_EMU_FRAME_WAIT_TIME);
+    TEST_ASSERT_FALSE(nfc.detectCard());
+}
+
+void test_proximity_check(void) {
+    DesfireCardEmulator   card(UID);
+    DesfireVirtualClock   clock;
+    DesfireEmulatedReader reader(card, clock);
+    DesfireNFC            nfc(reader);
+    setUpCard(card);
+
+    uint8_t aid[3];
+    memcpy(aid, AID, sizeof(aid));
+    TEST_ASSERT_TRUE(nfc.detectCard());
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectStrategy());
+
+    // Native frames at 848 kbit/s keep a round within the limit
+    TEST_ASSERT_TRUE(nfc.detectCard());
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectApplication(aid));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, KEY0));
+
+    DesfireProximityCheck result;
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.proximityCheck(1000, &result));
+    TEST_ASSERT_TRUE(result.maxRoundTrip < 1000);
+
+    // A relay adds its delay to every frame
+    DesfireEmulatorTiming timing = card.getTiming();
+    timing.extraDelay            = 5000;
+    card.setTiming(timing);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_PROXIMITY_ERROR, nfc.proximityCheck(1000, &result));
+}
+
+void test_transaction_mac_file(void) {
+    DesfireCardEmulator   card(UID);
+    DesfireVirtualClock   virtualClock;
+    DesfireEmulatedReader reader(card, virtualClock);
+    DesfireNFC            nfc(reader);
+    setUpCard(card);
+
+    const uint8_t tmKey[DF_AES_KEY_SIZE] = {0x3C, 0x4F, 0x27, 0x91, 0x0D, 0xE2, 0x58, 0xB6,
+                                            0x7A, 0x13, 0xC8, 0x65, 0xF0, 0x2E, 0x94, 0x41};
+    uint8_t       aid[3];
+    memcpy(aid, AID, sizeof(aid));
+    TEST_ASSERT_TRUE(nfc.detectCard());
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectApplication(aid));
+
+    // The key is never sent without a session
+    TEST_ASSERT_EQUAL(
+        DesfireStatus::DFST_AUTHENTICATION_ERROR,
+        nfc.createTransactionMACFile(
+            FILE_TMAC, DF_COMM_MAC, DF_AR_KEY0, DF_AR_KEY1, DF_AR_KEY0, tmKey, 0x07));
+
+    // The card decrypts TMKey || TMKeyVer after the plain five byte header
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, KEY0));
+    TEST_ASSERT_EQUAL(
+        DesfireStatus::DFST_SUCCESS,
+        nfc.createTransactionMACFile(
+            FILE_TMAC, DF_COMM_MAC, DF_AR_KEY0, DF_AR_KEY1, DF_AR_KEY0, tmKey, 0x07));
+    uint8_t        version = 0;
+    const uint8_t* stored  = card.getTransactionMACKey(AID, FILE_TMAC, &version);
+    TEST_ASSERT_NOT_NULL(stored);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(tmKey, stored, DF_AES_KEY_SIZE);
+    TEST_ASSERT_EQUAL_HEX8(0x07, version);
+    TEST_ASSERT_EQUAL_UINT16(card.getCommandCounter(), nfc.getSessionCounter());
+
+    // The new file reads as TMC 0 and an empty TMV, a second one is refused
+    DesfireTransactionMAC tmac;
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.readTransactionMAC(FILE_TMAC, &tmac, DF_COMM_MAC));
+    TEST_ASSERT_EQUAL_UINT32(0, tmac.counter);
+    TEST_ASSERT_EQUAL(
+        DesfireStatus::DFST_DUPLICATE_ERROR,
+        nfc.createTransactionMACFile(
+            0x10, DF_COMM_MAC, DF_AR_KEY0, DF_AR_KEY1, DF_AR_KEY0, tmKey, 0x08));
+}
+
+void test_ats_frame_size(void) {
+    DesfireCardEmulator card(UID);
+    DesfireVirtualClock virtualClock;
+    RecordingReader     reader(card, virtualClock);
+    DesfireNFC          nfc(reader);
+    setUpCard(card);
+
+    // TL, T0 with TA, TB, TC and FSCI 8 (256 bytes), TA, TB, TC
+    const uint8_t ats[5]                     = {0x05, 0x78, 0x77, 0x71, 0x02};
+    const uint8_t masterKey[DF_AES_KEY_SIZE] = {0x00};
+    uint8_t       picc[3]                    = {0x00, 0x00, 0x00};
+    uint8_t       aid[3];
+    uint8_t       data[200];
+    memcpy(aid, AID, sizeof(aid));
+    memset(data, 0xA5, sizeof(data));
+
+    TEST_ASSERT_TRUE(nfc.initialize());
+    TEST_ASSERT_TRUE(nfc.detectCard());
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectStrategy(nullptr));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectApplication(picc));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, masterKey));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.setConfiguration(DF_CONFIG_ATS, ats, sizeof(ats)));
+
+    // The card only answers frames of the activation FSC, 64 bytes with PCB and CRC
+    TEST_ASSERT_EQUAL_UINT16(64, nfc.getStrategy().frameSize);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectApplication(aid));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, KEY0));
+    reader.reset();
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.writeData(FILE_MAC, 0, sizeof(data), data, DF_COMM_MAC));
+    TEST_ASSERT_EQUAL_UINT16(64 - 3, reader.longest);
+
+    // The next activation sends the whole write in one frame, GetVersion keeps the FSC
+    TEST_ASSERT_TRUE(nfc.detectCard());
+    TEST_ASSERT_EQUAL_UINT16(256, nfc.getStrategy().frameSize);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectStrategy(nullptr));
+    TEST_ASSERT_EQUAL_UINT16(256, nfc.getStrategy().frameSize);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectApplication(aid));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, KEY0));
+    reader.reset();
+    data[0] = 0x5A;
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.writeData(FILE_MAC, 0, sizeof(data), data, DF_COMM_MAC));
+    TEST_ASSERT_EQUAL_UINT16(1 + 7 + sizeof(data) + DF_MACT_SIZE, reader.longest);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, card.getFileData(AID, FILE_MAC), sizeof(data));
+}
+
+void test_unknown_card_defaults(void) {
+    DesfireCardEmulator card(UID);
+    DesfireVirtualClock virtualClock;
+    RecordingReader     reader(card, virtualClock);
+    DesfireNFC          nfc(reader);
+    setUpCard(card);
+
+    // Settings of the previous card do not carry over to a card without a cached strategy
+    TEST_ASSERT_TRUE(nfc.detectCard());
+    nfc.setCardFrameSize(256);
+    nfc.setCardProfile(DF_PROFILE_LIGHT);
+    TEST_ASSERT_TRUE(nfc.detectCard());
+    TEST_ASSERT_EQUAL_UINT16(64, nfc.getStrategy().frameSize);
+    TEST_ASSERT_EQUAL(DF_PROFILE_GENERIC, nfc.getCardProfile());
+
+    uint8_t aid[3];
+    uint8_t data[100];
+    memcpy(aid, AID, sizeof(aid));
+    memset(data, 0x3C, sizeof(data));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectApplication(aid));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, KEY0));
+    reader.reset();
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.writeData(FILE_MAC, 0, sizeof(data), data, DF_COMM_MAC));
+    TEST_ASSERT_EQUAL_UINT16(64 - 3, reader.longest);
+}
+
+void test_light_profile(void) {
+    DesfireCardEmulator card(UID);
+    DesfireVirtualClock virtualClock;
+    RecordingReader     reader(card, virtualClock);
+    DesfireNFC          nfc(reader);
+
+    // Part of the factory file set of the Light
+    uint8_t contents[256];
+    for (uint16_t i = 0; i < sizeof(contents); i++) {
+        contents[i] = static_cast<uint8_t>(i * 13 + 1);
+    }
+    TEST_ASSERT_TRUE(card.addApplication(AID, KEY0, 2));
+    addFile(card, 0x00, DF_FILE_STANDARD, DF_COMM_MAC, DF_AR_KEY0, 256, contents);
+    addFile(card, 0x04, DF_FILE_STANDARD, DF_COMM_ENCRYPT, DF_AR_KEY0, 256, contents);
+    addFile(card, 0x1F, DF_FILE_STANDARD, DF_COMM_PLAIN, DF_AR_FREE, 32, contents);
+    card.setLight(true);
+    reader.maxReceive = 48;
+
+    TEST_ASSERT_TRUE(nfc.initialize());
+    TEST_ASSERT_TRUE(nfc.detectCard());
+    DESFireCardVersion version;
+    TEST_ASSERT_TRUE(nfc.getVersion(&version));
+    TEST_ASSERT_EQUAL_HEX8(DF_LIGHT_HARDWARE_TYPE, version.hardwareType);
+    TEST_ASSERT_TRUE(version.isLight());
+    TEST_ASSERT_EQUAL(DF_PROFILE_LIGHT, nfc.getCardProfile());
+
+    // The single application is selected by DF name, whatever AID is given
+    const uint8_t select[] = {0x00, 0xA4, 0x04, 0x0C, 0x10, 0xA0, 0x00, 0x00, 0x03, 0x96, 0x56,
+                              0x43, 0x41, 0x03, 0xF0, 0x15, 0x40, 0x00, 0x00, 0x00, 0x0B};
+    uint8_t       aid[3]   = {0x00, 0x00, 0x00};
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectApplication(aid));
+    TEST_ASSERT_EQUAL_UINT16(sizeof(select), reader.lastLength);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(select, reader.last, sizeof(select));
+
+    // Every ReadData answer fits the 48 byte receive buffer without additional frames
+    uint8_t  readBack[256];
+    uint16_t length = sizeof(readBack);
+    reader.reset();
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.readLightFile(0x1F, readBack, &length, DF_COMM_PLAIN));
+    TEST_ASSERT_EQUAL_UINT16(32, length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(contents, readBack, 32);
+    TEST_ASSERT_EQUAL_UINT16(1, reader.reads);
+
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, KEY0));
+    length = sizeof(readBack);
+    reader.reset();
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.readLightFile(0x00, readBack, &length, DF_COMM_MAC));
+    TEST_ASSERT_EQUAL_UINT16(256, length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(contents, readBack, 256);
+    TEST_ASSERT_EQUAL_UINT16(48 - 2 - DF_MACT_SIZE, reader.longestRead);
+    TEST_ASSERT_EQUAL_UINT16(0, reader.commands[DesfireCommand::DF_CMD_GET_ADDITIONAL_FRAME]);
+
+    // Encrypted chunks leave room for the padding block
+    length = sizeof(readBack);
+    reader.reset();
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.readLightFile(0x04, readBack, &length, DF_COMM_ENCRYPT));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(contents, readBack, 256);
+    TEST_ASSERT_EQUAL_UINT16(31, reader.longestRead);
+    TEST_ASSERT_EQUAL_UINT16(0, reader.commands[DesfireCommand::DF_CMD_GET_ADDITIONAL_FRAME]);
+
+    // A buffer too small for one encrypted block still reads a byte per command
+    reader.maxReceive = 24;
+    reader.reset();
+    TEST_ASSERT_NOT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                          nfc.readData(0x04, 0, 4, readBack, DF_COMM_ENCRYPT));
+    TEST_ASSERT_EQUAL_UINT16(1, reader.longestRead);
+    reader.maxReceive = 48;
+
+    // Only standard and transaction MAC files of the fixed file set are read whole
+    length = 16;
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_BUFFER_TOO_SMALL,
+                      nfc.readLightFile(0x00, readBack, &length, DF_COMM_MAC));
+    length = sizeof(readBack);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_FILE_NOT_FOUND,
+                      nfc.readLightFile(0x01, readBack, &length, DF_COMM_MAC));
+}
+
+void test_application_sweep(void) {
+    DesfireCardEmulator card(UID);
+    DesfireVirtualClock virtualClock;
+    RecordingReader     reader(card, virtualClock);
+    DesfireNFC          nfc(reader);
+
+    uint8_t contents[32];
+    for (uint8_t i = 0; i < sizeof(contents); i++) {
+        contents[i] = static_cast<uint8_t>(0xC0 + i);
+    }
+    TEST_ASSERT_TRUE(card.addApplication(AID, KEY0, 2));
+    TEST_ASSERT_TRUE(card.setKey(AID, 1, KEY1));
+    addFile(card, FILE_PLAIN, DF_FILE_STANDARD, DF_COMM_PLAIN, DF_AR_FREE, 32, contents);
+    addFile(card, FILE_MAC, DF_FILE_STANDARD, DF_COMM_MAC, DF_AR_KEY0, 32, contents);
+    addFile(card, FILE_ENC, DF_FILE_STANDARD, DF_COMM_ENCRYPT, DF_AR_KEY0, 32, contents);
+    addFile(card, FILE_PRIVATE, DF_FILE_STANDARD, DF_COMM_ENCRYPT, DF_AR_KEY1, 16, contents);
+
+    // key0 reads twice, key1 once, the missing file fails alone and ends the session
+    DesfireSweepEntry entries[6] = {
+        {{0x01, 0x02, 0x03}, 0, KEY0, FILE_MAC, 0, 16, DF_COMM_MAC},
+        {{0x01, 0x02, 0x03}, 0, KEY0, FILE_ENC, 4, 8, DF_COMM_ENCRYPT},
+        {{0x01, 0x02, 0x03}, 1, KEY1, FILE_PRIVATE, 0, 16, DF_COMM_ENCRYPT},
+        {{0x01, 0x02, 0x03}, 0, nullptr, FILE_PLAIN, 0, 4, DF_COMM_PLAIN},
+        {{0x01, 0x02, 0x03}, 0, KEY0, 0x09, 0, 4, DF_COMM_MAC},
+        {{0x01, 0x02, 0x03}, 0, KEY0, FILE_MAC, 16, 16, DF_COMM_MAC}};
+    DesfireSweepResult results[6];
+
+    TEST_ASSERT_TRUE(nfc.initialize());
+    TEST_ASSERT_TRUE(nfc.detectCard());
+    reader.reset();
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_FILE_NOT_FOUND,
+                      nfc.readApplicationFiles(entries, results, 6));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, results[0].status);
+    TEST_ASSERT_EQUAL_UINT8(16, results[0].length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(contents, results[0].data, 16);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, results[1].status);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(&contents[4], results[1].data, 8);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, results[2].status);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, results[3].status);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_FILE_NOT_FOUND, results[4].status);
+    TEST_ASSERT_EQUAL_UINT8(0, results[4].length);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, results[5].status);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(&contents[16], results[5].data, 16);
+
+    // One select for the application; key switches in entries 2 and 4 use NonFirst, entry 3
+    // reads in the key1 session and entry 5 starts a new session after the failure
+    TEST_ASSERT_EQUAL_UINT16(1, reader.commands[DesfireCommand::DF_CMD_SELECT_APPLICATION]);
+    TEST_ASSERT_EQUAL_UINT16(2, reader.commands[DesfireEV2Command::DF_CMD_AUTHENTICATE_EV2_FIRST]);
+    TEST_ASSERT_EQUAL_UINT16(2,
+                             reader.commands[DesfireEV2Command::DF_CMD_AUTHENTICATE_EV2_NONFIRST]);
+
+    // A lost card fails the remaining entries without further exchanges
+    card.setPresent(false);
+    reader.reset();
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_COMMUNICATION_ERROR,
+                      nfc.readApplicationFiles(entries, results, 1));
+    uint16_t framesPerFailure = reader.frames;
+    reader.reset();
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_COMMUNICATION_ERROR,
+                      nfc.readApplicationFiles(entries, results, 6));
+    TEST_ASSERT_EQUAL_UINT16(framesPerFailure, reader.frames);
+    for (uint8_t i = 0; i < 6; i++) {
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_COMMUNICATION_ERROR, results[i].status);
+        TEST_ASSERT_EQUAL_UINT8(0, results[i].length);
+    }
+
+    // A card without a strategy that does not answer GetVersion fails every entry
+    DesfireNFC fresh(reader);
+    card.setPresent(true);
+    TEST_ASSERT_TRUE(fresh.detectCard());
+    card.setPresent(false);
+    reader.reset();
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_COMMUNICATION_ERROR,
+                      fresh.readApplicationFiles(entries, results, 6));
+    TEST_ASSERT_EQUAL_UINT16(0, reader.commands[DesfireCommand::DF_CMD_SELECT_APPLICATION]);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_COMMUNICATION_ERROR, results[0].status);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_COMMUNICATION_ERROR, results[5].status);
+}
+
+void test_command_counter_resync(void) {
+    DesfireCardEmulator card(UID);
+    DesfireVirtualClock virtualClock;
+    RecordingReader     reader(card, virtualClock);
+    DesfireNFC          nfc(reader);
+    setUpCard(card);
+
+    uint8_t aid[3];
+    uint8_t data[16];
+    memcpy(aid, AID, sizeof(aid));
+    TEST_ASSERT_TRUE(nfc.detectCard());
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectApplication(aid));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, KEY0));
+
+    // Lost response: the card counted the read, the retry continues from its counter
+    uint16_t counter    = nfc.getSessionCounter();
+    reader.loseResponse = DesfireCommand::DF_CMD_READ_DATA;
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_COMMUNICATION_ERROR,
+                      nfc.readData(FILE_MAC, 0, sizeof(data), data, DF_COMM_MAC));
+    TEST_ASSERT_EQUAL_UINT16(counter + 1, card.getCommandCounter());
+    TEST_ASSERT_EQUAL_UINT16(counter, nfc.getSessionCounter());
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.readData(FILE_MAC, 0, sizeof(data), data, DF_COMM_MAC));
+    TEST_ASSERT_EQUAL_UINT16(1, reader.commands[DesfireEV2Command::DF_CMD_GET_COMMAND_COUNTER]);
+    TEST_ASSERT_EQUAL_UINT16(counter + 2, nfc.getSessionCounter());
+    TEST_ASSERT_EQUAL_UINT16(card.getCommandCounter(), nfc.getSessionCounter());
+
+    // Lost command: the card did not count it, the retry keeps the local counter
+    counter            = nfc.getSessionCounter();
+    reader.loseCommand = DesfireCommand::DF_CMD_READ_DATA;
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_COMMUNICATION_ERROR,
+                      nfc.readData(FILE_MAC, 0, sizeof(data), data, DF_COMM_MAC));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.readData(FILE_MAC, 0, sizeof(data), data, DF_COMM_MAC));
+    TEST_ASSERT_EQUAL_UINT16(counter + 1, nfc.getSessionCounter());
+    TEST_ASSERT_EQUAL_UINT16(card.getCommandCounter(), nfc.getSessionCounter());
+
+    // A forged reply that rolls the counter back ends the session before the retry
+    counter             = nfc.getSessionCounter();
+    reader.loseResponse = DesfireCommand::DF_CMD_READ_DATA;
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_COMMUNICATION_ERROR,
+                      nfc.readData(FILE_MAC, 0, sizeof(data), data, DF_COMM_MAC));
+    reader.reset();
+    reader.forgedCounter = counter - 1;
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_INTEGRITY_ERROR,
+                      nfc.readData(FILE_MAC, 0, sizeof(data), data, DF_COMM_MAC));
+    TEST_ASSERT_EQUAL_UINT16(0, reader.commands[DesfireCommand::DF_CMD_READ_DATA]);
+    TEST_ASSERT_EQUAL_UINT16(0, nfc.getSessionCounter());
+
+    // So does a value that skips ahead, and one that differs without a lost response
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, KEY0));
+    reader.loseResponse = DesfireCommand::DF_CMD_READ_DATA;
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_COMMUNICATION_ERROR,
+                      nfc.readData(FILE_MAC, 0, sizeof(data), data, DF_COMM_MAC));
+    reader.forgedCounter = nfc.getSessionCounter() + 2;
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_INTEGRITY_ERROR,
+                      nfc.readData(FILE_MAC, 0, sizeof(data), data, DF_COMM_MAC));
+    uint16_t value = 0;
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, KEY0));
+    reader.forgedCounter = nfc.getSessionCounter() + 1;
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_INTEGRITY_ERROR, nfc.getCommandCounter(&value));
+    TEST_ASSERT_EQUAL_UINT16(0, nfc.getSessionCounter());
+
+    // An exhausted counter ends the session without sending the command
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, KEY0));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.setCommandCounter(0xFFFE));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.readData(FILE_MAC, 0, sizeof(data), data, DF_COMM_MAC));
+    TEST_ASSERT_EQUAL_UINT16(0xFFFF, nfc.getSessionCounter());
+    reader.reset();
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_AUTHENTICATION_ERROR,
+                      nfc.readData(FILE_MAC, 0, sizeof(data), data, DF_COMM_MAC));
+    TEST_ASSERT_EQUAL_UINT16(0, reader.frames);
+    TEST_ASSERT_EQUAL_UINT16(0, nfc.getSessionCounter());
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, KEY0));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.readData(FILE_MAC, 0, sizeof(data), data, DF_COMM_MAC));
+}
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_tap_flow);
+    RUN_TEST(test_virtual_time);
+    RUN_TEST(test_proximity_check);
+    RUN_TEST(test_transaction_mac_file);
+    RUN_TEST(test_ats_frame_size);
+    RUN_TEST(test_unknown_card_defaults);
+    RUN_TEST(test_light_profile);
+    RUN_TEST(test_application_sweep);
+    RUN_TEST(test_command_counter_resync);
+
+    UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif
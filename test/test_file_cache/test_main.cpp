@@ -0,0 +1,109 @@
+/**
+ * @file test_main.cpp
+ * @brief Unit tests for the counter-validated file cache
+ */
+
+#include <string.h>
+#include <unity.h>
+#include "DesfireFileCache.h"
+
+static const uint8_t UID_A[7] = {0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+static const uint8_t UID_B[7] = {0x04, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC};
+static const uint8_t AID[3]   = {0x01, 0x02, 0x03};
+
+static DesfireFileCache cache;
+static uint8_t          content[64];
+
+void setUp(void) {
+    cache.clear();
+    for (uint8_t i = 0; i < sizeof(content); i++) {
+        content[i] = i;
+    }
+}
+
+void tearDown(void) {
+}
+
+void test_hit_with_same_counter(void) {
+    TEST_ASSERT_TRUE(cache.store(UID_A, 7, AID, 1, 0, sizeof(content), 5, content));
+
+    const uint8_t* cached = cache.lookup(UID_A, 7, AID, 1, 0, sizeof(content), 5);
+    TEST_ASSERT_NOT_NULL(cached);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(content, cached, sizeof(content));
+}
+
+void test_changed_counter_drops_entry(void) {
+    TEST_ASSERT_TRUE(cache.store(UID_A, 7, AID, 1, 0, sizeof(content), 5, content));
+
+    TEST_ASSERT_NULL(cache.lookup(UID_A, 7, AID, 1, 0, sizeof(content), 6));
+
+    // The stale entry is gone even if the counter is seen again
+    TEST_ASSERT_NULL(cache.lookup(UID_A, 7, AID, 1, 0, sizeof(content), 5));
+}
+
+void test_key_mismatch(void) {
+    const uint8_t otherAID[3] = {0x01, 0x02, 0x04};
+    TEST_ASSERT_TRUE(cache.store(UID_A, 7, AID, 1, 0, sizeof(content), 5, content));
+
+    TEST_ASSERT_NULL(cache.lookup(UID_B, 7, AID, 1, 0, sizeof(content), 5));
+    TEST_ASSERT_NULL(cache.lookup(UID_A, 7, otherAID, 1, 0, sizeof(content), 5));
+    TEST_ASSERT_NULL(cache.lookup(UID_A, 7, AID, 2, 0, sizeof(content), 5));
+    TEST_ASSERT_NULL(cache.lookup(UID_A, 7, AID, 1, 8, sizeof(content), 5));
+    TEST_ASSERT_NULL(cache.lookup(UID_A, 4, AID, 1, 0, sizeof(content), 5));
+}
+
+void test_least_recently_used_replaced(void) {
+    for (uint8_t file = 0; file < DF_FILE_CACHE_ENTRIES; file++) {
+        TEST_ASSERT_TRUE(cache.store(UID_A, 7, AID, file, 0, sizeof(content), 1, content));
+    }
+
+    // Touch file 0 so that file 1 becomes the oldest
+    TEST_ASSERT_NOT_NULL(cache.lookup(UID_A, 7, AID, 0, 0, sizeof(content), 1));
+    TEST_ASSERT_TRUE(cache.store(UID_B, 7, AID, 0, 0, sizeof(content), 1, content));
+
+    TEST_ASSERT_NOT_NULL(cache.lookup(UID_A, 7, AID, 0, 0, sizeof(content), 1));
+    TEST_ASSERT_NULL(cache.lookup(UID_A, 7, AID, 1, 0, sizeof(content), 1));
+    TEST_ASSERT_NOT_NULL(cache.lookup(UID_B, 7, AID, 0, 0, sizeof(content), 1));
+}
+
+void test_invalidate_and_limits(void) {
+    static uint8_t large[DF_FILE_CACHE_DATA_SIZE + 1];
+    TEST_ASSERT_FALSE(cache.store(UID_A, 7, AID, 1, 0, sizeof(large), 1, large));
+
+    TEST_ASSERT_TRUE(cache.store(UID_A, 7, AID, 1, 0, sizeof(content), 1, content));
+    TEST_ASSERT_TRUE(cache.store(UID_B, 7, AID, 1, 0, sizeof(content), 1, content));
+    cache.invalidate(UID_A, 7);
+
+    TEST_ASSERT_NULL(cache.lookup(UID_A, 7, AID, 1, 0, sizeof(content), 1));
+    TEST_ASSERT_NOT_NULL(cache.lookup(UID_B, 7, AID, 1, 0, sizeof(content), 1));
+}
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_hit_with_same_counter);
+    RUN_TEST(test_changed_counter_drops_entry);
+    RUN_TEST(test_key_mismatch);
+    RUN_TEST(test_least_recently_used_replaced);
+    RUN_TEST(test_invalidate_and_limits);
+
+    UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif
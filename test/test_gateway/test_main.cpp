@@ -0,0 +1,238 @@
+/**
+ * @file test_main.cpp
+ * @brief Unit tests for the reader gateway worker pool
+ */
+
+#include <unity.h>
+
+#if defined(__linux__)
+
+#include <unistd.h>
+#include <atomic>
+#include "DesfireGateway.h"
+#include "DesfireNFC.h"
+
+/**
+ * @brief Reader without a card, the steps below never use it
+ */
+class IdleReader : public NFCReaderInterface {
+public:
+    bool begin() override {
+        return true;
+    }
+    uint32_t getFirmwareVersion() override {
+        return 0;
+    }
+    bool configure() override {
+        return true;
+    }
+    bool detectCard(uint8_t* uid, uint8_t* uidLength) override {
+        (void)uid;
+        (void)uidLength;
+        return false;
+    }
+    bool transceive(const uint8_t* txData,
+                    uint16_t       txLength,
+                    uint8_t*       rxData,
+                    uint16_t*      rxLength) override {
+        (void)txData;
+        (void)txLength;
+        (void)rxData;
+        (void)rxLength;
+        return false;
+    }
+};
+
+struct StepLog {
+    std::atomic<uint32_t> steps;
+    std::atomic<int16_t>  worker;
+    std::atomic<bool>     moved;
+};
+
+struct SubmitLog {
+    std::atomic<bool>    submitted;
+    std::atomic<uint8_t> accepted;
+};
+
+struct TaskLog {
+    uint32_t value;
+    int16_t  worker;
+};
+
+static IdleReader readers[8];
+
+static void logStep(DesfireGateway& gateway, DesfireNFC& nfc, uint8_t reader, void* context) {
+    (void)gateway;
+    (void)nfc;
+    (void)reader;
+    StepLog* log    = static_cast<StepLog*>(context);
+    int16_t  worker = DesfireGateway::currentWorker();
+    if (log->steps.fetch_add(1) > 0 && log->worker.load() != worker) {
+        log->moved.store(true);
+    }
+    log->worker.store(worker);
+    usleep(1000);
+}
+
+static DesfireStatus squareTask(void* context) {
+    TaskLog* log = static_cast<TaskLog*>(context);
+    log->value   = log->value * log->value;
+    log->worker  = DesfireGateway::currentWorker();
+    return DesfireStatus::DFST_SUCCESS;
+}
+
+static TaskLog stolenTasks[16];
+
+/**
+ * @brief Submit tasks once, then block like a reader waiting for a slow card
+ *
+ * Runs on a worker, so the accepted submissions are counted for the test to check.
+ */
+static void slowStep(DesfireGateway& gateway, DesfireNFC& nfc, uint8_t reader, void* context) {
+    (void)nfc;
+    SubmitLog* log = static_cast<SubmitLog*>(context);
+    if (!log->submitted.exchange(true)) {
+        for (uint8_t i = 0; i < 16; i++) {
+            stolenTasks[i].value    = i;
+            DesfireGatewayTask task = {squareTask, &stolenTasks[i], reader};
+            if (gateway.submit(task)) {
+                log->accepted.fetch_add(1);
+            }
+        }
+    }
+    usleep(200000);
+}
+
+static uint16_t collectAll(DesfireGateway& gateway, DesfireGatewayResult* results, uint16_t count) {
+    uint16_t collected = 0;
+    for (int i = 0; i < 500 && collected < count; i++) {
+        collected += gateway.collect(&results[collected], count - collected);
+        usleep(1000);
+    }
+    return collected;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_readers_stay_on_their_worker(void) {
+    DesfireNFC*    nfc[8];
+    StepLog        logs[8];
+    DesfireGateway gateway(3);
+
+    for (uint8_t i = 0; i < 8; i++) {
+        nfc[i] = new DesfireNFC(readers[i]);
+        logs[i].steps.store(0);
+        logs[i].worker.store(-1);
+        logs[i].moved.store(false);
+        TEST_ASSERT_EQUAL_INT16(i, gateway.addReader(*nfc[i], logStep, &logs[i]));
+    }
+
+    TEST_ASSERT_TRUE(gateway.start());
+    TEST_ASSERT_EQUAL_INT16(-1, gateway.addReader(*nfc[0], logStep, &logs[0]));
+    usleep(50000);
+    gateway.stop();
+
+    for (uint8_t i = 0; i < 8; i++) {
+        TEST_ASSERT_GREATER_THAN_UINT32(1, logs[i].steps.load());
+        TEST_ASSERT_FALSE(logs[i].moved.load());
+        TEST_ASSERT_EQUAL_INT16(gateway.getWorkerOf(i), logs[i].worker.load());
+        delete nfc[i];
+    }
+}
+
+void test_idle_worker_steals_tasks(void) {
+    DesfireNFC           nfc(readers[0]);
+    SubmitLog            log;
+    DesfireGatewayResult results[16];
+    DesfireGateway       gateway(2);
+
+    log.submitted.store(false);
+    log.accepted.store(0);
+    TEST_ASSERT_EQUAL_INT16(0, gateway.addReader(nfc, slowStep, &log));
+    TEST_ASSERT_TRUE(gateway.start());
+    uint16_t collected = collectAll(gateway, results, 16);
+    gateway.stop();
+
+    // Worker 0 is blocked in the slow step, worker 1 runs the tasks
+    TEST_ASSERT_EQUAL_UINT8(16, log.accepted.load());
+    TEST_ASSERT_EQUAL_UINT16(16, collected);
+    uint16_t stolen = 0;
+    for (uint8_t i = 0; i < 16; i++) {
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, results[i].status);
+        TEST_ASSERT_EQUAL_UINT8(0, results[i].reader);
+        TEST_ASSERT_EQUAL_UINT32(i * i, stolenTasks[i].value);
+        stolen += (stolenTasks[i].worker == 1) ? 1 : 0;
+    }
+    TEST_ASSERT_GREATER_THAN_UINT16(8, stolen);
+}
+
+void test_submit_and_collect_without_readers(void) {
+    static TaskLog       logs[DF_GATEWAY_QUEUE_SIZE];
+    DesfireGatewayResult results[DF_GATEWAY_QUEUE_SIZE];
+    DesfireGateway       gateway(4);
+    DesfireGatewayTask   empty = {nullptr, nullptr, 0};
+
+    TEST_ASSERT_FALSE(gateway.submit(empty));
+
+    // Tasks of reader 1 wait on worker 1 until the gateway starts
+    for (uint16_t i = 0; i < DF_GATEWAY_QUEUE_SIZE; i++) {
+        logs[i].value           = i;
+        DesfireGatewayTask task = {squareTask, &logs[i], 1};
+        TEST_ASSERT_TRUE(gateway.submit(task));
+    }
+    DesfireGatewayTask overflow = {squareTask, &logs[0], 1};
+    TEST_ASSERT_FALSE(gateway.submit(overflow));
+    TEST_ASSERT_EQUAL_UINT16(0, gateway.collect(results, DF_GATEWAY_QUEUE_SIZE));
+
+    TEST_ASSERT_TRUE(gateway.start());
+    TEST_ASSERT_FALSE(gateway.start());
+    TEST_ASSERT_EQUAL_UINT16(DF_GATEWAY_QUEUE_SIZE,
+                             collectAll(gateway, results, DF_GATEWAY_QUEUE_SIZE));
+    gateway.stop();
+
+    for (uint16_t i = 0; i < DF_GATEWAY_QUEUE_SIZE; i++) {
+        TEST_ASSERT_EQUAL_UINT32(i * i, logs[i].value);
+        TEST_ASSERT_TRUE(logs[i].worker >= 0 && logs[i].worker < 4);
+    }
+    TEST_ASSERT_EQUAL_INT16(-1, DesfireGateway::currentWorker());
+}
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_readers_stay_on_their_worker);
+    RUN_TEST(test_idle_worker_steals_tasks);
+    RUN_TEST(test_submit_and_collect_without_readers);
+
+    UNITY_END();
+}
+
+#else
+void process(void) {
+    // The gateway is only available on Linux
+    UNITY_BEGIN();
+    UNITY_END();
+}
+#endif
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif
@@ -177,11 +177,11 @@ public:
                     uint16_t*      rxLength) override {
         // Store the last command sent for testing
         if (txLength > 0) {
-            _lastCommandSent = txData[4];  // Command code is at index 4 in APDU
+            _lastCommandSent = txData[1];  // Command code is the INS byte of the APDU
         }
 
         // Simulate DESFire responses based on the command
-        DesfireCommand cmd = static_cast<DesfireCommand>(txData[4]);
+        DesfireCommand cmd = static_cast<DesfireCommand>(txData[1]);
         switch (cmd) {
             case DesfireCommand::DF_CMD_GET_VERSION:
                 // Simulate GetVersion response (success)
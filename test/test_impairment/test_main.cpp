@@ -0,0 +1,203 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the impaired channel around the emulated reader
+ */
+
+#include <string.h>
+#include <unity.h>
+#include "DesfireEmulator.h"
+#include "DesfireImpairment.h"
+#include "DesfireNFC.h"
+
+static const uint8_t  UID[DF_EMU_UID_SIZE] = {0x04, 0x3F, 0x71, 0x0A, 0x92, 0x5C, 0x80};
+static const uint8_t  AID[3]               = {0x01, 0x02, 0x03};
+static const uint8_t  KEY[DF_AES_KEY_SIZE] = {0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+                                              0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C};
+static const uint8_t  FILE_ENC             = 0x01;
+static const uint8_t  FILE_BACKUP          = 0x02;
+static const uint16_t FILE_SIZE            = 64;
+
+/**
+ * @brief Card, reader and library of one test
+ */
+struct Bench {
+    DesfireCardEmulator   card;
+    DesfireVirtualClock   clock;
+    DesfireEmulatedReader emulated;
+    DesfireImpairedReader reader;
+    DesfireNFC            nfc;
+
+    explicit Bench(uint32_t seed)
+        : card(UID), emulated(card, clock), reader(emulated, seed), nfc(reader) {
+        DesfireEmulatorFile file;
+        file.fileNo   = FILE_ENC;
+        file.type     = DF_FILE_STANDARD;
+        file.commMode = DF_COMM_ENCRYPT;
+        file.readKey  = DF_AR_KEY0;
+        file.writeKey = DF_AR_KEY0;
+        file.size     = FILE_SIZE;
+        card.addApplication(AID, KEY, 1);
+        card.addFile(AID, file, nullptr);
+        file.fileNo   = FILE_BACKUP;
+        file.type     = DF_FILE_BACKUP;
+        file.commMode = DF_COMM_MAC;
+        card.addFile(AID, file, nullptr);
+    }
+
+    /**
+     * @brief Run a tap: select, authenticate and read the encrypted file
+     */
+    DesfireStatus tap() {
+        uint8_t aid[3];
+        uint8_t data[FILE_SIZE];
+        memcpy(aid, AID, sizeof(aid));
+        if (!nfc.detectCard()) {
+            return DesfireStatus::DFST_COMMUNICATION_ERROR;
+        }
+        DesfireStatus status = nfc.selectApplication(aid);
+        if (status == DesfireStatus::DFST_SUCCESS) {
+            status = nfc.authenticateEV2First(0, KEY);
+        }
+        if (status == DesfireStatus::DFST_SUCCESS) {
+            status = nfc.readData(FILE_ENC, 0, sizeof(data), data, DF_COMM_ENCRYPT);
+        }
+        return status;
+    }
+
+    /**
+     * @brief Wait until a removed card is back and detected
+     */
+    void retap() {
+        while (!nfc.detectCard()) {
+        }
+    }
+};
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_clean_channel(void) {
+    Bench bench(1);
+    for (uint8_t i = 0; i < 20; i++) {
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, bench.tap());
+    }
+
+    // Nothing is lost and the channel time is the exchange time of the library
+    const DesfireImpairmentStats& stats = bench.reader.getStats();
+    TEST_ASSERT_EQUAL_UINT32(stats.exchanges, stats.delivered);
+    TEST_ASSERT_EQUAL_UINT32(bench.nfc.getExchangeStats().exchanges, stats.exchanges);
+    TEST_ASSERT_TRUE(stats.time == bench.nfc.getExchangeStats().totalTime);
+    TEST_ASSERT_TRUE(bench.reader.getThroughput() > 0);
+
+    // Undetected bit errors reach the secure messaging checks
+    DesfireImpairment impairment = DesfireImpairedReader::getPreset(DF_IMPAIR_CLEAN);
+    impairment.bitErrorRate      = DF_IMPAIR_SCALE / 64;
+    impairment.crcCheck          = false;
+    bench.reader.setImpairment(impairment);
+    TEST_ASSERT_NOT_EQUAL(DesfireStatus::DFST_SUCCESS, bench.tap());
+    TEST_ASSERT_TRUE(bench.reader.getStats().corrupted > 0);
+}
+
+void test_seeded_runs_repeat(void) {
+    Bench first(42);
+    Bench second(42);
+    Bench other(43);
+    first.reader.setImpairment(DesfireImpairedReader::getPreset(DF_IMPAIR_EDGE));
+    second.reader.setImpairment(DesfireImpairedReader::getPreset(DF_IMPAIR_EDGE));
+    other.reader.setImpairment(DesfireImpairedReader::getPreset(DF_IMPAIR_EDGE));
+
+    for (uint16_t i = 0; i < 200; i++) {
+        TEST_ASSERT_EQUAL(first.tap(), second.tap());
+        other.tap();
+    }
+    TEST_ASSERT_EQUAL_MEMORY(&first.reader.getStats(),
+                             &second.reader.getStats(),
+                             sizeof(DesfireImpairmentStats));
+    TEST_ASSERT_TRUE(first.clock.getElapsed() == second.clock.getElapsed());
+    TEST_ASSERT_TRUE(first.clock.getElapsed() != other.clock.getElapsed());
+}
+
+void test_throughput_per_profile(void) {
+    const DesfireImpairmentPreset presets[] = {DF_IMPAIR_CLEAN, DF_IMPAIR_NOISY, DF_IMPAIR_EDGE};
+    uint32_t                      throughput[3];
+    uint16_t                      completed[3];
+
+    for (uint8_t p = 0; p < 3; p++) {
+        Bench bench(7);
+        bench.reader.setImpairment(DesfireImpairedReader::getPreset(presets[p]));
+        completed[p] = 0;
+        for (uint16_t i = 0; i < 500; i++) {
+            if (bench.tap() == DesfireStatus::DFST_SUCCESS) {
+                completed[p]++;
+            }
+        }
+        throughput[p] = bench.reader.getThroughput();
+    }
+
+    TEST_ASSERT_EQUAL_UINT16(500, completed[0]);
+    TEST_ASSERT_TRUE(completed[1] < completed[0] && completed[2] < completed[1]);
+    TEST_ASSERT_TRUE(throughput[1] < throughput[0] && throughput[2] < throughput[1]);
+}
+
+void test_tearing(void) {
+    Bench   bench(3);
+    uint8_t data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, bench.tap());
+
+    // Removed before the commit reached the card: the backup file keeps its contents
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      bench.nfc.writeData(FILE_BACKUP, 0, sizeof(data), data, DF_COMM_MAC));
+    uint64_t removed = bench.clock.getElapsed();
+    bench.reader.tearNextExchange(false);
+    TEST_ASSERT_NOT_EQUAL(DesfireStatus::DFST_SUCCESS, bench.nfc.commitTransaction());
+    TEST_ASSERT_TRUE(bench.reader.isRemoved());
+    TEST_ASSERT_FALSE(bench.nfc.detectCard());
+    TEST_ASSERT_EQUAL_HEX8(0x00, bench.card.getFileData(AID, FILE_BACKUP)[0]);
+
+    // The card is back after the removal time, the open transaction is gone
+    bench.retap();
+    TEST_ASSERT_TRUE(bench.clock.getElapsed() - removed >= DF_IMPAIR_REMOVAL_TIME);
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, bench.tap());
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, bench.nfc.commitTransaction());
+    TEST_ASSERT_EQUAL_HEX8(0x00, bench.card.getFileData(AID, FILE_BACKUP)[0]);
+
+    // Removed after the card executed the commit: the data is written, the host cannot tell
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      bench.nfc.writeData(FILE_BACKUP, 0, sizeof(data), data, DF_COMM_MAC));
+    bench.reader.tearNextExchange(true);
+    TEST_ASSERT_NOT_EQUAL(DesfireStatus::DFST_SUCCESS, bench.nfc.commitTransaction());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, bench.card.getFileData(AID, FILE_BACKUP), sizeof(data));
+    TEST_ASSERT_EQUAL_UINT32(2, bench.reader.getStats().removals);
+}
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_clean_channel);
+    RUN_TEST(test_seeded_runs_repeat);
+    RUN_TEST(test_throughput_per_profile);
+    RUN_TEST(test_tearing);
+
+    UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif
@@ -0,0 +1,152 @@
+/**
+ * @file test_main.cpp
+ * @brief Unit tests for the capability container and streaming NDEF parser
+ */
+
+#include <string.h>
+#include <unity.h>
+#include "DesfireNDEF.h"
+
+// URI record "https://www.example.com" followed by text record "Visitor 42" (en)
+static const uint8_t MESSAGE[] = {0x91, 0x01, 0x0C, 0x55, 0x02, 'e',  'x',  'a',  'm',  'p',  'l',
+                                  'e',  '.',  'c',  'o',  'm',  0x51, 0x01, 0x0D, 0x54, 0x02, 'e',
+                                  'n',  'V',  'i',  's',  'i',  't',  'o',  'r',  ' ',  '4',  '2'};
+
+// Length of the URI record within MESSAGE
+static const size_t URI_RECORD_LENGTH = 16;
+
+// Mapping version 2.0, MLe 0x003B, MLc 0x0034, NDEF file E104 of 0x0800 bytes, free read
+static const uint8_t CC[NDEF_CC_LENGTH] = {0x00, 0x0F, 0x20, 0x00, 0x3B, 0x00, 0x34, 0x04,
+                                           0x06, 0xE1, 0x04, 0x08, 0x00, 0x00, 0xFF};
+
+struct Collected {
+    uint8_t count;
+    bool    stopAfterFirst;
+    char    uri[64];
+    char    text[64];
+    bool    lastHadPayload;
+};
+
+static Collected collected;
+
+static bool collect(const NDEFRecord& record, void* context) {
+    Collected* result = static_cast<Collected*>(context);
+    result->count++;
+    result->lastHadPayload = record.payload != nullptr;
+    NDEFParser::decodeURI(record, result->uri, sizeof(result->uri));
+    NDEFParser::decodeText(record, result->text, sizeof(result->text));
+    return !result->stopAfterFirst;
+}
+
+void setUp(void) {
+    memset(&collected, 0, sizeof(collected));
+}
+
+void tearDown(void) {
+}
+
+void test_whole_message(void) {
+    NDEFParser parser(collect, &collected);
+
+    TEST_ASSERT_TRUE(parser.feed(MESSAGE, sizeof(MESSAGE)));
+    TEST_ASSERT_TRUE(parser.isComplete());
+    TEST_ASSERT_EQUAL_UINT8(2, collected.count);
+    TEST_ASSERT_EQUAL_STRING("https://www.example.com", collected.uri);
+    TEST_ASSERT_EQUAL_STRING("Visitor 42", collected.text);
+}
+
+void test_record_available_as_bytes_arrive(void) {
+    NDEFParser parser(collect, &collected);
+
+    for (size_t i = 0; i < URI_RECORD_LENGTH; i++) {
+        TEST_ASSERT_EQUAL_UINT8(0, collected.count);
+        TEST_ASSERT_TRUE(parser.feed(&MESSAGE[i], 1));
+    }
+    TEST_ASSERT_EQUAL_UINT8(1, collected.count);
+    TEST_ASSERT_EQUAL_STRING("https://www.example.com", collected.uri);
+    TEST_ASSERT_FALSE(parser.isComplete());
+
+    TEST_ASSERT_TRUE(parser.feed(&MESSAGE[URI_RECORD_LENGTH], 7));
+    TEST_ASSERT_TRUE(parser.feed(&MESSAGE[URI_RECORD_LENGTH + 7],
+                                 sizeof(MESSAGE) - URI_RECORD_LENGTH - 7));
+    TEST_ASSERT_TRUE(parser.isComplete());
+    TEST_ASSERT_EQUAL_UINT8(2, collected.count);
+}
+
+void test_callback_stops_parsing(void) {
+    NDEFParser parser(collect, &collected);
+    collected.stopAfterFirst = true;
+
+    TEST_ASSERT_TRUE(parser.feed(MESSAGE, URI_RECORD_LENGTH));
+    TEST_ASSERT_TRUE(parser.isComplete());
+    TEST_ASSERT_TRUE(parser.feed(&MESSAGE[URI_RECORD_LENGTH], 4));
+    TEST_ASSERT_EQUAL_UINT8(1, collected.count);
+}
+
+void test_long_record_and_malformed(void) {
+    NDEFParser parser(collect, &collected);
+
+    // Long record header with a 4-byte payload length of 300 and an ID
+    static uint8_t longRecord[9 + 300];
+    const uint8_t  header[] = {0xCA, 0x01, 0x00, 0x00, 0x01, 0x2C, 0x01, 'X', 'I'};
+    memcpy(longRecord, header, sizeof(header));
+    TEST_ASSERT_TRUE(parser.feed(longRecord, sizeof(header) + 300));
+    TEST_ASSERT_TRUE(parser.isComplete());
+    TEST_ASSERT_EQUAL_UINT8(1, collected.count);
+    TEST_ASSERT_FALSE(collected.lastHadPayload);
+
+    // Chunked records and a first record without MB are rejected
+    const uint8_t chunked[] = {0xB1, 0x01, 0x00, 0x55};
+    parser.reset();
+    TEST_ASSERT_FALSE(parser.feed(chunked, sizeof(chunked)));
+    parser.reset();
+    TEST_ASSERT_FALSE(parser.feed(&MESSAGE[URI_RECORD_LENGTH], 4));
+}
+
+void test_capability_container(void) {
+    NDEFCapabilityContainer cc;
+    TEST_ASSERT_TRUE(NDEFParser::parseCapabilityContainer(CC, sizeof(CC), &cc));
+    TEST_ASSERT_EQUAL_HEX8(0x20, cc.mappingVersion);
+    TEST_ASSERT_EQUAL_UINT16(0x3B, cc.maxReadLength);
+    TEST_ASSERT_EQUAL_UINT16(0x34, cc.maxCommandLength);
+    TEST_ASSERT_EQUAL_HEX16(0xE104, cc.fileId);
+    TEST_ASSERT_EQUAL_UINT16(0x800, cc.maxNdefSize);
+    TEST_ASSERT_EQUAL_HEX8(0x00, cc.readAccess);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, cc.writeAccess);
+
+    uint8_t broken[NDEF_CC_LENGTH];
+    memcpy(broken, CC, sizeof(CC));
+    broken[7] = 0x05;
+    TEST_ASSERT_FALSE(NDEFParser::parseCapabilityContainer(broken, sizeof(broken), &cc));
+    TEST_ASSERT_FALSE(NDEFParser::parseCapabilityContainer(CC, sizeof(CC) - 1, &cc));
+}
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_whole_message);
+    RUN_TEST(test_record_available_as_bytes_arrive);
+    RUN_TEST(test_callback_stops_parsing);
+    RUN_TEST(test_long_record_and_malformed);
+    RUN_TEST(test_capability_container);
+
+    UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif
@@ -0,0 +1,283 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests for the PC/SC reader against a reader or a virtual smart card
+ *
+ * Runs against the first PC/SC reader, for example vpcd from vsmartcard with
+ * vicc as the card. The tests are ignored when no reader or card is present;
+ * with DESFIRE_PCSC_REQUIRE_READER defined, a missing reader fails them. On
+ * Linux, an emulated DESFire card connects to vpcd and DesfireNFC runs a
+ * session through it.
+ */
+
+#include <string.h>
+#include <unity.h>
+#include "PCSCReader.h"
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "DesfireEmulator.h"
+#include "DesfireNFC.h"
+#endif
+
+// CI runs with vpcd, where a missing reader is a failure
+#ifdef DESFIRE_PCSC_REQUIRE_READER
+#define PCSC_MISSING(message) TEST_FAIL_MESSAGE(message)
+#else
+#define PCSC_MISSING(message) TEST_IGNORE_MESSAGE(message)
+#endif
+
+static PCSCReader* reader = nullptr;
+
+#if defined(__linux__)
+static pid_t cardProcess = -1;  // Emulated card connected to vpcd
+#endif
+
+void setUp(void) {
+    reader = new PCSCReader();
+}
+
+void tearDown(void) {
+    delete reader;
+    reader = nullptr;
+
+#if defined(__linux__)
+    // The card leaves the reader with its process
+    if (cardProcess > 0) {
+        kill(cardProcess, SIGTERM);
+        waitpid(cardProcess, nullptr, 0);
+        cardProcess = -1;
+    }
+#endif
+}
+
+void test_begin_selects_reader(void) {
+    if (!reader->begin()) {
+        PCSC_MISSING("No PC/SC reader");
+    }
+
+    TEST_ASSERT_TRUE(reader->configure());
+    TEST_ASSERT_NOT_EQUAL(0, reader->getFirmwareVersion());
+    TEST_ASSERT_NOT_EQUAL('\0', reader->getReaderName()[0]);
+    TEST_ASSERT_FALSE(reader->supportsNativeFrames());
+    TEST_ASSERT_TRUE(reader->setBitRate(848));
+
+    // DESFire cards only take short APDUs, whatever the reader supports
+    TEST_ASSERT_EQUAL_UINT16(PCSC_SHORT_APDU_SIZE, reader->getMaxTransmitLength());
+    TEST_ASSERT_EQUAL_UINT16(PCSC_SHORT_RESPONSE, reader->getMaxReceiveLength());
+}
+
+void test_transceive_returns_status_word(void) {
+    uint8_t  uid[10];
+    uint8_t  uidLength      = 0;
+    uint8_t  getChallenge[] = {0x00, 0x84, 0x00, 0x00, 0x08};
+    uint8_t  rx[PCSC_SHORT_RESPONSE];
+    uint16_t rxLength = sizeof(rx);
+
+    if (!reader->begin()) {
+        TEST_IGNORE_MESSAGE("No PC/SC reader");
+    }
+    if (!reader->detectCard(uid, &uidLength)) {
+        TEST_IGNORE_MESSAGE("No card on the PC/SC reader");
+    }
+
+    TEST_ASSERT_LESS_OR_EQUAL_UINT8(sizeof(uid), uidLength);
+    TEST_ASSERT_TRUE(reader->transceive(getChallenge, sizeof(getChallenge), rx, &rxLength));
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT16(2, rxLength);
+
+    // Detecting again resets the card and connects to it anew
+    rxLength = sizeof(rx);
+    TEST_ASSERT_TRUE(reader->detectCard(uid, &uidLength));
+    TEST_ASSERT_TRUE(reader->transceive(getChallenge, sizeof(getChallenge), rx, &rxLength));
+}
+
+void test_unknown_reader_fails(void) {
+    PCSCReader missing("No such PC/SC reader");
+    uint8_t    uid[10];
+    uint8_t    uidLength;
+
+    TEST_ASSERT_FALSE(missing.begin());
+    TEST_ASSERT_FALSE(missing.configure());
+    TEST_ASSERT_EQUAL_UINT32(0, missing.getFirmwareVersion());
+    TEST_ASSERT_FALSE(missing.detectCard(uid, &uidLength));
+}
+
+#if defined(__linux__)
+
+// vpcd from vsmartcard: the card of the first slot connects to this port
+#define VPCD_READER "Virtual PCD"
+#define VPCD_PORT 35963
+#define VPCD_CTRL_OFF 0x00
+#define VPCD_CTRL_ON 0x01
+#define VPCD_CTRL_RESET 0x02
+#define VPCD_CTRL_ATR 0x04
+#define VPCD_CARD_WAIT 50  // detectCard() attempts while the card connects
+
+static const uint8_t CARD_UID[DF_EMU_UID_SIZE] = {0x04, 0x51, 0x7C, 0x2A, 0x93, 0x6E, 0x80};
+static const uint8_t CARD_AID[3]               = {0x0A, 0x0B, 0x0C};
+static const uint8_t CARD_KEY[DF_AES_KEY_SIZE] = {0x10, 0x32, 0x54, 0x76, 0x98, 0xBA, 0xDC, 0xFE,
+                                                  0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF};
+
+// Contactless ATR of an ISO 14443-4 card without historical bytes (PC/SC part 3)
+static const uint8_t CARD_ATR[] = {0x3B, 0x80, 0x80, 0x01, 0x01};
+
+/**
+ * @brief Receive one vpcd message: 2-byte big-endian length and data
+ */
+static bool receiveMessage(int socket, uint8_t* data, uint16_t size, uint16_t* length) {
+    uint8_t header[2];
+    if (recv(socket, header, sizeof(header), MSG_WAITALL) != sizeof(header)) {
+        return false;
+    }
+    *length = (header[0] << 8) | header[1];
+    return *length <= size && recv(socket, data, *length, MSG_WAITALL) == *length;
+}
+
+/**
+ * @brief Send one vpcd message
+ */
+static bool sendMessage(int socket, const uint8_t* data, uint16_t length) {
+    uint8_t header[2] = {static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length & 0xFF)};
+    return send(socket, header, sizeof(header), 0) == sizeof(header) &&
+           send(socket, data, length, 0) == length;
+}
+
+/**
+ * @brief Connect an emulated card to vpcd and answer its APDUs until it disconnects
+ */
+static void runVirtualCard() {
+    int                socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family      = AF_INET;
+    address.sin_port        = htons(VPCD_PORT);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (socket < 0 || connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address))) {
+        _exit(1);
+    }
+
+    DesfireCardEmulator card(CARD_UID);
+    DesfireEmulatorFile file;
+    file.fileNo   = 0x01;
+    file.type     = DF_FILE_STANDARD;
+    file.commMode = DF_COMM_ENCRYPT;
+    file.readKey  = DF_AR_KEY0;
+    file.writeKey = DF_AR_KEY0;
+    file.size     = 1024;
+    card.addApplication(CARD_AID, CARD_KEY, 1);
+    card.addFile(CARD_AID, file, nullptr);
+
+    uint8_t  command[PCSC_SHORT_APDU_SIZE];
+    uint8_t  answer[DF_EMU_FRAME_DATA + 2];
+    uint16_t length;
+    while (receiveMessage(socket, command, sizeof(command), &length)) {
+        uint16_t answerLength = 0;
+        if (length == 1) {
+            // Power and ATR requests, only the ATR is answered
+            if (command[0] == VPCD_CTRL_ON || command[0] == VPCD_CTRL_RESET) {
+                card.activate();
+            } else if (command[0] == VPCD_CTRL_ATR &&
+                       !sendMessage(socket, CARD_ATR, sizeof(CARD_ATR))) {
+                break;
+            }
+            continue;
+        }
+
+        // Contactless readers answer GET DATA for the UID themselves
+        if (length == 5 && command[0] == 0xFF && command[1] == 0xCA) {
+            memcpy(answer, CARD_UID, sizeof(CARD_UID));
+            answer[sizeof(CARD_UID)]     = 0x90;
+            answer[sizeof(CARD_UID) + 1] = 0x00;
+            answerLength                 = sizeof(CARD_UID) + 2;
+        } else {
+            answerLength = card.process(command, length, answer);
+        }
+        if (!sendMessage(socket, answer, answerLength)) {
+            break;
+        }
+    }
+    _exit(0);
+}
+
+void test_desfire_round_trip(void) {
+    PCSCReader pcsc(VPCD_READER);
+    DesfireNFC nfc(pcsc);
+    if (!nfc.initialize()) {
+        PCSC_MISSING("No vpcd reader");
+    }
+
+    fflush(stdout);
+    cardProcess = fork();
+    if (cardProcess == 0) {
+        runVirtualCard();
+    }
+
+    bool detected = false;
+    for (uint8_t i = 0; i < VPCD_CARD_WAIT && !detected; i++) {
+        detected = nfc.detectCard();
+    }
+    TEST_ASSERT_TRUE(detected);
+
+    uint8_t uid[10];
+    uint8_t uidLength = 0;
+    TEST_ASSERT_TRUE(nfc.getCardUID(uid, &uidLength));
+    TEST_ASSERT_EQUAL_UINT8(sizeof(CARD_UID), uidLength);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(CARD_UID, uid, sizeof(CARD_UID));
+
+    // Several frames each way, fully encrypted, through the PC/SC stack
+    uint8_t aid[3];
+    uint8_t data[600];
+    uint8_t readBack[sizeof(data)];
+    memcpy(aid, CARD_AID, sizeof(aid));
+    for (uint16_t i = 0; i < sizeof(data); i++) {
+        data[i] = static_cast<uint8_t>(i * 7 + 3);
+    }
+
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectStrategy());
+    TEST_ASSERT_TRUE(nfc.detectCard());
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectApplication(aid));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, CARD_KEY));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.writeData(0x01, 100, sizeof(data), data, DF_COMM_ENCRYPT));
+    TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                      nfc.readData(0x01, 100, sizeof(readBack), readBack, DF_COMM_ENCRYPT));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, readBack, sizeof(data));
+}
+
+#endif
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_begin_selects_reader);
+    RUN_TEST(test_transceive_returns_status_word);
+    RUN_TEST(test_unknown_reader_fails);
+#if defined(__linux__)
+    RUN_TEST(test_desfire_round_trip);
+#endif
+
+    UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif
@@ -0,0 +1,334 @@
+/**
+ * @file test_main.cpp
+ * @brief Unit tests for the PN532 serial reader against a pseudo-terminal stand-in
+ */
+
+#include <unity.h>
+
+#if defined(__linux__)
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "PN532SerialReader.h"
+
+static const uint8_t CARD_UID[7] = {0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+
+static int   master = -1;
+static pid_t standIn = -1;
+
+static bool readExact(uint8_t* data, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = read(master, data + done, length - done);
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+/**
+ * @brief Receive one host frame, returns the TFI and data length (0 for an ACK)
+ */
+static int readHostFrame(uint8_t* data) {
+    uint8_t previous = 0xFF;
+    uint8_t current  = 0xFF;
+    while (previous != 0x00 || current != 0xFF) {
+        previous = current;
+        if (!readExact(&current, 1)) {
+            return -1;
+        }
+    }
+
+    uint8_t header[3];
+    if (!readExact(header, 2)) {
+        return -1;
+    }
+    if (header[0] == 0x00 && header[1] == 0xFF) {
+        readExact(header, 1);
+        return 0;
+    }
+
+    int length = header[0];
+    if (header[0] == 0xFF && header[1] == 0xFF) {
+        readExact(header, 3);
+        length = (header[0] << 8) | header[1];
+    }
+
+    uint8_t trailer[2];
+    if (!readExact(data, length) || !readExact(trailer, 2)) {
+        return -1;
+    }
+    return length;
+}
+
+static void writeAnswer(uint8_t code, const uint8_t* data, int length) {
+    static const uint8_t ACK[] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+
+    uint8_t frame[300];
+    int     pos   = 0;
+    int     total = length + 2;
+    frame[pos++]  = 0x00;
+    frame[pos++]  = 0x00;
+    frame[pos++]  = 0xFF;
+    if (total > 255) {
+        frame[pos++] = 0xFF;
+        frame[pos++] = 0xFF;
+        frame[pos++] = total >> 8;
+        frame[pos++] = total & 0xFF;
+        frame[pos++] = -((total >> 8) + (total & 0xFF));
+    } else {
+        frame[pos++] = total;
+        frame[pos++] = -total;
+    }
+
+    uint8_t sum  = 0xD5 + code + 1;
+    frame[pos++] = 0xD5;
+    frame[pos++] = code + 1;
+    for (int i = 0; i < length; i++) {
+        sum += data[i];
+        frame[pos++] = data[i];
+    }
+    frame[pos++] = -sum;
+    frame[pos++] = 0x00;
+
+    write(master, ACK, sizeof(ACK));
+    write(master, frame, pos);
+}
+
+/**
+ * @brief Answer host frames like a PN532 with one DESFire card in the field
+ */
+static void runStandIn() {
+    uint8_t frame[300];
+    uint8_t answer[300];
+    int     length;
+
+    while ((length = readHostFrame(frame)) >= 0) {
+        if (length == 0 || frame[0] != 0xD4) {
+            continue;
+        }
+
+        uint8_t code = frame[1];
+        switch (code) {
+            case 0x02: {
+                const uint8_t version[] = {0x32, 0x01, 0x06, 0x07};
+                writeAnswer(code, version, sizeof(version));
+                break;
+            }
+            case 0x10:
+                // The rate changes after the host acknowledges
+                writeAnswer(code, nullptr, 0);
+                readHostFrame(frame);
+                break;
+            case 0x4A:
+                answer[0] = 1;
+                answer[1] = 1;
+                answer[2] = 0x03;
+                answer[3] = 0x44;
+                answer[4] = 0x20;
+                answer[5] = sizeof(CARD_UID);
+                memcpy(&answer[6], CARD_UID, sizeof(CARD_UID));
+                writeAnswer(code, answer, 6 + sizeof(CARD_UID));
+                break;
+            case 0x4E:
+                // 848 kbit/s is rejected by the card
+                answer[0] = (frame[3] == 0x03) ? 0x01 : 0x00;
+                writeAnswer(code, answer, 1);
+                break;
+            case 0x40:
+                // A lost card never answers, the host aborts with an ACK
+                if (frame[3] == 0xEE) {
+                    write(master, "\x00\x00\xFF\x00\xFF\x00", 6);
+                    readHostFrame(frame);
+                    break;
+                }
+                // A slow card answers after the host gave up and aborted
+                if (frame[3] == 0xDD) {
+                    write(master, "\x00\x00\xFF\x00\xFF\x00", 6);
+                    readHostFrame(frame);
+                    answer[0] = 0x00;
+                    answer[1] = 0x00;
+                    answer[2] = 0xDD;
+                    writeAnswer(code, answer, 3);
+                    break;
+                }
+                // Echo the command data reversed after the status byte
+                answer[0] = 0x00;
+                for (int i = 3; i < length; i++) {
+                    answer[length - i] = frame[i];
+                }
+                writeAnswer(code, answer, length - 2);
+                break;
+            default:
+                writeAnswer(code, nullptr, 0);
+                break;
+        }
+    }
+}
+
+static const char* openStandIn() {
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    grantpt(master);
+    unlockpt(master);
+
+    fflush(stdout);
+    standIn = fork();
+    if (standIn == 0) {
+        runStandIn();
+        _exit(0);
+    }
+    return ptsname(master);
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+    if (master >= 0) {
+        close(master);
+        master = -1;
+    }
+    if (standIn > 0) {
+        kill(standIn, SIGTERM);
+        waitpid(standIn, nullptr, 0);
+        standIn = -1;
+    }
+}
+
+void test_begin_switches_baud_rate(void) {
+    PN532SerialReader reader(openStandIn(), 921600);
+
+    TEST_ASSERT_TRUE(reader.begin());
+    TEST_ASSERT_EQUAL_HEX32(0x32010607, reader.getFirmwareVersion());
+    TEST_ASSERT_TRUE(reader.configure());
+}
+
+void test_detect_and_bit_rate(void) {
+    PN532SerialReader reader(openStandIn());
+    uint8_t           uid[10];
+    uint8_t           uidLength = 0;
+
+    TEST_ASSERT_TRUE(reader.begin());
+    TEST_ASSERT_TRUE(reader.detectCard(uid, &uidLength));
+    TEST_ASSERT_EQUAL_UINT8(sizeof(CARD_UID), uidLength);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(CARD_UID, uid, sizeof(CARD_UID));
+
+    TEST_ASSERT_FALSE(reader.setBitRate(848));
+    TEST_ASSERT_TRUE(reader.setBitRate(424));
+    TEST_ASSERT_FALSE(reader.setBitRate(300));
+}
+
+void test_transceive_extended_frames(void) {
+    PN532SerialReader reader(openStandIn());
+    uint8_t           tx[PN532_HSU_MAX_DATA];
+    uint8_t           rx[PN532_HSU_MAX_DATA];
+    uint16_t          rxLength = sizeof(rx);
+
+    for (uint16_t i = 0; i < sizeof(tx); i++) {
+        tx[i] = static_cast<uint8_t>(i);
+    }
+
+    TEST_ASSERT_TRUE(reader.begin());
+    TEST_ASSERT_TRUE(reader.transceive(tx, 5, rx, &rxLength));
+    TEST_ASSERT_EQUAL_UINT16(5, rxLength);
+    TEST_ASSERT_EQUAL_HEX8(4, rx[0]);
+
+    // Both directions need extended frames
+    rxLength = sizeof(rx);
+    TEST_ASSERT_TRUE(reader.transceive(tx, 260, rx, &rxLength));
+    TEST_ASSERT_EQUAL_UINT16(260, rxLength);
+    TEST_ASSERT_EQUAL_HEX8(3, rx[256]);
+
+    // A response larger than the buffer fails
+    rxLength = 4;
+    TEST_ASSERT_FALSE(reader.transceive(tx, 5, rx, &rxLength));
+}
+
+void test_silent_card_times_out(void) {
+    PN532SerialReader reader(openStandIn());
+    uint8_t           tx[] = {0xEE, 0x00};
+    uint8_t           rx[16];
+    uint16_t          rxLength = sizeof(rx);
+
+    TEST_ASSERT_TRUE(reader.begin());
+    TEST_ASSERT_FALSE(reader.transceive(tx, sizeof(tx), rx, &rxLength));
+
+    // The aborted command leaves the link usable
+    tx[0]    = 0x60;
+    rxLength = sizeof(rx);
+    TEST_ASSERT_TRUE(reader.transceive(tx, sizeof(tx), rx, &rxLength));
+    TEST_ASSERT_EQUAL_HEX8(0x60, rx[1]);
+}
+
+void test_late_answer_discarded(void) {
+    PN532SerialReader reader(openStandIn());
+    uint8_t           tx[] = {0xDD, 0x00};
+    uint8_t           rx[16];
+    uint16_t          rxLength = sizeof(rx);
+
+    TEST_ASSERT_TRUE(reader.begin());
+    TEST_ASSERT_FALSE(reader.transceive(tx, sizeof(tx), rx, &rxLength));
+    usleep(50000);  // The late answer arrives while the host is idle
+
+    // The next command gets its own answer
+    tx[0]    = 0x60;
+    rxLength = sizeof(rx);
+    TEST_ASSERT_TRUE(reader.transceive(tx, sizeof(tx), rx, &rxLength));
+    TEST_ASSERT_EQUAL_UINT16(2, rxLength);
+    TEST_ASSERT_EQUAL_HEX8(0x60, rx[1]);
+}
+
+void test_missing_device(void) {
+    PN532SerialReader reader("/dev/nonexistent-pn532");
+    uint8_t           uid[10];
+    uint8_t           uidLength;
+
+    TEST_ASSERT_FALSE(reader.begin());
+    TEST_ASSERT_FALSE(reader.detectCard(uid, &uidLength));
+}
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_begin_switches_baud_rate);
+    RUN_TEST(test_detect_and_bit_rate);
+    RUN_TEST(test_transceive_extended_frames);
+    RUN_TEST(test_silent_card_times_out);
+    RUN_TEST(test_late_answer_discarded);
+    RUN_TEST(test_missing_device);
+
+    UNITY_END();
+}
+
+#else
+void process(void) {
+    // The serial reader is only available on Linux
+    UNITY_BEGIN();
+    UNITY_END();
+}
+#endif
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif
@@ -0,0 +1,401 @@
+/**
+ * @file test_main.cpp
+ * @brief Tests of the PN532 host interface simulator and the drivers on top of it
+ */
+
+#include <string.h>
+#include <unity.h>
+#include "DesfireNFC.h"
+#include "PN532Simulator.h"
+
+static const uint8_t UID[DF_EMU_UID_SIZE] = {0x04, 0x6A, 0x2E, 0x91, 0x0C, 0x77, 0x80};
+static const uint8_t AID[3]               = {0x0A, 0x0B, 0x0C};
+static const uint8_t KEY[DF_AES_KEY_SIZE] = {0x10, 0x32, 0x54, 0x76, 0x98, 0xBA, 0xDC, 0xFE,
+                                             0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF};
+static const uint8_t ACK[]                = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+static const uint8_t NACK[]               = {0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00};
+
+/**
+ * @brief Build a host information frame, extended above 255 bytes
+ *
+ * @return uint16_t Length of the frame
+ */
+static uint16_t buildFrame(const uint8_t* command, uint16_t length, uint8_t* frame) {
+    uint16_t dataLength = length + 1;
+    uint16_t pos        = 0;
+    frame[pos++]        = 0x00;
+    frame[pos++]        = 0x00;
+    frame[pos++]        = 0xFF;
+    if (dataLength > 255) {
+        frame[pos++] = 0xFF;
+        frame[pos++] = 0xFF;
+        frame[pos++] = dataLength >> 8;
+        frame[pos++] = dataLength & 0xFF;
+        frame[pos++] = static_cast<uint8_t>(-((dataLength >> 8) + (dataLength & 0xFF)));
+    } else {
+        frame[pos++] = static_cast<uint8_t>(dataLength);
+        frame[pos++] = static_cast<uint8_t>(-dataLength);
+    }
+
+    uint8_t sum  = 0xD4;
+    frame[pos++] = 0xD4;
+    for (uint16_t i = 0; i < length; i++) {
+        sum += command[i];
+        frame[pos++] = command[i];
+    }
+    frame[pos++] = static_cast<uint8_t>(-sum);
+    frame[pos++] = 0x00;
+    return pos;
+}
+
+/**
+ * @brief Run a command over I2C the way a driver does
+ *
+ * @return uint16_t Length of the answer frame after the status byte, 0 on a framing error
+ */
+static uint16_t exchangeI2C(PN532Simulator& pn532,
+                            const uint8_t*  command,
+                            uint16_t        length,
+                            uint8_t*        answer) {
+    uint8_t  frame[PN532_SIM_FRAME_SIZE];
+    uint8_t  status;
+    uint8_t  ack[1 + sizeof(ACK)];
+    uint16_t frameLength = buildFrame(command, length, frame);
+
+    pn532.i2cWrite(frame, frameLength);
+    pn532.i2cRead(&status, 1);
+    if (status != PN532_STATUS_READY) {
+        return 0;
+    }
+    pn532.i2cRead(ack, sizeof(ack));
+    if (memcmp(&ack[1], ACK, sizeof(ACK)) != 0) {
+        return 0;
+    }
+
+    pn532.i2cRead(answer, 1 + PN532_SIM_FRAME_SIZE);
+    if (answer[0] != PN532_STATUS_READY) {
+        return 0;
+    }
+    return answer[4] + 7;
+}
+
+/**
+ * @brief Run a command over SPI the way a driver does
+ *
+ * @return uint16_t Length of the answer frame after the direction byte, 0 on a framing error
+ */
+static uint16_t exchangeSPI(PN532Simulator& pn532,
+                            const uint8_t*  command,
+                            uint16_t        length,
+                            uint8_t*        answer) {
+    uint8_t  tx[1 + PN532_SIM_FRAME_SIZE];
+    uint8_t  status[2] = {PN532_SPI_STATUS_READ, 0x00};
+    uint8_t  ready[2];
+    uint16_t txLength = 1 + buildFrame(command, length, &tx[1]);
+    tx[0]             = PN532_SPI_DATA_WRITE;
+    pn532.spiTransfer(tx, answer, txLength);
+
+    pn532.spiTransfer(status, ready, sizeof(status));
+    if (ready[1] != PN532_STATUS_READY) {
+        return 0;
+    }
+
+    memset(tx, 0, sizeof(tx));
+    tx[0] = PN532_SPI_DATA_READ;
+    pn532.spiTransfer(tx, answer, 1 + sizeof(ACK));
+    if (memcmp(&answer[1], ACK, sizeof(ACK)) != 0) {
+        return 0;
+    }
+    pn532.spiTransfer(tx, answer, sizeof(tx));
+    return answer[4] + 7;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_i2c_framing(void) {
+    DesfireCardEmulator card(UID);
+    PN532EmulatedCard   backend(card);
+    PN532Simulator      pn532(&backend, PN532_HOST_I2C);
+    uint8_t             answer[1 + PN532_SIM_FRAME_SIZE];
+    uint8_t             again[1 + PN532_SIM_FRAME_SIZE];
+    uint8_t             status;
+
+    pn532.i2cRead(&status, 1);
+    TEST_ASSERT_EQUAL_HEX8(PN532_STATUS_BUSY, status);
+
+    // Status byte, then 00 00 FF LEN LCS D5 03 IC Ver Rev Support DCS 00
+    const uint8_t version[] = {0x02};
+    TEST_ASSERT_EQUAL_UINT16(13, exchangeI2C(pn532, version, sizeof(version), answer));
+    TEST_ASSERT_EQUAL_HEX8(0xD5, answer[6]);
+    TEST_ASSERT_EQUAL_HEX8(0x03, answer[7]);
+    TEST_ASSERT_EQUAL_HEX8(0x32, answer[8]);
+    pn532.i2cRead(&status, 1);
+    TEST_ASSERT_EQUAL_HEX8(PN532_STATUS_BUSY, status);
+
+    // NACK repeats the answer
+    pn532.i2cWrite(NACK, sizeof(NACK));
+    pn532.i2cRead(again, 1 + 13);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(answer, again, 1 + 13);
+
+    // A wrong checksum is neither acknowledged nor answered
+    uint8_t  frame[PN532_SIM_FRAME_SIZE];
+    uint16_t length = buildFrame(version, sizeof(version), frame);
+    frame[length - 2] ^= 0x01;
+    pn532.i2cWrite(frame, length);
+    TEST_ASSERT_FALSE(pn532.isReady());
+    TEST_ASSERT_EQUAL_UINT32(1, pn532.getStats().errors);
+
+    // Unknown commands get the syntax error frame
+    const uint8_t unknown[] = {0x7E};
+    TEST_ASSERT_EQUAL_UINT16(8, exchangeI2C(pn532, unknown, sizeof(unknown), answer));
+    TEST_ASSERT_EQUAL_HEX8(0x7F, answer[6]);
+    TEST_ASSERT_EQUAL_UINT32(2, pn532.getStats().commands);
+    TEST_ASSERT_EQUAL_UINT32(1, pn532.getStats().nacks);
+}
+
+void test_spi_data_exchange(void) {
+    DesfireCardEmulator card(UID);
+    PN532EmulatedCard   backend(card);
+    PN532Simulator      pn532(&backend, PN532_HOST_SPI);
+    uint8_t             answer[1 + PN532_SIM_FRAME_SIZE];
+
+    // NbTg || Tg || SENS_RES || SEL_RES || NFCIDLength || NFCID || ATS
+    const uint8_t list[] = {0x4A, 0x01, 0x00};
+    TEST_ASSERT_TRUE(exchangeSPI(pn532, list, sizeof(list), answer) > 0);
+    TEST_ASSERT_EQUAL_HEX8(0x4B, answer[1 + 6]);
+    TEST_ASSERT_EQUAL_HEX8(1, answer[1 + 7]);
+    TEST_ASSERT_EQUAL_HEX8(DF_EMU_UID_SIZE, answer[1 + 12]);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(UID, &answer[1 + 13], DF_EMU_UID_SIZE);
+
+    // InDataExchange in an extended frame reaches the card in one piece
+    uint8_t exchange[2 + PN532_SIM_MAX_DATA];
+    memset(exchange, 0, sizeof(exchange));
+    exchange[0] = 0x40;
+    exchange[1] = 0x01;
+    exchange[2] = 0x60;  // GetVersion with trailing data
+    TEST_ASSERT_TRUE(exchangeSPI(pn532, exchange, sizeof(exchange), answer) > 0);
+    TEST_ASSERT_EQUAL_HEX8(0x41, answer[1 + 6]);
+    TEST_ASSERT_EQUAL_HEX8(0x00, answer[1 + 7]);
+    TEST_ASSERT_EQUAL_HEX8(0x7E, answer[1 + 8]);
+
+    // A card that left the field times out
+    card.setPresent(false);
+    TEST_ASSERT_TRUE(exchangeSPI(pn532, exchange, 3, answer) > 0);
+    TEST_ASSERT_EQUAL_HEX8(0x01, answer[1 + 7]);
+    TEST_ASSERT_EQUAL_UINT32(1, pn532.getStats().timeouts);
+
+    // An empty field lists no target
+    TEST_ASSERT_TRUE(exchangeSPI(pn532, list, sizeof(list), answer) > 0);
+    TEST_ASSERT_EQUAL_HEX8(0, answer[1 + 7]);
+}
+
+void test_link_timing(void) {
+    DesfireCardEmulator card(UID);
+    PN532EmulatedCard   backend(card);
+    DesfireVirtualClock virtualClock;
+    PN532Simulator      i2c(&backend, PN532_HOST_I2C);
+    PN532Simulator      hsu(&backend, PN532_HOST_HSU);
+    uint8_t             frame[PN532_SIM_FRAME_SIZE];
+    uint8_t             answer[1 + PN532_SIM_FRAME_SIZE];
+    i2c.setClock(&virtualClock);
+    hsu.setClock(&virtualClock);
+
+    // The same command costs more on the slower link
+    const uint8_t version[] = {0x02};
+    TEST_ASSERT_EQUAL_UINT16(13, exchangeI2C(i2c, version, sizeof(version), answer));
+    uint64_t i2cTime = virtualClock.getElapsed();
+    TEST_ASSERT_TRUE(i2cTime > 0);
+
+    virtualClock.reset();
+    hsu.write(frame, buildFrame(version, sizeof(version), frame));
+    TEST_ASSERT_EQUAL_UINT16(sizeof(ACK) + 13, hsu.read(answer, sizeof(answer)));
+    TEST_ASSERT_TRUE(virtualClock.getElapsed() > i2cTime);
+
+    // The baud rate changes once the host acknowledges the answer
+    const uint8_t baud[] = {0x10, 0x07};
+    hsu.write(frame, buildFrame(baud, sizeof(baud), frame));
+    hsu.read(answer, sizeof(answer));
+    TEST_ASSERT_EQUAL_UINT32(PN532_SIM_HSU_BAUD, hsu.getBaudRate());
+    hsu.write(ACK, sizeof(ACK));
+    TEST_ASSERT_EQUAL_UINT32(921600, hsu.getBaudRate());
+
+    // Activation spends the anticollision time on the clock
+    virtualClock.reset();
+    const uint8_t list[] = {0x4A, 0x01, 0x00};
+    TEST_ASSERT_TRUE(exchangeI2C(i2c, list, sizeof(list), answer) > 0);
+    TEST_ASSERT_TRUE(virtualClock.getElapsed() >= DF_EMU_ACTIVATION_TIME);
+}
+
+#if defined(__linux__)
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "PN532SerialReader.h"
+
+/**
+ * @brief Run the simulator behind a pseudo-terminal until the driver closes it
+ *
+ * @param master Master side of the pseudo-terminal
+ * @param extraDelay Delay the card adds to every answer in microseconds
+ * @return pid_t Process of the simulator, which exits with its timeout count
+ */
+static pid_t startSimulator(int master, uint32_t extraDelay) {
+    fflush(stdout);
+    pid_t child = fork();
+    if (child != 0) {
+        return child;
+    }
+
+    DesfireCardEmulator card(UID);
+    PN532EmulatedCard   backend(card);
+    PN532Simulator      pn532(&backend, PN532_HOST_HSU);
+    DesfireEmulatorFile file;
+    uint8_t             buffer[PN532_SIM_FRAME_SIZE];
+    ssize_t             length;
+    file.fileNo   = 0x01;
+    file.type     = DF_FILE_STANDARD;
+    file.commMode = DF_COMM_MAC;
+    file.readKey  = DF_AR_KEY0;
+    file.writeKey = DF_AR_KEY0;
+    file.size     = 256;
+    card.addApplication(AID, KEY, 1);
+    card.addFile(AID, file, nullptr);
+
+    DesfireEmulatorTiming timing = card.getTiming();
+    timing.extraDelay            = extraDelay;
+    card.setTiming(timing);
+
+    while ((length = read(master, buffer, sizeof(buffer))) > 0) {
+        pn532.write(buffer, static_cast<uint16_t>(length));
+        uint16_t pending;
+        while ((pending = pn532.read(buffer, sizeof(buffer))) > 0) {
+            if (write(master, buffer, pending) != pending) {
+                _exit(0xFF);
+            }
+        }
+    }
+    _exit(static_cast<int>(pn532.getStats().timeouts));
+}
+
+void test_serial_driver_tap(void) {
+    // The simulator answers behind a pseudo-terminal, the driver is unchanged
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    TEST_ASSERT_TRUE(master >= 0);
+    grantpt(master);
+    unlockpt(master);
+    pid_t child = startSimulator(master, 0);
+
+    {
+        PN532SerialReader reader(ptsname(master), 921600);
+        DesfireNFC        nfc(reader);
+        uint8_t           aid[3];
+        uint8_t           data[200];
+        uint8_t           readBack[sizeof(data)];
+        memcpy(aid, AID, sizeof(aid));
+        for (uint16_t i = 0; i < sizeof(data); i++) {
+            data[i] = static_cast<uint8_t>(i ^ 0xA5);
+        }
+
+        TEST_ASSERT_TRUE(nfc.initialize());
+        TEST_ASSERT_TRUE(nfc.detectCard());
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectStrategy());
+        TEST_ASSERT_TRUE(nfc.detectCard());
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectApplication(aid));
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, KEY));
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                          nfc.writeData(0x01, 10, sizeof(data), data, DF_COMM_MAC));
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                          nfc.readData(0x01, 10, sizeof(data), readBack, DF_COMM_MAC));
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(data, readBack, sizeof(data));
+    }
+
+    close(master);
+    kill(child, SIGTERM);
+    waitpid(child, nullptr, 0);
+}
+
+void test_proximity_timeout(void) {
+    // A relay adds 20 ms on the RF side; the host sees no delay over the pty
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    TEST_ASSERT_TRUE(master >= 0);
+    grantpt(master);
+    unlockpt(master);
+    pid_t child = startSimulator(master, 20000);
+
+    {
+        PN532SerialReader reader(ptsname(master), 921600);
+        DesfireNFC        nfc(reader);
+        uint8_t           aid[3];
+        uint8_t           data[16];
+        memcpy(aid, AID, sizeof(aid));
+
+        TEST_ASSERT_TRUE(nfc.initialize());
+        TEST_ASSERT_TRUE(nfc.detectCard());
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectApplication(aid));
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, KEY));
+
+        // Within the limit, every round arrives
+        DesfireProximityCheck result;
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.proximityCheck(100000, &result));
+
+        // Host timing alone would pass this round, the RF timeout stops it
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_PROXIMITY_ERROR, nfc.proximityCheck(5000, &result));
+        TEST_ASSERT_TRUE(result.maxRoundTrip < 5000);
+
+        // The default timeout is back and the answers stay in step
+        TEST_ASSERT_TRUE(nfc.detectCard());
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.selectApplication(aid));
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS, nfc.authenticateEV2First(0, KEY));
+        TEST_ASSERT_EQUAL(DesfireStatus::DFST_SUCCESS,
+                          nfc.readData(0x01, 0, sizeof(data), data, DF_COMM_MAC));
+    }
+
+    // Only the over-limit round timed out
+    close(master);
+    int exitStatus = 0;
+    waitpid(child, &exitStatus, 0);
+    TEST_ASSERT_TRUE(WIFEXITED(exitStatus));
+    TEST_ASSERT_EQUAL(1, WEXITSTATUS(exitStatus));
+}
+
+#endif
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_i2c_framing);
+    RUN_TEST(test_spi_data_exchange);
+    RUN_TEST(test_link_timing);
+#if defined(__linux__)
+    RUN_TEST(test_serial_driver_tap);
+    RUN_TEST(test_proximity_timeout);
+#endif
+
+    UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif
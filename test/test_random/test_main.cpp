@@ -0,0 +1,189 @@
+/**
+ * @file test_main.cpp
+ * @brief Unit tests for the random source and the challenge pool
+ */
+
+#include <new>
+#include <string.h>
+#include <unity.h>
+#include "DesfireRandom.h"
+
+// Counting source: byte n of the stream is n + 1 (mod 256), so reuse shows up
+static uint8_t  nextByte   = 0;
+static uint32_t fillCalls  = 0;
+static bool     sourceDown = false;
+
+static bool countingSource(uint8_t* buffer, size_t length) {
+    fillCalls++;
+    if (sourceDown) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        buffer[i] = ++nextByte;
+    }
+    return true;
+}
+
+void setUp(void) {
+    nextByte   = 0;
+    fillCalls  = 0;
+    sourceDown = false;
+    DesfireRandom::setSource(countingSource);
+}
+
+void tearDown(void) {
+    DesfireRandom::setSource(nullptr);
+}
+
+/**
+ * @brief Check that the ring buffer (the first member of the pool) is all zero
+ */
+static bool poolIsWiped(const DesfireNoncePool& pool) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&pool);
+    for (uint16_t i = 0; i < DF_NONCE_POOL_SIZE; i++) {
+        if (bytes[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void test_platform_source(void) {
+    DesfireRandom::setSource(nullptr);
+
+    DesfireNoncePool pool;
+    TEST_ASSERT_EQUAL_UINT16(DF_NONCE_POOL_SIZE, pool.refill());
+
+    uint8_t first[DF_NONCE_MAX_LENGTH];
+    uint8_t second[DF_NONCE_MAX_LENGTH];
+    TEST_ASSERT_TRUE(pool.take(first, sizeof(first)));
+    TEST_ASSERT_TRUE(pool.take(second, sizeof(second)));
+    TEST_ASSERT_NOT_EQUAL(0, memcmp(first, second, sizeof(first)));
+}
+
+void test_refill_after_drain(void) {
+    DesfireNoncePool pool;
+    TEST_ASSERT_EQUAL_UINT16(DF_NONCE_POOL_SIZE, pool.refill());
+    TEST_ASSERT_EQUAL_UINT16(0, pool.refill());
+
+    // Drain the pool completely, in stream order
+    uint8_t nonce[DF_NONCE_MAX_LENGTH];
+    for (uint16_t taken = 0; taken < DF_NONCE_POOL_SIZE; taken += sizeof(nonce)) {
+        TEST_ASSERT_TRUE(pool.take(nonce, sizeof(nonce)));
+        TEST_ASSERT_EQUAL_HEX8(taken + 1, nonce[0]);
+    }
+    TEST_ASSERT_EQUAL_UINT16(0, pool.available());
+
+    // A refill tops up with fresh bytes, never the ones handed out
+    TEST_ASSERT_EQUAL_UINT16(DF_NONCE_POOL_SIZE, pool.refill());
+    TEST_ASSERT_TRUE(pool.take(nonce, 1));
+    TEST_ASSERT_EQUAL_HEX8(DF_NONCE_POOL_SIZE + 1, nonce[0]);
+
+    // Free space that wraps around the end is filled in two pieces
+    TEST_ASSERT_TRUE(pool.take(nonce, 5));
+    fillCalls = 0;
+    TEST_ASSERT_EQUAL_UINT16(6, pool.refill());
+    TEST_ASSERT_EQUAL_UINT32(1, fillCalls);
+    for (uint16_t taken = 0; taken < DF_NONCE_POOL_SIZE - 4; taken += 2) {
+        TEST_ASSERT_TRUE(pool.take(nonce, 2));
+    }
+    TEST_ASSERT_EQUAL_UINT16(4, pool.available());
+    TEST_ASSERT_EQUAL_UINT16(DF_NONCE_POOL_SIZE - 4, pool.refill());
+    TEST_ASSERT_EQUAL_UINT32(3, fillCalls);
+
+    // The older bytes come first, then the stream continues across the wrap
+    TEST_ASSERT_TRUE(pool.take(nonce, 4));
+    TEST_ASSERT_TRUE(pool.take(nonce, 1));
+    TEST_ASSERT_EQUAL_HEX8(static_cast<uint8_t>(2 * DF_NONCE_POOL_SIZE + 6 + 1), nonce[0]);
+}
+
+void test_wipe_on_use(void) {
+    DesfireNoncePool pool;
+    pool.refill();
+
+    // Take everything in pieces; the handed-out bytes are cleared each time
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&pool);
+    uint8_t        nonce[DF_NONCE_MAX_LENGTH];
+    for (uint16_t taken = 0; taken < DF_NONCE_POOL_SIZE; taken += 8) {
+        TEST_ASSERT_TRUE(pool.take(nonce, 8));
+        for (uint16_t i = 0; i < taken + 8; i++) {
+            TEST_ASSERT_EQUAL_HEX8(0, bytes[i]);
+        }
+        if (taken + 8 < DF_NONCE_POOL_SIZE) {
+            TEST_ASSERT_EQUAL_HEX8(taken + 9, bytes[taken + 8]);
+        }
+    }
+    TEST_ASSERT_TRUE(poolIsWiped(pool));
+
+    // The destructor wipes bytes that were never handed out
+    alignas(DesfireNoncePool) uint8_t storage[sizeof(DesfireNoncePool)];
+    DesfireNoncePool*                 unused = new (storage) DesfireNoncePool();
+    unused->refill();
+    TEST_ASSERT_FALSE(poolIsWiped(*unused));
+    unused->~DesfireNoncePool();
+    for (uint16_t i = 0; i < DF_NONCE_POOL_SIZE; i++) {
+        TEST_ASSERT_EQUAL_HEX8(0, storage[i]);
+    }
+}
+
+void test_source_unavailable(void) {
+    DesfireNoncePool pool;
+    uint8_t          nonce[DF_NONCE_MAX_LENGTH];
+
+    // An empty pool generates the challenge directly from the source
+    TEST_ASSERT_TRUE(pool.take(nonce, sizeof(nonce)));
+    TEST_ASSERT_EQUAL_HEX8(1, nonce[0]);
+    TEST_ASSERT_EQUAL_UINT16(0, pool.available());
+
+    // Without a source, a refill adds nothing and an empty pool has nothing to give
+    sourceDown = true;
+    TEST_ASSERT_EQUAL_UINT16(0, pool.refill());
+    memset(nonce, 0xA5, sizeof(nonce));
+    TEST_ASSERT_FALSE(pool.take(nonce, sizeof(nonce)));
+
+    // Bytes gathered while the source worked still serve challenges
+    sourceDown = false;
+    pool.refill();
+    sourceDown = true;
+    for (uint16_t taken = 0; taken < DF_NONCE_POOL_SIZE; taken += sizeof(nonce)) {
+        TEST_ASSERT_TRUE(pool.take(nonce, sizeof(nonce)));
+    }
+    TEST_ASSERT_FALSE(pool.take(nonce, 1));
+
+    // Invalid lengths are rejected before the source is asked
+    sourceDown = false;
+    fillCalls  = 0;
+    TEST_ASSERT_FALSE(pool.take(nonce, 0));
+    TEST_ASSERT_FALSE(pool.take(nonce, DF_NONCE_MAX_LENGTH + 1));
+    TEST_ASSERT_FALSE(pool.take(nullptr, sizeof(nonce)));
+    TEST_ASSERT_EQUAL_UINT32(0, fillCalls);
+}
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_platform_source);
+    RUN_TEST(test_refill_after_drain);
+    RUN_TEST(test_wipe_on_use);
+    RUN_TEST(test_source_unavailable);
+
+    UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif
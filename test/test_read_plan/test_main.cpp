@@ -0,0 +1,109 @@
+/**
+ * @file test_main.cpp
+ * @brief Unit tests for the coalescing of file range reads
+ */
+
+#include <unity.h>
+#include "DesfireReadPlan.h"
+
+static uint8_t buffer[8];
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_adjacent_and_overlapping_ranges_merge(void) {
+    DesfireReadRequest requests[4] = {{1, 20, 4, buffer, DF_COMM_PLAIN},
+                                      {1, 0, 8, buffer, DF_COMM_PLAIN},
+                                      {1, 8, 4, buffer, DF_COMM_PLAIN},
+                                      {1, 10, 10, buffer, DF_COMM_PLAIN}};
+    DesfireReadSpan    spans[4];
+
+    TEST_ASSERT_EQUAL_UINT8(1, DesfireReadPlanner::plan(requests, 4, 224, 0, spans));
+    TEST_ASSERT_EQUAL_UINT8(1, spans[0].fileNo);
+    TEST_ASSERT_EQUAL_UINT32(0, spans[0].offset);
+    TEST_ASSERT_EQUAL_UINT32(24, spans[0].length);
+    for (uint8_t i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE(DesfireReadPlanner::covers(spans[0], requests[i]));
+    }
+}
+
+void test_gap_limit(void) {
+    DesfireReadRequest requests[2] = {{1, 0, 4, buffer, DF_COMM_PLAIN},
+                                      {1, 20, 4, buffer, DF_COMM_PLAIN}};
+    DesfireReadSpan    spans[2];
+
+    TEST_ASSERT_EQUAL_UINT8(1, DesfireReadPlanner::plan(requests, 2, 224, 16, spans));
+    TEST_ASSERT_EQUAL_UINT32(24, spans[0].length);
+
+    TEST_ASSERT_EQUAL_UINT8(2, DesfireReadPlanner::plan(requests, 2, 224, 15, spans));
+    TEST_ASSERT_EQUAL_UINT32(0, spans[0].offset);
+    TEST_ASSERT_EQUAL_UINT32(20, spans[1].offset);
+}
+
+void test_files_and_modes_stay_apart(void) {
+    DesfireReadRequest requests[3] = {{2, 0, 4, buffer, DF_COMM_PLAIN},
+                                      {1, 4, 4, buffer, DF_COMM_PLAIN},
+                                      {1, 0, 4, buffer, DF_COMM_MAC}};
+    DesfireReadSpan    spans[3];
+
+    TEST_ASSERT_EQUAL_UINT8(3, DesfireReadPlanner::plan(requests, 3, 224, 16, spans));
+    TEST_ASSERT_EQUAL_UINT8(1, spans[0].fileNo);
+    TEST_ASSERT_EQUAL_UINT8(DF_COMM_PLAIN, spans[0].commMode);
+    TEST_ASSERT_EQUAL_UINT8(1, spans[1].fileNo);
+    TEST_ASSERT_EQUAL_UINT8(DF_COMM_MAC, spans[1].commMode);
+    TEST_ASSERT_EQUAL_UINT8(2, spans[2].fileNo);
+    TEST_ASSERT_FALSE(DesfireReadPlanner::covers(spans[0], requests[2]));
+}
+
+void test_span_size_limit(void) {
+    DesfireReadRequest requests[4] = {{1, 0, 32, buffer, DF_COMM_PLAIN},
+                                      {1, 32, 32, buffer, DF_COMM_PLAIN},
+                                      {1, 100, 200, buffer, DF_COMM_PLAIN},
+                                      {1, 120, 8, buffer, DF_COMM_PLAIN}};
+    DesfireReadSpan    spans[4];
+
+    // The long range is read on its own and serves the range inside it
+    TEST_ASSERT_EQUAL_UINT8(3, DesfireReadPlanner::plan(requests, 4, 48, 0, spans));
+    TEST_ASSERT_EQUAL_UINT32(32, spans[0].length);
+    TEST_ASSERT_EQUAL_UINT32(32, spans[1].offset);
+    TEST_ASSERT_EQUAL_UINT32(200, spans[2].length);
+    TEST_ASSERT_TRUE(DesfireReadPlanner::covers(spans[2], requests[3]));
+
+    // Empty ranges and oversized plans are rejected
+    requests[1].length = 0;
+    TEST_ASSERT_EQUAL_UINT8(0, DesfireReadPlanner::plan(requests, 4, 48, 0, spans));
+    TEST_ASSERT_EQUAL_UINT8(
+        0, DesfireReadPlanner::plan(requests, DF_READ_PLAN_MAX_REQUESTS + 1, 48, 0, spans));
+}
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_adjacent_and_overlapping_ranges_merge);
+    RUN_TEST(test_gap_limit);
+    RUN_TEST(test_files_and_modes_stay_apart);
+    RUN_TEST(test_span_size_limit);
+
+    UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif
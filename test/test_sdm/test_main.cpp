@@ -0,0 +1,106 @@
+/**
+ * @file test_main.cpp
+ * @brief Unit tests for Secure Dynamic Messaging (SUN) verification
+ */
+
+#include <string.h>
+#include <unity.h>
+#include "DesfireSDM.h"
+
+// AN12196 SUN example: all-zero SDM keys, PICC data and MAC as mirrored into the URL
+static const char PICC_DATA_HEX[] = "EF963FF7828658A599F3041510671E88";
+static const char MAC_HEX[]       = "94EED9EE65337086";
+
+static const uint8_t EXPECTED_UID[DF_SDM_UID_SIZE] = {0x04, 0xDE, 0x5F, 0x1E, 0xAC, 0xC0, 0x40};
+
+static const uint8_t ZERO_KEY[DF_AES_KEY_SIZE] = {0};
+
+static DesfireSDM sdm(ZERO_KEY, ZERO_KEY);
+static uint8_t    piccData[DF_SDM_PICC_DATA_SIZE];
+static uint8_t    mac[DF_MACT_SIZE];
+
+void setUp(void) {
+    DesfireSDM::parseHex(PICC_DATA_HEX, strlen(PICC_DATA_HEX), piccData, sizeof(piccData));
+    DesfireSDM::parseHex(MAC_HEX, strlen(MAC_HEX), mac, sizeof(mac));
+}
+
+void tearDown(void) {
+}
+
+void test_decrypt_picc_data(void) {
+    DesfireSUN sun;
+    TEST_ASSERT_TRUE(sdm.decryptPICCData(piccData, &sun));
+    TEST_ASSERT_EQUAL_UINT8(DF_SDM_UID_SIZE, sun.uidLength);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(EXPECTED_UID, sun.uid, DF_SDM_UID_SIZE);
+    TEST_ASSERT_TRUE(sun.hasCounter);
+    TEST_ASSERT_EQUAL_UINT32(0x3D, sun.counter);
+}
+
+void test_verify_sun(void) {
+    DesfireSUN sun;
+    TEST_ASSERT_TRUE(sdm.verify(piccData, nullptr, 0, mac, &sun));
+
+    mac[7] ^= 0x01;
+    TEST_ASSERT_FALSE(sdm.verify(piccData, nullptr, 0, mac, &sun));
+}
+
+void test_replayed_mac_with_other_counter(void) {
+    DesfireSUN sun;
+    TEST_ASSERT_TRUE(sdm.decryptPICCData(piccData, &sun));
+
+    sun.counter++;
+    TEST_ASSERT_FALSE(sdm.verifyMAC(sun, nullptr, 0, mac));
+}
+
+void test_wrong_key(void) {
+    uint8_t    key[DF_AES_KEY_SIZE] = {0x01};
+    DesfireSDM other(key, key);
+    DesfireSUN sun;
+    TEST_ASSERT_FALSE(other.verify(piccData, nullptr, 0, mac, &sun));
+}
+
+void test_parse_hex_and_file_data(void) {
+    uint8_t data[4];
+    TEST_ASSERT_EQUAL(2, DesfireSDM::parseHex("a0Ff", 4, data, sizeof(data)));
+    TEST_ASSERT_EQUAL_HEX8(0xA0, data[0]);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, data[1]);
+    TEST_ASSERT_EQUAL(0, DesfireSDM::parseHex("a0F", 3, data, sizeof(data)));
+    TEST_ASSERT_EQUAL(0, DesfireSDM::parseHex("zz", 2, data, sizeof(data)));
+    TEST_ASSERT_EQUAL(0, DesfireSDM::parseHex("0011223344", 10, data, sizeof(data)));
+
+    DesfireSUN sun;
+    uint8_t    block[DF_AES_BLOCK_SIZE + 1] = {0};
+    TEST_ASSERT_TRUE(sdm.decryptPICCData(piccData, &sun));
+    TEST_ASSERT_FALSE(sdm.decryptFileData(sun, block, block, sizeof(block)));
+    TEST_ASSERT_TRUE(sdm.decryptFileData(sun, block, block, DF_AES_BLOCK_SIZE));
+}
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_decrypt_picc_data);
+    RUN_TEST(test_verify_sun);
+    RUN_TEST(test_replayed_mac_with_other_counter);
+    RUN_TEST(test_wrong_key);
+    RUN_TEST(test_parse_hex_and_file_data);
+
+    UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif
@@ -0,0 +1,442 @@
+/**
+ * @file test_main.cpp
+ * @brief Soak test: randomized taps against the emulated card
+ *
+ * Runs DESFIRE_SOAK_TAPS taps (SOAK_TAPS in the environment overrides it)
+ * with a seed taken from SOAK_SEED or the clock. Every answer is checked
+ * against a shadow copy of the files and the command counters of card and
+ * library are compared after each command. The taps run on a thread with a
+ * painted stack; stack depth, heap use and the time per tap must not change
+ * after the warm-up.
+ *
+ * Rerun a failing seed with SOAK_SEED=<seed> to reproduce the tap sequence.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+#include <new>
+#include "DesfireEmulator.h"
+#include "DesfireNFC.h"
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define SOAK_MALLINFO 1
+#endif
+
+#ifndef DESFIRE_SOAK_TAPS
+#define DESFIRE_SOAK_TAPS 20000  // Short run for the regular native tests
+#endif
+
+#define SOAK_STACK_SIZE (512 * 1024)
+#define SOAK_STACK_PAINT 0xA5
+#define SOAK_WALL_MIN 200000  // Shortest window (microseconds) worth comparing wall time
+
+static const uint8_t  UID[DF_EMU_UID_SIZE] = {0x04, 0x19, 0x5D, 0xC2, 0x08, 0x3E, 0x80};
+static const uint8_t  AID[3]               = {0x5A, 0x0A, 0x01};
+static const uint8_t  KEY[DF_AES_KEY_SIZE] = {0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+                                              0xA8, 0xA9, 0xAA, 0xAB, 0xAC, 0xAD, 0xAE, 0xAF};
+static const uint8_t  FILE_ENC             = 0x01;
+static const uint8_t  FILE_BACKUP          = 0x02;
+static const uint16_t FILE_SIZE            = 128;
+
+/**
+ * @brief Operations of a tap after authentication
+ */
+enum SoakOperation : uint8_t {
+    SOAK_READ_ENC = 0,
+    SOAK_WRITE_ENC,
+    SOAK_WRITE_BACKUP,
+    SOAK_READ_BACKUP,
+    SOAK_GET_COUNTER,
+    SOAK_REAUTHENTICATE,
+    SOAK_OPERATIONS
+};
+
+/**
+ * @brief Outcome of a soak run
+ */
+struct SoakResult {
+    uint32_t    taps;          ///< Taps completed
+    uint32_t    commands;      ///< Operations checked
+    const char* failure;       ///< First failed check, nullptr if none
+    uint32_t    failedTap;     ///< Tap of the first failed check
+    size_t      stackWarm;     ///< Stack depth after the warm-up
+    size_t      stackFinal;    ///< Stack depth at the end
+    uint32_t    allocations;   ///< operator new calls after the warm-up
+    long        heapDelta;     ///< Change of the allocated heap after the warm-up
+    uint64_t    virtualFirst;  ///< Virtual time of the first window
+    uint64_t    virtualLast;   ///< Virtual time of the last window
+    uint64_t    wallFirst;     ///< Wall time of the first window
+    uint64_t    wallLast;      ///< Wall time of the last window
+};
+
+static volatile uint32_t allocationCount = 0;
+
+void* operator new(size_t size) {
+    allocationCount++;
+    void* memory = malloc(size ? size : 1);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t size) noexcept {
+    (void)size;
+    free(memory);
+}
+
+alignas(4096) static uint8_t soakStack[SOAK_STACK_SIZE];
+
+/**
+ * @brief Get the deepest stack use so far of the soak thread
+ */
+static size_t getStackDepth() {
+    size_t untouched = 0;
+    while (untouched < SOAK_STACK_SIZE && soakStack[untouched] == SOAK_STACK_PAINT) {
+        untouched++;
+    }
+    return SOAK_STACK_SIZE - untouched;
+}
+
+/**
+ * @brief Get the heap in use, 0 where it cannot be measured
+ */
+static long getHeapInUse() {
+#ifdef SOAK_MALLINFO
+    return static_cast<long>(mallinfo2().uordblks);
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Card, library and the expected file contents
+ */
+struct Soak {
+    DesfireCardEmulator   card;
+    DesfireVirtualClock   virtualClock;
+    DesfireEmulatedReader reader;
+    DesfireNFC            nfc;
+    uint8_t               enc[FILE_SIZE];
+    uint8_t               backup[FILE_SIZE];
+    uint32_t              random;
+    uint32_t              tapNo;
+    SoakResult*           result;
+
+    Soak(uint32_t seed, SoakResult* soakResult)
+        : card(UID), reader(card, virtualClock), nfc(reader), random(seed), tapNo(0),
+          result(soakResult) {
+        DesfireEmulatorFile file;
+        file.fileNo   = FILE_ENC;
+        file.type     = DF_FILE_STANDARD;
+        file.commMode = DF_COMM_ENCRYPT;
+        file.readKey  = DF_AR_KEY0;
+        file.writeKey = DF_AR_KEY0;
+        file.size     = FILE_SIZE;
+        card.addApplication(AID, KEY, 1);
+        card.addFile(AID, file, nullptr);
+        file.fileNo   = FILE_BACKUP;
+        file.type     = DF_FILE_BACKUP;
+        file.commMode = DF_COMM_MAC;
+        card.addFile(AID, file, nullptr);
+        card.setSeed(seed);
+        memset(enc, 0, sizeof(enc));
+        memset(backup, 0, sizeof(backup));
+    }
+
+    /**
+     * @brief Get the next number of the tap sequence
+     */
+    uint32_t next() {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        return random;
+    }
+
+    /**
+     * @brief Record the first failed check
+     */
+    bool check(bool condition, const char* what) {
+        if (!condition && !result->failure) {
+            result->failure   = what;
+            result->failedTap = tapNo;
+        }
+        return condition;
+    }
+
+    /**
+     * @brief Check that card and library agree on the session
+     */
+    bool checkSession() {
+        result->commands++;
+        return check(card.isAuthenticated(), "card lost the session") &&
+               check(nfc.getSessionCounter() == card.getCommandCounter(),
+                     "command counters differ");
+    }
+
+    /**
+     * @brief Run one randomized operation
+     */
+    bool operate(SoakOperation operation) {
+        uint8_t  data[FILE_SIZE];
+        uint16_t counter;
+        uint32_t offset = next() % FILE_SIZE;
+        uint32_t length = 1 + next() % (FILE_SIZE - offset);
+
+        switch (operation) {
+            case SOAK_READ_ENC:
+                return check(nfc.readData(FILE_ENC, offset, length, data, DF_COMM_ENCRYPT) ==
+                                 DesfireStatus::DFST_SUCCESS,
+                             "encrypted read failed") &&
+                       check(memcmp(data, &enc[offset], length) == 0, "encrypted read differs");
+
+            case SOAK_WRITE_ENC:
+                for (uint32_t i = 0; i < length; i++) {
+                    data[i] = static_cast<uint8_t>(next());
+                }
+                if (!check(nfc.writeData(FILE_ENC, offset, length, data, DF_COMM_ENCRYPT) ==
+                               DesfireStatus::DFST_SUCCESS,
+                           "encrypted write failed")) {
+                    return false;
+                }
+                memcpy(&enc[offset], data, length);
+                return true;
+
+            case SOAK_WRITE_BACKUP: {
+                bool commit = (next() & 0x03) != 0;
+                for (uint32_t i = 0; i < length; i++) {
+                    data[i] = static_cast<uint8_t>(next());
+                }
+                if (!check(nfc.writeData(FILE_BACKUP, offset, length, data, DF_COMM_MAC) ==
+                               DesfireStatus::DFST_SUCCESS,
+                           "backup write failed") ||
+                    !checkSession()) {
+                    return false;
+                }
+                DesfireStatus status = commit ? nfc.commitTransaction() : nfc.abortTransaction();
+                if (!check(status == DesfireStatus::DFST_SUCCESS, "transaction failed")) {
+                    return false;
+                }
+                if (commit) {
+                    memcpy(&backup[offset], data, length);
+                }
+                return true;
+            }
+
+            case SOAK_READ_BACKUP:
+                return check(nfc.readData(FILE_BACKUP, offset, length, data, DF_COMM_MAC) ==
+                                 DesfireStatus::DFST_SUCCESS,
+                             "backup read failed") &&
+                       check(memcmp(data, &backup[offset], length) == 0, "backup read differs");
+
+            case SOAK_GET_COUNTER:
+                return check(nfc.getCommandCounter(&counter) == DesfireStatus::DFST_SUCCESS,
+                             "GetCommandCounter failed") &&
+                       check(counter == card.getCommandCounter(), "card counter differs");
+
+            default:
+                // NonFirst within the session: the counter continues
+                return check(nfc.authenticateWithStrategy(0, KEY) == DesfireStatus::DFST_SUCCESS,
+                             "reauthentication failed");
+        }
+    }
+
+    /**
+     * @brief Run a tap: activation, authentication and one to six operations
+     */
+    bool tap() {
+        uint8_t aid[3];
+        memcpy(aid, AID, sizeof(aid));
+        tapNo++;
+
+        if (!check(nfc.detectCard(), "card not detected") ||
+            !check(!card.isAuthenticated() && nfc.getSessionCounter() == 0,
+                   "session survived the activation") ||
+            !check(nfc.selectApplication(aid) == DesfireStatus::DFST_SUCCESS,
+                   "selection failed") ||
+            !check(nfc.authenticateWithStrategy(0, KEY) == DesfireStatus::DFST_SUCCESS,
+                   "authentication failed") ||
+            !checkSession()) {
+            return false;
+        }
+
+        uint8_t operations = 1 + next() % 6;
+        for (uint8_t i = 0; i < operations; i++) {
+            if (!operate(static_cast<SoakOperation>(next() % SOAK_OPERATIONS)) ||
+                !checkSession()) {
+                return false;
+            }
+        }
+
+        // The card holds exactly what the library was told it wrote
+        return check(memcmp(card.getFileData(AID, FILE_ENC), enc, FILE_SIZE) == 0,
+                     "encrypted file differs") &&
+               check(memcmp(card.getFileData(AID, FILE_BACKUP), backup, FILE_SIZE) == 0,
+                     "backup file differs");
+    }
+};
+
+/**
+ * @brief Parameters of the soak thread
+ */
+struct SoakRun {
+    uint32_t   seed;    ///< Seed of the tap sequence and the card
+    uint32_t   taps;    ///< Number of taps
+    SoakResult result;  ///< Outcome of the run
+};
+
+static void* runSoak(void* argument) {
+    SoakRun*            run    = static_cast<SoakRun*>(argument);
+    SoakResult*         result = &run->result;
+    DesfireSystemClock& wall   = DesfireSystemClock::instance();
+    Soak                soak(run->seed, result);
+
+    // Strategy probing and the strategy cache are part of the warm-up
+    if (!soak.check(soak.nfc.initialize() && soak.nfc.detectCard() &&
+                        soak.nfc.selectStrategy() == DesfireStatus::DFST_SUCCESS,
+                    "setup failed")) {
+        return nullptr;
+    }
+
+    uint32_t window       = run->taps / 10;
+    uint32_t warmUp       = window;
+    uint32_t lastStart    = run->taps - window;
+    uint64_t virtualStart = 0;
+    uint32_t wallStart    = 0;
+    uint32_t allocations  = 0;
+    long     heap         = 0;
+
+    for (uint32_t i = 0; i < run->taps; i++) {
+        if (i == warmUp) {
+            result->stackWarm = getStackDepth();
+            allocations       = allocationCount;
+            heap              = getHeapInUse();
+        }
+        if (i == warmUp || i == lastStart) {
+            virtualStart = soak.virtualClock.getElapsed();
+            wallStart    = wall.micros();
+        }
+
+        if (!soak.tap()) {
+            return nullptr;
+        }
+        result->taps++;
+
+        if (i + 1 == warmUp + window) {
+            result->virtualFirst = soak.virtualClock.getElapsed() - virtualStart;
+            result->wallFirst    = wall.micros() - wallStart;
+        }
+    }
+
+    result->virtualLast = soak.virtualClock.getElapsed() - virtualStart;
+    result->wallLast    = wall.micros() - wallStart;
+    result->stackFinal  = getStackDepth();
+    result->allocations = allocationCount - allocations;
+    result->heapDelta   = getHeapInUse() - heap;
+    return nullptr;
+}
+
+/**
+ * @brief Read a number from the environment
+ */
+static uint32_t getSetting(const char* name, uint32_t fallback) {
+    const char* value = getenv(name);
+    if (!value || !*value) {
+        return fallback;
+    }
+    return static_cast<uint32_t>(strtoul(value, nullptr, 0));
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_soak(void) {
+    SoakRun run;
+    memset(&run, 0, sizeof(run));
+    run.seed = getSetting("SOAK_SEED", DesfireSystemClock::instance().micros() | 1);
+    run.taps = getSetting("SOAK_TAPS", DESFIRE_SOAK_TAPS);
+    TEST_ASSERT_TRUE(run.taps >= 100);
+    printf("soak: seed %lu, %lu taps\n",
+           static_cast<unsigned long>(run.seed),
+           static_cast<unsigned long>(run.taps));
+    fflush(stdout);
+
+    memset(soakStack, SOAK_STACK_PAINT, sizeof(soakStack));
+    pthread_attr_t attributes;
+    pthread_t      thread;
+    pthread_attr_init(&attributes);
+    TEST_ASSERT_EQUAL_INT(0, pthread_attr_setstack(&attributes, soakStack, sizeof(soakStack)));
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&thread, &attributes, runSoak, &run));
+    pthread_join(thread, nullptr);
+    pthread_attr_destroy(&attributes);
+
+    const SoakResult& result = run.result;
+    printf("soak: %lu taps, %lu commands, stack %lu bytes, %lu/%lu us per window "
+           "(virtual %lu/%lu us)\n",
+           static_cast<unsigned long>(result.taps),
+           static_cast<unsigned long>(result.commands),
+           static_cast<unsigned long>(result.stackFinal),
+           static_cast<unsigned long>(result.wallFirst),
+           static_cast<unsigned long>(result.wallLast),
+           static_cast<unsigned long>(result.virtualFirst),
+           static_cast<unsigned long>(result.virtualLast));
+    if (result.failure) {
+        printf("soak: tap %lu: %s (seed %lu)\n",
+               static_cast<unsigned long>(result.failedTap),
+               result.failure,
+               static_cast<unsigned long>(run.seed));
+    }
+    TEST_ASSERT_NULL(result.failure);
+    TEST_ASSERT_EQUAL_UINT32(run.taps, result.taps);
+
+    // Nothing grows once every path has been taken
+    TEST_ASSERT_EQUAL_UINT32(result.stackWarm, result.stackFinal);
+    TEST_ASSERT_EQUAL_UINT32(0, result.allocations);
+    TEST_ASSERT_EQUAL_INT(0, result.heapDelta);
+
+    // Same mix of operations, same time per tap
+    uint64_t tolerance = result.virtualFirst / 10;
+    TEST_ASSERT_TRUE(result.virtualLast + tolerance >= result.virtualFirst);
+    TEST_ASSERT_TRUE(result.virtualLast <= result.virtualFirst + tolerance);
+    if (result.wallFirst >= SOAK_WALL_MIN) {
+        TEST_ASSERT_TRUE(result.wallLast <= 2 * result.wallFirst);
+    }
+}
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_soak);
+
+    UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif
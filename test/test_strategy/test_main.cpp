@@ -0,0 +1,153 @@
+/**
+ * @file test_main.cpp
+ * @brief Unit tests for the card generation strategy selection and cache
+ */
+
+#include <string.h>
+#include <unity.h>
+#include "DesfireStrategy.h"
+
+static const uint8_t UID_A[7] = {0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+static const uint8_t UID_B[7] = {0x04, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC};
+
+static DESFireCardVersion makeVersion(uint8_t type, uint8_t major) {
+    DESFireCardVersion version;
+    memset(&version, 0, sizeof(version));
+    version.hardwareVendor       = 0x04;
+    version.hardwareType         = type;
+    version.hardwareVersionMajor = major;
+    return version;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_generation_from_version(void) {
+    // NXP encoding: type 01h, generation in the major version
+    TEST_ASSERT_EQUAL_UINT8(DF_GEN_D40, makeVersion(0x01, 0x00).getGeneration());
+    TEST_ASSERT_EQUAL_UINT8(DF_GEN_EV1, makeVersion(0x01, 0x01).getGeneration());
+    TEST_ASSERT_EQUAL_UINT8(DF_GEN_EV2, makeVersion(0x01, 0x12).getGeneration());
+    TEST_ASSERT_EQUAL_UINT8(DF_GEN_EV3, makeVersion(0x01, 0x33).getGeneration());
+    TEST_ASSERT_EQUAL_UINT8(DF_GEN_LIGHT, makeVersion(0x08, 0x30).getGeneration());
+
+    // Library type codes
+    TEST_ASSERT_EQUAL_UINT8(DF_GEN_EV2, makeVersion(0x02, 0x00).getGeneration());
+    TEST_ASSERT_EQUAL_UINT8(DF_GEN_EV3, makeVersion(0x03, 0x00).getGeneration());
+    TEST_ASSERT_EQUAL_UINT8(DF_GEN_LIGHT, makeVersion(0x41, 0x00).getGeneration());
+    TEST_ASSERT_EQUAL_UINT8(DF_GEN_UNKNOWN, makeVersion(0x55, 0x00).getGeneration());
+}
+
+void test_strategy_per_generation(void) {
+    DesfireCardStrategy ev1 = DesfireStrategyCache::select(makeVersion(0x01, 0x01));
+    TEST_ASSERT_EQUAL_UINT8(DF_AUTH_METHOD_AES, ev1.authMethod);
+    TEST_ASSERT_TRUE(ev1.nativeFraming);
+    TEST_ASSERT_EQUAL_UINT16(848, ev1.bitRate);
+
+    DesfireCardStrategy ev3 = DesfireStrategyCache::select(makeVersion(0x01, 0x33));
+    TEST_ASSERT_EQUAL_UINT8(DF_AUTH_METHOD_EV2, ev3.authMethod);
+    TEST_ASSERT_TRUE(ev3.nativeFraming);
+
+    DesfireCardStrategy light = DesfireStrategyCache::select(makeVersion(0x08, 0x30));
+    TEST_ASSERT_EQUAL_UINT8(DF_AUTH_METHOD_EV2, light.authMethod);
+    TEST_ASSERT_FALSE(light.nativeFraming);
+
+    DesfireCardStrategy d40 = DesfireStrategyCache::select(makeVersion(0x01, 0x00));
+    TEST_ASSERT_EQUAL_UINT8(DF_AUTH_METHOD_LEGACY, d40.authMethod);
+
+    // Unknown cards keep the options that work everywhere
+    DesfireCardStrategy unknown = DesfireStrategyCache::select(makeVersion(0x55, 0x00));
+    TEST_ASSERT_EQUAL_UINT8(DF_AUTH_METHOD_LEGACY, unknown.authMethod);
+    TEST_ASSERT_FALSE(unknown.nativeFraming);
+    TEST_ASSERT_EQUAL_UINT16(DF_STRATEGY_FRAME_SIZE, unknown.frameSize);
+    TEST_ASSERT_EQUAL_UINT16(DF_STRATEGY_BITRATE_BASE, unknown.bitRate);
+}
+
+void test_frame_size_from_fsci(void) {
+    TEST_ASSERT_EQUAL_UINT16(16, DesfireStrategyCache::getFrameSize(0));
+    TEST_ASSERT_EQUAL_UINT16(48, DesfireStrategyCache::getFrameSize(4));
+    TEST_ASSERT_EQUAL_UINT16(DF_STRATEGY_FRAME_SIZE, DesfireStrategyCache::getFrameSize(5));
+    TEST_ASSERT_EQUAL_UINT16(96, DesfireStrategyCache::getFrameSize(6));
+    TEST_ASSERT_EQUAL_UINT16(128, DesfireStrategyCache::getFrameSize(7));
+    TEST_ASSERT_EQUAL_UINT16(256, DesfireStrategyCache::getFrameSize(8));
+
+    // RFU values are treated as 256 bytes
+    TEST_ASSERT_EQUAL_UINT16(256, DesfireStrategyCache::getFrameSize(0x0F));
+}
+
+void test_cache_per_uid(void) {
+    DesfireStrategyCache cache;
+    DesfireCardStrategy  strategy;
+
+    TEST_ASSERT_FALSE(cache.lookup(UID_A, sizeof(UID_A), &strategy));
+
+    DesfireCardStrategy ev2 = DesfireStrategyCache::select(makeVersion(0x01, 0x12));
+    ev2.frameSize           = 128;
+    TEST_ASSERT_TRUE(cache.store(UID_A, sizeof(UID_A), ev2));
+    TEST_ASSERT_TRUE(cache.store(UID_B, sizeof(UID_B), DesfireStrategyCache::getDefault()));
+
+    TEST_ASSERT_TRUE(cache.lookup(UID_A, sizeof(UID_A), &strategy));
+    TEST_ASSERT_EQUAL_UINT8(DF_GEN_EV2, strategy.generation);
+    TEST_ASSERT_EQUAL_UINT16(128, strategy.frameSize);
+    TEST_ASSERT_TRUE(cache.lookup(UID_B, sizeof(UID_B), &strategy));
+    TEST_ASSERT_EQUAL_UINT8(DF_GEN_UNKNOWN, strategy.generation);
+
+    cache.invalidate(UID_A, sizeof(UID_A));
+    TEST_ASSERT_FALSE(cache.lookup(UID_A, sizeof(UID_A), &strategy));
+    TEST_ASSERT_FALSE(cache.store(UID_A, 0, ev2));
+}
+
+void test_cache_replaces_least_recently_used(void) {
+    DesfireStrategyCache cache;
+    DesfireCardStrategy  strategy = DesfireStrategyCache::getDefault();
+    uint8_t              uid[7];
+    memcpy(uid, UID_A, sizeof(uid));
+
+    for (uint8_t i = 0; i < DF_STRATEGY_CACHE_ENTRIES; i++) {
+        uid[6] = i;
+        cache.store(uid, sizeof(uid), strategy);
+    }
+
+    // Touch the oldest entry, the second oldest is replaced instead
+    uid[6] = 0;
+    TEST_ASSERT_TRUE(cache.lookup(uid, sizeof(uid), &strategy));
+    uid[6] = 0xF0;
+    cache.store(uid, sizeof(uid), strategy);
+
+    uid[6] = 0;
+    TEST_ASSERT_TRUE(cache.lookup(uid, sizeof(uid), &strategy));
+    uid[6] = 1;
+    TEST_ASSERT_FALSE(cache.lookup(uid, sizeof(uid), &strategy));
+}
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_generation_from_version);
+    RUN_TEST(test_strategy_per_generation);
+    RUN_TEST(test_frame_size_from_fsci);
+    RUN_TEST(test_cache_per_uid);
+    RUN_TEST(test_cache_replaces_least_recently_used);
+
+    UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif
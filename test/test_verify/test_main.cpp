@@ -0,0 +1,227 @@
+/**
+ * @file test_main.cpp
+ * @brief Unit tests for bulk transaction MAC and SUN verification
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include "DesfireVerify.h"
+
+#define RECORD_COUNT 37
+
+// AN12196 SUN example: all-zero SDM keys, PICC data and MAC as mirrored into the URL
+static const char SUN_LINE[] = "S,EF963FF7828658A599F3041510671E88,,94EED9EE65337086";
+
+// Transaction MAC computed outside the library (OpenSSL AES-CMAC) with TM_KEY below:
+// SesTMMACKey = CMAC(TM_KEY, 5A 00 01 00 80 || 05000000 || UID) = 98FBBD8DCBC4D012DC8F23657C36D403,
+// CMAC(SesTMMACKey, TMI) = 9C1B01644D1BD03ECCACCB6863490BC6, TMV = its odd bytes
+static const char TMAC_LINE[] = "T,04DE5F1EACC040,5,"
+                                "3D01000010000000F1E2D3C4B5A69788796A5B4C3D2E1F00"
+                                "112233445566778899AABBCCDDEEFF00000000,1B641B3EAC6849C6";
+
+static const uint8_t ZERO_KEY[DF_AES_KEY_SIZE] = {0};
+
+static const uint8_t TM_KEY[DF_AES_KEY_SIZE] = {0x10, 0x21, 0x32, 0x43, 0x54, 0x65, 0x76, 0x87,
+                                                0x98, 0xA9, 0xBA, 0xCB, 0xDC, 0xED, 0xFE, 0x0F};
+
+static DesfireVerifyRecord records[RECORD_COUNT];
+
+/**
+ * @brief Compute the TMV of a record one step at a time
+ */
+static void referenceTMV(const uint8_t* tmKey, DesfireVerifyRecord* record) {
+    uint8_t sv[DF_AES_BLOCK_SIZE] = {0x5A, 0x00, 0x01, 0x00, 0x80};
+    sv[5]                         = record->counter & 0xFF;
+    sv[6]                         = (record->counter >> 8) & 0xFF;
+    sv[7]                         = (record->counter >> 16) & 0xFF;
+    sv[8]                         = (record->counter >> 24) & 0xFF;
+    memcpy(&sv[9], record->uid, DF_VERIFY_UID_SIZE);
+
+    DesfireAES key(tmKey);
+    uint8_t    sessionKey[DF_AES_KEY_SIZE];
+    DesfireCMAC::compute(key, sv, sizeof(sv), sessionKey);
+
+    DesfireAES session(sessionKey);
+    uint8_t    mac[DF_CMAC_SIZE];
+    DesfireCMAC::compute(session, record->input, record->inputLength, mac);
+    DesfireCMAC::truncate(mac, record->mac);
+}
+
+/**
+ * @brief Fill the records with transactions of different cards and lengths
+ */
+static void buildRecords(const uint8_t* tmKey) {
+    for (uint8_t i = 0; i < RECORD_COUNT; i++) {
+        DesfireVerifyRecord& record = records[i];
+        record.type                 = DF_VERIFY_TYPE_TMAC;
+        record.result               = DF_VERIFY_PENDING;
+        record.counter              = 0x100 + i;
+        record.inputLength          = (i * 13) % 70;
+        for (uint8_t j = 0; j < DF_VERIFY_UID_SIZE; j++) {
+            record.uid[j] = 0x04 + i + j;
+        }
+        for (uint16_t j = 0; j < record.inputLength; j++) {
+            record.input[j] = static_cast<uint8_t>(i ^ (j * 7));
+        }
+        referenceTMV(tmKey, &record);
+    }
+}
+
+static bool countRecord(const DesfireVerifyRecord& record, void* context) {
+    uint16_t* counts = static_cast<uint16_t*>(context);
+    counts[record.result]++;
+    return true;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_tmac_known_answer(void) {
+    DesfireTransactionVerifier verifier;
+    verifier.setTransactionMACKey(TM_KEY);
+
+    TEST_ASSERT_TRUE(DesfireRecordParser::parseLine(TMAC_LINE, strlen(TMAC_LINE), &records[0]));
+    TEST_ASSERT_EQUAL_UINT32(5, records[0].counter);
+    TEST_ASSERT_EQUAL_UINT16(43, records[0].inputLength);
+
+    // The reference used by the batch tests agrees with the outside computation
+    records[1] = records[0];
+    memset(records[1].mac, 0, sizeof(records[1].mac));
+    referenceTMV(TM_KEY, &records[1]);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(records[0].mac, records[1].mac, DF_MACT_SIZE);
+
+    // The TMC of the transaction verifies, the one stored before it does not
+    records[1]         = records[0];
+    records[1].counter = 4;
+    TEST_ASSERT_EQUAL(1, verifier.verifyBatch(records, 2));
+    TEST_ASSERT_EQUAL(DF_VERIFY_OK, records[0].result);
+    TEST_ASSERT_EQUAL(DF_VERIFY_BAD_MAC, records[1].result);
+}
+
+void test_tmac_batch_matches_reference(void) {
+    DesfireTransactionVerifier verifier;
+    verifier.setTransactionMACKey(TM_KEY);
+
+    // Lanes of different lengths, in one thread and split across threads
+    for (uint8_t threads = 1; threads <= 4; threads += 3) {
+        buildRecords(TM_KEY);
+        records[5].mac[0] ^= 0x01;
+        records[30].counter++;
+        TEST_ASSERT_EQUAL(RECORD_COUNT - 2, verifier.verifyBatch(records, RECORD_COUNT, threads));
+        TEST_ASSERT_EQUAL(DF_VERIFY_BAD_MAC, records[5].result);
+        TEST_ASSERT_EQUAL(DF_VERIFY_BAD_MAC, records[30].result);
+        TEST_ASSERT_EQUAL(DF_VERIFY_OK, records[36].result);
+    }
+
+    // Per-card keys derived from the UID
+    static const uint8_t  AID[DF_DIV_AID_SIZE] = {0x12, 0x34, 0x56};
+    DesfireKeyDiversifier diversifier(TM_KEY);
+    uint8_t               cardKey[DF_AES_KEY_SIZE];
+    buildRecords(TM_KEY);
+    for (uint8_t i = 0; i < RECORD_COUNT; i++) {
+        TEST_ASSERT_TRUE(diversifier.diversify(records[i].uid, DF_VERIFY_UID_SIZE, AID, cardKey));
+        referenceTMV(cardKey, &records[i]);
+    }
+    verifier.setKeyDiversifier(&diversifier, AID);
+    TEST_ASSERT_EQUAL(RECORD_COUNT, verifier.verifyBatch(records, RECORD_COUNT, 2));
+}
+
+void test_sun_records(void) {
+    DesfireSDM                 sdm(ZERO_KEY, ZERO_KEY);
+    DesfireTransactionVerifier verifier;
+
+    TEST_ASSERT_TRUE(DesfireRecordParser::parseLine(SUN_LINE, strlen(SUN_LINE), &records[0]));
+    records[1] = records[0];
+    records[1].mac[7] ^= 0x01;
+    records[2] = records[0];
+    TEST_ASSERT_EQUAL(0, verifier.verifyBatch(records, 3));
+    TEST_ASSERT_EQUAL(DF_VERIFY_NO_KEY, records[0].result);
+
+    records[0].result = DF_VERIFY_PENDING;
+    records[1].result = DF_VERIFY_PENDING;
+    records[2].result = DF_VERIFY_PENDING;
+    verifier.setSDM(&sdm);
+    TEST_ASSERT_EQUAL(2, verifier.verifyBatch(records, 3));
+    TEST_ASSERT_EQUAL(DF_VERIFY_OK, records[0].result);
+    TEST_ASSERT_EQUAL(DF_VERIFY_BAD_MAC, records[1].result);
+    TEST_ASSERT_EQUAL_UINT32(0x3D, records[2].sun.counter);
+}
+
+void test_stream_with_malformed_lines(void) {
+    DesfireSDM                 sdm(ZERO_KEY, ZERO_KEY);
+    DesfireTransactionVerifier verifier;
+    verifier.setSDM(&sdm);
+    verifier.setTransactionMACKey(TM_KEY);
+    buildRecords(TM_KEY);
+
+    FILE* input = tmpfile();
+    TEST_ASSERT_NOT_NULL(input);
+    fprintf(input, "# exported log\n\n%s\r\n", SUN_LINE);
+    fprintf(input, "T,%02X%02X%02X%02X%02X%02X%02X,%X,",
+            records[1].uid[0], records[1].uid[1], records[1].uid[2], records[1].uid[3],
+            records[1].uid[4], records[1].uid[5], records[1].uid[6], records[1].counter);
+    for (uint16_t j = 0; j < records[1].inputLength; j++) {
+        fprintf(input, "%02x", records[1].input[j]);
+    }
+    fprintf(input, ",");
+    for (uint8_t j = 0; j < DF_MACT_SIZE; j++) {
+        fprintf(input, "%02X", records[1].mac[j]);
+    }
+    fprintf(input, "\nT,0102,1,,0000000000000000\nX,1,2,3\n%s", SUN_LINE);
+    rewind(input);
+
+    // A buffer of two records verifies the stream in three batches
+    uint16_t counts[DF_VERIFY_NO_KEY + 1] = {0};
+    TEST_ASSERT_EQUAL(3, verifier.verifyStream(input, records, 2, countRecord, counts));
+    TEST_ASSERT_EQUAL(3, counts[DF_VERIFY_OK]);
+    TEST_ASSERT_EQUAL(2, counts[DF_VERIFY_MALFORMED]);
+    TEST_ASSERT_EQUAL_UINT32(7, records[0].line);
+    fclose(input);
+
+    // Lines split across pieces and an overlong line
+    DesfireRecordParser parser(countRecord, counts);
+    memset(counts, 0, sizeof(counts));
+    TEST_ASSERT_TRUE(parser.feed(SUN_LINE, 10));
+    TEST_ASSERT_TRUE(parser.feed(&SUN_LINE[10], strlen(SUN_LINE) - 10));
+    TEST_ASSERT_TRUE(parser.feed("\n", 1));
+    for (uint16_t i = 0; i <= DF_VERIFY_LINE_SIZE; i++) {
+        TEST_ASSERT_TRUE(parser.feed("0", 1));
+    }
+    TEST_ASSERT_TRUE(parser.finish());
+    TEST_ASSERT_EQUAL(1, counts[DF_VERIFY_PENDING]);
+    TEST_ASSERT_EQUAL(1, counts[DF_VERIFY_MALFORMED]);
+    TEST_ASSERT_EQUAL_UINT32(2, parser.getLineCount());
+}
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_tmac_known_answer);
+    RUN_TEST(test_tmac_batch_matches_reference);
+    RUN_TEST(test_sun_records);
+    RUN_TEST(test_stream_with_malformed_lines);
+
+    UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif
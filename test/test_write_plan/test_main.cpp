@@ -0,0 +1,102 @@
+/**
+ * @file test_main.cpp
+ * @brief Unit tests for the delta planning of file writes
+ */
+
+#include <string.h>
+#include <unity.h>
+#include "DesfireWritePlan.h"
+
+static uint8_t previous[64];
+static uint8_t data[64];
+
+static uint8_t plan(uint32_t maxGap, DesfireWriteSpan* spans, uint8_t maxSpans) {
+    return DesfireWritePlanner::plan(previous, data, sizeof(data), maxGap, spans, maxSpans);
+}
+
+void setUp(void) {
+    for (uint8_t i = 0; i < sizeof(previous); i++) {
+        previous[i] = i;
+    }
+    memcpy(data, previous, sizeof(data));
+}
+
+void tearDown(void) {
+}
+
+void test_unchanged_contents(void) {
+    DesfireWriteSpan spans[DF_WRITE_PLAN_MAX_SPANS];
+    TEST_ASSERT_EQUAL_UINT8(0, plan(8, spans, DF_WRITE_PLAN_MAX_SPANS));
+}
+
+void test_changed_ranges(void) {
+    DesfireWriteSpan spans[DF_WRITE_PLAN_MAX_SPANS];
+    data[2]  = 0xFF;
+    data[3]  = 0xFF;
+    data[40] = 0xFF;
+    data[63] = 0xFF;
+
+    TEST_ASSERT_EQUAL_UINT8(3, plan(8, spans, DF_WRITE_PLAN_MAX_SPANS));
+    TEST_ASSERT_EQUAL_UINT32(2, spans[0].offset);
+    TEST_ASSERT_EQUAL_UINT32(2, spans[0].length);
+    TEST_ASSERT_EQUAL_UINT32(40, spans[1].offset);
+    TEST_ASSERT_EQUAL_UINT32(1, spans[1].length);
+    TEST_ASSERT_EQUAL_UINT32(63, spans[2].offset);
+    TEST_ASSERT_EQUAL_UINT32(1, spans[2].length);
+}
+
+void test_short_gaps_are_rewritten(void) {
+    DesfireWriteSpan spans[DF_WRITE_PLAN_MAX_SPANS];
+    data[10] = 0xFF;
+    data[19] = 0xFF;
+
+    // Eight unchanged bytes in between
+    TEST_ASSERT_EQUAL_UINT8(1, plan(8, spans, DF_WRITE_PLAN_MAX_SPANS));
+    TEST_ASSERT_EQUAL_UINT32(10, spans[0].offset);
+    TEST_ASSERT_EQUAL_UINT32(10, spans[0].length);
+
+    TEST_ASSERT_EQUAL_UINT8(2, plan(7, spans, DF_WRITE_PLAN_MAX_SPANS));
+}
+
+void test_span_limit_covers_all_changes(void) {
+    DesfireWriteSpan spans[2];
+    data[0]  = 0xFF;
+    data[20] = 0xFF;
+    data[40] = 0xFF;
+    data[60] = 0xFF;
+
+    TEST_ASSERT_EQUAL_UINT8(2, plan(0, spans, 2));
+    TEST_ASSERT_EQUAL_UINT32(0, spans[0].offset);
+    TEST_ASSERT_EQUAL_UINT32(1, spans[0].length);
+    TEST_ASSERT_EQUAL_UINT32(20, spans[1].offset);
+    TEST_ASSERT_EQUAL_UINT32(41, spans[1].length);
+}
+
+void process(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_unchanged_contents);
+    RUN_TEST(test_changed_ranges);
+    RUN_TEST(test_short_gaps_are_rewritten);
+    RUN_TEST(test_span_limit_covers_all_changes);
+
+    UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup(void) {
+    delay(2000);  // Give the serial port time to initialize
+    process();
+}
+
+void loop(void) {
+    // Empty
+}
+#else
+int main(int argc, char** argv) {
+    process();
+    return 0;
+}
+#endif